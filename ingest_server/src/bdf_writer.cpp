@@ -0,0 +1,358 @@
+/*
+ * Streaming BDF+ export, see bdf_writer.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "bdf_writer.h"
+#include "emg_proto.h"
+
+namespace emg {
+
+static const uint32_t ANN_SAMPLES = 256;        // annotation signal per record: 768 bytes, a dozen notes
+static const size_t MAX_TEXT = 64;
+static const int32_t DIG_MIN_24 = -8388608, DIG_MAX_24 = 8388607;
+static const size_t RECORDS_OFFSET = 236;       // "number of data records" in the header
+static const size_t RESERVED_OFFSET = 192;      // "BDF+C" / "BDF+D"
+
+bdf_writer::~bdf_writer()
+{
+    close();
+}
+
+/* write() everything */
+static bool write_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = write(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += r;
+        len -= (size_t)r;
+    }
+    return true;
+}
+
+/* An ASCII header field: s, cut or padded with spaces to width */
+static void field(std::string &h, const std::string &s, size_t width)
+{
+    std::string f = s.substr(0, width);
+    f.resize(width, ' ');
+    h += f;
+}
+
+/* A number that fits a header field of width characters */
+static std::string number(double v, size_t width)
+{
+    char buf[32];
+    for (int prec = (int)width; prec > 0; prec--) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, v);
+        if (strlen(buf) <= width) break;
+    }
+    return buf;
+}
+
+/* Onset or duration in an annotation: [+-]seconds, no trailing zeros */
+static std::string seconds(double s, bool sign)
+{
+    char buf[40];
+    snprintf(buf, sizeof(buf), sign ? "%+.6f" : "%.6f", s);
+    std::string r = buf;
+    r.erase(r.find_last_not_of('0') + 1);
+    if (r.back() == '.') r.pop_back();
+    return r;
+}
+
+/* A header name field: no spaces, printable only */
+static std::string token(const char *s, size_t max, const char *none)
+{
+    std::string r;
+    for (size_t i = 0; i < max && s[i]; i++) {
+        r += (s[i] > ' ' && s[i] < 127) ? s[i] : '_';
+    }
+    return r.empty() ? none : r;
+}
+
+static void put24(uint8_t *p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+}
+
+bool bdf_writer::open(const std::string &path, const rec_file_header &hdr, const bdf_options &opt,
+                      std::string *err)
+{
+    close();
+    rate_ = hdr.frame_rate_hz;
+    double spr = std::round(rate_ * opt.record_s);
+    if (hdr.channels == 0 || rate_ == 0 || spr < 1 || spr > 1e7 ||
+        (hdr.sample_format != REC_FMT_U8_OFFSET && hdr.sample_format != REC_FMT_I16)) {
+        if (err) *err = "bad channels, frame rate, record length or sample format";
+        return false;
+    }
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        if (err) *err = strerror(errno);
+        return false;
+    }
+    path_ = path;
+    hdr_ = hdr;
+    opt_ = opt;
+    channels_ = hdr.channels;
+    frame_bytes_ = rec_frame_bytes(hdr.sample_format, hdr.channels);
+    spr_ = (uint32_t)spr;
+    ann_bytes_ = ANN_SAMPLES * 3;
+    for (int s = 0; s < 256; s++) {
+        u8_[s] = s - EMG_SAMPLE_ZERO;
+    }
+    rec_.reset(new uint8_t[(size_t)channels_ * spr_ * 3 + ann_bytes_]);
+    failed_ = started_ = discontinuous_ = false;
+    records_ = dropped_ = 0;
+    fill_ = 0;
+    notes_.clear();
+    return true;
+}
+
+bool bdf_writer::write_header()
+{
+    const size_t ns = (size_t)channels_ + 1;
+    const bool u8 = hdr_.sample_format == REC_FMT_U8_OFFSET;
+    const int32_t dmin = u8 ? -EMG_SAMPLE_ZERO : INT16_MIN, dmax = u8 ? 255 - EMG_SAMPLE_ZERO : INT16_MAX;
+    const double lsb = opt_.lsb_uv > 0 ? opt_.lsb_uv : 1.0;
+
+    time_t t = (time_t)start_s_;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    static const char *MONTHS[] = { "JAN", "FEB", "MAR", "APR", "MAY", "JUN",
+                                    "JUL", "AUG", "SEP", "OCT", "NOV", "DEC" };
+    char buf[128];
+
+    std::string h;
+    h += '\xff';
+    field(h, "BIOSEMI", 7);
+    field(h, "X X X X", 80);
+    // EDF+ recording field: start date, admin code, technician, equipment
+    snprintf(buf, sizeof(buf), "Startdate %02d-%s-%04d X X %s", tm.tm_mday, MONTHS[tm.tm_mon], tm.tm_year + 1900,
+             token(hdr_.name, sizeof(hdr_.name), token(hdr_.device_id, sizeof(hdr_.device_id), "X").c_str()).c_str());
+    field(h, buf, 80);
+    snprintf(buf, sizeof(buf), "%02d.%02d.%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+    field(h, buf, 8);
+    snprintf(buf, sizeof(buf), "%02d.%02d.%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+    field(h, buf, 8);
+    field(h, std::to_string(256 * (ns + 1)), 8);
+    field(h, "BDF+C", 44);
+    field(h, "-1", 8);
+    field(h, number(opt_.record_s, 8), 8);
+    field(h, std::to_string(ns), 4);
+
+    auto each = [&](auto emg, const std::string &ann, size_t width) {
+        for (size_t c = 0; c < channels_; c++) field(h, emg(c), width);
+        field(h, ann, width);
+    };
+    each([](size_t c) { return "EMG" + std::to_string(c); }, "BDF Annotations", 16);
+    each([](size_t) { return std::string(); }, "", 80);
+    each([&](size_t) { return std::string(opt_.lsb_uv > 0 ? "uV" : "LSB"); }, "", 8);
+    each([&](size_t) { return number(dmin * lsb, 8); }, "-1", 8);
+    each([&](size_t) { return number(dmax * lsb, 8); }, "1", 8);
+    each([&](size_t) { return std::to_string(dmin); }, std::to_string(DIG_MIN_24), 8);
+    each([&](size_t) { return std::to_string(dmax); }, std::to_string(DIG_MAX_24), 8);
+    each([](size_t) { return std::string(); }, "", 80);
+    each([&](size_t) { return std::to_string(spr_); }, std::to_string(ANN_SAMPLES), 8);
+    each([](size_t) { return std::string(); }, "", 32);
+
+    return write_all(fd_, (const uint8_t *)h.data(), h.size());
+}
+
+void bdf_writer::add_note(note n)
+{
+    if (notes_.size() >= MAX_PENDING) {
+        dropped_++;
+        return;
+    }
+    for (char &ch : n.text) {
+        if ((unsigned char)ch < ' ' || ch == 127) ch = ' ';
+    }
+    if (n.text.size() > MAX_TEXT) n.text.resize(MAX_TEXT);
+    notes_.push_back(std::move(n));
+}
+
+void bdf_writer::annotate(uint64_t frame, int64_t t_ns, uint32_t frames, const char *text)
+{
+    if (fd_ < 0) {
+        return;
+    }
+    note n;
+    n.at_time = !started_ || frame < base_frame_ || frame > next_frame_;
+    n.t_ns = t_ns;
+    n.onset_s = n.at_time ? 0 : onset(base_pos_ + (frame - base_frame_));
+    n.duration_s = rate_ ? (double)frames / rate_ : 0;
+    n.text = text ? text : "";
+    add_note(std::move(n));
+}
+
+/* Write the full record and start the next one right after it */
+bool bdf_writer::flush_record()
+{
+    uint8_t *ann = rec_.get() + (size_t)channels_ * spr_ * 3;
+    memset(ann, 0, ann_bytes_);
+    std::string tal = seconds(onset(rec_pos_), true) + "\x14\x14";
+    size_t used = tal.size() + 1;
+    memcpy(ann, tal.data(), tal.size());
+    while (!notes_.empty()) {
+        const note &n = notes_.front();
+        double at = n.at_time ? (double)(n.t_ns - start_s_ * 1000000000) / 1e9 : n.onset_s;
+        tal = seconds(at, true);
+        if (n.duration_s > 0) tal += "\x15" + seconds(n.duration_s, false);
+        tal += "\x14" + n.text + "\x14";
+        if (used + tal.size() + 1 > ann_bytes_) break;
+        memcpy(ann + used, tal.data(), tal.size());
+        used += tal.size() + 1;
+        notes_.pop_front();
+    }
+    if (!write_all(fd_, rec_.get(), (size_t)channels_ * spr_ * 3 + ann_bytes_)) {
+        failed_ = true;
+        return false;
+    }
+    records_++;
+    rec_pos_ += spr_;
+    fill_ = 0;
+    return true;
+}
+
+/* n frames of zero at the end of the record, writing it when full */
+bool bdf_writer::fill(uint32_t n)
+{
+    while (n > 0) {
+        uint32_t take = std::min(n, spr_ - fill_);
+        for (size_t c = 0; c < channels_; c++) {
+            memset(rec_.get() + ((size_t)c * spr_ + fill_) * 3, 0, (size_t)take * 3);
+        }
+        fill_ += take;
+        n -= take;
+        if (fill_ == spr_ && !flush_record()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* First frame: the start time, and the header that holds it */
+bool bdf_writer::start(uint64_t frame0, int64_t t_ns, uint64_t pos)
+{
+    started_ = true;
+    first_t_ns_ = t_ns;
+    start_s_ = t_ns >= 0 ? t_ns / 1000000000 : -((-t_ns + 999999999) / 1000000000);
+    first_s_ = (double)(t_ns - start_s_ * 1000000000) / 1e9;
+    base_frame_ = next_frame_ = frame0;
+    base_pos_ = rec_pos_ = pos;
+    if (!write_header()) {
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool bdf_writer::append(const uint8_t *frames, uint32_t n, uint64_t frame0, int64_t t_first_ns)
+{
+    if (fd_ < 0 || failed_) {
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+    if (!started_) {
+        if (!start(frame0, t_first_ns, 0)) return false;
+    } else if (frame0 > next_frame_) {
+        // Missing frames: zero up to the end of this record, then resume on time
+        uint64_t missing = frame0 - next_frame_, pos = rec_pos_ + fill_;
+        note g = { false, 0, onset(pos), (double)missing / rate_, "gap" };
+        add_note(std::move(g));
+        uint32_t room = spr_ - fill_;
+        if (missing <= room) {
+            if (!fill((uint32_t)missing)) return false;
+        } else {
+            if (fill_ > 0 && !fill(room)) return false;
+            rec_pos_ = pos + missing;
+            discontinuous_ = true;
+        }
+    } else if (frame0 < next_frame_) {
+        // Frame numbers went back: a new run, placed by host time
+        uint64_t pos = rec_pos_ + fill_;
+        if (fill_ > 0) {
+            note pad = { false, 0, onset(pos), (double)(spr_ - fill_) / rate_, "no data" };
+            add_note(std::move(pad));
+            if (!fill(spr_ - fill_)) return false;
+        }
+        double since = (double)(t_first_ns - first_t_ns_) * rate_ / 1e9;
+        rec_pos_ = std::max(rec_pos_, since > 0 ? (uint64_t)std::llround(since) : 0);
+        base_frame_ = frame0;
+        base_pos_ = rec_pos_;
+        discontinuous_ = true;
+    }
+    next_frame_ = frame0 + n;
+
+    // Transpose into the record, channel after channel
+    const bool u8 = hdr_.sample_format == REC_FMT_U8_OFFSET;
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t take = std::min(n - done, spr_ - fill_);
+        const uint8_t *src = frames + (size_t)done * frame_bytes_;
+        for (size_t c = 0; c < channels_; c++) {
+            uint8_t *dst = rec_.get() + ((size_t)c * spr_ + fill_) * 3;
+            if (u8) {
+                for (uint32_t i = 0; i < take; i++) {
+                    put24(dst + 3 * i, u8_[src[(size_t)i * channels_ + c]]);
+                }
+            } else {
+                for (uint32_t i = 0; i < take; i++) {
+                    int16_t s;
+                    memcpy(&s, src + 2 * ((size_t)i * channels_ + c), sizeof(s));
+                    put24(dst + 3 * i, s);
+                }
+            }
+        }
+        fill_ += take;
+        done += take;
+        if (fill_ == spr_ && !flush_record()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bdf_writer::close()
+{
+    if (fd_ < 0) {
+        return true;
+    }
+    bool ok = !failed_;
+    if (!started_) {
+        // No frames: a valid file with no records
+        ok = start(0, (int64_t)time(nullptr) * 1000000000, 0) && ok;
+    } else if (ok && fill_ > 0) {
+        ok = fill(spr_ - fill_);
+    }
+    dropped_ += notes_.size();
+    notes_.clear();
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%-8llu", (unsigned long long)records_);
+    ok = pwrite(fd_, buf, 8, RECORDS_OFFSET) == 8 && ok;
+    if (discontinuous_) {
+        ok = pwrite(fd_, "BDF+D", 5, RESERVED_OFFSET) == 5 && ok;
+    }
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    rec_.reset();
+    return ok;
+}
+
+} // namespace emg
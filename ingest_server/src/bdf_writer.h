@@ -0,0 +1,129 @@
+/*
+ * Streaming BDF+ export of a recording, for tools that read EDF/BDF.
+ *
+ * BDF is EDF with 24-bit samples; BDF+ adds an annotation signal. The file
+ * is a text header (256 bytes, plus 256 per signal) followed by data
+ * records of a fixed duration, each holding every channel's samples for
+ * that duration one channel after the other, then the annotation signal.
+ * Frames are transposed into the record being filled and the record is
+ * written once full, so memory stays at one record however long the
+ * session; the header goes out with the first frame (it holds the start
+ * time) and the record count, -1 while writing, is patched in by close().
+ *
+ * Samples are written as they were recorded, less the sample zero: a
+ * uint8 recording as -128..127, int16 as is, through a table built once.
+ * The physical range follows from the digital one and lsb_uv, or is in
+ * counts ("LSB") when the gain is not known.
+ *
+ * Every record starts with its time-keeping annotation (onset from the
+ * start time in the header, which is whole seconds; the first onset holds
+ * the fraction). Missing frames are annotated "gap" and filled with zero
+ * up to the end of the record they start in; a longer gap, or frames that
+ * go back (a device reboot), start a new record at their own time, which
+ * makes the file discontinuous (BDF+D, patched in by close()). Annotations
+ * wait for the next record with room for them; at most MAX_PENDING do, any
+ * beyond are dropped and counted.
+ */
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "recording.h"
+
+namespace emg {
+
+struct bdf_options {
+    double record_s = 1.0;              // data record duration; frame_rate_hz * record_s frames per record
+    double lsb_uv = 0.0;                // microvolts per count, 0 = unknown (physical unit "LSB")
+};
+
+class bdf_writer {
+public:
+    static const size_t MAX_PENDING = 4096;     // annotations waiting for a record
+
+    bdf_writer() = default;
+    ~bdf_writer();
+
+    bdf_writer(const bdf_writer &) = delete;
+    bdf_writer &operator=(const bdf_writer &) = delete;
+
+    /**
+     * Create path (replacing it) for the frames of a recording with header
+     * hdr (channels, sample_format, frame_rate_hz, name and device_id are
+     * used). Nothing is written until the first frame.
+     */
+    bool open(const std::string &path, const rec_file_header &hdr, const bdf_options &opt = bdf_options(),
+              std::string *err = nullptr);
+
+    /**
+     * Append n frames in the recording's sample format, starting at device
+     * frame frame0, the first at host wall clock t_first_ns.
+     */
+    bool append(const uint8_t *frames, uint32_t n, uint64_t frame0, int64_t t_first_ns);
+
+    /**
+     * Annotate text at device frame frame if it lies in the frames written
+     * since the last discontinuity, else at host time t_ns; with frames, it
+     * lasts that long.
+     */
+    void annotate(uint64_t frame, int64_t t_ns, uint32_t frames, const char *text);
+
+    /** Pad and write the last record, then patch the header. */
+    bool close();
+
+    bool is_open() const { return fd_ >= 0; }
+    uint64_t records() const { return records_; }
+    uint64_t dropped() const { return dropped_; }      // annotations that did not fit
+
+private:
+    struct note {
+        bool at_time;               // onset from t_ns, else onset_s
+        int64_t t_ns;
+        double onset_s;
+        double duration_s;
+        std::string text;
+    };
+
+    bool write_header();
+    bool start(uint64_t frame0, int64_t t_ns, uint64_t pos);
+    bool fill(uint32_t n);
+    bool flush_record();
+    double onset(uint64_t pos) const { return first_s_ + (double)pos / rate_; }
+    void add_note(note n);
+
+    int fd_ = -1;
+    bool failed_ = false;
+    std::string path_;
+    rec_file_header hdr_ = {};
+    bdf_options opt_;
+    uint16_t channels_ = 0;
+    uint32_t rate_ = 0;
+    uint32_t frame_bytes_ = 0;
+    uint32_t spr_ = 0;              // frames per record
+    uint32_t ann_bytes_ = 0;        // bytes of the annotation signal per record
+    int32_t u8_[256];               // digital value of every uint8 sample
+
+    bool started_ = false;          // header written
+    int64_t start_s_ = 0;           // header start time, UNIX seconds
+    double first_s_ = 0;            // onset of frame position 0
+    int64_t first_t_ns_ = 0;        // host time of frame position 0
+    bool discontinuous_ = false;
+    uint64_t records_ = 0;
+    uint64_t dropped_ = 0;
+
+    // The continuous run of frames being written: frame base_frame_ is at
+    // position base_pos_ (frames since the first, on the file's timeline)
+    uint64_t base_frame_ = 0;
+    uint64_t base_pos_ = 0;
+    uint64_t next_frame_ = 0;
+
+    // Record being filled: channel-major 24-bit samples, then annotations
+    std::unique_ptr<uint8_t[]> rec_;
+    uint64_t rec_pos_ = 0;          // position of its first frame
+    uint32_t fill_ = 0;             // frames in it
+    std::deque<note> notes_;
+};
+
+} // namespace emg
@@ -0,0 +1,64 @@
+/*
+ * Preallocated receive chunks, see buffer_pool.h.
+ */
+#include <cstdlib>
+#include <cstring>
+#include "buffer_pool.h"
+
+namespace emg {
+
+static const size_t PAGE = 4096;
+
+buffer_pool::buffer_pool(size_t count, size_t chunk_size)
+    : count_(count), chunk_size_((chunk_size + PAGE - 1) & ~(PAGE - 1)), free_(count)
+{
+    void *p = nullptr;
+    if (count_ == 0 || posix_memalign(&p, PAGE, count_ * chunk_size_) != 0) {
+        return;
+    }
+    slab_ = static_cast<uint8_t *>(p);
+    // Touch every page now so the first burst does not page-fault on the network thread
+    memset(slab_, 0, count_ * chunk_size_);
+
+    chunks_ = new chunk[count_];
+    for (size_t i = 0; i < count_; i++) {
+        chunk &c = chunks_[i];
+        c.data = slab_ + i * chunk_size_;
+        c.capacity = (uint32_t)chunk_size_;
+        c.index = (uint32_t)i;
+        free_.push(&c);
+    }
+}
+
+buffer_pool::~buffer_pool()
+{
+    delete[] chunks_;
+    free(slab_);
+}
+
+chunk *buffer_pool::acquire()
+{
+    chunk *c = nullptr;
+    if (!free_.pop(c)) {
+        return nullptr;
+    }
+    c->len = 0;
+    c->stream = 0;
+    c->flags = 0;
+    c->recv_ns = 0;
+    c->messages = 0;
+    c->refs.store(1, std::memory_order_relaxed);
+    return c;
+}
+
+void buffer_pool::release(chunk *c)
+{
+    if (c->index == chunk::NOT_POOLED) {
+        return;
+    }
+    if (c->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        free_.push(c);
+    }
+}
+
+} // namespace emg
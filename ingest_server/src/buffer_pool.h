@@ -0,0 +1,74 @@
+/*
+ * Preallocated receive chunks.
+ *
+ * All chunk memory is one page-aligned slab allocated at startup, so the
+ * network thread never allocates and every chunk can be used for direct I/O.
+ * A chunk is reference counted: the network thread hands the same chunk to
+ * the writer and the consumer, and it returns to the free list when the last
+ * of them releases it.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "mpmc_queue.h"
+
+namespace emg {
+
+enum : uint32_t {
+    CHUNK_END_OF_STREAM = 1u << 0,   // no data; the stream's connection closed
+};
+
+struct chunk {
+    static constexpr uint32_t NOT_POOLED = UINT32_MAX;
+
+    uint8_t *data;          // capacity bytes, page aligned
+    uint32_t capacity;
+    uint32_t len;           // valid bytes: whole protocol messages only
+    uint32_t stream;        // stream slot the data belongs to
+    uint32_t flags;         // CHUNK_*
+    uint64_t recv_ns;       // monotonic time the first byte was read
+    uint32_t messages;      // messages in data
+    uint32_t index;         // position in the pool
+    std::atomic<uint32_t> refs{0};
+};
+
+class buffer_pool {
+public:
+    buffer_pool(size_t count, size_t chunk_size);
+    ~buffer_pool();
+
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+
+    bool ok() const { return slab_ != nullptr; }
+
+    /** Take a free chunk with one reference, or nullptr when exhausted. */
+    chunk *acquire();
+
+    /** Add references before handing a chunk to more owners. */
+    void retain(chunk *c, uint32_t n = 1) { c->refs.fetch_add(n, std::memory_order_relaxed); }
+
+    /**
+     * Drop one reference; the chunk is recycled when none remain. Any thread.
+     * Chunks that do not belong to a pool (index == NOT_POOLED) are ignored.
+     */
+    void release(chunk *c);
+
+    size_t count() const { return count_; }
+    size_t chunk_size() const { return chunk_size_; }
+    size_t available() const { return free_.size(); }
+
+    /** The slab backing all chunks, e.g. for registering with the kernel. */
+    uint8_t *slab() const { return slab_; }
+    size_t slab_bytes() const { return count_ * chunk_size_; }
+
+private:
+    size_t count_;
+    size_t chunk_size_;
+    uint8_t *slab_ = nullptr;
+    chunk *chunks_ = nullptr;
+    mpmc_queue<chunk *> free_;
+};
+
+} // namespace emg
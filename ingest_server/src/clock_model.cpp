@@ -0,0 +1,203 @@
+/*
+ * Device-to-host clock model, see clock_model.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include "clock_model.h"
+
+namespace emg {
+
+void clock_model::reset()
+{
+    if (have_ref_) {
+        resets_++;
+    }
+    have_ref_ = false;
+}
+
+void clock_model::start(int64_t dev_ns, int64_t host_ns)
+{
+    have_ref_ = true;
+    locked_ = false;
+    dev0_ = dev_ns;
+    host0_ = host_ns;
+    last_dev_ = dev_ns;
+    offset_ = 0.0;
+    slope_ = 0.0;
+    head_ = 0;
+    count_ = 0;
+    have_open_ = true;
+    open_index_ = 0;
+    open_ = { 0, 0.0 };
+    early_run_ = 0;
+    late_run_ = 0;
+    rejected_ = 0;
+}
+
+int64_t clock_model::to_host(int64_t dev_ns) const
+{
+    int64_t x = dev_ns - dev0_;
+    return host0_ + x + (int64_t)llround(offset_ + slope_ * (double)x);
+}
+
+bool clock_model::add(int64_t dev_ns, int64_t host_ns)
+{
+    if (!have_ref_) {
+        start(dev_ns, host_ns);
+        return true;
+    }
+    if (dev_ns < last_dev_) {
+        // The device clock restarted: a reboot
+        reset();
+        start(dev_ns, host_ns);
+        return false;
+    }
+    last_dev_ = dev_ns;
+
+    int64_t x = dev_ns - dev0_;
+    double d = (double)(host_ns - host0_ - x);
+    double r = d - (offset_ + slope_ * (double)x);
+    if (r < -(double)STEP_NS && count_ > 0) {
+        // Earlier than any delay allows: a one-off is ignored, a run is a
+        // clock step. Before the first bucket closed, the reference arrival
+        // itself may have been the late one
+        if (++early_run_ >= EARLY_RESET) {
+            reset();
+            start(dev_ns, host_ns);
+            return false;
+        }
+        return true;
+    }
+    early_run_ = 0;
+
+    jit_n_++;
+    jit_sq_ += r * r;
+    jit_max_ = std::max(jit_max_, (int64_t)r);
+
+    int64_t index = x / BUCKET_NS;
+    if (have_open_ && index != open_index_) {
+        if (!close_bucket()) {
+            // Late for LATE_RESET buckets in a row: the line is wrong
+            reset();
+            start(dev_ns, host_ns);
+            return false;
+        }
+    }
+    if (!have_open_) {
+        have_open_ = true;
+        open_index_ = index;
+        open_ = { x, d };
+    } else if (d < open_.d) {
+        open_ = { x, d };
+    }
+    if (count_ == 0) {
+        // No bucket closed yet: the earliest arrival so far sets the offset
+        offset_ = std::min(offset_, d);
+    }
+    return true;
+}
+
+/* Move the open bucket into the window and refit; false on a late step */
+bool clock_model::close_bucket()
+{
+    have_open_ = false;
+    if (count_ > 0 && open_.d - (offset_ + slope_ * (double)open_.x) > (double)STEP_NS) {
+        if (++late_run_ >= LATE_RESET) {
+            return false;
+        }
+    } else {
+        late_run_ = 0;
+    }
+    if (count_ < WINDOW) {
+        window_[(head_ + count_++) % WINDOW] = open_;
+    } else {
+        window_[head_] = open_;
+        head_ = (head_ + 1) % WINDOW;
+    }
+    fit();
+    return true;
+}
+
+/* Least squares line through the kept points; the slope stays as it is unless free_slope */
+static void fit_line(const int64_t *x, const double *d, const bool *keep, size_t n, bool free_slope, double *offset,
+                     double *slope)
+{
+    double sx = 0.0, sd = 0.0;
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (keep[i]) {
+            sx += (double)x[i];
+            sd += d[i];
+            m++;
+        }
+    }
+    if (m == 0) {
+        return;
+    }
+    double xm = sx / m, dm = sd / m;
+    if (free_slope) {
+        // Centred, so that x in the 1e12 range does not eat the precision
+        double sxx = 0.0, sxd = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            if (keep[i]) {
+                double u = (double)x[i] - xm;
+                sxx += u * u;
+                sxd += u * (d[i] - dm);
+            }
+        }
+        if (sxx > 0.0) {
+            *slope = sxd / sxx;
+        }
+    }
+    *offset = dm - *slope * xm;
+}
+
+void clock_model::fit()
+{
+    int64_t x[WINDOW];
+    double d[WINDOW], r[WINDOW], dev[WINDOW];
+    bool keep[WINDOW];
+    size_t n = count_;
+    for (size_t i = 0; i < n; i++) {
+        const bucket &b = window_[(head_ + i) % WINDOW];
+        x[i] = b.x;
+        d[i] = b.d;
+    }
+    bool free_slope = n >= 3 && x[n - 1] - x[0] >= MIN_SLOPE_SPAN_NS;
+
+    // Leave out buckets far off the current line, which a stall's worth of
+    // late buckets cannot drag along the way they would a fresh fit
+    for (size_t i = 0; i < n; i++) {
+        r[i] = d[i] - (offset_ + slope_ * (double)x[i]);
+        dev[i] = r[i];
+    }
+    std::nth_element(dev, dev + n / 2, dev + n);
+    double med = dev[n / 2];
+    for (size_t i = 0; i < n; i++) {
+        dev[i] = std::fabs(r[i] - med);
+    }
+    std::nth_element(dev, dev + n / 2, dev + n);
+    double limit = std::max(REJECT_MADS * 1.4826 * dev[n / 2], (double)REJECT_FLOOR_NS);
+    rejected_ = 0;
+    for (size_t i = 0; i < n; i++) {
+        keep[i] = std::fabs(r[i] - med) <= limit;
+        rejected_ += !keep[i];
+    }
+    double offset = offset_, slope = slope_;
+    fit_line(x, d, keep, n, free_slope, &offset, &slope);
+
+    offset_ = offset;
+    slope_ = slope;
+    locked_ = free_slope;
+}
+
+clock_jitter clock_model::take_jitter()
+{
+    clock_jitter j = { jit_n_, jit_n_ ? std::sqrt(jit_sq_ / (double)jit_n_) : 0.0, jit_max_ };
+    jit_n_ = 0;
+    jit_sq_ = 0.0;
+    jit_max_ = 0;
+    return j;
+}
+
+} // namespace emg
@@ -0,0 +1,125 @@
+/*
+ * Device-to-host clock model: a host timestamp for every device frame.
+ *
+ * A device stamps each batch with its own clock (t_us, the esp_timer time of
+ * the first frame). The host only knows when the batch arrived, which is
+ * that time shifted by an unknown offset, stretched by the drift between
+ * the two crystals, and delayed by the network: usually by about the
+ * minimum, now and then by far more (Wi-Fi retries, TCP stalls, several
+ * batches in one read). The model fits
+ *
+ *   host_ns = host0 + dev_ns - dev0 + offset + slope * (dev_ns - dev0)
+ *
+ * to the lower envelope of the arrivals. Arrivals are grouped into buckets
+ * of BUCKET_NS device time and each bucket keeps only its earliest one
+ * (relative to the device clock), which drops delayed batches. A least
+ * squares line through the last WINDOW buckets, fitted again without the
+ * buckets more than REJECT_MADS median deviations off it, gives offset and
+ * slope (the drift); the slope is only fitted once the window spans
+ * MIN_SLOPE_SPAN_NS. Mapped times are therefore when a frame was acquired
+ * plus the minimum transport delay, on the host clock, without the jitter.
+ *
+ * The delay of every arrival over the line is the jitter; it is summed for
+ * take_jitter(). The model starts over when the device clock goes
+ * backwards (a reboot) or when arrivals keep landing STEP_NS or more off
+ * the line (a clock step on either side).
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "emg_proto.h"
+
+namespace emg {
+
+/** Arrival delay over the model line, summed since the previous take_jitter(). */
+struct clock_jitter {
+    uint64_t count;
+    double rms_ns;
+    int64_t max_ns;
+};
+
+class clock_model {
+public:
+    static constexpr int64_t BUCKET_NS = 250000000;             // 250 ms of device time
+    static constexpr size_t WINDOW = 240;                       // buckets in the fit: 60 s
+    static constexpr int64_t MIN_SLOPE_SPAN_NS = 10000000000;   // fit drift from 10 s on
+    static constexpr double REJECT_MADS = 4.0;
+    static constexpr int64_t REJECT_FLOOR_NS = 50000;           // never reject within 50 us
+    static constexpr int64_t STEP_NS = 5000000;                 // 5 ms off the line: a clock step
+    static constexpr int EARLY_RESET = 3;                       // arrivals in a row
+    static constexpr int LATE_RESET = 20;                       // buckets in a row (5 s)
+
+    /**
+     * Add one arrival: the frame at dev_ns on the device clock arrived at
+     * host_ns. @return false if it made the model start over
+     */
+    bool add(int64_t dev_ns, int64_t host_ns);
+
+    /** Forget everything, e.g. when the device reboots. */
+    void reset();
+
+    /** True once there has been an arrival to map from. */
+    bool valid() const { return have_ref_; }
+
+    /** True once the drift is fitted rather than assumed zero. */
+    bool locked() const { return locked_; }
+
+    /** Host time of device time dev_ns (valid() only). */
+    int64_t to_host(int64_t dev_ns) const;
+
+    /** Host ns per device ns: 1 + drift. */
+    double rate() const { return 1.0 + slope_; }
+    double drift_ppm() const { return slope_ * 1e6; }
+
+    /** Buckets left out of the last fit as outliers. */
+    size_t rejected() const { return rejected_; }
+    uint64_t resets() const { return resets_; }
+
+    /** Jitter since the previous call. */
+    clock_jitter take_jitter();
+
+private:
+    struct bucket {
+        int64_t x;      // device ns since dev0_
+        double d;       // host - device ns, less the reference offset
+    };
+
+    bool close_bucket();
+    void fit();
+    void start(int64_t dev_ns, int64_t host_ns);
+
+    bool have_ref_ = false;
+    bool locked_ = false;
+    int64_t dev0_ = 0;
+    int64_t host0_ = 0;
+    int64_t last_dev_ = 0;
+    double offset_ = 0.0;
+    double slope_ = 0.0;
+
+    bucket window_[WINDOW];
+    size_t head_ = 0;               // oldest bucket
+    size_t count_ = 0;
+    bool have_open_ = false;
+    int64_t open_index_ = 0;        // x / BUCKET_NS of the open bucket
+    bucket open_ = {};
+
+    int early_run_ = 0;
+    int late_run_ = 0;
+    size_t rejected_ = 0;
+    uint64_t resets_ = 0;
+
+    uint64_t jit_n_ = 0;
+    double jit_sq_ = 0.0;
+    int64_t jit_max_ = 0;
+};
+
+/** Device time (ns) of frame i of a raw batch, from its t_us or, if it has none, its frame index. */
+inline int64_t batch_frame_dev_ns(const emg_msg_hdr_t &h, uint32_t i, uint32_t frame_rate_hz)
+{
+    const uint64_t s = 1000000000ull;
+    uint64_t base = h.t_us ? h.t_us * 1000
+                           : h.frame0 / frame_rate_hz * s + h.frame0 % frame_rate_hz * s / frame_rate_hz;
+    return (int64_t)(base + (uint64_t)i * s / frame_rate_hz);
+}
+
+} // namespace emg
@@ -0,0 +1,233 @@
+/*
+ * Min/max decimation of a live window of frames, see decimate.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include "decimate.h"
+#include "deinterleave.h"
+
+namespace emg {
+
+minmax_pyramid::minmax_pyramid(size_t channels, size_t capacity_frames)
+    : channels_(channels), cap_(1), levels_(0)
+{
+    while (cap_ < capacity_frames) {
+        cap_ <<= 1;
+        levels_++;
+    }
+    samples_.resize(channels_ * cap_);
+    nodes_.resize(levels_ + 1);
+    for (int k = 1; k <= levels_; k++) {
+        nodes_[k].resize(channels_ * (cap_ >> k));
+    }
+}
+
+void minmax_pyramid::clear()
+{
+    written_ = 0;
+}
+
+void minmax_pyramid::append_u8(const uint8_t *frames, size_t n)
+{
+    uint64_t end = written_ + n;
+    if (n > cap_) {
+        // Only the newest cap_ frames can survive
+        frames += (n - cap_) * channels_;
+        n = cap_;
+    }
+    uint64_t s0 = end - n;
+    size_t pos = (size_t)(s0 & (cap_ - 1));
+    size_t m = std::min(n, cap_ - pos);
+    deinterleave_u8(frames, m, channels_, samples_.data() + pos, cap_);
+    if (m < n) {
+        deinterleave_u8(frames + m * channels_, n - m, channels_, samples_.data(), cap_);
+    }
+    written_ = end;
+    update(s0, end);
+}
+
+void minmax_pyramid::append_f32(const float *frames, size_t n)
+{
+    uint64_t end = written_ + n;
+    if (n > cap_) {
+        frames += (n - cap_) * channels_;
+        n = cap_;
+    }
+    uint64_t s0 = end - n;
+    for (size_t c = 0; c < channels_; c++) {
+        float *row = samples_.data() + c * cap_;
+        for (size_t i = 0; i < n; i++) {
+            row[(s0 + i) & (cap_ - 1)] = frames[i * channels_ + c];
+        }
+    }
+    written_ = end;
+    update(s0, end);
+}
+
+minmax_pyramid::node minmax_pyramid::at(size_t channel, int level, uint64_t index) const
+{
+    if (level == 0) {
+        float v = samples_[channel * cap_ + (index & (cap_ - 1))];
+        return { v, v, v };
+    }
+    size_t len = cap_ >> level;
+    return nodes_[level][channel * len + (index & (len - 1))];
+}
+
+/* Recompute the nodes over frames [s0, s1), which were just written; a
+ * node whose second half is still to come covers its first half only */
+void minmax_pyramid::update(uint64_t s0, uint64_t s1)
+{
+    if (s0 == s1) {
+        return;
+    }
+    for (int k = 1; k <= levels_; k++) {
+        uint64_t j0 = s0 >> k, j1 = (s1 - 1) >> k;
+        size_t len = cap_ >> k;
+        for (size_t c = 0; c < channels_; c++) {
+            node *row = nodes_[k].data() + c * len;
+            for (uint64_t j = j0; j <= j1; j++) {
+                node a = at(c, k - 1, 2 * j);
+                if (((2 * j + 1) << (k - 1)) < s1) {
+                    node b = at(c, k - 1, 2 * j + 1);
+                    a.min = std::min(a.min, b.min);
+                    a.max = std::max(a.max, b.max);
+                    a.sum += b.sum;
+                }
+                row[j & (len - 1)] = a;
+            }
+        }
+    }
+}
+
+bool minmax_pyramid::clip(uint64_t &first, size_t &n) const
+{
+    uint64_t lo = written_ - stored();
+    uint64_t end = std::min<uint64_t>(first + n, written_);
+    first = std::max(first, lo);
+    if (first >= end) {
+        return false;
+    }
+    n = (size_t)(end - first);
+    return true;
+}
+
+/* Min, max and sum of frames [a, b) from the largest aligned nodes that fit */
+minmax_pyramid::extremes minmax_pyramid::range(size_t channel, uint64_t a, uint64_t b) const
+{
+    extremes e = {};
+    bool first = true;
+    while (a < b) {
+        int k = a ? std::min(__builtin_ctzll(a), levels_) : levels_;
+        while ((1ull << k) > b - a) {
+            k--;
+        }
+        node n = at(channel, k, a >> k);
+        if (first || n.min < e.n.min) {
+            e.n.min = n.min;
+            e.min_level = k;
+            e.min_index = a >> k;
+        }
+        if (first || n.max > e.n.max) {
+            e.n.max = n.max;
+            e.max_level = k;
+            e.max_index = a >> k;
+        }
+        e.n.sum = first ? n.sum : e.n.sum + n.sum;
+        first = false;
+        a += 1ull << k;
+    }
+    return e;
+}
+
+/* Frame holding the minimum (or maximum) of a complete node */
+uint64_t minmax_pyramid::descend(size_t channel, int level, uint64_t index, bool want_max) const
+{
+    for (; level > 0; level--) {
+        node p = at(channel, level, index);
+        node l = at(channel, level - 1, 2 * index);
+        index = 2 * index + ((want_max ? l.max == p.max : l.min == p.min) ? 0 : 1);
+    }
+    return index;
+}
+
+size_t minmax_pyramid::envelope(size_t channel, uint64_t first, size_t n, size_t columns,
+                                envelope_column *out) const
+{
+    if (channel >= channels_ || columns == 0 || !clip(first, n)) {
+        return 0;
+    }
+    columns = std::min(columns, n);
+    for (size_t i = 0; i < columns; i++) {
+        uint64_t a = first + (uint64_t)i * n / columns;
+        uint64_t b = first + (uint64_t)(i + 1) * n / columns;
+        extremes e = range(channel, a, b);
+        out[i] = { a, (uint32_t)(b - a), e.n.min, e.n.max, e.n.sum / (float)(b - a) };
+    }
+    return columns;
+}
+
+size_t minmax_pyramid::lttb(size_t channel, uint64_t first, size_t n, size_t points, uint64_t *seq,
+                            float *value) const
+{
+    if (channel >= channels_ || !clip(first, n)) {
+        return 0;
+    }
+    if (n <= points || points < 3) {
+        size_t m = std::min(n, std::max<size_t>(points, 1));
+        for (size_t i = 0; i < m; i++) {
+            seq[i] = first + i;
+            value[i] = at(channel, 0, first + i).min;
+        }
+        return m;
+    }
+
+    // First and last frame are kept; the frames between go into points - 2
+    // buckets, and each bucket keeps the candidate making the largest
+    // triangle with the point kept before it and the next bucket's mean
+    size_t buckets = points - 2;
+    uint64_t inner = first + 1, inner_n = n - 2;
+    auto bucket = [&](size_t i, uint64_t *a, uint64_t *b) {
+        *a = inner + (uint64_t)i * inner_n / buckets;
+        *b = inner + (uint64_t)(i + 1) * inner_n / buckets;
+    };
+
+    seq[0] = first;
+    value[0] = at(channel, 0, first).min;
+    double ax = 0.0, ay = value[0];
+    uint64_t a, b;
+    bucket(0, &a, &b);
+    extremes cur = range(channel, a, b);
+    for (size_t i = 0; i < buckets; i++) {
+        uint64_t na, nb;
+        double cx, cy;
+        extremes next = {};
+        if (i + 1 < buckets) {
+            bucket(i + 1, &na, &nb);
+            next = range(channel, na, nb);
+            cx = (double)(na - first) + (double)(nb - na - 1) / 2.0;
+            cy = next.n.sum / (double)(nb - na);
+        } else {
+            cx = (double)(n - 1);
+            cy = at(channel, 0, first + n - 1).min;
+        }
+
+        uint64_t lo = descend(channel, cur.min_level, cur.min_index, false);
+        uint64_t hi = descend(channel, cur.max_level, cur.max_index, true);
+        auto area = [&](uint64_t s, double y) {
+            double x = (double)(s - first);
+            return std::fabs((ax - cx) * (y - ay) - (ax - x) * (cy - ay));
+        };
+        bool take_hi = area(hi, cur.n.max) > area(lo, cur.n.min);
+        seq[i + 1] = take_hi ? hi : lo;
+        value[i + 1] = take_hi ? cur.n.max : cur.n.min;
+        ax = (double)(seq[i + 1] - first);
+        ay = value[i + 1];
+        cur = next;
+    }
+    seq[points - 1] = first + n - 1;
+    value[points - 1] = at(channel, 0, first + n - 1).min;
+    return points;
+}
+
+} // namespace emg
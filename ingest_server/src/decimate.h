@@ -0,0 +1,99 @@
+/*
+ * Min/max decimation of a live window of frames, for plotting.
+ *
+ * A plot a few thousand pixels wide cannot show more than a few thousand
+ * points, however many samples the window holds. minmax_pyramid keeps the
+ * newest capacity frames of every channel together with a pyramid over
+ * them: level k holds min, max and sum of every aligned run of 2^k frames,
+ * so any range is covered by O(log n) nodes. Queries then cost O(columns *
+ * log(frames per column)) whatever the sample rate:
+ *
+ *   envelope()  min, max and mean of each of `columns` equal slices of a
+ *               range, to draw as a band or as a min/max zig-zag that shows
+ *               every peak
+ *   lttb()      a `points` long series picked by largest-triangle-three-
+ *               buckets, with each bucket's candidates cut down to its
+ *               minimum and maximum (found in the pyramid, with their
+ *               positions); with one frame per bucket it is plain LTTB
+ *
+ * Appending costs about two node updates per sample and channel. Frames
+ * are numbered from 0 in the order they were appended; a range asked for is
+ * clipped to the frames still held. Not thread-safe: appends and queries
+ * from different threads need a lock.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace emg {
+
+/** One slice of a range: frames [first, first + count). */
+struct envelope_column {
+    uint64_t first;
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+};
+
+class minmax_pyramid {
+public:
+    /** Holds the newest capacity_frames (rounded up to a power of two) frames of channels samples. */
+    minmax_pyramid(size_t channels, size_t capacity_frames);
+
+    /** Append n offset-binary uint8 frames; samples are stored less EMG_SAMPLE_ZERO. */
+    void append_u8(const uint8_t *frames, size_t n);
+
+    /** Append n frames of channels float samples. */
+    void append_f32(const float *frames, size_t n);
+
+    /** Drop everything; numbering starts at 0 again. */
+    void clear();
+
+    size_t channels() const { return channels_; }
+    size_t capacity() const { return cap_; }
+    uint64_t written() const { return written_; }
+    size_t stored() const { return written_ < cap_ ? (size_t)written_ : cap_; }
+
+    /**
+     * Split frames [first, first + n), clipped to the frames held, into
+     * min(columns, frames) slices of (nearly) equal length.
+     * @return columns written to out
+     */
+    size_t envelope(size_t channel, uint64_t first, size_t n, size_t columns, envelope_column *out) const;
+
+    /**
+     * Downsample frames [first, first + n), clipped to the frames held, to
+     * at most points points (>= 3; all frames if there are no more than that).
+     * @return points written to seq and value
+     */
+    size_t lttb(size_t channel, uint64_t first, size_t n, size_t points, uint64_t *seq, float *value) const;
+
+private:
+    struct node {
+        float min;
+        float max;
+        float sum;
+    };
+    struct extremes {
+        node n;
+        int min_level, max_level;   // nodes holding the minimum and the maximum
+        uint64_t min_index, max_index;
+    };
+
+    node at(size_t channel, int level, uint64_t index) const;
+    void update(uint64_t s0, uint64_t s1);
+    extremes range(size_t channel, uint64_t a, uint64_t b) const;
+    uint64_t descend(size_t channel, int level, uint64_t index, bool want_max) const;
+    bool clip(uint64_t &first, size_t &n) const;
+
+    size_t channels_;
+    size_t cap_;
+    int levels_;                            // 2^levels_ == cap_
+    uint64_t written_ = 0;
+    std::vector<float> samples_;            // level 0: channel rows of cap_ samples
+    std::vector<std::vector<node>> nodes_;  // level k >= 1: channel rows of cap_ >> k nodes
+};
+
+} // namespace emg
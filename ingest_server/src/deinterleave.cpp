@@ -0,0 +1,268 @@
+/*
+ * Frame deinterleave kernels, see deinterleave.h.
+ */
+#include <algorithm>
+#include <cstdint>
+#include "deinterleave.h"
+#include "emg_proto.h"
+#include "recording.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EMG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace emg {
+
+// Frames per block: the input block (64 frames of 64 channels: 4 KB of
+// uint8) stays in L1 while each channel's 256-byte output run is written
+static const size_t BLOCK_FRAMES = 64;
+
+template <typename T>
+static inline float sample_zero()
+{
+    return sizeof(T) == 1 ? (float)EMG_SAMPLE_ZERO : 0.0f;
+}
+
+/* Frames [f0, f1) of channels [c0, c1), one sample at a time */
+template <typename T>
+static void scalar_block(const T *frames, size_t f0, size_t f1, size_t c0, size_t c1, size_t channels, float *out,
+                         size_t stride, float zero, float scale)
+{
+    for (size_t c = c0; c < c1; c++) {
+        float *o = out + c * stride;
+        const T *p = frames + c;
+        for (size_t i = f0; i < f1; i++) {
+            o[i] = ((float)p[i * channels] - zero) * scale;
+        }
+    }
+}
+
+template <typename T>
+static void deinterleave_scalar(const T *frames, size_t n, size_t channels, float *out, size_t stride, float scale)
+{
+    for (size_t b0 = 0; b0 < n; b0 += BLOCK_FRAMES) {
+        scalar_block(frames, b0, std::min(n, b0 + BLOCK_FRAMES), 0, channels, channels, out, stride,
+                     sample_zero<T>(), scale);
+    }
+}
+
+#if EMG_X86
+
+/* ---- SSE2: 4 frames x 4 channels per register tile ---- */
+
+__attribute__((target("sse2"))) static inline __m128 sse2_scale(__m128i x, __m128 zero, __m128 scale)
+{
+    return _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(x), zero), scale);
+}
+
+/* Channels [c, c + 8) of one frame as 2 vectors of 4 floats */
+template <typename T>
+__attribute__((target("sse2"))) static inline void sse2_row(const T *p, __m128 *v, __m128 zero, __m128 scale)
+{
+    if constexpr (sizeof(T) == 1) {
+        const __m128i z = _mm_setzero_si128();
+        __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), z);
+        v[0] = sse2_scale(_mm_unpacklo_epi16(w, z), zero, scale);
+        v[1] = sse2_scale(_mm_unpackhi_epi16(w, z), zero, scale);
+    } else {
+        // Sign-extend by placing each int16 in the top half and shifting down
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        v[0] = sse2_scale(_mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16), zero, scale);
+        v[1] = sse2_scale(_mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16), zero, scale);
+    }
+}
+
+template <typename T>
+__attribute__((target("sse2"))) static void deinterleave_sse2(const T *frames, size_t n, size_t channels, float *out,
+                                                              size_t stride, float scale)
+{
+    // 8 channels per tile: more output rows at once would evict each other
+    // from L1 when the row stride is a multiple of 4 KB
+    constexpr size_t TC = 8;
+    constexpr size_t Q = 2;
+    const float zero = sample_zero<T>();
+    const __m128 vz = _mm_set1_ps(zero);
+    const __m128 vs = _mm_set1_ps(scale);
+    size_t cfull = channels - channels % TC;
+
+    for (size_t b0 = 0; b0 < n; b0 += BLOCK_FRAMES) {
+        size_t b1 = std::min(n, b0 + BLOCK_FRAMES);
+        size_t ffull = b0 + ((b1 - b0) & ~(size_t)3);
+        for (size_t c = 0; c < cfull; c += TC) {
+            for (size_t i = b0; i < ffull; i += 4) {
+                const T *p = frames + i * channels + c;
+                __m128 v[4][Q];
+                for (size_t f = 0; f < 4; f++) {
+                    sse2_row(p + f * channels, v[f], vz, vs);
+                }
+                for (size_t q = 0; q < Q; q++) {
+                    __m128 r0 = v[0][q], r1 = v[1][q], r2 = v[2][q], r3 = v[3][q];
+                    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                    float *o = out + (c + 4 * q) * stride + i;
+                    _mm_storeu_ps(o, r0);
+                    _mm_storeu_ps(o + stride, r1);
+                    _mm_storeu_ps(o + 2 * stride, r2);
+                    _mm_storeu_ps(o + 3 * stride, r3);
+                }
+            }
+        }
+        scalar_block(frames, ffull, b1, 0, cfull, channels, out, stride, zero, scale);
+        scalar_block(frames, b0, b1, cfull, channels, channels, out, stride, zero, scale);
+    }
+}
+
+/* ---- AVX2: 8 frames x 8 channels per register tile ---- */
+
+/* Channels [c, c + 8) of one frame as 8 floats */
+template <typename T>
+__attribute__((target("avx2"))) static inline __m256 avx2_row(const T *p, __m256 zero, __m256 scale)
+{
+    __m256i x;
+    if constexpr (sizeof(T) == 1) {
+        x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+    } else {
+        x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p));
+    }
+    return _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(x), zero), scale);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) static void deinterleave_avx2(const T *frames, size_t n, size_t channels, float *out,
+                                                              size_t stride, float scale)
+{
+    const float zero = sample_zero<T>();
+    const __m256 vz = _mm256_set1_ps(zero);
+    const __m256 vs = _mm256_set1_ps(scale);
+    size_t cfull = channels & ~(size_t)7;
+
+    for (size_t b0 = 0; b0 < n; b0 += BLOCK_FRAMES) {
+        size_t b1 = std::min(n, b0 + BLOCK_FRAMES);
+        size_t ffull = b0 + ((b1 - b0) & ~(size_t)7);
+        for (size_t c = 0; c < cfull; c += 8) {
+            for (size_t i = b0; i < ffull; i += 8) {
+                const T *p = frames + i * channels + c;
+                __m256 r0 = avx2_row(p, vz, vs);
+                __m256 r1 = avx2_row(p + channels, vz, vs);
+                __m256 r2 = avx2_row(p + 2 * channels, vz, vs);
+                __m256 r3 = avx2_row(p + 3 * channels, vz, vs);
+                __m256 r4 = avx2_row(p + 4 * channels, vz, vs);
+                __m256 r5 = avx2_row(p + 5 * channels, vz, vs);
+                __m256 r6 = avx2_row(p + 6 * channels, vz, vs);
+                __m256 r7 = avx2_row(p + 7 * channels, vz, vs);
+
+                // 8x8 transpose: rows are frames, columns channels
+                __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+                __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+                __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+                __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+                __m256 s0 = _mm256_shuffle_ps(t0, t2, 0x44), s1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+                __m256 s2 = _mm256_shuffle_ps(t1, t3, 0x44), s3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+                __m256 s4 = _mm256_shuffle_ps(t4, t6, 0x44), s5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+                __m256 s6 = _mm256_shuffle_ps(t5, t7, 0x44), s7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+
+                float *o = out + c * stride + i;
+                _mm256_storeu_ps(o, _mm256_permute2f128_ps(s0, s4, 0x20));
+                _mm256_storeu_ps(o + stride, _mm256_permute2f128_ps(s1, s5, 0x20));
+                _mm256_storeu_ps(o + 2 * stride, _mm256_permute2f128_ps(s2, s6, 0x20));
+                _mm256_storeu_ps(o + 3 * stride, _mm256_permute2f128_ps(s3, s7, 0x20));
+                _mm256_storeu_ps(o + 4 * stride, _mm256_permute2f128_ps(s0, s4, 0x31));
+                _mm256_storeu_ps(o + 5 * stride, _mm256_permute2f128_ps(s1, s5, 0x31));
+                _mm256_storeu_ps(o + 6 * stride, _mm256_permute2f128_ps(s2, s6, 0x31));
+                _mm256_storeu_ps(o + 7 * stride, _mm256_permute2f128_ps(s3, s7, 0x31));
+            }
+        }
+        scalar_block(frames, ffull, b1, 0, cfull, channels, out, stride, zero, scale);
+        scalar_block(frames, b0, b1, cfull, channels, channels, out, stride, zero, scale);
+    }
+}
+
+#endif // EMG_X86
+
+bool isa_supported(simd_isa isa)
+{
+    switch (isa) {
+    case simd_isa::scalar:
+        return true;
+#if EMG_X86
+    case simd_isa::sse2:
+        return __builtin_cpu_supports("sse2");
+    case simd_isa::avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+simd_isa best_isa()
+{
+    static const simd_isa best = isa_supported(simd_isa::avx2) ? simd_isa::avx2
+                                 : isa_supported(simd_isa::sse2) ? simd_isa::sse2
+                                 : simd_isa::scalar;
+    return best;
+}
+
+const char *isa_name(simd_isa isa)
+{
+    switch (isa) {
+    case simd_isa::sse2: return "sse2";
+    case simd_isa::avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+template <typename T>
+static void dispatch(const T *frames, size_t n, size_t channels, float *out, size_t stride, float scale, simd_isa isa)
+{
+    if (!isa_supported(isa)) {
+        isa = best_isa();
+    }
+    // Unless every row starts 32-byte aligned, half the AVX2 stores would
+    // split a cache line, which costs more than the wider registers gain
+    if (isa == simd_isa::avx2 && (((uintptr_t)out | (stride * sizeof(float))) & 31)) {
+        isa = simd_isa::sse2;
+    }
+    switch (isa) {
+#if EMG_X86
+    case simd_isa::avx2:
+        deinterleave_avx2(frames, n, channels, out, stride, scale);
+        return;
+    case simd_isa::sse2:
+        deinterleave_sse2(frames, n, channels, out, stride, scale);
+        return;
+#endif
+    default:
+        deinterleave_scalar(frames, n, channels, out, stride, scale);
+        return;
+    }
+}
+
+void deinterleave_u8(const uint8_t *frames, size_t n, size_t channels, float *out, size_t out_stride, float scale,
+                     simd_isa isa)
+{
+    dispatch(frames, n, channels, out, out_stride, scale, isa);
+}
+
+void deinterleave_i16(const int16_t *frames, size_t n, size_t channels, float *out, size_t out_stride, float scale,
+                      simd_isa isa)
+{
+    dispatch(frames, n, channels, out, out_stride, scale, isa);
+}
+
+bool deinterleave(uint8_t sample_format, const void *frames, size_t n, size_t channels, float *out,
+                  size_t out_stride, float scale, simd_isa isa)
+{
+    switch (sample_format) {
+    case REC_FMT_U8_OFFSET:
+        deinterleave_u8((const uint8_t *)frames, n, channels, out, out_stride, scale, isa);
+        return true;
+    case REC_FMT_I16:
+        deinterleave_i16((const int16_t *)frames, n, channels, out, out_stride, scale, isa);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace emg
@@ -0,0 +1,60 @@
+/*
+ * Frame deinterleave kernels: sample-major frames to channel-major float32.
+ *
+ * Frames arrive (and are recorded) sample-major: all channels of one
+ * sample, then all channels of the next. Analysis wants one contiguous
+ * array per channel. These kernels transpose a batch of frames and convert
+ * the samples to float32 on the way:
+ *
+ *   out[c * out_stride + i] = (sample(i, c) - zero) * scale
+ *
+ * where zero is EMG_SAMPLE_ZERO for offset-binary uint8 and 0 for int16.
+ *
+ * Each has a scalar version and SSE2 and AVX2 versions that transpose
+ * register tiles (4x4 and 8x8 floats). Frames are processed in blocks small
+ * enough that the input block stays in L1 while every channel's output run
+ * for the block is written out in full cache lines, which keeps the SIMD
+ * versions at memory bandwidth for any batch size. Channel and frame counts
+ * that do not fill a tile are finished by the scalar code. The best version
+ * the CPU supports is picked at run time; x86 builds need no special
+ * compiler flags, other architectures get the scalar code.
+ *
+ * AVX2 is only used when every output row starts 32-byte aligned (out
+ * aligned and out_stride a multiple of 8); otherwise the SSE2 version runs,
+ * since split-line stores would make AVX2 the slower of the two.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace emg {
+
+enum class simd_isa { scalar, sse2, avx2 };
+
+/** Best instruction set this CPU supports (detected once). */
+simd_isa best_isa();
+
+const char *isa_name(simd_isa isa);
+
+/** True if this build and CPU can run isa. */
+bool isa_supported(simd_isa isa);
+
+/**
+ * Deinterleave n frames of channels offset-binary uint8 samples.
+ * @param out_stride  floats between the starts of two channels' rows, >= n
+ */
+void deinterleave_u8(const uint8_t *frames, size_t n, size_t channels, float *out, size_t out_stride,
+                     float scale = 1.0f, simd_isa isa = best_isa());
+
+/** Deinterleave n frames of channels int16 samples (native-endian). */
+void deinterleave_i16(const int16_t *frames, size_t n, size_t channels, float *out, size_t out_stride,
+                      float scale = 1.0f, simd_isa isa = best_isa());
+
+/**
+ * Deinterleave frames in a recording sample format (REC_FMT_*).
+ * @return false if the format is unknown
+ */
+bool deinterleave(uint8_t sample_format, const void *frames, size_t n, size_t channels, float *out,
+                  size_t out_stride, float scale = 1.0f, simd_isa isa = best_isa());
+
+} // namespace emg
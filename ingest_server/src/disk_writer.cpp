@@ -0,0 +1,532 @@
+/*
+ * Asynchronous batched file writer, see disk_writer.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "disk_writer.h"
+#include "wire.h"
+#if EMG_HAVE_IO_URING
+#include "uring.h"
+#endif
+
+namespace emg {
+
+static const size_t PAGE = 4096;
+
+/* State of one open file shared between its producer and the I/O thread */
+struct disk_file::target {
+    int fd;
+    bool direct;                    // O_DIRECT: lengths are padded to whole pages
+    std::atomic<bool> failed{false};
+    // I/O thread only
+    int slot = -1;                  // registered file slot (io_uring)
+    unsigned inflight = 0;          // writes submitted and not yet completed
+    uint64_t inflight_end = 0;      // highest end offset among them
+    uint64_t end = 0;               // end of the data written so far
+    uint64_t unsynced = 0;          // bytes written since the last fdatasync()
+    uint64_t dirty_ns = 0;          // when the oldest unsynced write finished
+    std::function<void(bool)> closed;   // set by the producer before REQ_CLOSE
+};
+
+bool parse_sync_policy(const char *s, disk_config *cfg)
+{
+    if (strcmp(s, "none") == 0) {
+        cfg->sync = sync_policy::none;
+        return true;
+    }
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+        return false;
+    }
+    if (strcasecmp(end, "mb") == 0) {
+        cfg->sync = sync_policy::bytes;
+        cfg->sync_bytes = v << 20;
+        return true;
+    }
+    if (strcmp(end, "ms") == 0) {
+        cfg->sync = sync_policy::interval;
+        cfg->sync_ms = (unsigned)v;
+        return true;
+    }
+    return false;
+}
+
+/* ======= Producer side ======= */
+
+void disk_file::open(int fd, uint64_t offset)
+{
+    close();
+    target_ = new target();
+    target_->fd = fd;
+    target_->direct = (fcntl(fd, F_GETFL) & O_DIRECT) != 0;
+    base_ = offset;
+    fill_ = 0;
+    flushed_ = 0;
+}
+
+bool disk_file::failed() const
+{
+    return target_ && target_->failed.load(std::memory_order_relaxed);
+}
+
+bool disk_file::append(const struct iovec *iov, int n)
+{
+    if (!target_ || failed()) {
+        return false;
+    }
+    const size_t cap = w_.cfg_.buffer_size;
+    for (int i = 0; i < n; i++) {
+        const uint8_t *p = (const uint8_t *)iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        while (len > 0) {
+            if (!cur_) {
+                cur_ = w_.acquire();
+            }
+            if (fill_ == flushed_) {
+                dirty_ns_ = now_ns();
+            }
+            size_t take = std::min(len, cap - fill_);
+            memcpy(cur_ + fill_, p, take);
+            fill_ += take;
+            p += take;
+            len -= take;
+            if (fill_ == cap) {
+                w_.submit({ disk_writer::REQ_WRITE, target_, cur_, base_, fill_ });
+                cur_ = nullptr;
+                base_ += fill_;
+                fill_ = 0;
+                flushed_ = 0;
+            }
+        }
+    }
+    return true;
+}
+
+void disk_file::flush()
+{
+    if (!target_ || !cur_ || fill_ == flushed_) {
+        return;
+    }
+    // Write what there is; keep the incomplete last page for the next write
+    size_t tail = (size_t)((base_ + fill_) % PAGE);
+    if (tail > fill_) tail = fill_;
+    uint8_t *old = cur_;
+    w_.submit({ disk_writer::REQ_WRITE, target_, old, base_, fill_ });
+    cur_ = nullptr;
+    if (tail) {
+        // Only this thread takes buffers from the pool, so old is unchanged
+        // even if its write has completed; acquire() may hand back old itself
+        cur_ = w_.acquire();
+        memmove(cur_, old + fill_ - tail, tail);
+    }
+    base_ += fill_ - tail;
+    fill_ = tail;
+    flushed_ = tail;
+}
+
+void disk_file::tick(uint64_t now)
+{
+    if (cur_ && fill_ > flushed_ && now - dirty_ns_ >= (uint64_t)w_.cfg_.flush_ms * 1000000ull) {
+        flush();
+    }
+}
+
+void disk_file::close(std::function<void(bool ok)> closed)
+{
+    if (!target_) {
+        if (closed) closed(false);
+        return;
+    }
+    flush();
+    target_->closed = std::move(closed);
+    w_.submit({ disk_writer::REQ_CLOSE, target_, cur_, 0, 0 });
+    target_ = nullptr;
+    cur_ = nullptr;
+    base_ = 0;
+    fill_ = 0;
+    flushed_ = 0;
+}
+
+/* ======= disk_writer ======= */
+
+static const unsigned FILE_SLOTS = 128;     // registered file table (io_uring)
+
+disk_writer::disk_writer(const disk_config &cfg)
+    : cfg_(cfg), queue_(cfg.buffers + 2 * 64), free_(cfg.buffers)
+{
+    cfg_.buffer_size = std::max(PAGE, cfg_.buffer_size / PAGE * PAGE);
+    cfg_.buffers = std::max<size_t>(cfg_.buffers, 2);
+    cfg_.queue_depth = std::max(1u, cfg_.queue_depth);
+    if (cfg_.sync == sync_policy::interval) {
+        // Data cannot be on disk sooner than it leaves the buffer
+        cfg_.flush_ms = std::min(cfg_.flush_ms, cfg_.sync_ms);
+    }
+}
+
+disk_writer::~disk_writer()
+{
+    stop();
+    free(slab_);
+}
+
+int disk_writer::open_flags() const
+{
+    return cfg_.direct ? O_DIRECT : 0;
+}
+
+const char *disk_writer::backend() const
+{
+#if EMG_HAVE_IO_URING
+    if (ring_) {
+        return fixed_bufs_ ? "io_uring (registered buffers)" : "io_uring";
+    }
+#endif
+    return "pwrite";
+}
+
+bool disk_writer::start()
+{
+    if (!io_wake_.ok() || !free_wake_.ok()) {
+        return false;
+    }
+    void *p = nullptr;
+    if (posix_memalign(&p, PAGE, cfg_.buffers * cfg_.buffer_size) != 0) {
+        fprintf(stderr, "disk_writer: cannot allocate %zu x %zu bytes\n", cfg_.buffers, cfg_.buffer_size);
+        return false;
+    }
+    slab_ = (uint8_t *)p;
+    memset(slab_, 0, cfg_.buffers * cfg_.buffer_size);   // fault the pages in now, not mid-burst
+    for (size_t i = 0; i < cfg_.buffers; i++) {
+        free_.push(slab_ + i * cfg_.buffer_size);
+    }
+    if (cfg_.io_uring) {
+#if EMG_HAVE_IO_URING
+        start_uring();
+#else
+        fprintf(stderr, "disk_writer: built without io_uring, using pwrite\n");
+#endif
+    }
+    thread_ = std::thread(&disk_writer::io_loop, this);
+    return true;
+}
+
+void disk_writer::stop()
+{
+    if (thread_.joinable()) {
+        stop_.store(true, std::memory_order_release);
+        io_wake_.notify();
+        thread_.join();
+    }
+}
+
+uint8_t *disk_writer::acquire()
+{
+    uint8_t *b;
+    if (free_.pop(b)) {
+        return b;
+    }
+    waits.fetch_add(1, std::memory_order_relaxed);
+    while (!free_.pop(b)) {
+        free_wake_.wait(100);
+    }
+    return b;
+}
+
+void disk_writer::submit(const request &r)
+{
+    while (!queue_.push(r)) {
+        free_wake_.wait(100);
+    }
+    io_wake_.notify();
+}
+
+/* ======= I/O thread ======= */
+
+void disk_writer::io_loop()
+{
+    for (;;) {
+        bool done = stop_.load(std::memory_order_acquire);
+        request r;
+        while (queue_.pop(r)) {
+            process(r);
+            free_wake_.notify();
+        }
+        reap(false);
+        sync_due(now_ns());
+        if (done) {
+            while (inflight_ > 0) {
+                reap(true);
+            }
+            break;
+        }
+        int wait_ms = 100;
+        if (cfg_.sync == sync_policy::interval && !dirty_.empty()) {
+            wait_ms = std::min<int>(wait_ms, (int)cfg_.sync_ms);
+        }
+        // With io_uring, completions signal io_wake_ as well
+        io_wake_.wait(wait_ms);
+    }
+}
+
+void disk_writer::sync(disk_file::target *t)
+{
+    // Covers every completed write; ones still in flight count towards the next sync
+    uint64_t t0 = now_ns();
+    if (fdatasync(t->fd) != 0) {
+        t->failed.store(true, std::memory_order_relaxed);
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    sync_latency.add(now_ns() - t0);
+    syncs.fetch_add(1, std::memory_order_relaxed);
+    t->unsynced = 0;
+    dirty_.erase(std::remove(dirty_.begin(), dirty_.end(), t), dirty_.end());
+}
+
+void disk_writer::sync_due(uint64_t now)
+{
+    if (cfg_.sync != sync_policy::interval) {
+        return;
+    }
+    const uint64_t limit = (uint64_t)cfg_.sync_ms * 1000000ull;
+    for (size_t i = 0; i < dirty_.size();) {
+        disk_file::target *t = dirty_[i];
+        if (now - t->dirty_ns >= limit) {
+            sync(t);        // removes t from dirty_
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Both backends: account a finished write of len bytes and recycle its buffer */
+void disk_writer::complete(disk_file::target *t, uint8_t *buf, size_t len, bool ok, uint64_t t0)
+{
+    write_latency.add(now_ns() - t0);
+    writes.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        t->failed.store(true, std::memory_order_relaxed);
+        errors.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        bytes.fetch_add(len, std::memory_order_relaxed);
+        if (t->unsynced == 0 && cfg_.sync != sync_policy::none) {
+            t->dirty_ns = now_ns();
+            dirty_.push_back(t);
+        }
+        t->unsynced += len;
+        if (cfg_.sync == sync_policy::bytes && t->unsynced >= cfg_.sync_bytes) {
+            sync(t);
+        }
+    }
+    free_.push(buf);        // never full: there are only cfg_.buffers buffers
+}
+
+/* pwrite() all of [buf, buf + len) at off */
+static bool pwrite_all(int fd, const uint8_t *buf, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "disk_writer: write failed: %s\n", n < 0 ? strerror(errno) : "no progress");
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+    return true;
+}
+
+void disk_writer::process(const request &r)
+{
+    disk_file::target *t = r.t;
+
+    if (r.op == REQ_WRITE) {
+        if (t->failed.load(std::memory_order_relaxed)) {
+            free_.push(r.buf);
+            return;
+        }
+        size_t len = r.len;
+        if (t->direct && len % PAGE) {
+            // O_DIRECT writes whole pages; the zero padding is overwritten
+            // by the next write and cut off by ftruncate() at close
+            size_t padded = (len + PAGE - 1) / PAGE * PAGE;
+            memset(r.buf + len, 0, padded - len);
+            len = padded;
+        }
+        t->end = std::max(t->end, r.offset + r.len);
+#if EMG_HAVE_IO_URING
+        if (ring_) {
+            submit_uring(t, r.buf, r.offset, len, r.len);
+            return;
+        }
+#endif
+        uint64_t t0 = now_ns();
+        bool ok = pwrite_all(t->fd, r.buf, len, r.offset);
+        complete(t, r.buf, r.len, ok, t0);
+        return;
+    }
+
+    // REQ_CLOSE: every write of the file must have landed first
+    while (t->inflight > 0) {
+        reap(true);
+    }
+    if (r.buf) {
+        free_.push(r.buf);
+    }
+    if (cfg_.sync != sync_policy::none && t->unsynced > 0) {
+        sync(t);
+    }
+    dirty_.erase(std::remove(dirty_.begin(), dirty_.end(), t), dirty_.end());
+    if (t->direct && ftruncate(t->fd, (off_t)t->end) != 0) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+#if EMG_HAVE_IO_URING
+    if (t->slot >= 0) {
+        ring_->update_file((unsigned)t->slot, -1);
+        free_slots_.push_back((unsigned)t->slot);
+    }
+#endif
+    bool ok = !t->failed.load(std::memory_order_relaxed);
+    if (::close(t->fd) != 0) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        ok = false;
+    }
+    if (t->closed) {
+        t->closed(ok);
+    }
+    delete t;
+}
+
+#if EMG_HAVE_IO_URING
+
+void disk_writer::start_uring()
+{
+    std::unique_ptr<uring> ring(new uring());
+    if (!ring->init(cfg_.queue_depth * 2) || !ring->register_eventfd(io_wake_.fd())) {
+        fprintf(stderr, "disk_writer: io_uring unavailable (%s), using pwrite\n", strerror(errno));
+        return;
+    }
+    // Registered buffers are pinned once instead of on every write; if the
+    // memlock limit refuses them, plain IORING_OP_WRITE still works
+    std::vector<struct iovec> iov(cfg_.buffers);
+    for (size_t i = 0; i < cfg_.buffers; i++) {
+        iov[i] = { slab_ + i * cfg_.buffer_size, cfg_.buffer_size };
+    }
+    fixed_bufs_ = ring->register_buffers(iov.data(), (unsigned)iov.size());
+
+    std::vector<int> fds(FILE_SLOTS, -1);
+    if (ring->register_files(fds.data(), FILE_SLOTS)) {
+        for (unsigned i = FILE_SLOTS; i-- > 0;) {
+            free_slots_.push_back(i);
+        }
+    }
+    ops_.resize(cfg_.queue_depth);
+    for (unsigned i = cfg_.queue_depth; i-- > 0;) {
+        free_ops_.push_back(i);
+    }
+    ring_ = std::move(ring);
+}
+
+void disk_writer::submit_uring(disk_file::target *t, uint8_t *buf, uint64_t offset, size_t len, size_t data_len)
+{
+    // A partial buffer is rewritten from its last page on; never let the
+    // two writes race
+    while (t->inflight > 0 && offset < t->inflight_end) {
+        reap(true);
+    }
+    while (free_ops_.empty()) {
+        reap(true);
+    }
+    struct io_uring_sqe *sqe = ring_->get_sqe();
+    while (!sqe) {
+        ring_->submit(0);
+        sqe = ring_->get_sqe();
+    }
+    if (t->slot < 0 && !free_slots_.empty()) {
+        unsigned slot = free_slots_.back();
+        if (ring_->update_file(slot, t->fd)) {
+            free_slots_.pop_back();
+            t->slot = (int)slot;
+        }
+    }
+
+    unsigned id = free_ops_.back();
+    free_ops_.pop_back();
+    ops_[id] = { t, buf, offset, len, data_len, now_ns() };
+
+    sqe->opcode = fixed_bufs_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    if (t->slot >= 0) {
+        sqe->fd = t->slot;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = t->fd;
+    }
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = offset;
+    sqe->buf_index = fixed_bufs_ ? (uint16_t)((buf - slab_) / cfg_.buffer_size) : 0;
+    sqe->user_data = id;
+
+    t->inflight++;
+    t->inflight_end = std::max(t->inflight_end, offset + len);
+    inflight_++;
+    ring_->submit(0);
+}
+
+void disk_writer::reap(bool wait)
+{
+    if (!ring_ || inflight_ == 0) {
+        return;
+    }
+    if (wait) {
+        ring_->submit(1);
+    }
+    struct io_uring_cqe cqe;
+    bool any = false;
+    while (ring_->peek(&cqe)) {
+        io_op &op = ops_[cqe.user_data];
+        bool ok = cqe.res >= 0;
+        if (ok && (size_t)cqe.res < op.len) {
+            // Short write: finish it synchronously
+            ok = pwrite_all(op.t->fd, op.buf + cqe.res, op.len - cqe.res, op.offset + cqe.res);
+        } else if (!ok) {
+            fprintf(stderr, "disk_writer: write failed: %s\n", strerror(-cqe.res));
+        }
+        op.t->inflight--;
+        if (op.t->inflight == 0) {
+            op.t->inflight_end = 0;
+        }
+        inflight_--;
+        free_ops_.push_back((unsigned)cqe.user_data);
+        complete(op.t, op.buf, op.data_len, ok, op.t0);
+        any = true;
+    }
+    if (any) {
+        free_wake_.notify();
+    }
+}
+
+#else
+
+void disk_writer::reap(bool) {}
+
+#endif
+
+void disk_writer::print_summary(FILE *out) const
+{
+    fprintf(out, "disk (%s): %.1f MB in %llu writes, %llu syncs, %llu errors, %llu producer waits\n",
+            backend(), bytes.load() / 1e6, (unsigned long long)writes.load(), (unsigned long long)syncs.load(),
+            (unsigned long long)errors.load(), (unsigned long long)waits.load());
+    write_latency.print(out, "write latency");
+    if (sync_latency.count()) {
+        sync_latency.print(out, "fdatasync latency");
+    }
+}
+
+} // namespace emg
@@ -0,0 +1,204 @@
+/*
+ * Asynchronous, batched file writer.
+ *
+ * Producers copy into large page-aligned aggregation buffers (4 MB by
+ * default) taken from a shared pool; a full buffer is queued to a dedicated
+ * I/O thread, which writes it with one pwrite() at a page-aligned file
+ * offset and returns it to the pool. The pool is the burst reserve: while
+ * buffers are free, a producer never waits for the disk, however slow it
+ * is. Only when every buffer is queued does the producer block, which in
+ * the ingest server backs up into the receive pool and finally into TCP.
+ *
+ * Data does not sit in a buffer for longer than flush_ms: a partial buffer
+ * is written as is and its last, incomplete page is carried into the next
+ * buffer, so the next write starts at the same aligned offset and rewrites
+ * that page. Readers of a growing file always see a valid prefix.
+ *
+ * Durability is a policy: none (leave it to the page cache), fdatasync()
+ * after every N bytes of a file, or at most T ms after data was written.
+ * Files are always synced before they are closed unless the policy is none.
+ *
+ * Write and fsync latencies go into histograms; throughput, queue depth and
+ * producer waits are counters.
+ *
+ * The I/O thread writes with pwrite(), or, with io_uring set and where the
+ * kernel allows it, through an io_uring with the buffer pool and the open
+ * files registered, keeping up to queue_depth writes in flight. Files
+ * opened with O_DIRECT (see open_flags()) get whole-page writes with zero
+ * padding, trimmed by ftruncate() when the file is closed.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+#include "spsc_queue.h"
+#include "wakeup.h"
+
+namespace emg {
+
+enum class sync_policy { none, bytes, interval };
+
+struct disk_config {
+    size_t buffer_size = 4 << 20;       // aggregation buffer, a multiple of 4 KB
+    size_t buffers = 16;                // pool shared by all files (burst reserve)
+    unsigned flush_ms = 1000;           // longest time data waits in a buffer
+    sync_policy sync = sync_policy::none;
+    uint64_t sync_bytes = 64ull << 20;  // sync_policy::bytes
+    unsigned sync_ms = 1000;            // sync_policy::interval
+    bool io_uring = false;              // use io_uring if available, else pwrite()
+    unsigned queue_depth = 8;           // io_uring writes in flight
+    bool direct = false;                // open files with O_DIRECT
+};
+
+/** Parse "none", "<N>MB" (sync every N MB) or "<T>ms" (sync every T ms). */
+bool parse_sync_policy(const char *s, disk_config *cfg);
+
+class disk_writer;
+class uring;
+
+/**
+ * One file written through a disk_writer. All calls must come from the same
+ * thread (the writer's single producer).
+ */
+class disk_file {
+public:
+    explicit disk_file(disk_writer &w) : w_(w) {}
+    ~disk_file() { close(); }
+
+    disk_file(const disk_file &) = delete;
+    disk_file &operator=(const disk_file &) = delete;
+
+    /** Take over fd; the file's data so far ends at offset. */
+    void open(int fd, uint64_t offset);
+
+    /** Queue bytes for writing. False once a write of this file has failed. */
+    bool append(const struct iovec *iov, int n);
+
+    /** Hand the partly filled buffer to the I/O thread now. */
+    void flush();
+
+    /** flush() if data has been waiting for flush_ms. */
+    void tick(uint64_t now);
+
+    /**
+     * flush(), then sync (per policy) and close on the I/O thread, which
+     * then calls closed (if given) with false if any write failed.
+     */
+    void close(std::function<void(bool ok)> closed = nullptr);
+
+    bool is_open() const { return target_ != nullptr; }
+    bool failed() const;
+    uint64_t size() const { return base_ + fill_; }
+
+private:
+    friend class disk_writer;
+    struct target;
+
+    disk_writer &w_;
+    target *target_ = nullptr;      // shared with the I/O thread, freed by it on close
+    uint8_t *cur_ = nullptr;        // buffer being filled
+    uint64_t base_ = 0;             // file offset of cur_[0]
+    size_t fill_ = 0;               // bytes in cur_
+    size_t flushed_ = 0;            // bytes of cur_ already written
+    uint64_t dirty_ns_ = 0;         // when unwritten data first entered cur_
+};
+
+class disk_writer {
+public:
+    explicit disk_writer(const disk_config &cfg);
+    ~disk_writer();
+
+    disk_writer(const disk_writer &) = delete;
+    disk_writer &operator=(const disk_writer &) = delete;
+
+    /** Allocate the buffer pool and start the I/O thread. */
+    bool start();
+
+    /** Write everything queued, close remaining files and join the I/O thread. */
+    void stop();
+
+    const disk_config &config() const { return cfg_; }
+
+    /** Extra open() flags for files written through this writer (O_DIRECT). */
+    int open_flags() const;
+
+    /** "pwrite" or "io_uring ..." once started. */
+    const char *backend() const;
+
+    size_t queued() const { return queue_.size(); }
+    size_t free_buffers() const { return free_.size(); }
+
+    /** Print totals and both histograms. */
+    void print_summary(FILE *out) const;
+
+    // I/O thread counters
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> syncs{0};
+    std::atomic<uint64_t> errors{0};
+    // producer counters
+    std::atomic<uint64_t> waits{0};         // times a producer blocked for a free buffer
+
+    histogram write_latency;                // per buffer write, submission to completion
+    histogram sync_latency;                 // per fdatasync()
+
+private:
+    friend class disk_file;
+
+    enum : uint8_t { REQ_WRITE, REQ_CLOSE };
+    struct request {
+        uint8_t op;
+        disk_file::target *t;
+        uint8_t *buf;                       // returned to the pool when done (may be null)
+        uint64_t offset;
+        size_t len;
+    };
+
+    uint8_t *acquire();                     // producer: a free buffer, waiting if need be
+    void submit(const request &r);          // producer
+    void io_loop();
+    void process(const request &r);
+    void complete(disk_file::target *t, uint8_t *buf, size_t len, bool ok, uint64_t t0);
+    void reap(bool wait);                   // io_uring completions
+    void sync(disk_file::target *t);
+    void sync_due(uint64_t now);
+
+    disk_config cfg_;
+    uint8_t *slab_ = nullptr;
+    spsc_queue<request> queue_;             // producer -> I/O thread
+    spsc_queue<uint8_t *> free_;            // I/O thread -> producer
+    wakeup io_wake_;
+    wakeup free_wake_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    std::vector<disk_file::target *> dirty_;    // I/O thread: files with unsynced data
+    unsigned inflight_ = 0;                     // io_uring writes not yet completed
+
+#if EMG_HAVE_IO_URING
+    struct io_op {
+        disk_file::target *t;
+        uint8_t *buf;
+        uint64_t offset;
+        size_t len;                         // bytes submitted (padded for O_DIRECT)
+        size_t data_len;                    // bytes of data among them
+        uint64_t t0;
+    };
+
+    void start_uring();
+    void submit_uring(disk_file::target *t, uint8_t *buf, uint64_t offset, size_t len, size_t data_len);
+
+    std::unique_ptr<uring> ring_;
+    bool fixed_bufs_ = false;
+    std::vector<unsigned> free_slots_;          // registered file slots
+    std::vector<io_op> ops_;
+    std::vector<unsigned> free_ops_;
+#endif
+};
+
+} // namespace emg
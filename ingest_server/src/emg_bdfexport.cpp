@@ -0,0 +1,181 @@
+/*
+ * emg_bdfexport: convert a recording to BDF+ for EDF/BDF tools.
+ *
+ * Takes a recording (.emgr), a segmented session through its manifest
+ * (.emgm), or a plain uint8 frame file such as received_data.bin, and
+ * streams it block by block through bdf_writer (bdf_writer.h): memory use
+ * is one block and one data record whatever the length of the input.
+ * Markers, batch losses, connects, disconnects and reboots become
+ * annotations, and gaps
+ * are annotated and filled or skipped by the writer. A plain frame file has
+ * no times of its own; it is taken to end at its modification time.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include "bdf_writer.h"
+#include "rec_manifest.h"
+#include "rec_reader.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] RECORDING.emgr | SESSION.emgm | FRAMES.bin OUT.bdf\n"
+            "  -d, --record S        data record duration in seconds (default 1)\n"
+            "  -u, --uv-per-lsb UV   physical scale, microvolts per count (default: counts)\n"
+            "  -c, --channels N      channels per frame of a plain frame file (default 64)\n"
+            "  -r, --rate HZ         frame rate of a plain frame file (default 2048)\n",
+            argv0);
+}
+
+static const char *event_text(const emg::rec_event &e)
+{
+    switch (e.kind) {
+    case emg::REC_EVENT_CONNECT: return "connect";
+    case emg::REC_EVENT_DISCONNECT: return "disconnect";
+    case emg::REC_EVENT_REBOOT: return "reboot";
+    case emg::REC_EVENT_MARKER: return "marker";
+    case emg::REC_EVENT_LOSS: return "loss";
+    default: return nullptr;    // gaps are found from the frames
+    }
+}
+
+/* Every block of one recording, in file order; the first opens out */
+static bool export_recording(const std::string &path, const std::string &out, emg::bdf_writer &w,
+                             const emg::bdf_options &opt)
+{
+    emg::rec_reader rd;
+    std::string err;
+    if (!rd.open(path, &err)) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), err.c_str());
+        return false;
+    }
+    if (!w.is_open() && !w.open(out, rd.header(), opt, &err)) {
+        fprintf(stderr, "%s: %s\n", out.c_str(), err.c_str());
+        return false;
+    }
+    emg::rec_block_header h;
+    std::vector<uint8_t> buf;
+    bool ok = true;
+    for (size_t i = 0; i < rd.blocks().size(); i++) {
+        const emg::rec_index_entry &e = rd.blocks()[i];
+        if (e.type == emg::REC_BLOCK_DATA) {
+            if (!rd.read_frames(i, &h, &buf)) {
+                fprintf(stderr, "%s: block %zu unreadable, left out\n", path.c_str(), i);
+                ok = false;
+                continue;
+            }
+            if (!w.append(buf.data(), h.frames, h.frame0, h.t0_ns)) {
+                return false;
+            }
+        } else if (e.type == emg::REC_BLOCK_EVENT && rd.read_block(i, &h, &buf)) {
+            for (size_t k = 0; k + sizeof(emg::rec_event) <= buf.size(); k += sizeof(emg::rec_event)) {
+                emg::rec_event ev;
+                memcpy(&ev, buf.data() + k, sizeof(ev));
+                const char *what = event_text(ev);
+                if (what) {
+                    char text[96];
+                    snprintf(text, sizeof(text), "%s%s%.*s", what, ev.text[0] ? " " : "", (int)sizeof(ev.text),
+                             ev.text);
+                    w.annotate(ev.frame, ev.t_ns, 0, text);
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    emg::bdf_options opt;
+    unsigned channels = 64, rate = 2048;
+
+    static const struct option opts[] = {
+        { "record",     required_argument, nullptr, 'd' },
+        { "uv-per-lsb", required_argument, nullptr, 'u' },
+        { "channels",   required_argument, nullptr, 'c' },
+        { "rate",       required_argument, nullptr, 'r' },
+        { "help",       no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt_c;
+    while ((opt_c = getopt_long(argc, argv, "d:u:c:r:h", opts, nullptr)) != -1) {
+        switch (opt_c) {
+        case 'd': opt.record_s = atof(optarg); break;
+        case 'u': opt.lsb_uv = atof(optarg); break;
+        case 'c': channels = (unsigned)atoi(optarg); break;
+        case 'r': rate = (unsigned)atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt_c == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 2 || channels == 0 || channels > 65535 || rate == 0 || opt.record_s <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    const std::string in = argv[optind], out = argv[optind + 1];
+    emg::bdf_writer w;
+    std::string err;
+    bool ok = true;
+
+    char magic[sizeof(emg::REC_FILE_MAGIC)] = {};
+    FILE *f = fopen(in.c_str(), "rb");
+    if (!f) {
+        perror(in.c_str());
+        return 1;
+    }
+    bool recording = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                     memcmp(magic, emg::REC_FILE_MAGIC, sizeof(magic)) == 0;
+    rewind(f);
+
+    if (in.size() > 5 && in.compare(in.size() - 5, 5, ".emgm") == 0) {
+        fclose(f);
+        emg::rec_manifest m;
+        if (!emg::rec_manifest_read(in, &m, &err)) {
+            fprintf(stderr, "%s: %s\n", in.c_str(), err.c_str());
+            return 1;
+        }
+        for (const emg::rec_segment &seg : m.segments) {
+            ok = export_recording(emg::rec_segment_path(in, seg), out, w, opt) && ok;
+        }
+    } else if (recording) {
+        fclose(f);
+        ok = export_recording(in, out, w, opt);
+    } else {
+        // A plain frame file, ending at its modification time
+        emg::rec_file_header hdr = {};
+        hdr.channels = (uint16_t)channels;
+        hdr.sample_format = emg::REC_FMT_U8_OFFSET;
+        hdr.frame_rate_hz = rate;
+        struct stat st;
+        fstat(fileno(f), &st);
+        uint64_t frames = (uint64_t)st.st_size / channels;
+        int64_t t = (int64_t)st.st_mtime * 1000000000 - (int64_t)(frames * 1000000000 / rate);
+        if (!w.open(out, hdr, opt, &err)) {
+            fprintf(stderr, "%s: %s\n", out.c_str(), err.c_str());
+        } else {
+            std::vector<uint8_t> buf((size_t)rate * channels);
+            uint64_t frame = 0;
+            size_t got;
+            while (ok && (got = fread(buf.data(), channels, rate, f)) > 0) {
+                ok = w.append(buf.data(), (uint32_t)got, frame, t + (int64_t)(frame * 1000000000 / rate));
+                frame += got;
+            }
+        }
+        fclose(f);
+    }
+    if (!w.is_open()) {
+        return 1;
+    }
+    ok = w.close() && ok;
+    printf("%s: %llu records%s\n", out.c_str(), (unsigned long long)w.records(), ok ? "" : ", incomplete");
+    if (w.dropped()) {
+        printf("%llu annotations left out\n", (unsigned long long)w.dropped());
+    }
+    return ok ? 0 : 1;
+}
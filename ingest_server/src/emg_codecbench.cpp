@@ -0,0 +1,215 @@
+/*
+ * emg_codecbench: compression ratio and speed of the recording block codecs
+ * (rec_codec.h) on recorded data.
+ *
+ * Takes the data blocks of a recording (.emgr), or a plain frame file such
+ * as received_data.bin cut into blocks of --block-frames, and runs every
+ * codec over all of them: the ratio of raw to encoded bytes (and of raw to
+ * stored, where a block that does not shrink is kept raw as rec_writer
+ * does), encode speed, and decode speed for every instruction set the CPU
+ * supports, all in bytes of raw frames per second on one core. Every decode
+ * is checked against the original frames.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include "rec_codec.h"
+#include "rec_reader.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] RECORDING.emgr | FRAMES.bin\n"
+            "  -c, --channels N      channels per frame of a plain uint8 frame file (default 64)\n"
+            "  -k, --block-frames N  frames per block of a plain frame file (default 2048)\n"
+            "  -m, --mb MB           at most this much of the input (default 256)\n"
+            "  -s, --seconds S       minimum time per measurement (default 0.5)\n",
+            argv0);
+}
+
+static double now_s()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct block {
+    uint32_t frames;
+    std::vector<uint8_t> data;          // raw frames
+};
+
+struct input {
+    uint8_t sample_format = emg::REC_FMT_U8_OFFSET;
+    uint16_t channels = 0;
+    std::vector<block> blocks;
+    uint64_t bytes = 0;
+};
+
+static bool is_recording(const char *path)
+{
+    char magic[sizeof(emg::REC_FILE_MAGIC)] = {};
+    FILE *f = fopen(path, "rb");
+    bool yes = f && fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+               memcmp(magic, emg::REC_FILE_MAGIC, sizeof(magic)) == 0;
+    if (f) fclose(f);
+    return yes;
+}
+
+static bool load_recording(const char *path, uint64_t max_bytes, input &in)
+{
+    emg::rec_reader rd;
+    std::string err;
+    if (!rd.open(path, &err)) {
+        fprintf(stderr, "%s: %s\n", path, err.c_str());
+        return false;
+    }
+    in.sample_format = rd.header().sample_format;
+    in.channels = rd.header().channels;
+    emg::rec_block_header h;
+    for (uint32_t i : rd.data_blocks()) {
+        block b;
+        if (!rd.read_frames(i, &h, &b.data)) {
+            fprintf(stderr, "%s: block %u unreadable, skipped\n", path, i);
+            continue;
+        }
+        b.frames = h.frames;
+        in.bytes += b.data.size();
+        in.blocks.push_back(std::move(b));
+        if (in.bytes >= max_bytes) break;
+    }
+    return true;
+}
+
+static bool load_frames(const char *path, uint16_t channels, uint32_t block_frames, uint64_t max_bytes, input &in)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    in.sample_format = emg::REC_FMT_U8_OFFSET;
+    in.channels = channels;
+    for (;;) {
+        block b;
+        b.data.resize((size_t)block_frames * channels);
+        size_t got = fread(b.data.data(), 1, b.data.size(), f) / channels;
+        if (got == 0) break;
+        b.frames = (uint32_t)got;
+        b.data.resize(got * channels);
+        in.bytes += b.data.size();
+        in.blocks.push_back(std::move(b));
+        if (got < block_frames || in.bytes >= max_bytes) break;
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned channels = 64, block_frames = 2048;
+    uint64_t max_mb = 256;
+    double min_s = 0.5;
+
+    static const struct option opts[] = {
+        { "channels",     required_argument, nullptr, 'c' },
+        { "block-frames", required_argument, nullptr, 'k' },
+        { "mb",           required_argument, nullptr, 'm' },
+        { "seconds",      required_argument, nullptr, 's' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:k:m:s:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'c': channels = (unsigned)atoi(optarg); break;
+        case 'k': block_frames = (unsigned)atoi(optarg); break;
+        case 'm': max_mb = (uint64_t)atoll(optarg); break;
+        case 's': min_s = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || channels == 0 || channels > 65535 || block_frames == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *path = argv[optind];
+
+    input in;
+    bool ok = is_recording(path) ? load_recording(path, max_mb << 20, in)
+                                 : load_frames(path, (uint16_t)channels, block_frames, max_mb << 20, in);
+    if (!ok) {
+        return 1;
+    }
+    if (in.blocks.empty()) {
+        fprintf(stderr, "%s: no frames\n", path);
+        return 1;
+    }
+    printf("%s: %zu blocks, %.1f MB, %u channels, %s\n", path, in.blocks.size(), in.bytes / 1e6, in.channels,
+           in.sample_format == emg::REC_FMT_U8_OFFSET ? "uint8" : "int16");
+    printf("%-6s %8s %8s %12s %8s %12s\n", "codec", "ratio", "stored", "encode MB/s", "decode", "GB/s");
+
+    int status = 0;
+    std::vector<std::vector<uint8_t>> enc(in.blocks.size());
+    std::vector<uint8_t> out;
+    for (uint8_t codec : { emg::REC_CODEC_NONE, emg::REC_CODEC_DELTA_BP, emg::REC_CODEC_LZ }) {
+        // Encode every block, as often as min_s takes
+        uint64_t encoded = 0, stored = 0, bytes = 0;
+        double t0 = now_s(), t;
+        do {
+            encoded = stored = 0;
+            for (size_t i = 0; i < in.blocks.size(); i++) {
+                const block &b = in.blocks[i];
+                enc[i].resize(emg::rec_encode_bound(codec, in.sample_format, in.channels, b.frames));
+                enc[i].resize(emg::rec_encode(codec, in.sample_format, in.channels, b.data.data(), b.frames,
+                                              enc[i].data()));
+                encoded += enc[i].size();
+                stored += std::min(enc[i].size(), b.data.size());
+            }
+            bytes += in.bytes;
+            t = now_s();
+        } while (t - t0 < min_s);
+        double enc_mbs = bytes / (t - t0) / 1e6;
+
+        bool first = true;
+        for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+            if (!emg::isa_supported(isa)) continue;
+            // Decode once to check, then for time
+            bool same = true;
+            for (size_t i = 0; i < in.blocks.size() && same; i++) {
+                const block &b = in.blocks[i];
+                out.resize(b.data.size());
+                same = emg::rec_decode(codec, in.sample_format, in.channels, enc[i].data(), enc[i].size(),
+                                       b.frames, out.data(), isa) &&
+                       out == b.data;
+            }
+            bytes = 0;
+            t0 = now_s();
+            do {
+                for (size_t i = 0; i < in.blocks.size(); i++) {
+                    const block &b = in.blocks[i];
+                    out.resize(b.data.size());
+                    emg::rec_decode(codec, in.sample_format, in.channels, enc[i].data(), enc[i].size(), b.frames,
+                                    out.data(), isa);
+                }
+                bytes += in.bytes;
+                t = now_s();
+            } while (t - t0 < min_s);
+            if (first) {
+                printf("%-6s %8.3f %8.3f %12.0f", emg::rec_codec_name(codec), (double)in.bytes / encoded,
+                       (double)in.bytes / stored, enc_mbs);
+            } else {
+                printf("%-6s %8s %8s %12s", "", "", "", "");
+            }
+            printf(" %8s %12.2f%s\n", emg::isa_name(isa), bytes / (t - t0) / 1e9, same ? "" : "  MISMATCH");
+            if (!same) status = 1;
+            first = false;
+        }
+    }
+    return status;
+}
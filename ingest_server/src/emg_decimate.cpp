@@ -0,0 +1,75 @@
+/*
+ * C ABI onto the decimation pyramid, see emg_decimate.h.
+ */
+#include <cstddef>
+#include <new>
+#include "decimate.h"
+#include "emg_decimate.h"
+
+struct emg_decimator {
+    emg::minmax_pyramid pyramid;
+
+    emg_decimator(size_t channels, size_t capacity) : pyramid(channels, capacity) {}
+};
+
+static_assert(sizeof(emg_envelope_column) == sizeof(emg::envelope_column) &&
+                  offsetof(emg_envelope_column, mean) == offsetof(emg::envelope_column, mean),
+              "emg_envelope_column must match envelope_column");
+
+extern "C" {
+
+emg_decimator *emg_decimator_create(size_t channels, size_t capacity_frames)
+{
+    if (channels == 0 || capacity_frames == 0) {
+        return nullptr;
+    }
+    try {
+        return new emg_decimator(channels, capacity_frames);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void emg_decimator_destroy(emg_decimator *d)
+{
+    delete d;
+}
+
+void emg_decimator_append_u8(emg_decimator *d, const uint8_t *frames, size_t n)
+{
+    d->pyramid.append_u8(frames, n);
+}
+
+void emg_decimator_append_f32(emg_decimator *d, const float *frames, size_t n)
+{
+    d->pyramid.append_f32(frames, n);
+}
+
+void emg_decimator_clear(emg_decimator *d)
+{
+    d->pyramid.clear();
+}
+
+uint64_t emg_decimator_written(const emg_decimator *d)
+{
+    return d->pyramid.written();
+}
+
+size_t emg_decimator_capacity(const emg_decimator *d)
+{
+    return d->pyramid.capacity();
+}
+
+size_t emg_decimator_envelope(const emg_decimator *d, size_t channel, uint64_t first, size_t n, size_t columns,
+                              emg_envelope_column *out)
+{
+    return d->pyramid.envelope(channel, first, n, columns, reinterpret_cast<emg::envelope_column *>(out));
+}
+
+size_t emg_decimator_lttb(const emg_decimator *d, size_t channel, uint64_t first, size_t n, size_t points,
+                          uint64_t *seq, float *value)
+{
+    return d->pyramid.lttb(channel, first, n, points, seq, value);
+}
+
+} // extern "C"
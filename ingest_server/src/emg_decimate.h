@@ -0,0 +1,58 @@
+/*
+ * C ABI onto the min/max decimation pyramid (see decimate.h), for plotting
+ * from other languages: python_tcp_server/emg_decimate.py loads it with
+ * ctypes.
+ *
+ * Built as libemg_decimate.so. A decimator holds the newest frames of
+ * every channel; queries return O(columns) points for any window length.
+ * Not thread-safe: serialise appends and queries on one decimator.
+ */
+#ifndef EMG_DECIMATE_H
+#define EMG_DECIMATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emg_decimator emg_decimator;
+
+typedef struct {
+    uint64_t first;             /* frames [first, first + count) */
+    uint32_t count;
+    float    min;
+    float    max;
+    float    mean;
+} emg_envelope_column;
+
+/** Decimator over the newest capacity_frames (rounded up to a power of two); NULL if out of memory. */
+emg_decimator *emg_decimator_create(size_t channels, size_t capacity_frames);
+void emg_decimator_destroy(emg_decimator *d);
+
+/** Append n offset-binary uint8 frames (stored less 128). */
+void emg_decimator_append_u8(emg_decimator *d, const uint8_t *frames, size_t n);
+
+/** Append n frames of float samples. */
+void emg_decimator_append_f32(emg_decimator *d, const float *frames, size_t n);
+
+void emg_decimator_clear(emg_decimator *d);
+
+/** Frames appended so far; the number of the next frame. */
+uint64_t emg_decimator_written(const emg_decimator *d);
+size_t emg_decimator_capacity(const emg_decimator *d);
+
+/** min/max/mean of up to `columns` equal slices of frames [first, first + n); returns columns written. */
+size_t emg_decimator_envelope(const emg_decimator *d, size_t channel, uint64_t first, size_t n, size_t columns,
+                              emg_envelope_column *out);
+
+/** Frames [first, first + n) downsampled to at most `points` by min/max LTTB; returns points written. */
+size_t emg_decimator_lttb(const emg_decimator *d, size_t channel, uint64_t first, size_t n, size_t points,
+                          uint64_t *seq, float *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMG_DECIMATE_H */
@@ -0,0 +1,192 @@
+/*
+ * emg_diskbench: compare disk writer backends on recorded traffic.
+ *
+ * Loads the samples of a recording (.emgr) into memory, then replays them
+ * as fast as possible as several devices at once through rec_writer and a
+ * disk_writer, once per backend: pwrite and io_uring, each through the page
+ * cache and with O_DIRECT. Every run writes the same bytes, so throughput,
+ * write latency and CPU time are directly comparable.
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#include "disk_writer.h"
+#include "rec_reader.h"
+#include "rec_writer.h"
+#include "wire.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] RECORDING.emgr\n"
+            "  -o, --out DIR         scratch directory (default .)\n"
+            "  -d, --devices N       devices replayed at once (default 4)\n"
+            "  -m, --mb MB           data per device, the recording is looped (default 256)\n"
+            "  -s, --sync POLICY     none, <N>MB or <T>ms (default none)\n"
+            "  -Q, --queue-depth N   io_uring writes in flight (default 8)\n"
+            "  -k, --keep            keep the files written\n",
+            argv0);
+}
+
+struct block {
+    std::vector<uint8_t> data;
+    uint32_t frames;
+};
+
+static double cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+    std::string out_dir = ".";
+    unsigned devices = 4;
+    uint64_t per_device = 256ull << 20;
+    bool keep = false;
+    emg::disk_config base;
+
+    static const struct option opts[] = {
+        { "out",          required_argument, nullptr, 'o' },
+        { "devices",      required_argument, nullptr, 'd' },
+        { "mb",           required_argument, nullptr, 'm' },
+        { "sync",         required_argument, nullptr, 's' },
+        { "queue-depth",  required_argument, nullptr, 'Q' },
+        { "keep",         no_argument,       nullptr, 'k' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:d:m:s:Q:kh", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'o': out_dir = optarg; break;
+        case 'd': devices = (unsigned)atoi(optarg); break;
+        case 'm': per_device = (uint64_t)atoll(optarg) << 20; break;
+        case 's':
+            if (!emg::parse_sync_policy(optarg, &base)) {
+                fprintf(stderr, "bad sync policy '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'Q': base.queue_depth = (unsigned)atoi(optarg); break;
+        case 'k': keep = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || devices == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // The traffic: every data block of the recording, up to 256 MB
+    emg::rec_reader rd;
+    std::string err;
+    if (!rd.open(argv[optind], &err)) {
+        fprintf(stderr, "%s: %s\n", argv[optind], err.c_str());
+        return 1;
+    }
+    std::vector<block> traffic;
+    uint64_t traffic_bytes = 0;
+    emg::rec_block_header bh;
+    for (uint32_t i : rd.data_blocks()) {
+        block b;
+        if (!rd.read_frames(i, &bh, &b.data)) {
+            continue;
+        }
+        b.frames = bh.frames;
+        traffic_bytes += b.data.size();
+        traffic.push_back(std::move(b));
+        if (traffic_bytes >= (256ull << 20)) break;
+    }
+    if (traffic.empty()) {
+        fprintf(stderr, "%s: no data blocks\n", argv[optind]);
+        return 1;
+    }
+    emg::rec_file_header hdr = rd.header();
+    printf("traffic: %zu blocks, %.1f MB from %s; %u devices x %.0f MB per run\n", traffic.size(),
+           traffic_bytes / 1e6, argv[optind], devices, per_device / 1e6);
+    printf("%-16s %10s %10s %10s %10s %8s\n", "backend", "MB/s", "write p50", "write p99", "fsync p99", "cpu s");
+
+    struct variant {
+        const char *name;
+        bool io_uring;
+        bool direct;
+    };
+    static const variant variants[] = {
+        { "pwrite", false, false },
+        { "pwrite+direct", false, true },
+        { "io_uring", true, false },
+        { "io_uring+direct", true, true },
+    };
+
+    for (const variant &v : variants) {
+        emg::disk_config cfg = base;
+        cfg.io_uring = v.io_uring;
+        cfg.direct = v.direct;
+        emg::disk_writer disk(cfg);
+        if (!disk.start()) {
+            return 1;
+        }
+        if (v.io_uring && strncmp(disk.backend(), "io_uring", 8) != 0) {
+            printf("%-16s unavailable\n", v.name);
+            continue;
+        }
+
+        std::vector<std::unique_ptr<emg::rec_writer>> writers;
+        std::vector<std::string> paths;
+        for (unsigned d = 0; d < devices; d++) {
+            std::string path = out_dir + "/diskbench_" + std::to_string(getpid()) + "_" + std::to_string(d) + ".emgr";
+            std::unique_ptr<emg::rec_writer> w(new emg::rec_writer());
+            if (!w->open(path, hdr, &disk)) {
+                return 1;
+            }
+            writers.push_back(std::move(w));
+            paths.push_back(path);
+        }
+
+        double cpu0 = cpu_seconds();
+        uint64_t t0 = emg::now_ns();
+        std::vector<uint64_t> next_frame(devices, 0);
+        uint64_t written = 0;
+        size_t bi = 0;
+        bool ok = true;
+        while (written < per_device * devices && ok) {
+            const block &b = traffic[bi++ % traffic.size()];
+            for (unsigned d = 0; d < devices; d++) {
+                int64_t t = (int64_t)(next_frame[d] * 1000000000ull / hdr.frame_rate_hz);
+                int64_t t_last = t + (int64_t)((b.frames - 1) * 1000000000ull / hdr.frame_rate_hz);
+                ok = writers[d]->append(b.data.data(), b.frames, next_frame[d], 0, t, t_last) && ok;
+                next_frame[d] += b.frames;
+                written += b.data.size();
+            }
+        }
+        for (auto &w : writers) {
+            ok = w->close() && ok;
+        }
+        disk.stop();
+        double secs = (emg::now_ns() - t0) * 1e-9;
+        double cpu = cpu_seconds() - cpu0;
+
+        printf("%-16s %10.1f %7llu us %7llu us %7llu us %8.2f%s\n", v.name, disk.bytes.load() / secs / 1e6,
+               (unsigned long long)disk.write_latency.quantile_us(0.5),
+               (unsigned long long)disk.write_latency.quantile_us(0.99),
+               (unsigned long long)disk.sync_latency.quantile_us(0.99), cpu,
+               ok && disk.errors.load() == 0 ? "" : "  (errors)");
+        fflush(stdout);
+        if (!keep) {
+            for (const std::string &p : paths) unlink(p.c_str());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * emg_kernelbench: throughput of the host signal kernels.
+ *
+ * Runs the frame deinterleave (sample-major uint8/int16 to channel-major
+ * float32) with every instruction set the CPU supports, once on a batch
+ * that fits in cache and once streaming through a buffer far larger than
+ * the last-level cache, and prints GB/s of input consumed and of memory
+ * traffic (input read plus float output written), next to memcpy() as the
+ * memory bandwidth reference.
+ *
+ * Then times the plot decimation (decimate.h) over a window of the newest
+ * 5 s at increasing sample rates: appending frames, and an envelope and an
+ * LTTB series of one plot width. Query times grow only with the log of
+ * the frames per column, not with the window.
+ */
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include "decimate.h"
+#include "deinterleave.h"
+#include "emg_proto.h"
+#include "recording.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -c, --channels N      channels per frame (default 64)\n"
+            "  -b, --batch N         frames per call (default 2048)\n"
+            "  -m, --mb MB           input streamed in the large run (default 256)\n"
+            "  -s, --seconds S       minimum time per measurement (default 0.5)\n"
+            "  -w, --width N         plot width in columns for decimation (default 1920)\n",
+            argv0);
+}
+
+static double now_s()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Deinterleave all of in, batch frames per call, until min_s has passed; input bytes per second */
+static double run(uint8_t fmt, const std::vector<uint8_t> &in, size_t channels, size_t batch, float *out,
+                  emg::simd_isa isa, double min_s)
+{
+    size_t frame_bytes = emg::rec_frame_bytes(fmt, (uint16_t)channels);
+    size_t frames = in.size() / frame_bytes;
+    uint64_t bytes = 0;
+    double t0 = now_s(), t;
+    do {
+        for (size_t f = 0; f < frames; f += batch) {
+            size_t n = std::min(batch, frames - f);
+            emg::deinterleave(fmt, in.data() + f * frame_bytes, n, channels, out, batch, 1.0f, isa);
+        }
+        bytes += frames * frame_bytes;
+        t = now_s();
+    } while (t - t0 < min_s);
+    return bytes / (t - t0);
+}
+
+/* Append and query times of a 5 s decimation window at rate_hz */
+static void run_decimate(const std::vector<uint8_t> &in, size_t channels, uint32_t rate_hz, size_t width, double min_s)
+{
+    const size_t batch = 32;
+    size_t window = (size_t)rate_hz * 5;
+    emg::minmax_pyramid p(channels, window);
+    size_t frames = std::min(in.size() / channels, 4 * p.capacity());
+
+    uint64_t appended = 0;
+    double t0 = now_s(), t;
+    do {
+        for (size_t f = 0; f + batch <= frames; f += batch) {
+            p.append_u8(in.data() + f * channels, batch);
+        }
+        appended += frames / batch * batch;
+        t = now_s();
+    } while (t - t0 < min_s);
+    double append_rate = appended / (t - t0);
+
+    std::vector<emg::envelope_column> cols(width);
+    std::vector<uint64_t> seq(width);
+    std::vector<float> value(width);
+    uint64_t first = p.written() - window;
+    uint64_t queries = 0;
+    t0 = now_s();
+    do {
+        p.envelope(queries % channels, first, window, width, cols.data());
+        queries++;
+        t = now_s();
+    } while (t - t0 < min_s);
+    double envelope_us = (t - t0) / queries * 1e6;
+
+    queries = 0;
+    t0 = now_s();
+    do {
+        p.lttb(queries % channels, first, window, width, seq.data(), value.data());
+        queries++;
+        t = now_s();
+    } while (t - t0 < min_s);
+    double lttb_us = (t - t0) / queries * 1e6;
+
+    printf("%8u %10zu %16.2f %14.1f %12.1f\n", rate_hz, window, append_rate / 1e6, envelope_us, lttb_us);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    size_t channels = EMG_NUM_CHANNELS;
+    size_t batch = 2048;
+    size_t stream_mb = 256;
+    double min_s = 0.5;
+    size_t width = 1920;
+
+    static const struct option opts[] = {
+        { "channels", required_argument, nullptr, 'c' },
+        { "batch",    required_argument, nullptr, 'b' },
+        { "mb",       required_argument, nullptr, 'm' },
+        { "seconds",  required_argument, nullptr, 's' },
+        { "width",    required_argument, nullptr, 'w' },
+        { "help",     no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:b:m:s:w:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'c': channels = (size_t)atoi(optarg); break;
+        case 'b': batch = (size_t)atoi(optarg); break;
+        case 'm': stream_mb = (size_t)atoi(optarg); break;
+        case 's': min_s = atof(optarg); break;
+        case 'w': width = (size_t)atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (channels == 0 || batch == 0 || width < 3) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> big(stream_mb << 20);
+    for (uint8_t &x : big) x = (uint8_t)rng();
+
+    // Reference: what plain copying moves through memory on this machine
+    {
+        std::vector<uint8_t> dst(big.size());
+        uint64_t bytes = 0;
+        double t0 = now_s(), t;
+        do {
+            memcpy(dst.data(), big.data(), big.size());
+            bytes += big.size();
+            t = now_s();
+        } while (t - t0 < min_s);
+        printf("memcpy: %.2f GB/s traffic (read + write)\n", 2.0 * bytes / (t - t0) / 1e9);
+    }
+
+    printf("deinterleave, %zu channels, %zu frames per call\n", channels, batch);
+    printf("%-8s %-6s %14s %14s %14s\n", "isa", "format", "cached GB/s", "stream GB/s", "traffic GB/s");
+    for (uint8_t fmt : { emg::REC_FMT_U8_OFFSET, emg::REC_FMT_I16 }) {
+        size_t frame_bytes = emg::rec_frame_bytes(fmt, (uint16_t)channels);
+        // Cached: one batch over and over; streaming: the whole buffer,
+        // writing each batch's output to the same place as an analysis
+        // pipeline would
+        std::vector<uint8_t> small(big.begin(), big.begin() + std::min(big.size(), batch * frame_bytes));
+        std::unique_ptr<float, decltype(&free)> out((float *)aligned_alloc(64, (channels * batch * sizeof(float) + 63) & ~(size_t)63), &free);
+        double out_per_in = 4.0 / (frame_bytes / (double)channels);
+        for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+            if (!emg::isa_supported(isa)) {
+                continue;
+            }
+            double cached = run(fmt, small, channels, batch, out.get(), isa, min_s);
+            double stream = run(fmt, big, channels, batch, out.get(), isa, min_s);
+            printf("%-8s %-6s %14.2f %14.2f %14.2f\n", emg::isa_name(isa),
+                   fmt == emg::REC_FMT_U8_OFFSET ? "u8" : "i16", cached / 1e9, stream / 1e9,
+                   stream * (1.0 + out_per_in) / 1e9);
+            fflush(stdout);
+        }
+    }
+
+    printf("decimate, %zu channels, 5 s window, %zu columns per query\n", channels, width);
+    printf("%8s %10s %16s %14s %12s\n", "rate Hz", "frames", "append Mframe/s", "envelope us", "lttb us");
+    for (uint32_t rate : { 2048u, 8192u, 32768u, 131072u }) {
+        run_decimate(big, channels, rate, width, min_s);
+    }
+    return 0;
+}
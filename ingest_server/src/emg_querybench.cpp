@@ -0,0 +1,181 @@
+/*
+ * emg_querybench: latency of random-access reads from a recording.
+ *
+ * Opens a recording (.emgr) through rec_session and reads windows of
+ * increasing length at random times for a set of channels, as offline
+ * analysis would ask for them, and prints latency percentiles and the rate
+ * the samples come out at. With --cold the file is dropped from the page
+ * cache and reopened before every read, so each one pays for the disk and
+ * for opening the file (timed separately); otherwise they find the page
+ * cache as earlier reads (and runs: the windows are the same every run)
+ * left it.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <getopt.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "rec_session.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] RECORDING.emgr | SESSION.emgm\n"
+            "  -n, --reads N         reads per window length (default 100)\n"
+            "  -c, --channels A-B    channels read (default all)\n"
+            "  -w, --windows LIST    window lengths in seconds (default 0.1,1,10,60)\n"
+            "  -C, --cold            drop the file from the page cache and reopen before each read\n"
+            "  -v, --verify          check block CRCs on first read\n",
+            argv0);
+}
+
+static double now_s()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void drop_cache(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static double pct(std::vector<double> &v, double q)
+{
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0.0 : v[std::min(v.size() - 1, (size_t)(q * (double)v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    unsigned reads = 100;
+    int ch_lo = -1, ch_hi = -1;
+    std::vector<double> windows = { 0.1, 1.0, 10.0, 60.0 };
+    bool cold = false, verify = false;
+
+    static const struct option opts[] = {
+        { "reads",    required_argument, nullptr, 'n' },
+        { "channels", required_argument, nullptr, 'c' },
+        { "windows",  required_argument, nullptr, 'w' },
+        { "cold",     no_argument,       nullptr, 'C' },
+        { "verify",   no_argument,       nullptr, 'v' },
+        { "help",     no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:w:Cvh", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'n': reads = (unsigned)atoi(optarg); break;
+        case 'c':
+            if (sscanf(optarg, "%d-%d", &ch_lo, &ch_hi) != 2 || ch_lo < 0 || ch_hi < ch_lo) {
+                fprintf(stderr, "bad channel range '%s': want A-B\n", optarg);
+                return 2;
+            }
+            break;
+        case 'w':
+            windows.clear();
+            for (char *p = optarg; *p;) {
+                char *end;
+                double w = strtod(p, &end);
+                if (end == p || w <= 0.0) {
+                    fprintf(stderr, "bad window list '%s'\n", optarg);
+                    return 2;
+                }
+                windows.push_back(w);
+                p = *end == ',' ? end + 1 : end;
+            }
+            break;
+        case 'C': cold = true; break;
+        case 'v': verify = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || reads == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *path = argv[optind];
+
+    if (cold) drop_cache(path);
+    emg::rec_session s;
+    std::string err;
+    double t0 = now_s();
+    if (!s.open(path, verify, &err)) {
+        fprintf(stderr, "%s: %s\n", path, err.c_str());
+        return 1;
+    }
+    double open_ms = (now_s() - t0) * 1e3;
+    const emg::rec_file_header &h = s.header();
+    if (ch_lo < 0) {
+        ch_lo = 0;
+        ch_hi = h.channels - 1;
+    }
+    if (ch_hi >= h.channels || s.frames() == 0) {
+        fprintf(stderr, "%s: no channel %d or no frames\n", path, ch_hi);
+        return 1;
+    }
+    std::vector<uint16_t> channels;
+    for (int c = ch_lo; c <= ch_hi; c++) channels.push_back((uint16_t)c);
+    uint32_t frame_bytes = emg::rec_frame_bytes(h.sample_format, h.channels);
+    double span = (s.end_ns() - s.start_ns()) * 1e-9;
+    printf("%s: %" PRIu64 " frames, %.1f GB, %.0f s, %zu data blocks, opened in %.2f ms (%s)\n", path, s.frames(),
+           (double)s.frames() * frame_bytes / 1e9, span, s.data_blocks(), open_ms,
+           s.finished() ? "index" : "scan");
+    printf("reading channels %d-%d, %s\n", ch_lo, ch_hi,
+           cold ? "cold: page cache dropped and file reopened per read" : "page cache as found");
+    printf("%10s %10s %10s %10s %10s %10s %12s%s\n", "window s", "frames", "p50 ms", "p90 ms", "p99 ms", "max ms",
+           "Msample/s", cold ? "   open ms" : "");
+
+    std::mt19937_64 rng(1);
+    std::vector<float> out;
+    for (double w : windows) {
+        std::vector<double> lat, opens;
+        double busy = 0.0;
+        uint64_t samples = 0;
+        size_t frames = 0;
+        for (unsigned i = 0; i < reads; i++) {
+            if (cold) {
+                s.close();
+                drop_cache(path);
+                double a = now_s();
+                if (!s.open(path, verify, &err)) {
+                    fprintf(stderr, "%s: %s\n", path, err.c_str());
+                    return 1;
+                }
+                opens.push_back((now_s() - a) * 1e3);
+            }
+            // A window starting anywhere in the recording, by host time
+            int64_t start = s.start_ns() + (int64_t)(rng() % (uint64_t)std::max<int64_t>(
+                                                          1, s.end_ns() - s.start_ns() - (int64_t)(w * 1e9)));
+            double a = now_s();
+            uint64_t first = s.frame_at(start), last = s.frame_at(start + (int64_t)(w * 1e9));
+            size_t n = (size_t)(last - first);
+            if (out.size() < n * channels.size()) out.resize(n * channels.size());
+            if (!s.read(first, n, channels.data(), channels.size(), out.data(), n, nullptr, 1.0f, &err)) {
+                fprintf(stderr, "%s: %s\n", path, err.c_str());
+                return 1;
+            }
+            double dt = now_s() - a;
+            lat.push_back(dt * 1e3);
+            busy += dt;
+            samples += (uint64_t)n * channels.size();
+            frames = std::max(frames, n);
+        }
+        printf("%10g %10zu %10.3f %10.3f %10.3f %10.3f %12.1f", w, frames, pct(lat, 0.5), pct(lat, 0.9),
+               pct(lat, 0.99), pct(lat, 1.0), samples / busy / 1e6);
+        if (cold) printf(" %9.3f", pct(opens, 0.5));
+        printf("\n");
+    }
+    return 0;
+}
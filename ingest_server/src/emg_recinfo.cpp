@@ -0,0 +1,221 @@
+/*
+ * emg_recinfo: inspect, verify and export a recording (.emgr).
+ *
+ * Prints the file header and a summary of its blocks. Optionally lists the
+ * events, checks every CRC, looks up the data block at a time offset,
+ * exports the samples as a plain frame file (the received_data.bin layout
+ * simple_plotter.py reads), (re)builds the summary pyramid (rec_summary.h),
+ * or summarises a time range from it.
+ */
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include "rec_codec.h"
+#include "rec_reader.h"
+#include "rec_summary.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] FILE.emgr\n"
+            "  -e, --events          list events\n"
+            "  -v, --verify          read every block and check its CRC\n"
+            "  -t, --at SECONDS      find the data block at this offset from the start\n"
+            "  -x, --export FILE     write all samples as raw frames\n"
+            "  -S, --summarize       build the summary pyramid (FILE.emgr.sum*) from the samples\n"
+            "  -z, --zoom A:B:N      summarise seconds A to B in N columns from the summary\n"
+            "  -C, --channel CH      channel printed by --zoom (default 0)\n",
+            argv0);
+}
+
+static const char *event_name(uint8_t kind)
+{
+    switch (kind) {
+    case emg::REC_EVENT_CONNECT: return "connect";
+    case emg::REC_EVENT_DISCONNECT: return "disconnect";
+    case emg::REC_EVENT_REBOOT: return "reboot";
+    case emg::REC_EVENT_GAP: return "gap";
+    case emg::REC_EVENT_MARKER: return "marker";
+    case emg::REC_EVENT_LOSS: return "loss";
+    default: return "?";
+    }
+}
+
+static int zoom(const emg::rec_reader &rd, const char *path, const char *spec, unsigned channel, int64_t start)
+{
+    double a, b;
+    unsigned columns;
+    if (sscanf(spec, "%lf:%lf:%u", &a, &b, &columns) != 3 || b <= a || columns == 0) {
+        fprintf(stderr, "bad zoom '%s': want START:END:COLUMNS\n", spec);
+        return 2;
+    }
+    auto t_open = std::chrono::steady_clock::now();
+    emg::rec_summary_reader sr;
+    std::string err;
+    if (!sr.open(path, rd.header(), &err)) {
+        fprintf(stderr, "%s: %s (build it with -S)\n", path, err.c_str());
+        return 1;
+    }
+    auto t_query = std::chrono::steady_clock::now();
+    emg::summary_view v;
+    if (!sr.query(start + (int64_t)(a * 1e9), start + (int64_t)(b * 1e9), columns, &v) || channel >= v.channels) {
+        fprintf(stderr, "%s: summary read failed or no channel %u\n", path, channel);
+        return 1;
+    }
+    auto t_done = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < v.columns; c++) {
+        if (!v.frames[c]) continue;
+        const emg::summary_value &s = v.at(c, channel);
+        printf("  %+10.3f s  %8" PRIu64 " frames  min %8.2f max %8.2f mean %8.2f rms %8.2f\n",
+               (v.t0_ns[c] - start) * 1e-9, v.frames[c], s.min, s.max, s.mean, s.rms);
+    }
+    using us = std::chrono::microseconds;
+    printf("zoom      level 2^%d, %zu entries read, open %lld us, query %lld us\n", v.shift, v.entries_read,
+           (long long)std::chrono::duration_cast<us>(t_query - t_open).count(),
+           (long long)std::chrono::duration_cast<us>(t_done - t_query).count());
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool list_events = false, verify = false, build_summary = false;
+    double at = -1.0;
+    const char *export_path = nullptr;
+    const char *zoom_spec = nullptr;
+    unsigned channel = 0;
+
+    static const struct option opts[] = {
+        { "events",  no_argument,       nullptr, 'e' },
+        { "verify",  no_argument,       nullptr, 'v' },
+        { "at",      required_argument, nullptr, 't' },
+        { "export",  required_argument, nullptr, 'x' },
+        { "summarize", no_argument,     nullptr, 'S' },
+        { "zoom",    required_argument, nullptr, 'z' },
+        { "channel", required_argument, nullptr, 'C' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "evt:x:Sz:C:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'e': list_events = true; break;
+        case 'v': verify = true; break;
+        case 't': at = atof(optarg); break;
+        case 'x': export_path = optarg; break;
+        case 'S': build_summary = true; break;
+        case 'z': zoom_spec = optarg; break;
+        case 'C': channel = (unsigned)atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    emg::rec_reader rd;
+    std::string err;
+    if (!rd.open(argv[optind], &err)) {
+        fprintf(stderr, "%s: %s\n", argv[optind], err.c_str());
+        return 1;
+    }
+    const emg::rec_file_header &h = rd.header();
+    const std::vector<emg::rec_index_entry> &blocks = rd.blocks();
+    const std::vector<uint32_t> &data = rd.data_blocks();
+
+    printf("device    %.32s (%.64s)\n", h.device_id, h.name);
+    printf("format    %u channels, format %u, %u Hz, layout %u, %u frames per block\n",
+           h.channels, h.sample_format, h.frame_rate_hz, h.layout, h.chunk_frames);
+    printf("state     %s, %zu blocks (%zu data), %" PRIu64 " frames\n",
+           rd.finished() ? "closed" : "open or unfinished (index rebuilt by scanning)",
+           blocks.size(), data.size(), rd.frames());
+    {
+        // Stored size from the offset of the next block, so the last one is left out
+        size_t encoded = 0;
+        uint64_t raw = 0, stored = 0;
+        for (uint32_t i : data) {
+            if (blocks[i].codec != emg::REC_CODEC_NONE) encoded++;
+            if (i + 1 < blocks.size()) {
+                raw += (uint64_t)blocks[i].frames * emg::rec_frame_bytes(h.sample_format, h.channels);
+                stored += blocks[i + 1].offset - blocks[i].offset - sizeof(emg::rec_block_header);
+            }
+        }
+        printf("codec     %s, %zu of %zu data blocks encoded, %.2fx\n", emg::rec_codec_name(h.codec), encoded,
+               data.size(), stored ? (double)raw / stored : 1.0);
+    }
+    int64_t start = data.empty() ? 0 : blocks[data.front()].t0_ns;
+    if (!data.empty()) {
+        double span = (blocks[data.back()].t1_ns - start) * 1e-9;
+        printf("span      %.3f s wall clock, %.3f s of samples\n", span, (double)rd.frames() / h.frame_rate_hz);
+    }
+
+    if (list_events) {
+        for (const emg::rec_event &e : rd.events()) {
+            printf("  %+10.3f s  %-10s frame %" PRIu64, (e.t_ns - start) * 1e-9, event_name(e.kind), e.frame);
+            if (e.frames) printf(" (+%u)", e.frames);
+            if (e.text[0]) printf("  %.40s", e.text);
+            printf("\n");
+        }
+    }
+
+    if (at >= 0.0 && !data.empty()) {
+        size_t i = rd.find_time(start + (int64_t)(at * 1e9));
+        if (i == data.size()) {
+            printf("at %.3f s: past the end\n", at);
+        } else {
+            const emg::rec_index_entry &e = blocks[data[i]];
+            printf("at %.3f s: block %u, frames %" PRIu64 "..%" PRIu64 ", %+.3f..%+.3f s, offset %" PRIu64 "\n",
+                   at, data[i], e.frame0, e.frame0 + e.frames - 1, (e.t0_ns - start) * 1e-9,
+                   (e.t1_ns - start) * 1e-9, e.offset);
+        }
+    }
+
+    int status = 0;
+    if (verify || export_path) {
+        FILE *out = export_path ? fopen(export_path, "wb") : nullptr;
+        if (export_path && !out) {
+            perror(export_path);
+            return 1;
+        }
+        emg::rec_block_header bh;
+        std::vector<uint8_t> payload;
+        size_t bad = 0;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            bool want = verify || blocks[i].type == emg::REC_BLOCK_DATA;
+            if (!want) continue;
+            bool ok = blocks[i].type == emg::REC_BLOCK_DATA ? rd.read_frames(i, &bh, &payload, true)
+                                                            : rd.read_block(i, &bh, &payload, true);
+            if (!ok) {
+                fprintf(stderr, "block %zu at offset %" PRIu64 ": read, CRC or decode error\n", i, blocks[i].offset);
+                bad++;
+                continue;
+            }
+            if (out && bh.type == emg::REC_BLOCK_DATA) {
+                fwrite(payload.data(), 1, payload.size(), out);
+            }
+        }
+        if (out) fclose(out);
+        if (verify) printf("verify    %zu bad blocks\n", bad);
+        status = bad ? 1 : 0;
+    }
+    if (build_summary) {
+        if (!emg::rec_summary_build(rd, argv[optind])) {
+            fprintf(stderr, "%s: summary incomplete\n", argv[optind]);
+            status = 1;
+        } else {
+            printf("summary   %s.sum%d..%d\n", argv[optind], emg::REC_SUMMARY_BASE_SHIFT,
+                   emg::REC_SUMMARY_BASE_SHIFT + (emg::REC_SUMMARY_LEVELS - 1) * emg::REC_SUMMARY_LEVEL_STEP);
+        }
+    }
+    if (zoom_spec) {
+        int z = zoom(rd, argv[optind], zoom_spec, channel, start);
+        status = status ? status : z;
+    }
+    return status;
+}
@@ -0,0 +1,644 @@
+/*
+ * emg_replay: stand in for ESP32 boards by replaying recorded frames.
+ *
+ * Every emulated device connects to the ingest server and behaves like
+ * tcp_task in the firmware: connect (retried every 500 ms), the hello
+ * first on every connection, then raw batches of TCP_BATCH_FRAMES frames
+ * (16 KB) with the same header fields. Message numbers and frame indices
+ * run on across reconnects; the batch a connection broke on is lost, as
+ * its buffer is on the board, and so are its number and frames. After a
+ * broken connection it waits 200 ms and connects again. A reboot starts
+ * with a new boot id, numbers and frame indices from zero.
+ *
+ * Frames come from a plain frame file (received_data.bin), a recording
+ * (.emgr) or a segmented session (.emgm), streamed block by block, looped
+ * as often as asked. They are sent back to back as the board would have
+ * acquired them; gaps in a recording are not reproduced. With --synth they
+ * are generated instead (muap_synth.h), each device with its own units and
+ * noise (seed plus device index), one pass being the spec's seconds and
+ * further loops carrying the same signal on. Every device then writes its
+ * ground truth to the truth directory: LABEL.units.csv, and LABEL.spikes.csv
+ * with each firing's frame in the generated signal (src_frame), the boot and
+ * device frame index it was sent under, and whether its batch was lost. The device clock
+ * (t_us) is the time of the first frame of a batch since boot, frames
+ * paced at the frame rate plus the time spent disconnected, as on a board
+ * that stops acquiring while it is offline.
+ *
+ * Pacing is real time, N times real time or as fast as the connection
+ * takes it. Jitter delays each batch by an exponential random time without
+ * reordering them (batches queue up behind a late one, as on Wi-Fi), and
+ * disconnects (and optionally reboots) are injected at exponential random
+ * intervals.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "muap_synth.h"
+#include "rec_manifest.h"
+#include "rec_reader.h"
+#include "wire.h"
+
+static const uint32_t BATCH_FRAMES = 256;           // TCP_BATCH_FRAMES in the firmware
+static const int CONNECT_RETRY_MS = 500;            // tcp_task after a failed connect
+static const int RECONNECT_MS = 200;                // and after a broken connection
+
+static std::atomic<bool> stop_flag{false};
+
+static void on_signal(int)
+{
+    stop_flag.store(true);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] FRAMES.bin | RECORDING.emgr | SESSION.emgm\n"
+            "       %s [options] --synth SPEC\n"
+            "  -H, --host HOST       ingest server (default 127.0.0.1)\n"
+            "  -p, --port PORT       (default 3333)\n"
+            "  -n, --devices N       devices replaying the input at once (default 1)\n"
+            "  -x, --speed X         pace at X times real time, 0 = as fast as possible (default 1)\n"
+            "  -l, --loops N         play the input N times, 0 = until interrupted (default 1)\n"
+            "  -b, --batch FRAMES    frames per batch (default 256, 16 KB)\n"
+            "  -r, --rate HZ         frame rate of a plain frame file (default 2048)\n"
+            "  -j, --jitter MS       mean extra delay per batch (default 0)\n"
+            "  -d, --disconnect S    mean seconds between injected disconnects (default never)\n"
+            "  -D, --down MS         time offline after an injected disconnect (default 0)\n"
+            "  -R, --reboot-every N  every Nth injected disconnect is a reboot (default never)\n"
+            "  -N, --name NAME       device label, numbered with several devices (default replay)\n"
+            "  -S, --synth SPEC      send synthetic EMG, key=value,... as for emg_synth; seconds= is one loop\n"
+            "  -T, --truth DIR       where synthetic devices write their firings and units (default .)\n",
+            argv0, argv0);
+}
+
+struct replay_config {
+    std::string host = "127.0.0.1";
+    std::string port = "3333";
+    std::string input;
+    std::string name = "replay";
+    unsigned devices = 1;
+    double speed = 1.0;
+    unsigned loops = 1;
+    uint32_t batch_frames = BATCH_FRAMES;
+    uint32_t rate = 2048;
+    double jitter_ms = 0;
+    double disconnect_s = 0;
+    double down_ms = 0;
+    unsigned reboot_every = 0;
+    bool synth = false;
+    emg::synth_config synth_cfg;
+    std::string truth_dir = ".";
+};
+
+/* Frames of the input in order, across blocks and segments, from the start again on rewind() */
+class frame_source {
+public:
+    /* Generated frames instead, synth.seconds of them per pass, the signal running on across rewinds */
+    void open_synth(const emg::synth_config &synth)
+    {
+        synth_.reset(new emg::muap_synth(synth));
+        rate_ = synth.frame_rate_hz;
+        end_ = pass_frames();
+    }
+
+    bool open(const std::string &path, uint32_t rate, std::string *err)
+    {
+        path_ = path;
+        rate_ = rate;
+        if (path.size() > 5 && path.compare(path.size() - 5, 5, ".emgm") == 0) {
+            recording_ = true;
+            emg::rec_manifest m;
+            if (!emg::rec_manifest_read(path, &m, err)) {
+                return false;
+            }
+            for (const emg::rec_segment &s : m.segments) {
+                files_.push_back(emg::rec_segment_path(path, s));
+            }
+            if (files_.empty()) {
+                *err = "no segments";
+                return false;
+            }
+        } else {
+            char magic[sizeof(emg::REC_FILE_MAGIC)] = {};
+            FILE *f = fopen(path.c_str(), "rb");
+            if (!f) {
+                *err = strerror(errno);
+                return false;
+            }
+            bool recording = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                             memcmp(magic, emg::REC_FILE_MAGIC, sizeof(magic)) == 0;
+            fclose(f);
+            if (recording) {
+                recording_ = true;
+                files_.push_back(path);
+            }
+        }
+        return rewind(err);
+    }
+
+    bool rewind(std::string *err = nullptr)
+    {
+        if (synth_) {
+            end_ = synth_->position() + pass_frames();
+            return true;
+        }
+        if (!recording_) {
+            if (raw_) fclose(raw_);
+            raw_ = fopen(path_.c_str(), "rb");
+            if (!raw_ && err) *err = strerror(errno);
+            return raw_ != nullptr;
+        }
+        file_ = 0;
+        return open_file(err);
+    }
+
+    /** Up to max frames into dst; 0 at the end of the input. Generated firings are added to spikes. */
+    uint32_t read(uint8_t *dst, uint32_t max, std::vector<emg::synth_spike> *spikes = nullptr)
+    {
+        if (synth_) {
+            uint32_t n = (uint32_t)std::min<uint64_t>(max, end_ - synth_->position());
+            synth_->generate(dst, n, spikes);
+            return n;
+        }
+        if (!recording_) {
+            return raw_ ? (uint32_t)fread(dst, EMG_FRAME_BYTES, max, raw_) : 0;
+        }
+        uint32_t n = 0;
+        while (n < max) {
+            if (pos_ == buf_.size()) {
+                if (!next_block()) {
+                    break;
+                }
+                continue;
+            }
+            size_t take = std::min<size_t>((buf_.size() - pos_) / EMG_FRAME_BYTES, max - n);
+            memcpy(dst + (size_t)n * EMG_FRAME_BYTES, buf_.data() + pos_, take * EMG_FRAME_BYTES);
+            pos_ += take * EMG_FRAME_BYTES;
+            n += (uint32_t)take;
+        }
+        return n;
+    }
+
+    uint32_t rate() const { return rate_; }
+    const emg::rec_file_header *header() const { return recording_ ? &rd_.header() : nullptr; }
+    const emg::muap_synth *synth() const { return synth_.get(); }
+
+    ~frame_source()
+    {
+        if (raw_) fclose(raw_);
+    }
+
+private:
+    uint64_t pass_frames() const { return (uint64_t)(synth_->config().seconds * rate_); }
+
+    bool open_file(std::string *err)
+    {
+        std::string e;
+        if (!rd_.open(files_[file_], &e)) {
+            if (err) *err = files_[file_] + ": " + e;
+            return false;
+        }
+        const emg::rec_file_header &h = rd_.header();
+        if (h.channels != EMG_NUM_CHANNELS || h.sample_format != emg::REC_FMT_U8_OFFSET) {
+            if (err) *err = files_[file_] + ": not 64 channels of uint8 samples as the board sends them";
+            return false;
+        }
+        rate_ = h.frame_rate_hz;
+        block_ = 0;
+        buf_.clear();
+        pos_ = 0;
+        return true;
+    }
+
+    /* Next data block, in this file or the next one; false at the end */
+    bool next_block()
+    {
+        for (;;) {
+            while (block_ < rd_.data_blocks().size()) {
+                emg::rec_block_header h;
+                if (rd_.read_frames(rd_.data_blocks()[block_++], &h, &buf_)) {
+                    pos_ = 0;
+                    return true;
+                }
+                fprintf(stderr, "%s: block %zu unreadable, skipped\n", files_[file_].c_str(), block_ - 1);
+            }
+            if (file_ + 1 >= files_.size() || !(++file_, open_file(nullptr))) {
+                buf_.clear();
+                pos_ = 0;
+                return false;
+            }
+        }
+    }
+
+    std::string path_;
+    uint32_t rate_ = 0;
+    bool recording_ = false;        // a recording or session, else a plain frame file
+    FILE *raw_ = nullptr;
+    std::vector<std::string> files_;
+    size_t file_ = 0;
+    emg::rec_reader rd_;
+    size_t block_ = 0;              // next position in rd_.data_blocks()
+    std::vector<uint8_t> buf_;
+    size_t pos_ = 0;
+    std::unique_ptr<emg::muap_synth> synth_;
+    uint64_t end_ = 0;              // generated frame this pass ends at
+};
+
+struct device_stats {
+    uint64_t batches = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t connects = 0;
+    uint64_t disconnects = 0;       // injected
+    uint64_t reboots = 0;
+    uint64_t lost = 0;              // batches lost with a connection
+    bool failed = false;
+};
+
+static void sleep_until(uint64_t t_ns)
+{
+    struct timespec ts = { (time_t)(t_ns / 1000000000), (long)(t_ns % 1000000000) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR && !stop_flag.load()) {
+    }
+}
+
+static void sleep_ms(double ms)
+{
+    if (ms > 0) sleep_until(emg::now_ns() + (uint64_t)(ms * 1e6));
+}
+
+static bool send_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w > 0) {
+            p += w;
+            n -= (size_t)w;
+        } else if (w < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* One board: its own connection, counters and copy of the input */
+class device {
+public:
+    device(const replay_config &cfg, unsigned index) : cfg_(cfg), index_(index), rng_(std::random_device()() + index)
+    {
+    }
+
+    void run();
+    const device_stats &stats() const { return st_; }
+
+private:
+    int connect_server();
+    bool send_hello(int fd);
+    void msg_hdr_init(uint8_t *buf, uint8_t type, uint32_t len, uint32_t count, uint64_t frame0);
+    uint64_t dev_us() const { return frame_idx_ * 1000000 / src_.rate() + offline_us_; }
+    void reboot();
+    bool open_truth();
+    void write_truth(uint64_t src0, uint64_t frame0, bool lost);
+    std::string label() const { return cfg_.devices > 1 ? cfg_.name + std::to_string(index_) : cfg_.name; }
+
+    const replay_config &cfg_;
+    unsigned index_;
+    std::mt19937_64 rng_;
+    frame_source src_;
+    device_stats st_;
+
+    uint32_t boot_id_ = 0;
+    uint32_t seq_[EMG_MSG_TYPE_COUNT] = {};
+    uint64_t frame_idx_ = 0;
+    uint64_t offline_us_ = 0;       // device time spent disconnected since boot
+
+    FILE *truth_ = nullptr;         // spikes.csv of a synthetic device
+    std::vector<emg::synth_spike> spikes_;  // firings in the batch being filled
+};
+
+void device::reboot()
+{
+    boot_id_ = (uint32_t)rng_();
+    memset(seq_, 0, sizeof(seq_));
+    frame_idx_ = 0;
+    offline_us_ = 0;
+}
+
+void device::msg_hdr_init(uint8_t *buf, uint8_t type, uint32_t len, uint32_t count, uint64_t frame0)
+{
+    emg_msg_hdr_t h = {};
+    h.magic = EMG_MSG_MAGIC;
+    h.version = EMG_PROTO_VERSION;
+    h.type = type;
+    h.len = len;
+    h.seq = seq_[type]++;
+    h.count = count;
+    h.frame0 = frame0;
+    h.t_us = dev_us();
+    memcpy(buf, &h, sizeof(h));
+}
+
+int device::connect_server()
+{
+    struct addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    while (!stop_flag.load()) {
+        int err = getaddrinfo(cfg_.host.c_str(), cfg_.port.c_str(), &hints, &res);
+        if (err == 0) {
+            for (struct addrinfo *a = res; a; a = a->ai_next) {
+                int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+                    freeaddrinfo(res);
+                    return fd;
+                }
+                if (fd >= 0) close(fd);
+            }
+            freeaddrinfo(res);
+        }
+        sleep_ms(CONNECT_RETRY_MS);
+    }
+    return -1;
+}
+
+bool device::send_hello(int fd)
+{
+    uint8_t buf[emg::MSG_HDR_SIZE + sizeof(emg_hello_msg_t)] = {};
+    emg_hello_msg_t hello = {};
+    const emg::rec_file_header *h = src_.header();
+    // Locally administered addresses, one per emulated board
+    const uint8_t mac[6] = { 0x02, 'E', 'M', 'G', (uint8_t)(index_ >> 8), (uint8_t)index_ };
+    memcpy(hello.mac, mac, sizeof(mac));
+    hello.channels = EMG_NUM_CHANNELS;
+    hello.sample_bits = 8;
+    hello.frame_rate_hz = src_.rate();
+    hello.boot_id = boot_id_;
+    hello.layout = h ? h->layout : src_.synth() ? src_.synth()->config().layout : 0;
+    hello.spatial = h ? h->spatial : 0;
+    std::string name = label();
+    memcpy(hello.name, name.c_str(), std::min(name.size(), sizeof(hello.name)));
+    memcpy(buf + emg::MSG_HDR_SIZE, &hello, sizeof(hello));
+    msg_hdr_init(buf, EMG_MSG_HELLO, sizeof(hello), 0, 0);
+    return send_all(fd, buf, sizeof(buf));
+}
+
+bool device::open_truth()
+{
+    std::string base = cfg_.truth_dir + "/" + label();
+    if (!src_.synth()->write_units(base + ".units.csv") || !(truth_ = fopen((base + ".spikes.csv").c_str(), "w"))) {
+        fprintf(stderr, "%s: %s\n", base.c_str(), strerror(errno));
+        return false;
+    }
+    fprintf(truth_, "unit,src_frame,t_s,boot_id,frame,lost\n");
+    return true;
+}
+
+/* The firings of a batch of generated frames from src0 on, sent as device frames from frame0 */
+void device::write_truth(uint64_t src0, uint64_t frame0, bool lost)
+{
+    if (truth_) {
+        for (const emg::synth_spike &s : spikes_) {
+            fprintf(truth_, "%u,%llu,%.6f,%08x,%llu,%d\n", s.unit, (unsigned long long)s.frame,
+                    (double)s.frame / src_.rate(), boot_id_, (unsigned long long)(frame0 + s.frame - src0), lost);
+        }
+    }
+    spikes_.clear();
+}
+
+void device::run()
+{
+    std::string err;
+    if (cfg_.synth) {
+        emg::synth_config synth = cfg_.synth_cfg;
+        synth.seed += index_;
+        src_.open_synth(synth);
+        if (!open_truth()) {
+            st_.failed = true;
+            return;
+        }
+    } else if (!src_.open(cfg_.input, cfg_.rate, &err)) {
+        fprintf(stderr, "%s: %s\n", cfg_.input.c_str(), err.c_str());
+        st_.failed = true;
+        return;
+    }
+    reboot();
+    std::exponential_distribution<double> jitter(cfg_.jitter_ms > 0 ? 1.0 / cfg_.jitter_ms : 1.0);
+    std::exponential_distribution<double> uptime(cfg_.disconnect_s > 0 ? 1.0 / cfg_.disconnect_s : 1.0);
+
+    std::vector<uint8_t> batch(emg::MSG_HDR_SIZE + (size_t)cfg_.batch_frames * EMG_FRAME_BYTES);
+    uint8_t *frames = batch.data() + emg::MSG_HDR_SIZE;
+    unsigned loop = 0;
+    uint64_t pass = 0;              // frames read since the input was last started
+    uint32_t n = 0;                 // frames in the batch, sent once full or at the end
+    uint64_t paced = 0;             // frames paced since the clock was last set
+    uint64_t clock0 = 0;            // when frame `paced` 0 was due
+    uint64_t last_send = 0;
+    uint64_t src0 = 0;              // generated frame the batch starts at
+    bool done = false;
+
+    while (!done && !stop_flag.load()) {
+        int fd = connect_server();
+        if (fd < 0) {
+            break;
+        }
+        uint64_t up_ns = cfg_.disconnect_s > 0 ? emg::now_ns() + (uint64_t)(uptime(rng_) * 1e9) : UINT64_MAX;
+        if (!send_hello(fd)) {
+            close(fd);
+            sleep_ms(CONNECT_RETRY_MS);
+            continue;
+        }
+        st_.connects++;
+        clock0 = emg::now_ns();
+        paced = 0;
+
+        bool broken = false, injected = false;
+        while (!broken && !stop_flag.load()) {
+            if (n == 0 && src_.synth()) {
+                src0 = src_.synth()->position();
+            }
+            uint32_t got = src_.read(frames + (size_t)n * EMG_FRAME_BYTES, cfg_.batch_frames - n, &spikes_);
+            n += got;
+            pass += got;
+            if (n < cfg_.batch_frames) {
+                // End of the input: go round again, or send what is left and finish
+                if (pass > 0 && (cfg_.loops == 0 || ++loop < cfg_.loops)) {
+                    pass = 0;
+                    if (src_.rewind(&err)) {
+                        continue;
+                    }
+                    fprintf(stderr, "%s: %s\n", cfg_.input.c_str(), err.c_str());
+                }
+                done = true;
+                if (n == 0) {
+                    break;
+                }
+            }
+
+            // The batch goes out once its last frame was acquired, plus jitter
+            paced += n;
+            if (cfg_.speed > 0) {
+                uint64_t due = clock0 + (uint64_t)((double)paced * 1e9 / src_.rate() / cfg_.speed);
+                if (cfg_.jitter_ms > 0) {
+                    due += (uint64_t)(jitter(rng_) * 1e6);
+                }
+                sleep_until(std::max(due, last_send));
+            }
+
+            msg_hdr_init(batch.data(), EMG_MSG_RAW_BATCH, n * EMG_FRAME_BYTES, n, frame_idx_);
+            uint64_t frame0 = frame_idx_;
+            frame_idx_ += n;
+            uint32_t sent = n;
+            n = 0;
+            if (emg::now_ns() >= up_ns) {
+                injected = true;
+            } else if (!send_all(fd, batch.data(), emg::MSG_HDR_SIZE + (size_t)sent * EMG_FRAME_BYTES)) {
+                broken = true;
+            } else {
+                write_truth(src0, frame0, false);
+                last_send = emg::now_ns();
+                st_.batches++;
+                st_.frames += sent;
+                st_.bytes += emg::MSG_HDR_SIZE + (size_t)sent * EMG_FRAME_BYTES;
+                continue;
+            }
+            // The batch was numbered and its frames counted, but never arrives
+            write_truth(src0, frame0, true);
+            st_.lost++;
+            broken = true;
+        }
+
+        if (!broken) {
+            shutdown(fd, SHUT_WR);
+            close(fd);
+            break;
+        }
+        close(fd);
+        uint64_t t_off = emg::now_ns();
+        if (injected) {
+            st_.disconnects++;
+            sleep_ms(cfg_.down_ms);
+            if (cfg_.reboot_every && st_.disconnects % cfg_.reboot_every == 0) {
+                st_.reboots++;
+                reboot();
+            }
+        }
+        sleep_ms(RECONNECT_MS);
+        offline_us_ += (emg::now_ns() - t_off) / 1000;
+    }
+    if (truth_ && fclose(truth_) != 0) {
+        perror("spikes.csv");
+        st_.failed = true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    replay_config cfg;
+
+    static const struct option opts[] = {
+        { "host",         required_argument, nullptr, 'H' },
+        { "port",         required_argument, nullptr, 'p' },
+        { "devices",      required_argument, nullptr, 'n' },
+        { "speed",        required_argument, nullptr, 'x' },
+        { "loops",        required_argument, nullptr, 'l' },
+        { "batch",        required_argument, nullptr, 'b' },
+        { "rate",         required_argument, nullptr, 'r' },
+        { "jitter",       required_argument, nullptr, 'j' },
+        { "disconnect",   required_argument, nullptr, 'd' },
+        { "down",         required_argument, nullptr, 'D' },
+        { "reboot-every", required_argument, nullptr, 'R' },
+        { "name",         required_argument, nullptr, 'N' },
+        { "synth",        required_argument, nullptr, 'S' },
+        { "truth",        required_argument, nullptr, 'T' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    std::string err;
+    while ((opt = getopt_long(argc, argv, "H:p:n:x:l:b:r:j:d:D:R:N:S:T:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'H': cfg.host = optarg; break;
+        case 'p': cfg.port = optarg; break;
+        case 'n': cfg.devices = (unsigned)atoi(optarg); break;
+        case 'x': cfg.speed = atof(optarg); break;
+        case 'l': cfg.loops = (unsigned)atoi(optarg); break;
+        case 'b': cfg.batch_frames = (uint32_t)atoi(optarg); break;
+        case 'r': cfg.rate = (uint32_t)atoi(optarg); break;
+        case 'j': cfg.jitter_ms = atof(optarg); break;
+        case 'd': cfg.disconnect_s = atof(optarg); break;
+        case 'D': cfg.down_ms = atof(optarg); break;
+        case 'R': cfg.reboot_every = (unsigned)atoi(optarg); break;
+        case 'N': cfg.name = optarg; break;
+        case 'S':
+            cfg.synth = true;
+            if (!emg::parse_synth_spec(optarg, &cfg.synth_cfg, &err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+            break;
+        case 'T': cfg.truth_dir = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - (cfg.synth ? 0 : 1) || cfg.devices == 0 || cfg.devices > 65536 || cfg.speed < 0 ||
+        cfg.batch_frames == 0 || cfg.batch_frames > emg::MSG_MAX_PAYLOAD / EMG_FRAME_BYTES || cfg.rate == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    cfg.input = cfg.synth ? "synth" : argv[optind];
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::vector<std::unique_ptr<device>> devs;
+    std::vector<std::thread> threads;
+    uint64_t t0 = emg::now_ns();
+    for (unsigned i = 0; i < cfg.devices; i++) {
+        devs.emplace_back(new device(cfg, i));
+        threads.emplace_back(&device::run, devs.back().get());
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double secs = (emg::now_ns() - t0) * 1e-9;
+
+    device_stats sum;
+    for (const std::unique_ptr<device> &d : devs) {
+        const device_stats &s = d->stats();
+        sum.batches += s.batches;
+        sum.frames += s.frames;
+        sum.bytes += s.bytes;
+        sum.connects += s.connects;
+        sum.disconnects += s.disconnects;
+        sum.reboots += s.reboots;
+        sum.lost += s.lost;
+        sum.failed |= s.failed;
+    }
+    printf("%u devices, %.1f s: %llu batches, %llu frames (%.0f frames/s), %.1f MB (%.2f MB/s)\n", cfg.devices,
+           secs, (unsigned long long)sum.batches, (unsigned long long)sum.frames, sum.frames / secs, sum.bytes / 1e6,
+           sum.bytes / secs / 1e6);
+    printf("%llu connects, %llu injected disconnects, %llu reboots, %llu batches lost\n",
+           (unsigned long long)sum.connects, (unsigned long long)sum.disconnects, (unsigned long long)sum.reboots,
+           (unsigned long long)sum.lost);
+    return sum.failed ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * C ABI onto the live rings, see emg_ring.h.
+ */
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include "emg_ring.h"
+#include "shm_ring.h"
+
+struct emg_ring {
+    emg::shm_ring_reader reader;
+};
+
+extern "C" {
+
+emg_ring *emg_ring_open(const char *shm_name, char *err, size_t err_len)
+{
+    emg_ring *r = new (std::nothrow) emg_ring();
+    std::string msg;
+    if (r && r->reader.attach(shm_name, &msg)) {
+        return r;
+    }
+    if (err && err_len) {
+        snprintf(err, err_len, "%s", r ? msg.c_str() : "out of memory");
+    }
+    delete r;
+    return nullptr;
+}
+
+void emg_ring_close(emg_ring *r)
+{
+    delete r;
+}
+
+void emg_ring_get_info(const emg_ring *r, emg_ring_info *out)
+{
+    const emg::shm_ring_header &h = r->reader.header();
+    emg::shm_ring_state st = r->reader.state();
+    memset(out, 0, sizeof(*out));
+    out->capacity = r->reader.capacity();
+    out->frame_bytes = r->reader.frame_bytes();
+    out->channels = h.channels;
+    out->sample_format = h.sample_format;
+    out->frame_rate_hz = st.frame_rate_hz;
+    out->flags = st.flags;
+    out->written = st.written;
+    out->next_frame = st.next_frame;
+    out->gaps = st.gaps;
+    out->t_ns = st.t_ns;
+    memcpy(out->device_id, h.device_id, sizeof(out->device_id));
+    memcpy(out->name, h.name, sizeof(out->name));
+    out->frame_ps = st.frame_ps;
+}
+
+const uint8_t *emg_ring_latest(const emg_ring *r, size_t n, uint64_t *first, size_t *got)
+{
+    return r->reader.latest(n, first, got);
+}
+
+const uint8_t *emg_ring_since(const emg_ring *r, uint64_t seq, size_t max, uint64_t *first, size_t *got)
+{
+    return r->reader.since(seq, max, first, got);
+}
+
+int emg_ring_valid(const emg_ring *r, uint64_t seq)
+{
+    return r->reader.valid(seq) ? 1 : 0;
+}
+
+int emg_ring_wait(const emg_ring *r, uint64_t seq, int timeout_ms)
+{
+    return r->reader.wait(seq, timeout_ms) ? 1 : 0;
+}
+
+} // extern "C"
@@ -0,0 +1,63 @@
+/*
+ * C ABI onto the live rings (see shm_ring.h), for bindings in other
+ * languages: python_tcp_server/emg_ring.py loads it with ctypes.
+ *
+ * Built as libemg_ring.so. Pointers returned point straight into the
+ * read-only shared mapping: no sample is ever copied. They stay mapped
+ * until emg_ring_close(), but the frames are overwritten once the server is
+ * a ring further on; call emg_ring_valid() with the first sequence number
+ * after using them.
+ */
+#ifndef EMG_RING_H
+#define EMG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emg_ring emg_ring;
+
+typedef struct {
+    uint64_t capacity;          /* frames */
+    uint32_t frame_bytes;
+    uint16_t channels;
+    uint8_t  sample_format;     /* REC_FMT_* in recording.h: 1 = uint8 offset binary */
+    uint8_t  reserved;
+    uint32_t frame_rate_hz;
+    uint32_t flags;             /* SHM_RING_CONNECTED, SHM_RING_CLOSED */
+    uint64_t written;           /* frames published in total */
+    uint64_t next_frame;        /* device frame index after the newest frame */
+    uint64_t gaps;
+    int64_t  t_ns;              /* host wall clock of the newest frame */
+    char     device_id[32];
+    char     name[64];
+    uint64_t frame_ps;          /* frame period on the host clock, picoseconds */
+} emg_ring_info;
+
+/** Attach to the ring shm_name ("/emg.<device>"); NULL with a message in err on failure. */
+emg_ring *emg_ring_open(const char *shm_name, char *err, size_t err_len);
+void emg_ring_close(emg_ring *r);
+
+/** Fixed fields and a consistent snapshot of the live ones. */
+void emg_ring_get_info(const emg_ring *r, emg_ring_info *out);
+
+/** Newest min(n, stored) frames; *first is the sequence number of the first. */
+const uint8_t *emg_ring_latest(const emg_ring *r, size_t n, uint64_t *first, size_t *got);
+
+/** Frames from sequence seq on, at most max; *first > seq if frames were lost. */
+const uint8_t *emg_ring_since(const emg_ring *r, uint64_t seq, size_t max, uint64_t *first, size_t *got);
+
+/** 1 while frames from sequence seq on have not been overwritten. */
+int emg_ring_valid(const emg_ring *r, uint64_t seq);
+
+/** Wait up to timeout_ms (< 0: forever) until more than seq frames are written; 1 if they are. */
+int emg_ring_wait(const emg_ring *r, uint64_t seq, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMG_RING_H */
@@ -0,0 +1,166 @@
+/*
+ * emg_ringtail: follow a device's live ring in shared memory.
+ *
+ * Without a device, lists the rings published by the ingest server. With
+ * one, attaches read-only and follows it: prints a status line per second
+ * (frame rate, frames lost to overrun, device gaps), or, with -x, streams
+ * the raw frames to stdout for another program to consume. A reader that
+ * falls more than a ring behind skips ahead and counts the frames it lost;
+ * the server is never slowed down by it.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <getopt.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "shm_ring.h"
+#include "wire.h"
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int)
+{
+    g_stop = 1;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] [DEVICE]\n"
+            "  -S, --shm PREFIX      ring name prefix (default emg)\n"
+            "  -x, --export          write raw frames to stdout instead of status lines\n"
+            "  -n, --frames N        stop after N frames\n",
+            argv0);
+}
+
+static int list_rings(const std::string &prefix)
+{
+    DIR *d = opendir("/dev/shm");
+    if (!d) {
+        perror("/dev/shm");
+        return 1;
+    }
+    std::string head = prefix + ".";
+    int found = 0;
+    while (struct dirent *e = readdir(d)) {
+        if (strncmp(e->d_name, head.c_str(), head.size()) != 0) {
+            continue;
+        }
+        emg::shm_ring_reader r;
+        std::string err;
+        if (!r.attach("/" + std::string(e->d_name), &err)) {
+            continue;
+        }
+        emg::shm_ring_state st = r.state();
+        printf("%-40s %-20s %6u Hz %8zu frames ring  %12" PRIu64 " written  %s\n", e->d_name + head.size(),
+               r.header().device_id, st.frame_rate_hz, r.capacity(), st.written,
+               (st.flags & emg::SHM_RING_CLOSED) ? "closed"
+               : (st.flags & emg::SHM_RING_CONNECTED) ? "connected" : "offline");
+        found++;
+    }
+    closedir(d);
+    if (!found) {
+        printf("no live rings in /dev/shm/%s*\n", head.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::string prefix = "emg";
+    bool export_raw = false;
+    uint64_t limit = UINT64_MAX;
+
+    static const struct option opts[] = {
+        { "shm",     required_argument, nullptr, 'S' },
+        { "export",  no_argument,       nullptr, 'x' },
+        { "frames",  required_argument, nullptr, 'n' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "S:xn:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'S': prefix = optarg; break;
+        case 'x': export_raw = true; break;
+        case 'n': limit = strtoull(optarg, nullptr, 10); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind == argc) {
+        return list_rings(prefix);
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::string name = emg::shm_ring_name(prefix, argv[optind]);
+    emg::shm_ring_reader r;
+    std::string err;
+    if (!r.attach(name, &err)) {
+        fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    FILE *status = export_raw ? stderr : stdout;
+    fprintf(status, "%s: %s, %zu frames of %u bytes\n", name.c_str(), r.header().device_id, r.capacity(),
+            r.frame_bytes());
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    // Start with what arrives from now on
+    uint64_t seen = r.state().written;
+    uint64_t frames = 0, lost = 0, prev_frames = 0, prev_ns = emg::now_ns();
+    std::vector<uint8_t> copy;      // -x: frames are checked before they go out
+    while (!g_stop && frames < limit) {
+        if (r.wait(seen, 200)) {
+            uint64_t first;
+            size_t n;
+            const uint8_t *p = r.since(seen, (size_t)std::min<uint64_t>(limit - frames, r.capacity()), &first, &n);
+            if (export_raw) {
+                copy.assign(p, p + n * r.frame_bytes());
+            }
+            if (!r.valid(first)) {
+                // Overwritten while being read; since() moves past it next time
+                continue;
+            }
+            if (export_raw && fwrite(copy.data(), r.frame_bytes(), n, stdout) != n) {
+                break;
+            }
+            lost += first - seen;
+            frames += n;
+            seen = first + n;
+        } else if (r.state().flags & emg::SHM_RING_CLOSED) {
+            fprintf(status, "%s: closed by the server\n", name.c_str());
+            break;
+        }
+
+        uint64_t now = emg::now_ns();
+        if (!export_raw && now - prev_ns >= 1000000000ull) {
+            emg::shm_ring_state st = r.state();
+            printf("%8.0f frames/s  %" PRIu64 " frames, %" PRIu64 " lost to overrun, %" PRIu64
+                   " device gaps, frame %" PRIu64 "%s\n",
+                   (frames - prev_frames) / ((now - prev_ns) * 1e-9), frames, lost, st.gaps, st.next_frame,
+                   (st.flags & emg::SHM_RING_CONNECTED) ? "" : "  (offline)");
+            fflush(stdout);
+            prev_frames = frames;
+            prev_ns = now;
+        }
+    }
+    if (export_raw) {
+        fflush(stdout);
+        fprintf(stderr, "%" PRIu64 " frames, %" PRIu64 " lost to overrun\n", frames, lost);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * C ABI onto random access to recordings, see emg_session.h.
+ */
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include "emg_session.h"
+#include "rec_session.h"
+
+struct emg_session {
+    emg::rec_session session;
+};
+
+extern "C" {
+
+emg_session *emg_session_open(const char *path, int verify, char *err, size_t err_len)
+{
+    emg_session *s = new (std::nothrow) emg_session();
+    std::string msg;
+    if (s && s->session.open(path, verify != 0, &msg)) {
+        return s;
+    }
+    if (err && err_len) {
+        snprintf(err, err_len, "%s", s ? msg.c_str() : "out of memory");
+    }
+    delete s;
+    return nullptr;
+}
+
+void emg_session_close(emg_session *s)
+{
+    delete s;
+}
+
+size_t emg_session_refresh(emg_session *s)
+{
+    return s->session.refresh();
+}
+
+void emg_session_get_info(const emg_session *s, emg_session_info *out)
+{
+    const emg::rec_session &rs = s->session;
+    const emg::rec_file_header &h = rs.header();
+    memset(out, 0, sizeof(*out));
+    out->channels = h.channels;
+    out->sample_format = h.sample_format;
+    out->finished = rs.finished() ? 1 : 0;
+    out->frame_rate_hz = h.frame_rate_hz;
+    out->frames = rs.frames();
+    out->blocks = rs.data_blocks();
+    out->start_ns = rs.start_ns();
+    out->end_ns = rs.end_ns();
+    out->created_ns = h.created_ns;
+    memcpy(out->device_id, h.device_id, sizeof(out->device_id));
+    memcpy(out->name, h.name, sizeof(out->name));
+}
+
+uint64_t emg_session_frame_at(const emg_session *s, int64_t t_ns)
+{
+    return s->session.frame_at(t_ns);
+}
+
+int emg_session_read(const emg_session *s, uint64_t first, size_t n, const uint16_t *channels, size_t nch,
+                     float *out, size_t out_stride, int64_t *t_ns, float scale, char *err, size_t err_len)
+{
+    std::string msg;
+    if (s->session.read(first, n, channels, nch, out, out_stride, t_ns, scale, &msg)) {
+        return 0;
+    }
+    if (err && err_len) {
+        snprintf(err, err_len, "%s", msg.c_str());
+    }
+    return -1;
+}
+
+} // extern "C"
@@ -0,0 +1,60 @@
+/*
+ * C ABI onto random access to recordings (see rec_session.h), for analysis
+ * in other languages: python_tcp_server/emg_session.py loads it with ctypes.
+ *
+ * Built as libemg_session.so. A session maps one .emgr file, or the segments
+ * listed in a .emgm manifest as one recording, and reads any frame range of any channels as channel-major float32, touching only the
+ * blocks in the range. Reads may run on several threads at once; refresh
+ * and close must not run alongside them.
+ */
+#ifndef EMG_SESSION_H
+#define EMG_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emg_session emg_session;
+
+typedef struct {
+    uint16_t channels;
+    uint8_t  sample_format;     /* REC_FMT_* in recording.h: 1 = uint8 offset binary */
+    uint8_t  finished;          /* 1 if the writer closed the file (every segment) */
+    uint32_t frame_rate_hz;     /* nominal */
+    uint64_t frames;            /* in data blocks, numbered from 0 */
+    uint64_t blocks;            /* data blocks */
+    int64_t  start_ns;          /* host wall clock of the first and the last frame */
+    int64_t  end_ns;
+    int64_t  created_ns;
+    char     device_id[32];
+    char     name[64];
+} emg_session_info;
+
+/** Open and map a recording; verify != 0 checks each block's CRC when first read. NULL with a message in err on failure. */
+emg_session *emg_session_open(const char *path, int verify, char *err, size_t err_len);
+void emg_session_close(emg_session *s);
+
+/** Pick up blocks appended to a file still being written; returns how many. */
+size_t emg_session_refresh(emg_session *s);
+
+void emg_session_get_info(const emg_session *s, emg_session_info *out);
+
+/** Number of the first frame at or after host time t_ns (the frame count if none). */
+uint64_t emg_session_frame_at(const emg_session *s, int64_t t_ns);
+
+/**
+ * Frames [first, first + n) of channels[0 .. nch - 1] (NULL: all, in order)
+ * into out[k * out_stride + i], less the sample zero, times scale; with
+ * t_ns, every frame's host time too. 0 on success, -1 with a message in err.
+ */
+int emg_session_read(const emg_session *s, uint64_t first, size_t n, const uint16_t *channels, size_t nch,
+                     float *out, size_t out_stride, int64_t *t_ns, float scale, char *err, size_t err_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMG_SESSION_H */
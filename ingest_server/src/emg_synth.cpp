@@ -0,0 +1,178 @@
+/*
+ * emg_synth: write synthetic HD-EMG with its ground truth.
+ *
+ * Generates frames with muap_synth (muap_synth.h) and writes them as a
+ * recording (OUT.emgr, timed from now at the nominal rate) or as a plain
+ * frame file in the received_data.bin layout (any other name). The firings
+ * go to OUT.spikes.csv (unit,frame,t_s) and the units with their positions,
+ * sizes and rates to OUT.units.csv. With -n several independent devices are
+ * generated, numbered before the extension, to check how many the host
+ * keeps up with; the time taken is reported as a multiple of real time.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "muap_synth.h"
+#include "rec_writer.h"
+#include "wire.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] OUT.emgr | OUT.bin\n"
+            "  -p, --params SPEC     generator settings, key=value,... (see muap_synth.h), e.g.\n"
+            "                        units=30,rate=6:25,noise=5,mains=50:40,contract=5:3,seconds=120\n"
+            "  -n, --devices N       generate N devices on as many threads, OUT numbered (default 1)\n"
+            "  -k, --block-frames N  frames per recording block (default 2048)\n",
+            argv0);
+}
+
+struct result {
+    bool ok = false;
+    uint64_t spikes = 0;
+    uint64_t clipped = 0;
+};
+
+/* One device: frames to out, firings and units next to it */
+static void synthesize(const emg::synth_config &cfg, const std::string &out, uint32_t block_frames, result *res)
+{
+    emg::muap_synth syn(cfg);
+    bool recording = out.size() > 5 && out.compare(out.size() - 5, 5, ".emgr") == 0;
+    std::string base = out.substr(0, out.rfind('.'));
+
+    emg::rec_writer w;
+    FILE *raw = nullptr;
+    if (recording) {
+        emg::rec_file_header hdr = {};
+        hdr.channels = EMG_NUM_CHANNELS;
+        hdr.sample_format = emg::REC_FMT_U8_OFFSET;
+        hdr.frame_rate_hz = cfg.frame_rate_hz;
+        hdr.chunk_frames = block_frames;
+        hdr.layout = cfg.layout;
+        snprintf(hdr.name, sizeof(hdr.name), "synth_seed-%llu", (unsigned long long)cfg.seed);
+        snprintf(hdr.device_id, sizeof(hdr.device_id), "synth-%llu", (unsigned long long)cfg.seed);
+        if (!w.open(out, hdr)) {
+            perror(out.c_str());
+            return;
+        }
+    } else if (!(raw = fopen(out.c_str(), "wb"))) {
+        perror(out.c_str());
+        return;
+    }
+    FILE *spikes = fopen((base + ".spikes.csv").c_str(), "w");
+    if (!spikes || !syn.write_units(base + ".units.csv")) {
+        perror(base.c_str());
+        if (spikes) fclose(spikes);
+        if (raw) fclose(raw);
+        return;
+    }
+    fprintf(spikes, "unit,frame,t_s\n");
+
+    uint64_t total = (uint64_t)(cfg.seconds * cfg.frame_rate_hz);
+    std::vector<uint8_t> buf((size_t)block_frames * EMG_FRAME_BYTES);
+    std::vector<emg::synth_spike> fired;
+    int64_t t0 = emg::wall_ns();
+    bool ok = true;
+    for (uint64_t done = 0; done < total && ok;) {
+        uint32_t n = (uint32_t)std::min<uint64_t>(block_frames, total - done);
+        fired.clear();
+        syn.generate(buf.data(), n, &fired);
+        if (recording) {
+            int64_t t_first = t0 + (int64_t)(done * 1000000000 / cfg.frame_rate_hz);
+            int64_t t_last = t0 + (int64_t)((done + n - 1) * 1000000000 / cfg.frame_rate_hz);
+            ok = w.append(buf.data(), n, done, done * 1000000 / cfg.frame_rate_hz, t_first, t_last);
+        } else {
+            ok = fwrite(buf.data(), EMG_FRAME_BYTES, n, raw) == n;
+        }
+        for (const emg::synth_spike &s : fired) {
+            fprintf(spikes, "%u,%llu,%.6f\n", s.unit, (unsigned long long)s.frame,
+                    (double)s.frame / cfg.frame_rate_hz);
+        }
+        res->spikes += fired.size();
+        done += n;
+    }
+    ok = (recording ? w.close() : fclose(raw) == 0) && ok;
+    ok = fclose(spikes) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", out.c_str());
+    }
+    res->clipped = syn.clipped();
+    res->ok = ok;
+}
+
+int main(int argc, char **argv)
+{
+    emg::synth_config cfg;
+    unsigned devices = 1;
+    uint32_t block_frames = 2048;
+
+    static const struct option opts[] = {
+        { "params",       required_argument, nullptr, 'p' },
+        { "devices",      required_argument, nullptr, 'n' },
+        { "block-frames", required_argument, nullptr, 'k' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    std::string err;
+    while ((opt = getopt_long(argc, argv, "p:n:k:h", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'p':
+            if (!emg::parse_synth_spec(optarg, &cfg, &err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+            break;
+        case 'n': devices = (unsigned)atoi(optarg); break;
+        case 'k': block_frames = (uint32_t)atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || devices == 0 || block_frames == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::string out = argv[optind];
+
+    std::vector<result> results(devices);
+    std::vector<std::thread> threads;
+    auto t0 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < devices; i++) {
+        emg::synth_config c = cfg;
+        std::string path = out;
+        if (devices > 1) {
+            // Different units and noise per device, OUT numbered before its extension
+            c.seed = cfg.seed + i;
+            size_t dot = out.rfind('.');
+            char num[16];
+            snprintf(num, sizeof(num), ".%02u", i);
+            path = dot == std::string::npos || dot < out.rfind('/') + 1 ? out + num : out.substr(0, dot) + num +
+                                                                                      out.substr(dot);
+        }
+        threads.emplace_back(synthesize, c, path, block_frames, &results[i]);
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    bool ok = true;
+    uint64_t spikes = 0, clipped = 0;
+    for (const result &r : results) {
+        ok = ok && r.ok;
+        spikes += r.spikes;
+        clipped += r.clipped;
+    }
+    printf("%u devices x %.1f s of %u units in %.2f s: %.0fx real time per device, %.0fx in all\n", devices,
+           cfg.seconds, cfg.units, secs, cfg.seconds / secs, cfg.seconds * devices / secs);
+    printf("%llu firings, %llu samples clipped\n", (unsigned long long)spikes, (unsigned long long)clipped);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+/*
+ * Lock-free latency histogram with power-of-two microsecond buckets.
+ *
+ * Written by one thread, read at any time by the reporting thread. Bucket k
+ * counts samples in [2^(k-1), 2^k) us (bucket 0: below 1 us), so quantiles
+ * are exact to a factor of two, which is what a tail-latency report needs.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+namespace emg {
+
+class histogram {
+public:
+    static constexpr int BUCKETS = 32;
+
+    void add(uint64_t ns)
+    {
+        uint64_t us = ns / 1000;
+        int k = us ? 64 - __builtin_clzll(us) : 0;
+        if (k >= BUCKETS) k = BUCKETS - 1;
+        buckets_[k].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t m = max_ns_.load(std::memory_order_relaxed);
+        if (ns > m) max_ns_.store(ns, std::memory_order_relaxed);   // single writer
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max_ns() const { return max_ns_.load(std::memory_order_relaxed); }
+
+    /** Upper bound (us) of the bucket holding quantile q (0..1), 0 if empty. */
+    uint64_t quantile_us(double q) const
+    {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t want = (uint64_t)(q * (double)n), seen = 0;
+        for (int k = 0; k < BUCKETS; k++) {
+            seen += buckets_[k].load(std::memory_order_relaxed);
+            if (seen > want) return 1ull << k;
+        }
+        return 1ull << (BUCKETS - 1);
+    }
+
+    /** One line per non-empty bucket. */
+    void print(FILE *out, const char *title) const
+    {
+        uint64_t n = count();
+        fprintf(out, "%s: %llu samples, max %.3f ms\n", title, (unsigned long long)n, max_ns() * 1e-6);
+        for (int k = 0; k < BUCKETS; k++) {
+            uint64_t c = buckets_[k].load(std::memory_order_relaxed);
+            if (c) {
+                fprintf(out, "  < %8llu us %10llu  %5.1f%%\n", 1ull << k, (unsigned long long)c, 100.0 * c / n);
+            }
+        }
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+} // namespace emg
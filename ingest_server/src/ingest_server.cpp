@@ -0,0 +1,617 @@
+/*
+ * Native ingest server, see ingest_server.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ingest_server.h"
+#include "wire.h"
+
+namespace emg {
+
+static const int READS_PER_EVENT = 16;   // fairness between devices on one thread
+static const size_t NOTICE_QUEUE = 256;  // terminal lines waiting for the consumer thread
+
+static size_t min_chunk_size(size_t want)
+{
+    return std::max(want, MSG_HDR_SIZE + MSG_MAX_PAYLOAD);
+}
+
+ingest_server::ingest_server(const ingest_config &cfg)
+    : cfg_(cfg),
+      pool_(cfg.pool_chunks, min_chunk_size(cfg.chunk_size)),
+      writer_q_(cfg.pool_chunks + MAX_STREAMS),   // every pooled chunk plus an end-of-stream marker per device
+      consumer_q_(std::max<size_t>(cfg.pool_chunks / 4, 2)),
+      notice_q_(NOTICE_QUEUE),
+      finalizer_(cfg.rec.summary),
+      disk_(cfg.disk),
+      recorder_(cfg.rec, streams_, &disk_, &finalizer_),
+      monitor_(streams_, cfg.ring_frames, cfg.shm_prefix)
+{
+    for (uint32_t i = 0; i < MAX_STREAMS; i++) {
+        chunk &e = eos_[i];
+        e.data = nullptr;
+        e.capacity = e.len = 0;
+        e.stream = i;
+        e.flags = CHUNK_END_OF_STREAM;
+        e.recv_ns = 0;
+        e.messages = 0;
+        e.index = chunk::NOT_POOLED;
+    }
+}
+
+ingest_server::~ingest_server()
+{
+    stop();
+    net_done_.store(true, std::memory_order_release);
+    writer_wake_.notify();
+    consumer_wake_.notify();
+    if (writer_thread_.joinable()) writer_thread_.join();
+    if (consumer_thread_.joinable()) consumer_thread_.join();
+    for (auto &c : conns_) {
+        if (c->fd >= 0) close(c->fd);
+    }
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool ingest_server::start()
+{
+    if (!pool_.ok() || !stop_wake_.ok() || !writer_wake_.ok() || !consumer_wake_.ok()) {
+        fprintf(stderr, "ingest: cannot allocate %zu chunks of %zu bytes\n", pool_.count(), pool_.chunk_size());
+        return false;
+    }
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        perror("ingest: socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg_.port);
+    if (inet_pton(AF_INET, cfg_.bind_addr.c_str(), &addr.sin_addr) != 1) {
+        fprintf(stderr, "ingest: bad bind address %s\n", cfg_.bind_addr.c_str());
+        return false;
+    }
+    if (bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 64) < 0) {
+        perror("ingest: bind/listen");
+        return false;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        perror("ingest: epoll_create1");
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.data.ptr = &stop_wake_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_wake_.fd(), &ev);
+
+    if (!disk_.start()) {
+        return false;
+    }
+    finalizer_.start();
+    running_.store(true, std::memory_order_release);
+    writer_thread_ = std::thread(&ingest_server::writer_loop, this);
+    consumer_thread_ = std::thread(&ingest_server::consumer_loop, this);
+
+    printf("Ingest listening on %s:%u, %zu x %zu KB chunks, output in %s\n",
+           cfg_.bind_addr.c_str(), cfg_.port, pool_.count(), pool_.chunk_size() / 1024, cfg_.rec.out_dir.c_str());
+    printf("Disk writer: %s, %zu x %zu KB buffers%s\n", disk_.backend(), disk_.config().buffers,
+           disk_.config().buffer_size / 1024, disk_.config().direct ? ", O_DIRECT" : "");
+    fflush(stdout);
+    return true;
+}
+
+void ingest_server::stop()
+{
+    running_.store(false, std::memory_order_release);
+    stop_wake_.notify();
+}
+
+/* ======= Network thread ======= */
+
+void ingest_server::run()
+{
+    struct epoll_event evs[64];
+
+    while (running_.load(std::memory_order_acquire)) {
+        bool any_stalled = false, any_partial = false;
+        for (auto &c : conns_) {
+            any_stalled |= c->stalled;
+            any_partial |= c->parsed > 0;
+        }
+        int timeout = any_stalled ? 1 : (any_partial ? (int)cfg_.flush_ms : -1);
+
+        int n = epoll_wait(epoll_fd_, evs, 64, timeout);
+        if (n < 0 && errno != EINTR) {
+            perror("ingest: epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void *tag = evs[i].data.ptr;
+            if (tag == this) {
+                accept_all();
+            } else if (tag != &stop_wake_) {
+                connection *c = static_cast<connection *>(tag);
+                if (c->fd >= 0 && !c->stalled) {
+                    service(c);
+                }
+            }
+        }
+
+        retry_stalled();
+        flush_aged(now_ns());
+
+        // Reap connections closed during this round (events may still have pointed at them)
+        conns_.erase(std::remove_if(conns_.begin(), conns_.end(),
+                                    [](const std::unique_ptr<connection> &c) { return c->fd < 0; }),
+                     conns_.end());
+
+        // One wakeup per round instead of one per chunk
+        if (writer_pending_) {
+            writer_wake_.notify();
+            writer_pending_ = false;
+        }
+        if (consumer_pending_) {
+            consumer_wake_.notify();
+            consumer_pending_ = false;
+        }
+    }
+
+    for (auto &c : conns_) {
+        if (c->fd >= 0) close_connection(c.get());
+    }
+    conns_.clear();
+
+    net_done_.store(true, std::memory_order_release);
+    writer_wake_.notify();
+    consumer_wake_.notify();
+    if (writer_thread_.joinable()) writer_thread_.join();
+    if (consumer_thread_.joinable()) consumer_thread_.join();
+    disk_.stop();
+    if (cfg_.report_ms) {
+        disk_.print_summary(stdout);
+    }
+    size_t pending = finalizer_.pending();
+    if (pending) {
+        printf("Finalizing %zu segments\n", pending);
+        fflush(stdout);
+    }
+    finalizer_.stop();
+}
+
+void ingest_server::accept_all()
+{
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        int fd = accept4(listen_fd_, (struct sockaddr *)&peer, &plen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                note(true, "ingest: accept: %s", strerror(errno));
+            }
+            return;
+        }
+        if (cfg_.rcvbuf > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &cfg_.rcvbuf, sizeof(cfg_.rcvbuf));
+        }
+
+        // The device is identified by its first message, see attach()
+        std::unique_ptr<connection> c(new connection);
+        c->fd = fd;
+        inet_ntop(AF_INET, &peer.sin_addr, c->ip, sizeof(c->ip));
+        snprintf(c->peer, sizeof(c->peer), "%s:%u", c->ip, ntohs(peer.sin_port));
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = c.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            note(true, "ingest: epoll_ctl: %s", strerror(errno));
+            close(fd);
+            continue;
+        }
+        conns_.push_back(std::move(c));
+    }
+}
+
+/* Keep letters, digits, '-', '_' and '.'; anything else becomes '_' */
+static void file_safe(char *s)
+{
+    for (; *s; s++) {
+        char ch = *s;
+        bool ok = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+                  ch == '-' || ch == '_' || ch == '.';
+        if (!ok) *s = '_';
+    }
+}
+
+/* Bind a connection to its device's stream, claiming a slot for a new device */
+bool ingest_server::attach(connection *c, const emg_hello_msg_t *hello)
+{
+    char id[sizeof(streams_[0].device_id)];
+    if (hello) {
+        const uint8_t *m = hello->mac;
+        snprintf(id, sizeof(id), "mac-%02x%02x%02x%02x%02x%02x", m[0], m[1], m[2], m[3], m[4], m[5]);
+    } else {
+        snprintf(id, sizeof(id), "ip-%s", c->ip);
+    }
+
+    uint32_t slot = NO_STREAM, free_slot = NO_STREAM;
+    for (uint32_t i = 0; i < MAX_STREAMS; i++) {
+        if (!streams_[i].in_use.load(std::memory_order_acquire)) {
+            if (free_slot == NO_STREAM) free_slot = i;
+        } else if (strcmp(streams_[i].device_id, id) == 0) {
+            slot = i;
+            break;
+        }
+    }
+
+    const bool reattach = slot != NO_STREAM;
+    if (!reattach) {
+        if (free_slot == NO_STREAM) {
+            note(true, "ingest: no free stream slot for %s (%s), refusing", id, c->peer);
+            return false;
+        }
+        slot = free_slot;
+        stream_slot &s = streams_[slot];
+        memcpy(s.device_id, id, sizeof(id));
+        char label[EMG_HELLO_NAME_LEN + 1] = {0};
+        if (hello) memcpy(label, hello->name, EMG_HELLO_NAME_LEN);
+        if (label[0]) {
+            snprintf(s.name, sizeof(s.name), "%s_%s", label, id);
+        } else {
+            snprintf(s.name, sizeof(s.name), "%s", id);
+        }
+        file_safe(s.name);
+        s.stats.reset();
+        s.in_use.store(true, std::memory_order_release);
+    } else if (streams_[slot].connected.load(std::memory_order_relaxed)) {
+        // The device reconnected before its old connection timed out here; drop the old one
+        for (auto &o : conns_) {
+            if (o.get() != c && o->fd >= 0 && o->stream == slot) {
+                close_connection(o.get());
+            }
+        }
+    }
+
+    stream_slot &s = streams_[slot];
+    if (hello) {
+        if (s.has_hello && s.hello.boot_id != hello->boot_id) {
+            s.stats.reboots.fetch_add(1, std::memory_order_relaxed);
+        }
+        s.hello = *hello;
+        s.has_hello = true;
+    }
+    snprintf(s.peer, sizeof(s.peer), "%s", c->peer);
+    s.stats.connects.fetch_add(1, std::memory_order_relaxed);
+    s.connected.store(true, std::memory_order_release);
+    c->stream = slot;
+
+    note(false, "Device %s %s from %s", s.name, reattach ? "reattached" : "connected", c->peer);
+    return true;
+}
+
+void ingest_server::set_polling(connection *c, bool on)
+{
+    struct epoll_event ev;
+    ev.events = on ? (EPOLLIN | EPOLLRDHUP) : 0;
+    ev.data.ptr = c;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->fd, &ev);
+    c->stalled = !on;
+    if (!on && c->stream != NO_STREAM) {
+        streams_[c->stream].stats.stalls.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ingest_server::service(connection *c)
+{
+    for (int i = 0; i < READS_PER_EVENT; i++) {
+        if (!c->cur) {
+            c->cur = pool_.acquire();
+            if (!c->cur) {
+                set_polling(c, false);
+                return;
+            }
+            c->fill = c->parsed = c->messages = 0;
+        }
+        if (c->fill == c->cur->capacity) {
+            if (!hand_off(c)) {
+                set_polling(c, false);
+                return;
+            }
+            continue;
+        }
+
+        ssize_t r = read(c->fd, c->cur->data + c->fill, c->cur->capacity - c->fill);
+        if (r > 0) {
+            uint64_t now = now_ns();
+            if (c->fill == 0) c->cur->recv_ns = now;
+            c->fill += (uint32_t)r;
+            scan(c);
+            if (c->fd < 0) {
+                return;   // refused while identifying
+            }
+            if (c->stream != NO_STREAM) {
+                streams_[c->stream].stats.last_recv_ns.store(now, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        if (r == 0) {
+            close_connection(c);
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            note(true, "ingest: read from %s: %s", c->peer, strerror(errno));
+            close_connection(c);
+        }
+        return;
+    }
+}
+
+/* Advance over whole messages in the current chunk, skipping garbage between them */
+void ingest_server::scan(connection *c)
+{
+    uint8_t *d = c->cur->data;
+    uint64_t bytes = 0, frames = 0, resync = 0;
+    uint32_t msgs = 0;
+
+    while (c->fill - c->parsed >= MSG_HDR_SIZE) {
+        emg_msg_hdr_t h = load_header(d + c->parsed);
+        if (!header_valid(h)) {
+            // Drop bytes up to the next possible magic ("EM") and retry
+            uint32_t p = c->parsed + 1;
+            while (p + 1 < c->fill && !(d[p] == (EMG_MSG_MAGIC & 0xFF) && d[p + 1] == (EMG_MSG_MAGIC >> 8))) {
+                p++;
+            }
+            if (p + 1 == c->fill && d[p] != (EMG_MSG_MAGIC & 0xFF)) {
+                p = c->fill;
+            }
+            uint32_t skip = p - c->parsed;
+            memmove(d + c->parsed, d + p, c->fill - p);
+            c->fill -= skip;
+            resync += skip;
+            continue;
+        }
+        if (c->fill - c->parsed - MSG_HDR_SIZE < h.len) {
+            break;   // rest of the message has not arrived yet
+        }
+        if (c->stream == NO_STREAM) {
+            // First message: a hello names the device, anything else means old firmware
+            emg_hello_msg_t hello;
+            bool is_hello = h.type == EMG_MSG_HELLO && h.len >= sizeof(hello);
+            if (is_hello) memcpy(&hello, d + c->parsed + MSG_HDR_SIZE, sizeof(hello));
+            if (!attach(c, is_hello ? &hello : nullptr)) {
+                close_connection(c);
+                return;
+            }
+        }
+        c->parsed += (uint32_t)(MSG_HDR_SIZE + h.len);
+        c->messages++;
+        msgs++;
+        bytes += MSG_HDR_SIZE + h.len;
+        if (h.type == EMG_MSG_RAW_BATCH) {
+            frames += h.count;
+        }
+    }
+
+    if (c->stream == NO_STREAM) {
+        return;
+    }
+    stream_stats &st = streams_[c->stream].stats;
+    st.resync_bytes.fetch_add(resync, std::memory_order_relaxed);
+    st.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    st.messages.fetch_add(msgs, std::memory_order_relaxed);
+    st.frames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+/* Publish the whole messages of the current chunk and carry the partial tail over */
+bool ingest_server::hand_off(connection *c)
+{
+    if (c->parsed == 0) {
+        return c->fill < c->cur->capacity;
+    }
+
+    chunk *next = nullptr;
+    uint32_t tail = c->fill - c->parsed;
+    if (tail > 0) {
+        next = pool_.acquire();
+        if (!next) {
+            return false;
+        }
+        memcpy(next->data, c->cur->data + c->parsed, tail);
+        next->recv_ns = now_ns();
+    }
+
+    chunk *done = c->cur;
+    done->len = c->parsed;
+    done->stream = c->stream;
+    done->messages = c->messages;
+    publish(done);
+
+    c->cur = next;
+    c->fill = tail;
+    c->parsed = 0;
+    c->messages = 0;
+    return true;
+}
+
+void ingest_server::publish(chunk *ch)
+{
+    // The consumer queue has a single producer (us), so if it has room now the push succeeds
+    bool to_consumer = consumer_q_.size() < consumer_q_.capacity();
+    if (to_consumer) {
+        pool_.retain(ch);
+    } else {
+        streams_[ch->stream].stats.consumer_drops.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Room for every pooled chunk and one marker per device; only a device reconnecting and
+    // dropping again and again while the disk is stalled can fill it, and then we wait
+    while (!writer_q_.push(ch)) {
+        writer_wake_.notify();
+        usleep(100);
+    }
+    writer_pending_ = true;
+    if (to_consumer) {
+        consumer_q_.push(ch);
+        consumer_pending_ = true;
+    }
+}
+
+void ingest_server::close_connection(connection *c)
+{
+    const bool known = c->stream != NO_STREAM;
+    note(false, "Client disconnected: %s (%s)", c->peer, known ? streams_[c->stream].name : "unidentified");
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    c->fd = -1;
+    c->stalled = false;
+
+    // Keep what arrived complete; an unfinished trailing message is lost with the connection
+    if (c->cur) {
+        if (c->parsed > 0) {
+            c->fill = c->parsed;
+            hand_off(c);
+        } else {
+            pool_.release(c->cur);
+            c->cur = nullptr;
+        }
+    }
+
+    if (known) {
+        stream_slot &s = streams_[c->stream];
+        s.stats.disconnect_ns.store(now_ns(), std::memory_order_relaxed);
+        s.connected.store(false, std::memory_order_release);
+        publish(&eos_[c->stream]);
+    }
+}
+
+void ingest_server::flush_aged(uint64_t now)
+{
+    const uint64_t age = (uint64_t)cfg_.flush_ms * 1000000ull;
+    for (auto &c : conns_) {
+        if (c->fd >= 0 && !c->stalled && c->cur && c->parsed > 0 && now - c->cur->recv_ns >= age) {
+            if (!hand_off(c.get())) {
+                set_polling(c.get(), false);
+            }
+        }
+    }
+}
+
+/* Queue a line for the consumer thread; dropped (and counted) rather than waited for */
+void ingest_server::note(bool error, const char *fmt, ...)
+{
+    notice n;
+    n.error = error;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(n.text, sizeof(n.text), fmt, ap);
+    va_end(ap);
+    if (notice_q_.push(n)) {
+        consumer_pending_ = true;
+    } else {
+        notices_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ingest_server::retry_stalled()
+{
+    // Start at a different connection each round so freed chunks are shared fairly
+    const size_t n = conns_.size();
+    const size_t first = n ? stall_rr_++ % n : 0;
+    for (size_t k = 0; k < n; k++) {
+        connection *c = conns_[(first + k) % n].get();
+        if (c->fd < 0 || !c->stalled) {
+            continue;
+        }
+        bool ok = c->cur ? (c->fill < c->cur->capacity || hand_off(c)) : pool_.available() > 0;
+        if (ok) {
+            set_polling(c, true);
+            service(c);
+        }
+    }
+}
+
+/* ======= Writer and consumer threads ======= */
+
+void ingest_server::writer_loop()
+{
+    for (;;) {
+        bool done = net_done_.load(std::memory_order_acquire);
+        chunk *c;
+        while (writer_q_.pop(c)) {
+            recorder_.handle(*c);
+            pool_.release(c);
+        }
+        if (done) {
+            break;
+        }
+        recorder_.tick(now_ns());
+        writer_wake_.wait((int)std::min(100u, disk_.config().flush_ms));
+    }
+    recorder_.close_all();
+}
+
+void ingest_server::consumer_loop()
+{
+    uint64_t next_report = now_ns() + (uint64_t)cfg_.report_ms * 1000000ull;
+    for (;;) {
+        bool done = net_done_.load(std::memory_order_acquire);
+        chunk *c;
+        while (consumer_q_.pop(c)) {
+            monitor_.handle(*c);
+            pool_.release(c);
+        }
+        print_notices();
+        if (done) {
+            break;
+        }
+
+        uint64_t now = now_ns();
+        if (cfg_.report_ms && now >= next_report) {
+            monitor_.report(now, writer_q_.size(), consumer_q_.size(), pool_.available(), disk_);
+            next_report = now + (uint64_t)cfg_.report_ms * 1000000ull;
+        }
+        int wait_ms = cfg_.report_ms ? (int)((next_report - std::min(now, next_report)) / 1000000ull) + 1 : 100;
+        consumer_wake_.wait(wait_ms);
+    }
+}
+
+void ingest_server::print_notices()
+{
+    notice n;
+    bool out = false, err = false;
+    while (notice_q_.pop(n)) {
+        fprintf(n.error ? stderr : stdout, "%s\n", n.text);
+        out |= !n.error;
+        err |= n.error;
+    }
+    uint64_t dropped = notices_dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+        fprintf(stderr, "ingest: %llu messages not shown\n", (unsigned long long)dropped);
+    }
+    if (out) fflush(stdout);
+    if (err) fflush(stderr);
+}
+
+} // namespace emg
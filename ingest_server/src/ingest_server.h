@@ -0,0 +1,139 @@
+/*
+ * Native ingest server for the ESP32 EMG stream.
+ *
+ * Any number of devices (up to MAX_STREAMS) may be connected at once. Each
+ * is identified by the hello message it sends first (MAC address), or by
+ * its IP address if the firmware predates it; a reconnect reattaches to the
+ * device's existing stream, and a new connection from a device that still
+ * appears connected replaces the stale one.
+ *
+ * One network thread accepts device connections and reads them with epoll
+ * into large preallocated chunks. Each chunk holds only whole protocol
+ * messages; any partial trailing message is carried over to the next chunk.
+ * Finished chunks go over lock-free SPSC queues to
+ *   - the writer thread, which records them (never skipped), and
+ *   - the consumer thread, which feeds live views (skipped when it falls
+ *     behind, so a slow consumer costs it data, never the recording).
+ * The network thread never touches the disk or the terminal: its messages
+ * (connects, disconnects, read errors) are queued to the consumer thread,
+ * which prints them. If the writer falls so far behind that every chunk is
+ * in use, reading pauses and TCP flow control pushes back on the device.
+ */
+#pragma once
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer_pool.h"
+#include "disk_writer.h"
+#include "live_monitor.h"
+#include "recorder.h"
+#include "segment_finalizer.h"
+#include "spsc_queue.h"
+#include "stream_table.h"
+#include "wakeup.h"
+
+namespace emg {
+
+struct ingest_config {
+    std::string bind_addr = "0.0.0.0";
+    uint16_t port = 3333;
+    size_t chunk_size = 256 * 1024;     // bytes per receive chunk
+    size_t pool_chunks = 256;           // chunks preallocated (chunk_size * pool_chunks bytes)
+    unsigned flush_ms = 2;              // hand off a partly filled chunk after this long
+    unsigned report_ms = 1000;          // live status interval, 0 = quiet
+    size_t ring_frames = 10 * 2048;     // live ring per device (frames)
+    std::string shm_prefix = "emg";     // live rings in /dev/shm/<prefix>.<device>, empty = private
+    recorder_config rec;                // output directory, blocks, summaries, codec, segments
+    disk_config disk;                   // aggregation buffers and durability policy
+    int rcvbuf = 4 << 20;               // SO_RCVBUF per connection
+};
+
+class ingest_server {
+public:
+    explicit ingest_server(const ingest_config &cfg);
+    ~ingest_server();
+
+    ingest_server(const ingest_server &) = delete;
+    ingest_server &operator=(const ingest_server &) = delete;
+
+    /** Bind, listen and start the writer and consumer threads. */
+    bool start();
+
+    /** Run the network loop on the calling thread until stop(). */
+    void run();
+
+    /** Ask run() to return. Async-signal-safe. */
+    void stop();
+
+    stream_slot *streams() { return streams_; }
+
+private:
+    struct connection {
+        int fd = -1;
+        uint32_t stream = NO_STREAM;    // until the first message identifies the device
+        char ip[16] = {0};
+        char peer[64] = {0};
+        chunk *cur = nullptr;   // chunk being filled
+        uint32_t fill = 0;      // bytes in cur
+        uint32_t parsed = 0;    // bytes of whole messages at the front of cur
+        uint32_t messages = 0;  // whole messages in cur
+        bool stalled = false;   // waiting for a free chunk, not polled
+    };
+
+    /* A line for the terminal, printed by the consumer thread */
+    struct notice {
+        bool error = false;     // to stderr, else stdout
+        char text[160];
+    };
+
+    void accept_all();
+    bool attach(connection *c, const emg_hello_msg_t *hello);
+    void service(connection *c);
+    void scan(connection *c);
+    bool hand_off(connection *c);
+    void publish(chunk *ch);
+    void close_connection(connection *c);
+    void set_polling(connection *c, bool on);
+    void flush_aged(uint64_t now);
+    void retry_stalled();
+    void note(bool error, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+    void print_notices();
+
+    void writer_loop();
+    void consumer_loop();
+
+    ingest_config cfg_;
+    std::atomic<bool> running_{false};
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    wakeup stop_wake_;
+
+    buffer_pool pool_;
+    spsc_queue<chunk *> writer_q_;
+    spsc_queue<chunk *> consumer_q_;
+    spsc_queue<notice> notice_q_;
+    std::atomic<uint64_t> notices_dropped_{0};
+    wakeup writer_wake_;
+    wakeup consumer_wake_;
+    bool writer_pending_ = false;     // network thread: pushed since last notify
+    bool consumer_pending_ = false;
+
+    stream_slot streams_[MAX_STREAMS];
+    chunk eos_[MAX_STREAMS];          // end-of-stream markers, not pooled
+    std::atomic<bool> net_done_{false};
+    std::vector<std::unique_ptr<connection>> conns_;
+    size_t stall_rr_ = 0;
+
+    segment_finalizer finalizer_;     // outlives disk_, whose I/O thread hands it closed segments
+    disk_writer disk_;
+    recorder recorder_;
+    live_monitor monitor_;
+    std::thread writer_thread_;
+    std::thread consumer_thread_;
+};
+
+} // namespace emg
@@ -0,0 +1,167 @@
+/*
+ * Consumer-thread side of the ingest server, see live_monitor.h.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "live_monitor.h"
+
+namespace emg {
+
+static const size_t LEVEL_FRAMES = 256;   // frames averaged for the level column
+
+static const uint32_t DEFAULT_FRAME_RATE_HZ = 2048;   // firmware default, for devices without hello
+
+live_monitor::live_monitor(stream_slot *streams, size_t ring_frames, const std::string &shm_prefix)
+    : streams_(streams), ring_frames_(ring_frames), shm_prefix_(shm_prefix),
+      wall_offset_ns_(wall_ns() - (int64_t)now_ns())
+{
+    memset(views_, 0, sizeof(views_));
+}
+
+/* Once per device, on the consumer thread, at its first raw batch */
+shm_ring *live_monitor::open_ring(uint32_t stream)
+{
+    const stream_slot &s = streams_[stream];
+    const view &v = views_[stream];
+    uint32_t rate = v.frame_rate_hz ? v.frame_rate_hz : DEFAULT_FRAME_RATE_HZ;
+    std::unique_ptr<shm_ring> r(new shm_ring());
+    std::string err;
+    std::string name = shm_prefix_.empty() ? std::string() : shm_ring_name(shm_prefix_, s.name);
+    if (!r->create(name, s.device_id, s.name, ring_frames_, EMG_FRAME_BYTES, rate, &err)) {
+        // Live views in the server still work from a private ring
+        fprintf(stderr, "[%s] live ring: %s, not shared\n", s.name, err.c_str());
+        if (name.empty() || !r->create(std::string(), s.device_id, s.name, ring_frames_, EMG_FRAME_BYTES, rate,
+                                       &err)) {
+            fprintf(stderr, "[%s] live ring: %s\n", s.name, err.c_str());
+            return nullptr;
+        }
+    } else if (!name.empty()) {
+        printf("[%s] live ring /dev/shm%s, %zu frames\n", s.name, name.c_str(), r->capacity());
+    }
+    rings_[stream] = std::move(r);
+    return rings_[stream].get();
+}
+
+void live_monitor::handle(const chunk &c)
+{
+    shm_ring *r = rings_[c.stream].get();
+    if (c.flags & CHUNK_END_OF_STREAM) {
+        if (r) r->set_connected(false);
+        return;
+    }
+    view &v = views_[c.stream];
+    v.lag_ns = now_ns() - c.recv_ns;
+    clock_model &clock = clocks_[c.stream];
+    for_each_message(c.data, c.len, [&](const emg_msg_hdr_t &h, const uint8_t *payload) {
+        v.msgs_by_type[h.type]++;
+        if (h.type == EMG_MSG_HELLO && h.len >= sizeof(emg_hello_msg_t)) {
+            emg_hello_msg_t hello;
+            memcpy(&hello, payload, sizeof(hello));
+            v.frame_rate_hz = hello.frame_rate_hz;
+            if (r && hello.frame_rate_hz) r->set_frame_rate(hello.frame_rate_hz);
+        } else if (h.type == EMG_MSG_RAW_BATCH && h.count > 0) {
+            if (!r && !(r = open_ring(c.stream))) {
+                return;
+            }
+            uint32_t rate = v.frame_rate_hz ? v.frame_rate_hz : DEFAULT_FRAME_RATE_HZ;
+            int64_t dev_last = batch_frame_dev_ns(h, h.count - 1, rate);
+            clock.add(dev_last, (int64_t)c.recv_ns);
+            r->set_frame_period((uint64_t)llround(1e12 / rate * clock.rate()));
+            r->append(payload, h.count, h.frame0, clock.to_host(dev_last) + wall_offset_ns_);
+        }
+    });
+}
+
+/* Mean absolute deviation from midscale over the newest frames, all channels */
+static double signal_level(const shm_ring *r)
+{
+    size_t n = 0;
+    const uint8_t *p = r ? r->latest(LEVEL_FRAMES, &n) : nullptr;
+    if (n == 0) {
+        return 0.0;
+    }
+    uint64_t acc = 0;
+    for (size_t i = 0; i < n * EMG_FRAME_BYTES; i++) {
+        acc += (uint64_t)abs((int)p[i] - EMG_SAMPLE_ZERO);
+    }
+    return (double)acc / (double)(n * EMG_FRAME_BYTES);
+}
+
+void live_monitor::report(uint64_t now, size_t writer_depth, size_t consumer_depth, size_t free_chunks,
+                          const disk_writer &disk)
+{
+    double dt = prev_report_ns_ ? (now - prev_report_ns_) * 1e-9 : 0.0;
+    prev_report_ns_ = now;
+
+    int known = 0;
+    for (uint32_t i = 0; i < MAX_STREAMS; i++) {
+        stream_slot &s = streams_[i];
+        if (!s.in_use.load(std::memory_order_acquire)) {
+            continue;
+        }
+        known++;
+        view &v = views_[i];
+        const stream_stats &st = s.stats;
+        uint64_t bytes = st.bytes.load(std::memory_order_relaxed);
+        uint64_t frames = st.frames.load(std::memory_order_relaxed);
+        const shm_ring *r = rings_[i].get();
+        clock_model &clock = clocks_[i];
+        clock_jitter jit = clock.take_jitter();
+
+        if (dt > 0.0 && s.connected.load(std::memory_order_acquire)) {
+            char drift[16] = "fitting";
+            if (clock.locked()) {
+                snprintf(drift, sizeof(drift), "%+.1f ppm", clock.drift_ppm());
+            }
+            printf("[%s] %7.2f MB/s %8.0f frames/s  lag net->disk %6.2f ms net->live %6.2f ms  level %5.1f"
+                   "  clock %s jitter rms %.2f ms max %.2f ms"
+                   "  msgs raw=%llu feat=%llu spec=%llu qual=%llu"
+                   "  gaps=%llu lost=%llu dup=%llu reord=%llu"
+                   "  resync=%llu stalls=%llu drops=%llu werr=%llu conn=%llu reboots=%llu\n",
+                   s.name, (bytes - v.prev_bytes) / dt / 1e6, (frames - v.prev_frames) / dt,
+                   st.writer_lag_ns.load(std::memory_order_relaxed) * 1e-6, v.lag_ns * 1e-6,
+                   signal_level(r), drift, jit.rms_ns * 1e-6, jit.max_ns * 1e-6,
+                   (unsigned long long)v.msgs_by_type[EMG_MSG_RAW_BATCH],
+                   (unsigned long long)v.msgs_by_type[EMG_MSG_FEATURES],
+                   (unsigned long long)v.msgs_by_type[EMG_MSG_SPECTRAL],
+                   (unsigned long long)v.msgs_by_type[EMG_MSG_QUALITY],
+                   (unsigned long long)(r ? r->gaps() : 0),
+                   (unsigned long long)st.seq_lost.load(std::memory_order_relaxed),
+                   (unsigned long long)st.seq_duplicates.load(std::memory_order_relaxed),
+                   (unsigned long long)st.seq_reorders.load(std::memory_order_relaxed),
+                   (unsigned long long)st.resync_bytes.load(std::memory_order_relaxed),
+                   (unsigned long long)st.stalls.load(std::memory_order_relaxed),
+                   (unsigned long long)st.consumer_drops.load(std::memory_order_relaxed),
+                   (unsigned long long)st.write_errors.load(std::memory_order_relaxed),
+                   (unsigned long long)st.connects.load(std::memory_order_relaxed),
+                   (unsigned long long)st.reboots.load(std::memory_order_relaxed));
+        } else if (dt > 0.0) {
+            uint64_t gone = st.disconnect_ns.load(std::memory_order_relaxed);
+            printf("[%s] offline for %.1f s, %llu frames so far, %llu connects\n", s.name,
+                   gone ? (now - gone) * 1e-9 : 0.0, (unsigned long long)frames,
+                   (unsigned long long)st.connects.load(std::memory_order_relaxed));
+        }
+        v.prev_bytes = bytes;
+        v.prev_frames = frames;
+    }
+    uint64_t disk_bytes = disk.bytes.load(std::memory_order_relaxed);
+    if (known > 0 && dt > 0.0) {
+        printf("  queues: writer=%zu consumer=%zu free chunks=%zu\n", writer_depth, consumer_depth, free_chunks);
+        printf("  disk: %7.2f MB/s, %zu queued / %zu free buffers, write p50 %llu us p99 %llu us"
+               ", fsync p50 %llu us p99 %llu us max %.2f ms, waits=%llu errors=%llu\n",
+               (disk_bytes - prev_disk_bytes_) / dt / 1e6, disk.queued(), disk.free_buffers(),
+               (unsigned long long)disk.write_latency.quantile_us(0.5),
+               (unsigned long long)disk.write_latency.quantile_us(0.99),
+               (unsigned long long)disk.sync_latency.quantile_us(0.5),
+               (unsigned long long)disk.sync_latency.quantile_us(0.99),
+               disk.sync_latency.max_ns() * 1e-6,
+               (unsigned long long)disk.waits.load(std::memory_order_relaxed),
+               (unsigned long long)disk.errors.load(std::memory_order_relaxed));
+        fflush(stdout);
+    }
+    prev_disk_bytes_ = disk_bytes;
+}
+
+} // namespace emg
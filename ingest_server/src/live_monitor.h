@@ -0,0 +1,65 @@
+/*
+ * Consumer-thread side of the ingest server: live view of every device.
+ *
+ * Publishes the raw frames of every device into its shared-memory live ring
+ * (see shm_ring.h), where local readers pick them up, and prints one status
+ * line per device per report interval (throughput, frame rate, lags, signal
+ * level, clock drift and jitter, loss counters) instead of a line per
+ * received chunk. Frames are placed on the host clock by a per-device clock
+ * model (clock_model.h). It runs on its own thread, so a slow terminal or
+ * reader can never hold up the socket.
+ */
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "buffer_pool.h"
+#include "clock_model.h"
+#include "disk_writer.h"
+#include "shm_ring.h"
+#include "stream_table.h"
+#include "wire.h"
+
+namespace emg {
+
+class live_monitor {
+public:
+    /**
+     * @param shm_prefix  rings are shared as /<shm_prefix>.<device name>;
+     *                    empty keeps them private to the server
+     */
+    live_monitor(stream_slot *streams, size_t ring_frames, const std::string &shm_prefix);
+
+    /** Account one chunk (called for chunks that made it into the consumer queue). */
+    void handle(const chunk &c);
+
+    /** Print the status of every known device and of the disk since the previous report. */
+    void report(uint64_t now, size_t writer_depth, size_t consumer_depth, size_t free_chunks,
+                const disk_writer &disk);
+
+    /** The device's live ring, or nullptr before its first raw batch. */
+    const shm_ring *ring(uint32_t stream) const { return rings_[stream].get(); }
+
+private:
+    struct view {
+        uint64_t lag_ns;        // newest chunk: consume time - receive time
+        uint64_t msgs_by_type[EMG_MSG_TYPE_COUNT];
+        uint64_t prev_bytes;
+        uint64_t prev_frames;
+        uint32_t frame_rate_hz; // from the newest hello, 0 if none
+    };
+
+    shm_ring *open_ring(uint32_t stream);
+
+    stream_slot *streams_;
+    size_t ring_frames_;
+    std::string shm_prefix_;
+    int64_t wall_offset_ns_;        // CLOCK_REALTIME - CLOCK_MONOTONIC
+    view views_[MAX_STREAMS];
+    std::unique_ptr<shm_ring> rings_[MAX_STREAMS];
+    clock_model clocks_[MAX_STREAMS];
+    uint64_t prev_report_ns_ = 0;
+    uint64_t prev_disk_bytes_ = 0;
+};
+
+} // namespace emg
@@ -0,0 +1,137 @@
+/*
+ * emg_ingest: receive EMG streams from one or more ESP32 clients.
+ *
+ * Drop-in replacement for the receive loop of python_tcp_server/simple_server.py:
+ * listens on the same port and records the raw samples of every device to
+ * its own recording (see recording.h), across reconnects.
+ */
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include "ingest_server.h"
+#include "rec_codec.h"
+
+static emg::ingest_server *g_server = nullptr;
+
+static void on_signal(int)
+{
+    if (g_server) g_server->stop();
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b, --bind ADDR       listen address (default 0.0.0.0)\n"
+            "  -p, --port PORT       listen port (default 3333)\n"
+            "  -o, --out DIR         output directory (default .)\n"
+            "  -c, --chunk-kb KB     receive chunk size (default 256)\n"
+            "  -n, --chunks N        preallocated chunks (default 256)\n"
+            "  -f, --flush-ms MS     max time a partial chunk is held (default 2)\n"
+            "  -r, --report-ms MS    status interval, 0 = quiet (default 1000)\n"
+            "  -R, --ring-frames N   live ring per device (default 20480)\n"
+            "  -S, --shm PREFIX      share live rings as /dev/shm/PREFIX.<device>, none = private (default emg)\n"
+            "  -k, --block-frames N  frames per recording data block (default 2048)\n"
+            "  -Z, --no-summary      do not write summary pyramids (.sum*) next to recordings\n"
+            "  -C, --codec CODEC     none, delta or lz: compress recording data blocks (default none)\n"
+            "  -E, --bdf             also write every recording as BDF+ (.bdf) as it is received\n"
+            "  -G, --segment LIMIT   roll recordings over to a new segment at <N>MB, <N>GB, <T>s, <T>min or <T>h\n"
+            "  -B, --buffers N       4 MB disk aggregation buffers (default 16)\n"
+            "  -s, --sync POLICY     none, <N>MB or <T>ms: fdatasync every N MB / T ms (default none)\n"
+            "  -F, --disk-ms MS      max time data waits in a disk buffer (default 1000)\n"
+            "  -U, --io-uring        write through io_uring (falls back to pwrite)\n"
+            "  -Q, --queue-depth N   io_uring writes in flight (default 8)\n"
+            "  -D, --direct          open recordings with O_DIRECT\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    emg::ingest_config cfg;
+
+    static const struct option opts[] = {
+        { "bind",         required_argument, nullptr, 'b' },
+        { "port",         required_argument, nullptr, 'p' },
+        { "out",          required_argument, nullptr, 'o' },
+        { "chunk-kb",     required_argument, nullptr, 'c' },
+        { "chunks",       required_argument, nullptr, 'n' },
+        { "flush-ms",     required_argument, nullptr, 'f' },
+        { "report-ms",    required_argument, nullptr, 'r' },
+        { "ring-frames",  required_argument, nullptr, 'R' },
+        { "shm",          required_argument, nullptr, 'S' },
+        { "block-frames", required_argument, nullptr, 'k' },
+        { "no-summary",   no_argument,       nullptr, 'Z' },
+        { "codec",        required_argument, nullptr, 'C' },
+        { "bdf",          no_argument,       nullptr, 'E' },
+        { "segment",      required_argument, nullptr, 'G' },
+        { "buffers",      required_argument, nullptr, 'B' },
+        { "sync",         required_argument, nullptr, 's' },
+        { "disk-ms",      required_argument, nullptr, 'F' },
+        { "io-uring",     no_argument,       nullptr, 'U' },
+        { "queue-depth",  required_argument, nullptr, 'Q' },
+        { "direct",       no_argument,       nullptr, 'D' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:p:o:c:n:f:r:R:S:k:ZC:EG:B:s:F:UQ:Dh", opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'b': cfg.bind_addr = optarg; break;
+        case 'p': cfg.port = (uint16_t)atoi(optarg); break;
+        case 'o': cfg.rec.out_dir = optarg; break;
+        case 'c': cfg.chunk_size = (size_t)atoi(optarg) * 1024; break;
+        case 'n': cfg.pool_chunks = (size_t)atoi(optarg); break;
+        case 'f': cfg.flush_ms = (unsigned)atoi(optarg); break;
+        case 'r': cfg.report_ms = (unsigned)atoi(optarg); break;
+        case 'R': cfg.ring_frames = (size_t)atol(optarg); break;
+        case 'S': cfg.shm_prefix = strcmp(optarg, "none") == 0 ? "" : optarg; break;
+        case 'k': cfg.rec.block_frames = (uint32_t)atoi(optarg); break;
+        case 'Z': cfg.rec.summary = false; break;
+        case 'C':
+            if (!emg::rec_codec_from_name(optarg, &cfg.rec.codec)) {
+                fprintf(stderr, "unknown codec '%s': want none, delta or lz\n", optarg);
+                return 2;
+            }
+            break;
+        case 'E': cfg.rec.bdf = true; break;
+        case 'G':
+            if (!emg::parse_segment_limit(optarg, &cfg.rec)) {
+                fprintf(stderr, "bad segment limit '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'B': cfg.disk.buffers = (size_t)atoi(optarg); break;
+        case 's':
+            if (!emg::parse_sync_policy(optarg, &cfg.disk)) {
+                fprintf(stderr, "bad sync policy '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'F': cfg.disk.flush_ms = (unsigned)atoi(optarg); break;
+        case 'U': cfg.disk.io_uring = true; break;
+        case 'Q': cfg.disk.queue_depth = (unsigned)atoi(optarg); break;
+        case 'D': cfg.disk.direct = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    emg::ingest_server server(cfg);
+    if (!server.start()) {
+        return 1;
+    }
+
+    g_server = &server;
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    server.run();
+    g_server = nullptr;
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Bounded multi-producer / multi-consumer queue (Vyukov's array queue).
+ *
+ * Every slot carries a sequence number, so producers and consumers only
+ * contend on a single CAS of their own index. Used as the free list of the
+ * buffer pool, where chunks are released from several threads.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace emg {
+
+template <typename T>
+class mpmc_queue {
+public:
+    // capacity is rounded up to a power of two
+    explicit mpmc_queue(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        mask_ = n - 1;
+        slots_.reset(new slot[n]);
+        for (size_t i = 0; i < n; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    bool push(const T &v)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot &s = slots_[pos & mask_];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value = v;
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T &out)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot &s = slots_[pos & mask_];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = s.value;
+                    s.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<slot[]> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // namespace emg
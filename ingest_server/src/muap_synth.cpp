@@ -0,0 +1,345 @@
+/*
+ * Synthetic HD-EMG, see muap_synth.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "emg_spatial.h"
+#include "muap_synth.h"
+
+namespace emg {
+
+static const double TWO_PI = 6.283185307179586;
+
+/* Seeds far apart from nearby integers */
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/* xorshift64* */
+static inline uint64_t next64(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1Dull;
+}
+
+static inline double uniform(uint64_t &s)
+{
+    return (double)(next64(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normal(uint64_t &s)
+{
+    double u = uniform(s), v = uniform(s);
+    return sqrt(-2.0 * log(1.0 - u)) * cos(TWO_PI * v);
+}
+
+static bool parse_pair(const char *v, double *a, double *b)
+{
+    char *end;
+    *a = strtod(v, &end);
+    if (end == v || *end != ':') {
+        return false;
+    }
+    const char *w = end + 1;
+    *b = strtod(w, &end);
+    return end != w && *end == 0;
+}
+
+bool parse_synth_spec(const char *spec, synth_config *cfg, std::string *err)
+{
+    std::string s = spec;
+    size_t at = 0;
+    while (at < s.size()) {
+        size_t comma = s.find(',', at);
+        std::string item = s.substr(at, comma == std::string::npos ? std::string::npos : comma - at);
+        at = comma == std::string::npos ? s.size() : comma + 1;
+        size_t eq = item.find('=');
+        std::string key = item.substr(0, eq);
+        const char *v = eq == std::string::npos ? "" : item.c_str() + eq + 1;
+        char *end;
+        double x = strtod(v, &end);
+        bool num = end != v && *end == 0;
+        bool ok = true;
+        if (key == "fs") {
+            ok = num && x >= 1;
+            cfg->frame_rate_hz = (uint32_t)x;
+        } else if (key == "layout") {
+            ok = strcmp(v, "8x8") == 0 || strcmp(v, "13x5") == 0;
+            cfg->layout = strcmp(v, "13x5") == 0 ? EMG_LAYOUT_13X5 : EMG_LAYOUT_8X8;
+        } else if (key == "ied") {
+            ok = num && x > 0;
+            cfg->ied_mm = x;
+        } else if (key == "units") {
+            ok = num && x >= 0 && x <= 1000;
+            cfg->units = (uint32_t)x;
+        } else if (key == "rate") {
+            ok = parse_pair(v, &cfg->rate_min_hz, &cfg->rate_max_hz) && cfg->rate_min_hz > 0 &&
+                 cfg->rate_max_hz >= cfg->rate_min_hz;
+        } else if (key == "cov") {
+            ok = num && x >= 0 && x < 1;
+            cfg->isi_cov = x;
+        } else if (key == "peak") {
+            ok = parse_pair(v, &cfg->peak_min_uv, &cfg->peak_max_uv) && cfg->peak_min_uv > 0 &&
+                 cfg->peak_max_uv >= cfg->peak_min_uv;
+        } else if (key == "depth") {
+            ok = parse_pair(v, &cfg->depth_min_mm, &cfg->depth_max_mm) && cfg->depth_min_mm > 0 &&
+                 cfg->depth_max_mm >= cfg->depth_min_mm;
+        } else if (key == "cv") {
+            ok = num && x > 0;
+            cfg->cv_m_s = x;
+        } else if (key == "contract") {
+            ok = parse_pair(v, &cfg->contract_s, &cfg->rest_s) && cfg->contract_s > 0 && cfg->rest_s >= 0;
+        } else if (key == "noise") {
+            ok = num && x >= 0;
+            cfg->noise_uv = x;
+        } else if (key == "mains") {
+            ok = parse_pair(v, &cfg->mains_hz, &cfg->mains_uv) && cfg->mains_hz >= 0 && cfg->mains_uv >= 0;
+        } else if (key == "lsb") {
+            ok = num && x > 0;
+            cfg->lsb_uv = x;
+        } else if (key == "seconds") {
+            ok = num && x > 0;
+            cfg->seconds = x;
+        } else if (key == "seed") {
+            ok = num;
+            cfg->seed = strtoull(v, nullptr, 10);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            if (err) *err = "bad synth item '" + item + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+muap_synth::muap_synth(const synth_config &cfg) : cfg_(cfg)
+{
+    build_units();
+
+    noise_rng_ = splitmix64(cfg_.seed ^ 0x6E6F697365ull);
+    noise_.resize(NOISE_TABLE);
+    double sum = 0, sq = 0;
+    for (float &n : noise_) {
+        n = (float)normal(noise_rng_);
+        sum += n;
+    }
+    for (float &n : noise_) {
+        n -= (float)(sum / NOISE_TABLE);
+        sq += (double)n * n;
+    }
+    for (float &n : noise_) {
+        n *= (float)(cfg_.noise_uv / sqrt(sq / NOISE_TABLE));
+    }
+
+    acc_.assign((size_t)(CHUNK + muap_frames_) * EMG_NUM_CHANNELS, 0.0f);
+    out_.resize((size_t)CHUNK * EMG_FRAME_BYTES);
+}
+
+muap_synth::~muap_synth() = default;
+
+void muap_synth::build_units()
+{
+    const emg_layout_t *l = cfg_.layout == EMG_LAYOUT_13X5 ? &emg_layout_13x5 : &emg_layout_8x8;
+    double x_ch[EMG_NUM_CHANNELS], y_ch[EMG_NUM_CHANNELS];
+    bool on_grid[EMG_NUM_CHANNELS] = {};
+    for (int r = 0; r < l->rows; r++) {
+        for (int c = 0; c < l->cols; c++) {
+            int ch = l->ch[r * l->cols + c];
+            if (ch >= 0 && ch < EMG_NUM_CHANNELS) {
+                x_ch[ch] = c * cfg_.ied_mm;
+                y_ch[ch] = r * cfg_.ied_mm;
+                on_grid[ch] = true;
+            }
+        }
+    }
+    double width_x = (l->cols - 1) * cfg_.ied_mm, length_y = (l->rows - 1) * cfg_.ied_mm;
+
+    // Mains pickup grows across the grid, averaging mains_uv
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        double across = width_x > 0 ? x_ch[ch] / width_x : 0.5;
+        mains_gain_[ch] = on_grid[ch] ? (float)(cfg_.mains_uv * (0.5 + across)) : 0.0f;
+    }
+
+    uint64_t rng = splitmix64(cfg_.seed);
+    units_.resize(cfg_.units);
+    state_.resize(cfg_.units);
+    double max_width = 0, max_delay = 0;
+    for (uint32_t u = 0; u < cfg_.units; u++) {
+        double f = cfg_.units > 1 ? (double)u / (cfg_.units - 1) : 0.0;
+        synth_unit &m = units_[u];
+        m.peak_uv = cfg_.peak_min_uv * pow(cfg_.peak_max_uv / cfg_.peak_min_uv, f);
+        m.rate_hz = cfg_.rate_max_hz - (cfg_.rate_max_hz - cfg_.rate_min_hz) * f;
+        m.x_mm = uniform(rng) * width_x;
+        m.y_mm = length_y * (1.0 + uniform(rng)) / 3.0;      // end plate in the middle third
+        m.depth_mm = cfg_.depth_min_mm + uniform(rng) * (cfg_.depth_max_mm - cfg_.depth_min_mm);
+        m.width_ms = 0.5 + 0.1 * m.depth_mm;
+        max_width = std::max(max_width, m.width_ms);
+        max_delay = std::max(max_delay, std::max(m.y_mm, length_y - m.y_mm) / cfg_.cv_m_s);
+        state_[u].rng = splitmix64(cfg_.seed * 1000003 + u + 1);
+    }
+
+    // Room for four sigmas either side, plus the longest propagation delay
+    double ms_per_frame = 1000.0 / cfg_.frame_rate_hz;
+    center_ = (uint32_t)ceil(4.0 * max_width / ms_per_frame);
+    muap_frames_ = center_ + (uint32_t)ceil(max_delay / ms_per_frame) + center_ + 1;
+    templates_.assign((size_t)cfg_.units * muap_frames_ * EMG_NUM_CHANNELS, 0.0f);
+    for (uint32_t u = 0; u < cfg_.units; u++) {
+        const synth_unit &m = units_[u];
+        float *t = &templates_[(size_t)u * muap_frames_ * EMG_NUM_CHANNELS];
+        for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+            if (!on_grid[ch]) {
+                continue;
+            }
+            double dx = x_ch[ch] - m.x_mm, d2 = m.depth_mm * m.depth_mm;
+            double amp = m.peak_uv * pow(d2 / (d2 + dx * dx), 1.5);
+            double delay = fabs(y_ch[ch] - m.y_mm) / cfg_.cv_m_s;
+            for (uint32_t k = 0; k < muap_frames_; k++) {
+                double z = (((double)k - center_) * ms_per_frame - delay) / m.width_ms;
+                t[(size_t)k * EMG_NUM_CHANNELS + ch] = (float)(amp * (1.0 - z * z) * exp(-0.5 * z * z));
+            }
+        }
+    }
+
+    // First firings at a random phase, none before a whole MUAP fits
+    for (uint32_t u = 0; u < cfg_.units; u++) {
+        state_[u].next = center_ + uniform(state_[u].rng) * cfg_.frame_rate_hz / units_[u].rate_hz;
+        schedule(u);
+    }
+}
+
+double muap_synth::interval(uint32_t u)
+{
+    double mean = cfg_.frame_rate_hz / units_[u].rate_hz;
+    return std::max(0.3 * mean, mean * (1.0 + cfg_.isi_cov * normal(state_[u].rng)));
+}
+
+void muap_synth::schedule(uint32_t u)
+{
+    if (cfg_.contract_s <= 0 || cfg_.rest_s <= 0) {
+        return;
+    }
+    double on = cfg_.contract_s * cfg_.frame_rate_hz, period = on + cfg_.rest_s * cfg_.frame_rate_hz;
+    unit_state &s = state_[u];
+    double phase = fmod(s.next, period);
+    if (phase >= on) {
+        // Resting: the first firing of the next contraction comes at a random phase
+        s.next += period - phase + uniform(s.rng) * cfg_.frame_rate_hz / units_[u].rate_hz;
+    }
+}
+
+void muap_synth::make_chunk()
+{
+    const uint32_t n = CHUNK;
+    const size_t L = (size_t)muap_frames_ * EMG_NUM_CHANNELS;
+
+    // Place every firing whose MUAP starts in this chunk; it may end in the next ones
+    for (uint32_t u = 0; u < cfg_.units; u++) {
+        unit_state &s = state_[u];
+        while (s.next < (double)(pos_ + n + center_)) {
+            uint64_t frame = (uint64_t)(s.next + 0.5);
+            const float *t = muap(u);
+            float *a = &acc_[(size_t)(frame - center_ - pos_) * EMG_NUM_CHANNELS];
+            for (size_t i = 0; i < L; i++) {
+                a[i] += t[i];
+            }
+            pending_.push_back({ u, frame });
+            s.next += interval(u);
+            schedule(u);
+        }
+    }
+
+    // Add noise and mains, quantise
+    const float inv_lsb = (float)(1.0 / cfg_.lsb_uv), zero = EMG_SAMPLE_ZERO + 0.5f;   // + 0.5 rounds
+    const double cycles_per_frame = cfg_.mains_hz / cfg_.frame_rate_hz;
+    uint64_t r = 0;
+    unsigned bits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        float mains = (float)sin(TWO_PI * fmod(cycles_per_frame * (double)(pos_ + i), 1.0));
+        const float *a = &acc_[(size_t)i * EMG_NUM_CHANNELS];
+        uint8_t *o = &out_[(size_t)i * EMG_FRAME_BYTES];
+        for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+            if (bits < 12) {
+                r = next64(noise_rng_);
+                bits = 64;
+            }
+            float v = (a[ch] + noise_[r & (NOISE_TABLE - 1)] + mains_gain_[ch] * mains) * inv_lsb + zero;
+            r >>= 12;
+            bits -= 12;
+            if (v < 0.0f) {
+                o[ch] = 0;
+                clipped_++;
+            } else if (v >= 256.0f) {
+                o[ch] = 255;
+                clipped_++;
+            } else {
+                o[ch] = (uint8_t)v;
+            }
+        }
+    }
+
+    // Firings peaking in this chunk, in order
+    std::sort(pending_.begin(), pending_.end(), [](const synth_spike &a, const synth_spike &b) {
+        return a.frame < b.frame || (a.frame == b.frame && a.unit < b.unit);
+    });
+    size_t k = 0;
+    while (k < pending_.size() && pending_[k].frame < pos_ + n) {
+        k++;
+    }
+    fired_.assign(pending_.begin(), pending_.begin() + k);
+    pending_.erase(pending_.begin(), pending_.begin() + k);
+    fired_taken_ = 0;
+
+    // Slide the MUAP sums along by the chunk
+    memmove(acc_.data(), acc_.data() + (size_t)n * EMG_NUM_CHANNELS, L * sizeof(float));
+    std::fill(acc_.begin() + L, acc_.end(), 0.0f);
+    pos_ += n;
+    ready_ = n;
+    taken_ = 0;
+}
+
+void muap_synth::generate(uint8_t *out, size_t n, std::vector<synth_spike> *spikes)
+{
+    while (n > 0) {
+        if (taken_ == ready_) {
+            make_chunk();
+        }
+        uint32_t take = (uint32_t)std::min<size_t>(n, ready_ - taken_);
+        memcpy(out, &out_[(size_t)taken_ * EMG_FRAME_BYTES], (size_t)take * EMG_FRAME_BYTES);
+        taken_ += take;
+        out += (size_t)take * EMG_FRAME_BYTES;
+        n -= take;
+        uint64_t end = pos_ - ready_ + taken_;
+        while (fired_taken_ < fired_.size() && fired_[fired_taken_].frame < end) {
+            if (spikes) spikes->push_back(fired_[fired_taken_]);
+            fired_taken_++;
+        }
+    }
+}
+
+bool muap_synth::write_units(const std::string &path) const
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "unit,x_mm,y_mm,depth_mm,peak_uv,width_ms,rate_hz\n");
+    for (size_t u = 0; u < units_.size(); u++) {
+        const synth_unit &m = units_[u];
+        fprintf(f, "%zu,%.2f,%.2f,%.2f,%.1f,%.3f,%.2f\n", u, m.x_mm, m.y_mm, m.depth_mm, m.peak_uv, m.width_ms,
+                m.rate_hz);
+    }
+    return fclose(f) == 0;
+}
+
+} // namespace emg
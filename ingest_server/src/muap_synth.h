@@ -0,0 +1,154 @@
+/*
+ * Synthetic HD-EMG with known motor unit firings, for load and accuracy
+ * tests without a subject.
+ *
+ * Frames are what the board sends: one uint8 offset-binary sample per
+ * channel (EMG_FRAME_BYTES), channels placed on the grid of one of the
+ * firmware's electrode layouts (emg_spatial.h), rows along the fibres.
+ *
+ * Every motor unit has a position over the grid, a depth and an end plate
+ * row. Its action potential (MUAP) on an electrode is a triphasic wave (the
+ * negative second derivative of a Gaussian, wider for deeper units) whose
+ * amplitude falls off with the distance across the fibres,
+ * (d^2 / (d^2 + dx^2))^1.5 for depth d, and which arrives later the further
+ * the electrode is along the fibres from the end plate (conduction
+ * velocity cv). Each unit's templates are built once; a firing adds them
+ * into the output at its frame. Units are sized log-uniformly between the
+ * peak amplitudes given, and the smallest fire fastest (onion skin). Inter-
+ * spike intervals are Gaussian around the unit's mean with the given
+ * coefficient of variation, and with a contraction pattern units fire only
+ * while the muscle is on. White Gaussian noise and mains interference with
+ * an amplitude that varies across the grid are added, and samples are
+ * quantised at lsb_uv microvolts per count and clipped to 0..255.
+ *
+ * Frames are made CHUNK at a time, for about one multiply-add per sample
+ * plus one per template sample of each firing. A 64-channel device at
+ * 2048 Hz takes a few milliseconds per second of signal. Every unit draws
+ * its intervals from its own random stream and the noise from another, so
+ * the output depends only on the configuration and the seed, not on how
+ * the frames are asked for. Not thread-safe: one generator per device.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "emg_proto.h"
+
+namespace emg {
+
+struct synth_config {
+    uint32_t frame_rate_hz = 2048;
+    uint8_t layout = EMG_LAYOUT_8X8;    // EMG_LAYOUT_*
+    double ied_mm = 8.0;                // inter-electrode distance
+    uint32_t units = 20;
+    double rate_min_hz = 8.0;           // mean firing rate of the largest unit
+    double rate_max_hz = 20.0;          // and of the smallest
+    double isi_cov = 0.15;              // inter-spike interval SD / mean
+    double peak_min_uv = 20.0;          // MUAP peak right above the unit
+    double peak_max_uv = 150.0;
+    double depth_min_mm = 2.0;
+    double depth_max_mm = 10.0;
+    double cv_m_s = 4.0;                // conduction velocity
+    double contract_s = 0.0;            // contraction on this long, then
+    double rest_s = 0.0;                // off this long; 0 = always on
+    double noise_uv = 8.0;              // white noise RMS
+    double mains_hz = 50.0;
+    double mains_uv = 20.0;             // mains amplitude, mean over the grid
+    double lsb_uv = 4.0;                // microvolts per count
+    double seconds = 60.0;              // length, for tools that need one
+    uint64_t seed = 1;
+};
+
+/**
+ * Parse "key=value,..." into cfg: fs, layout (8x8, 13x5), ied, units,
+ * rate (MIN:MAX Hz), cov, peak (MIN:MAX uV), depth (MIN:MAX mm), cv,
+ * contract (ON:OFF s), noise, mains (HZ:UV), lsb, seconds, seed. On failure
+ * err (if given) says which item is wrong.
+ */
+bool parse_synth_spec(const char *spec, synth_config *cfg, std::string *err = nullptr);
+
+struct synth_unit {
+    double x_mm, y_mm;                  // position over the grid, y along the fibres (rows)
+    double depth_mm;
+    double peak_uv;
+    double width_ms;                    // Gaussian sigma of the MUAP
+    double rate_hz;                     // mean firing rate
+};
+
+/** Unit unit fired at frame frame (the MUAP peak under its end plate). */
+struct synth_spike {
+    uint32_t unit;
+    uint64_t frame;
+};
+
+class muap_synth {
+public:
+    static const uint32_t CHUNK = 1024;             // frames generated at a time
+    static const uint32_t NOISE_TABLE = 1 << 12;    // Gaussian variates drawn from
+
+    explicit muap_synth(const synth_config &cfg);
+    ~muap_synth();
+
+    muap_synth(const muap_synth &) = delete;
+    muap_synth &operator=(const muap_synth &) = delete;
+
+    /**
+     * Generate the next n frames into out (n * EMG_FRAME_BYTES bytes) and
+     * append the firings that peak within them to spikes, in frame order.
+     */
+    void generate(uint8_t *out, size_t n, std::vector<synth_spike> *spikes = nullptr);
+
+    const synth_config &config() const { return cfg_; }
+    const std::vector<synth_unit> &units() const { return units_; }
+    uint64_t position() const { return pos_ - (ready_ - taken_); }     // frames handed out so far
+    uint64_t clipped() const { return clipped_; }   // samples clipped to 0 or 255
+
+    /**
+     * MUAP templates of unit u: muap_frames() frames of EMG_NUM_CHANNELS
+     * microvolt values, frame muap_center() at the firing.
+     */
+    const float *muap(uint32_t u) const { return &templates_[(size_t)u * muap_frames_ * EMG_NUM_CHANNELS]; }
+    uint32_t muap_frames() const { return muap_frames_; }
+    uint32_t muap_center() const { return center_; }
+
+    /** Write the units as CSV: unit,x_mm,y_mm,depth_mm,peak_uv,width_ms,rate_hz. */
+    bool write_units(const std::string &path) const;
+
+private:
+    struct unit_state {
+        uint64_t rng;                   // this unit's interval stream
+        double next;                    // frame of the next firing, fractional
+    };
+
+    void build_units();
+    double interval(uint32_t u);        // next inter-spike interval, frames
+    void schedule(uint32_t u);          // move the next firing out of a rest
+    void make_chunk();
+
+    synth_config cfg_;
+    std::vector<synth_unit> units_;
+    std::vector<unit_state> state_;
+    std::vector<float> templates_;
+    uint32_t muap_frames_ = 0;
+    uint32_t center_ = 0;
+
+    uint64_t noise_rng_;
+    std::vector<float> noise_;          // NOISE_TABLE variates, mean 0 and RMS 1
+    float mains_gain_[EMG_NUM_CHANNELS];
+
+    // Sum of the MUAPs placed so far from frame pos_ on: CHUNK + muap_frames_ frames
+    std::vector<float> acc_;
+    std::vector<synth_spike> pending_;  // placed, peaking at or after pos_
+    uint64_t pos_ = 0;                  // frames made
+    uint64_t clipped_ = 0;
+
+    // The chunk made last, frames [pos_ - ready_, pos_), and its firings
+    std::vector<uint8_t> out_;
+    uint32_t ready_ = 0;
+    uint32_t taken_ = 0;                // frames of it handed out
+    std::vector<synth_spike> fired_;
+    size_t fired_taken_ = 0;
+};
+
+} // namespace emg
@@ -0,0 +1,607 @@
+/*
+ * Block codecs of the recording container, see rec_codec.h.
+ */
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "emg_proto.h"
+#include "rec_codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EMG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace emg {
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* ---- delta + bit packing ---- */
+
+static const size_t BP_LANES = 8;       // channels per group
+static const size_t BP_FRAMES = 32;     // frames per group
+static const int BP_WIDTHS = 18;        // 0..17 bits: an int16 difference needs 17
+
+template <typename T>
+static constexpr int bp_max_width()
+{
+    return sizeof(T) == 1 ? 9 : 17;
+}
+
+/* Sample i of the frames, less the sample zero */
+template <typename T>
+static inline int32_t get_sample(const uint8_t *frames, size_t i)
+{
+    if constexpr (sizeof(T) == 1) {
+        return (int32_t)frames[i] - EMG_SAMPLE_ZERO;
+    } else {
+        int16_t s;
+        memcpy(&s, frames + 2 * i, sizeof(s));
+        return s;
+    }
+}
+
+template <typename T>
+static inline void put_sample(uint8_t *frames, size_t i, int32_t v)
+{
+    if constexpr (sizeof(T) == 1) {
+        frames[i] = (uint8_t)(v + EMG_SAMPLE_ZERO);
+    } else {
+        int16_t s = (int16_t)v;
+        memcpy(frames + 2 * i, &s, sizeof(s));
+    }
+}
+
+template <typename T>
+static size_t bp_encode(const uint8_t *frames, uint32_t n, size_t channels, uint8_t *out)
+{
+    const size_t q_count = (channels + BP_LANES - 1) / BP_LANES, g_count = (n + BP_FRAMES - 1) / BP_FRAMES;
+    uint8_t *width = out;
+    uint8_t *p = out + q_count * g_count;
+    for (size_t q = 0; q < q_count; q++) {
+        const size_t lanes = std::min(BP_LANES, channels - q * BP_LANES);
+        int32_t prev[BP_LANES] = {};
+        for (size_t g = 0; g < g_count; g++) {
+            const size_t frames_in = std::min<size_t>(BP_FRAMES, n - g * BP_FRAMES);
+            uint32_t z[BP_FRAMES][BP_LANES] = {};
+            uint32_t any = 0;
+            for (size_t k = 0; k < frames_in; k++) {
+                const uint8_t *row = frames;
+                size_t base = (g * BP_FRAMES + k) * channels + q * BP_LANES;
+                for (size_t l = 0; l < lanes; l++) {
+                    int32_t x = get_sample<T>(row, base + l);
+                    uint32_t d = (uint32_t)x - (uint32_t)prev[l];
+                    prev[l] = x;
+                    z[k][l] = d;
+                    any |= (d << 1) ^ (uint32_t)((int32_t)d >> 31);   // zigzag: the width d needs
+                }
+            }
+            const int b = any ? 32 - __builtin_clz(any) : 0;
+            width[q * g_count + g] = (uint8_t)b;
+            const uint32_t half = b ? 1u << (b - 1) : 0;
+            for (size_t l = 0; l < BP_LANES; l++) {
+                uint64_t acc = 0;
+                int bits = 0;
+                size_t j = 0;
+                for (size_t k = 0; k < BP_FRAMES; k++) {
+                    acc |= (uint64_t)((z[k][l] + half) & ((1u << b) - 1)) << bits;
+                    bits += b;
+                    if (bits >= 32) {
+                        uint32_t w = (uint32_t)acc;
+                        memcpy(p + (j * BP_LANES + l) * 4, &w, 4);
+                        j++;
+                        acc >>= 32;
+                        bits -= 32;
+                    }
+                }
+            }
+            p += (size_t)b * BP_LANES * 4;
+        }
+    }
+    return (size_t)(p - out);
+}
+
+/* Check the width table: every width in range and the groups exactly filling len */
+template <typename T>
+static bool bp_check(const uint8_t *in, size_t len, size_t groups)
+{
+    if (len < groups) {
+        return false;
+    }
+    size_t bytes = groups;
+    for (size_t i = 0; i < groups; i++) {
+        if (in[i] > bp_max_width<T>()) {
+            return false;
+        }
+        bytes += (size_t)in[i] * BP_LANES * 4;
+    }
+    return bytes == len;
+}
+
+template <typename T>
+static bool bp_decode_scalar(const uint8_t *in, size_t len, uint32_t n, size_t channels, uint8_t *out)
+{
+    const size_t q_count = (channels + BP_LANES - 1) / BP_LANES, g_count = (n + BP_FRAMES - 1) / BP_FRAMES;
+    if (!bp_check<T>(in, len, q_count * g_count)) {
+        return false;
+    }
+    const uint8_t *p = in + q_count * g_count;
+    for (size_t q = 0; q < q_count; q++) {
+        const size_t lanes = std::min(BP_LANES, channels - q * BP_LANES);
+        uint32_t acc[BP_LANES] = {};
+        for (size_t g = 0; g < g_count; g++) {
+            const unsigned b = in[q * g_count + g];
+            const uint32_t mask = (1u << b) - 1;
+            const size_t frames_in = std::min<size_t>(BP_FRAMES, n - g * BP_FRAMES);
+            for (size_t l = 0; l < lanes; l++) {
+                for (size_t k = 0; k < frames_in; k++) {
+                    if (b) {
+                        size_t bit = k * b, j = bit >> 5;
+                        unsigned sh = bit & 31;
+                        uint64_t v = load32(p + (j * BP_LANES + l) * 4);
+                        if (sh + b > 32) {
+                            v |= (uint64_t)load32(p + ((j + 1) * BP_LANES + l) * 4) << 32;
+                        }
+                        acc[l] += ((uint32_t)(v >> sh) & mask) - (1u << (b - 1));
+                    }
+                    put_sample<T>(out, (g * BP_FRAMES + k) * channels + q * BP_LANES + l, (int32_t)acc[l]);
+                }
+            }
+            p += (size_t)b * BP_LANES * 4;
+        }
+    }
+    return true;
+}
+
+#if EMG_X86
+
+/*
+ * The SIMD decoders keep the running sum of the 8 lanes of a group in
+ * registers, starting from the sample zero so that the sums are the stored
+ * samples, and write each frame's 8 samples into its row of the output as
+ * they come. One function per width, so that every shift is an immediate.
+ * A group short of 8 lanes or 32 frames is decoded into a full-sized
+ * scratch group and copied out from there.
+ */
+
+#define BP_BY_WIDTH(f, T)                                                                                      \
+    {                                                                                                          \
+        &f<0, T>, &f<1, T>, &f<2, T>, &f<3, T>, &f<4, T>, &f<5, T>, &f<6, T>, &f<7, T>, &f<8, T>, &f<9, T>,    \
+            &f<10, T>, &f<11, T>, &f<12, T>, &f<13, T>, &f<14, T>, &f<15, T>, &f<16, T>, &f<17, T>,            \
+    }
+
+/* The part of a scratch group that exists */
+template <typename T>
+static void bp_copy_out(const uint8_t *group, size_t lanes, size_t frames_in, uint8_t *o, size_t row)
+{
+    for (size_t k = 0; k < frames_in; k++) {
+        memcpy(o + k * row, group + k * BP_LANES * sizeof(T), lanes * sizeof(T));
+    }
+}
+
+/* ---- SSE2: lanes 0-3 and 4-7 as two registers ---- */
+
+template <int B, typename T>
+__attribute__((target("sse2"))) static void bp_group_sse2(const uint8_t *p, __m128i *acc, uint8_t *o, size_t row)
+{
+    __m128i a0 = acc[0], a1 = acc[1];
+    const __m128i mask = _mm_set1_epi32((int)((1u << B) - 1)), half = _mm_set1_epi32(B ? 1 << (B - 1) : 0);
+#pragma GCC unroll 32
+    for (int k = 0; k < (int)BP_FRAMES; k++) {
+        if constexpr (B > 0) {
+            const int bit = k * B, j = bit >> 5, sh = bit & 31;
+            __m128i v0 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(p + j * 32)), sh);
+            __m128i v1 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(p + j * 32 + 16)), sh);
+            if (sh + B > 32) {
+                v0 = _mm_or_si128(v0, _mm_slli_epi32(_mm_loadu_si128((const __m128i *)(p + j * 32 + 32)), 32 - sh));
+                v1 = _mm_or_si128(v1, _mm_slli_epi32(_mm_loadu_si128((const __m128i *)(p + j * 32 + 48)), 32 - sh));
+            }
+            v0 = _mm_and_si128(v0, mask);
+            v1 = _mm_and_si128(v1, mask);
+            a0 = _mm_add_epi32(_mm_sub_epi32(a0, half), v0);
+            a1 = _mm_add_epi32(_mm_sub_epi32(a1, half), v1);
+        }
+        __m128i s16 = _mm_packs_epi32(a0, a1);
+        if constexpr (sizeof(T) == 1) {
+            _mm_storel_epi64((__m128i *)(o + k * row), _mm_packus_epi16(s16, s16));
+        } else {
+            _mm_storeu_si128((__m128i *)(o + k * row), s16);
+        }
+    }
+    acc[0] = a0;
+    acc[1] = a1;
+}
+
+using bp_group_sse2_fn = void (*)(const uint8_t *, __m128i *, uint8_t *, size_t);
+
+template <typename T>
+__attribute__((target("sse2"))) static bool bp_decode_sse2(const uint8_t *in, size_t len, uint32_t n,
+                                                           size_t channels, uint8_t *out)
+{
+    static const bp_group_sse2_fn by_width[BP_WIDTHS] = BP_BY_WIDTH(bp_group_sse2, T);
+    const size_t q_count = (channels + BP_LANES - 1) / BP_LANES, g_count = (n + BP_FRAMES - 1) / BP_FRAMES;
+    if (!bp_check<T>(in, len, q_count * g_count)) {
+        return false;
+    }
+    const uint8_t *p = in + q_count * g_count;
+    const size_t row = channels * sizeof(T);
+    alignas(16) uint8_t group[BP_FRAMES * BP_LANES * sizeof(T)];
+    for (size_t q = 0; q < q_count; q++) {
+        const size_t lanes = std::min(BP_LANES, channels - q * BP_LANES);
+        __m128i acc[2];
+        acc[0] = acc[1] = _mm_set1_epi32(sizeof(T) == 1 ? EMG_SAMPLE_ZERO : 0);
+        for (size_t g = 0; g < g_count; g++) {
+            const unsigned b = in[q * g_count + g];
+            const size_t frames_in = std::min<size_t>(BP_FRAMES, n - g * BP_FRAMES);
+            uint8_t *o = out + g * BP_FRAMES * row + q * BP_LANES * sizeof(T);
+            if (lanes == BP_LANES && frames_in == BP_FRAMES) {
+                by_width[b](p, acc, o, row);
+            } else {
+                by_width[b](p, acc, group, BP_LANES * sizeof(T));
+                bp_copy_out<T>(group, lanes, frames_in, o, row);
+            }
+            p += (size_t)b * BP_LANES * 4;
+        }
+    }
+    return true;
+}
+
+/* ---- AVX2: all 8 lanes in one register ---- */
+
+/* Frame k of a group: the running sums after adding its differences */
+template <int B>
+__attribute__((target("avx2"))) static inline __m256i bp_next_avx2(const uint8_t *p, int k, __m256i a)
+{
+    if constexpr (B > 0) {
+        const __m256i mask = _mm256_set1_epi32((int)((1u << B) - 1)), half = _mm256_set1_epi32(1 << (B - 1));
+        const int bit = k * B, j = bit >> 5, sh = bit & 31;
+        __m256i v = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i *)(p + j * 32)), sh);
+        if (sh + B > 32) {
+            v = _mm256_or_si256(v, _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)(p + (j + 1) * 32)), 32 - sh));
+        }
+        v = _mm256_and_si256(v, mask);
+        a = _mm256_add_epi32(_mm256_sub_epi32(a, half), v);
+    }
+    return a;
+}
+
+/* Four frames at a time for uint8 and two for int16, to share the packing shuffles between them */
+template <int B, typename T>
+__attribute__((target("avx2"))) static void bp_group_avx2(const uint8_t *p, __m256i *acc, uint8_t *o, size_t row)
+{
+    __m256i a = *acc;
+    if constexpr (sizeof(T) == 1) {
+        const __m256i rows = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+#pragma GCC unroll 8
+        for (int k = 0; k < (int)BP_FRAMES; k += 4) {
+            __m256i x0 = a = bp_next_avx2<B>(p, k, a);
+            __m256i x1 = a = bp_next_avx2<B>(p, k + 1, a);
+            __m256i x2 = a = bp_next_avx2<B>(p, k + 2, a);
+            __m256i x3 = a = bp_next_avx2<B>(p, k + 3, a);
+            // Bytes of lanes 0-3 of the four frames, then of lanes 4-7; dword shuffle into frame order
+            __m256i b = _mm256_packus_epi16(_mm256_packs_epi32(x0, x1), _mm256_packs_epi32(x2, x3));
+            b = _mm256_permutevar8x32_epi32(b, rows);
+            __m128i lo = _mm256_castsi256_si128(b), hi = _mm256_extracti128_si256(b, 1);
+            _mm_storel_epi64((__m128i *)(o + k * row), lo);
+            _mm_storeh_pd((double *)(o + (k + 1) * row), _mm_castsi128_pd(lo));
+            _mm_storel_epi64((__m128i *)(o + (k + 2) * row), hi);
+            _mm_storeh_pd((double *)(o + (k + 3) * row), _mm_castsi128_pd(hi));
+        }
+    } else {
+#pragma GCC unroll 16
+        for (int k = 0; k < (int)BP_FRAMES; k += 2) {
+            __m256i x0 = a = bp_next_avx2<B>(p, k, a);
+            __m256i x1 = a = bp_next_avx2<B>(p, k + 1, a);
+            __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(x0, x1), 0xD8);
+            _mm_storeu_si128((__m128i *)(o + k * row), _mm256_castsi256_si128(w));
+            _mm_storeu_si128((__m128i *)(o + (k + 1) * row), _mm256_extracti128_si256(w, 1));
+        }
+    }
+    *acc = a;
+}
+
+using bp_group_avx2_fn = void (*)(const uint8_t *, __m256i *, uint8_t *, size_t);
+
+template <typename T>
+__attribute__((target("avx2"))) static bool bp_decode_avx2(const uint8_t *in, size_t len, uint32_t n,
+                                                           size_t channels, uint8_t *out)
+{
+    static const bp_group_avx2_fn by_width[BP_WIDTHS] = BP_BY_WIDTH(bp_group_avx2, T);
+    const size_t q_count = (channels + BP_LANES - 1) / BP_LANES, g_count = (n + BP_FRAMES - 1) / BP_FRAMES;
+    if (!bp_check<T>(in, len, q_count * g_count)) {
+        return false;
+    }
+    const uint8_t *p = in + q_count * g_count;
+    const size_t row = channels * sizeof(T);
+    alignas(32) uint8_t group[BP_FRAMES * BP_LANES * sizeof(T)];
+    for (size_t q = 0; q < q_count; q++) {
+        const size_t lanes = std::min(BP_LANES, channels - q * BP_LANES);
+        __m256i acc = _mm256_set1_epi32(sizeof(T) == 1 ? EMG_SAMPLE_ZERO : 0);
+        for (size_t g = 0; g < g_count; g++) {
+            const unsigned b = in[q * g_count + g];
+            const size_t frames_in = std::min<size_t>(BP_FRAMES, n - g * BP_FRAMES);
+            uint8_t *o = out + g * BP_FRAMES * row + q * BP_LANES * sizeof(T);
+            if (lanes == BP_LANES && frames_in == BP_FRAMES) {
+                by_width[b](p, &acc, o, row);
+            } else {
+                by_width[b](p, &acc, group, BP_LANES * sizeof(T));
+                bp_copy_out<T>(group, lanes, frames_in, o, row);
+            }
+            p += (size_t)b * BP_LANES * 4;
+        }
+    }
+    return true;
+}
+
+#undef BP_BY_WIDTH
+
+#endif // EMG_X86
+
+template <typename T>
+static bool bp_decode(const uint8_t *in, size_t len, uint32_t n, size_t channels, uint8_t *out, simd_isa isa)
+{
+    if (!isa_supported(isa)) {
+        isa = best_isa();
+    }
+    switch (isa) {
+#if EMG_X86
+    case simd_isa::avx2: return bp_decode_avx2<T>(in, len, n, channels, out);
+    case simd_isa::sse2: return bp_decode_sse2<T>(in, len, n, channels, out);
+#endif
+    default: return bp_decode_scalar<T>(in, len, n, channels, out);
+    }
+}
+
+/* ---- LZ, in the LZ4 block format ---- */
+
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_LAST_LITERALS = 5;     // the block ends in at least this many literals
+static const size_t LZ_MF_LIMIT = 12;         // and its last match starts at least this far from the end
+static const size_t LZ_MAX_OFFSET = 65535;
+static const int LZ_HASH_LOG = 14;
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static uint8_t *lz_length(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* One sequence: literals, then a match (none in the last sequence) */
+static uint8_t *lz_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t)(std::min<size_t>(lit_len, 15) << 4);
+    if (lit_len >= 15) {
+        op = lz_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        size_t m = match_len - LZ_MIN_MATCH;
+        *token |= (uint8_t)std::min<size_t>(m, 15);
+        if (m >= 15) {
+            op = lz_length(op, m - 15);
+        }
+    }
+    return op;
+}
+
+/* Greedy matching through a hash table of the last position of every 4-byte
+ * prefix; the search skips ahead faster the longer it finds nothing */
+static size_t lz_encode(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    if (n > LZ_MF_LIMIT) {
+        thread_local std::vector<uint32_t> table;
+        table.assign((size_t)1 << LZ_HASH_LOG, 0);   // position + 1, 0: none
+        const size_t limit = n - LZ_MF_LIMIT, match_limit = n - LZ_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < limit) {
+            uint32_t v = load32(src + ip);
+            uint32_t &slot = table[lz_hash(v)];
+            size_t ref = slot;
+            slot = (uint32_t)ip + 1;
+            if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || load32(src + ref - 1) != v) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            ref--;
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < match_limit && src[ip + len] == src[ref + len]) {
+                len++;
+            }
+            op = lz_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+    op = lz_sequence(op, src + anchor, n - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+static bool lz_read_length(const uint8_t *&ip, const uint8_t *iend, size_t *len)
+{
+    unsigned s;
+    do {
+        if (ip >= iend) {
+            return false;
+        }
+        s = *ip++;
+        *len += s;
+    } while (s == 255);
+    return true;
+}
+
+/* Bounds-checked; copies in 16- and 8-byte steps wherever there is room */
+static bool lz_decode(const uint8_t *in, size_t len, uint8_t *out, size_t n)
+{
+    const uint8_t *ip = in, *const iend = in + len;
+    uint8_t *op = out, *const oend = out + n;
+    for (;;) {
+        if (ip >= iend) {
+            return false;
+        }
+        const unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_read_length(ip, iend, &lit)) {
+            return false;
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) {
+            return false;
+        }
+        if ((size_t)(iend - ip) >= lit + 16 && (size_t)(oend - op) >= lit + 16) {
+            for (size_t k = 0; k < lit; k += 16) {
+                memcpy(op + k, ip + k, 16);
+            }
+        } else {
+            memcpy(op, ip, lit);
+        }
+        ip += lit;
+        op += lit;
+        if (ip == iend) {
+            return op == oend;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        const size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t m = token & 15;
+        if (m == 15 && !lz_read_length(ip, iend, &m)) {
+            return false;
+        }
+        m += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || (size_t)(oend - op) < m) {
+            return false;
+        }
+        const uint8_t *ref = op - offset;
+        if (offset >= 16 && (size_t)(oend - op) >= m + 16) {
+            for (size_t k = 0; k < m; k += 16) {
+                memcpy(op + k, ref + k, 16);
+            }
+        } else if (offset >= 8 && (size_t)(oend - op) >= m + 8) {
+            for (size_t k = 0; k < m; k += 8) {
+                memcpy(op + k, ref + k, 8);
+            }
+        } else {
+            // Overlapping: each byte may be one this copy just wrote
+            for (size_t k = 0; k < m; k++) {
+                op[k] = ref[k];
+            }
+        }
+        op += m;
+    }
+}
+
+/* ---- public ---- */
+
+const char *rec_codec_name(uint8_t codec)
+{
+    switch (codec) {
+    case REC_CODEC_NONE: return "none";
+    case REC_CODEC_DELTA_BP: return "delta";
+    case REC_CODEC_LZ: return "lz";
+    default: return "?";
+    }
+}
+
+bool rec_codec_from_name(const char *name, uint8_t *codec)
+{
+    for (uint8_t c : { REC_CODEC_NONE, REC_CODEC_DELTA_BP, REC_CODEC_LZ }) {
+        if (strcmp(name, rec_codec_name(c)) == 0) {
+            *codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t rec_encode_bound(uint8_t codec, uint8_t sample_format, uint16_t channels, uint32_t n)
+{
+    size_t raw = (size_t)n * rec_frame_bytes(sample_format, channels);
+    if (raw == 0 && n != 0) {
+        return 0;
+    }
+    switch (codec) {
+    case REC_CODEC_NONE:
+        return raw;
+    case REC_CODEC_DELTA_BP: {
+        size_t groups = (channels + BP_LANES - 1) / BP_LANES * ((n + BP_FRAMES - 1) / BP_FRAMES);
+        int max_width = sample_format == REC_FMT_U8_OFFSET ? bp_max_width<uint8_t>() : bp_max_width<int16_t>();
+        return groups * (1 + (size_t)max_width * BP_LANES * 4);
+    }
+    case REC_CODEC_LZ:
+        return raw + raw / 255 + 16;
+    default:
+        return 0;
+    }
+}
+
+size_t rec_encode(uint8_t codec, uint8_t sample_format, uint16_t channels, const uint8_t *frames, uint32_t n,
+                  uint8_t *out)
+{
+    size_t raw = (size_t)n * rec_frame_bytes(sample_format, channels);
+    if (raw == 0) {
+        return 0;
+    }
+    switch (codec) {
+    case REC_CODEC_NONE:
+        memcpy(out, frames, raw);
+        return raw;
+    case REC_CODEC_DELTA_BP:
+        return sample_format == REC_FMT_U8_OFFSET ? bp_encode<uint8_t>(frames, n, channels, out)
+                                                  : bp_encode<int16_t>(frames, n, channels, out);
+    case REC_CODEC_LZ:
+        return lz_encode(frames, raw, out);
+    default:
+        return 0;
+    }
+}
+
+bool rec_decode(uint8_t codec, uint8_t sample_format, uint16_t channels, const uint8_t *in, size_t len, uint32_t n,
+                uint8_t *out, simd_isa isa)
+{
+    size_t raw = (size_t)n * rec_frame_bytes(sample_format, channels);
+    if (raw == 0) {
+        return n == 0 && len == 0 && rec_frame_bytes(sample_format, channels) != 0;
+    }
+    switch (codec) {
+    case REC_CODEC_NONE:
+        if (len != raw) {
+            return false;
+        }
+        memcpy(out, in, raw);
+        return true;
+    case REC_CODEC_DELTA_BP:
+        return sample_format == REC_FMT_U8_OFFSET ? bp_decode<uint8_t>(in, len, n, channels, out, isa)
+                                                  : bp_decode<int16_t>(in, len, n, channels, out, isa);
+    case REC_CODEC_LZ:
+        return lz_decode(in, len, out, raw);
+    default:
+        return false;
+    }
+}
+
+} // namespace emg
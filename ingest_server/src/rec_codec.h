@@ -0,0 +1,64 @@
+/*
+ * Codecs for the payload of recording data blocks (REC_CODEC_* in
+ * recording.h). Every block is encoded on its own, so any block of a file
+ * decodes without the ones before it and random access stays one block
+ * deep.
+ *
+ * REC_CODEC_DELTA_BP: delta + bit packing, for multichannel integer EMG.
+ *   Each channel is coded as the difference to its previous sample (the
+ *   first one to the sample zero). Channels are taken 8 at a time and
+ *   frames 32 at a time; each such group of 8 x 32 differences is packed
+ *   at the smallest bit width b that holds all of them as b-bit offset
+ *   binary (difference + 2^(b-1)), in the lane layout of SIMD-BP128: lane
+ *   l holds channel 8q + l, and word j of all 8 lanes is stored together,
+ *   so one 32-byte load brings in one word of every lane and decoding
+ *   shifts all 8 channels at once.
+ *
+ *     payload   width[Q][G]   1 byte per group: bits per value (0..17)
+ *               group*        for q < Q, g < G: width * 8 32-bit words,
+ *                             word j of lane l at (8j + l) * 4
+ *
+ *   where Q = ceil(channels / 8) and G = ceil(frames / 32). Channels and
+ *   frames past the end pad with a difference of 0. Noise-level bits cost
+ *   what they cost; the bits above them do not.
+ *
+ * REC_CODEC_LZ: generic LZ77 in the LZ4 block format (byte-aligned
+ *   sequences of literals and matches within 64 KB), so any LZ4 block
+ *   decoder reads it. For recordings that repeat themselves (flat lines,
+ *   saturation, test patterns), not for noise.
+ *
+ * All fields are little-endian.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "deinterleave.h"
+#include "recording.h"
+
+namespace emg {
+
+/** "none", "delta" or "lz" for REC_CODEC_*; "?" if unknown. */
+const char *rec_codec_name(uint8_t codec);
+
+/** Codec by name (as rec_codec_name()); false if there is no such codec. */
+bool rec_codec_from_name(const char *name, uint8_t *codec);
+
+/** Bytes rec_encode() may write for n frames; 0 if the codec or format is unknown. */
+size_t rec_encode_bound(uint8_t codec, uint8_t sample_format, uint16_t channels, uint32_t n);
+
+/**
+ * Encode n frames (sample-major, in sample_format) into out, which holds
+ * rec_encode_bound() bytes. Returns the encoded size, 0 if the codec or
+ * format is unknown.
+ */
+size_t rec_encode(uint8_t codec, uint8_t sample_format, uint16_t channels, const uint8_t *frames, uint32_t n,
+                  uint8_t *out);
+
+/**
+ * Decode len bytes into n frames at out (n * rec_frame_bytes() bytes).
+ * False if the input is damaged or does not decode to exactly n frames.
+ */
+bool rec_decode(uint8_t codec, uint8_t sample_format, uint16_t channels, const uint8_t *in, size_t len, uint32_t n,
+                uint8_t *out, simd_isa isa = best_isa());
+
+} // namespace emg
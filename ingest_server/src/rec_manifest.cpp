@@ -0,0 +1,117 @@
+/*
+ * Session manifest, see rec_manifest.h.
+ */
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rec_manifest.h"
+
+namespace emg {
+
+static const char MANIFEST_MAGIC[] = "emg-session";
+static const int MANIFEST_VERSION = 1;
+
+bool rec_manifest_read(const std::string &path, rec_manifest *m, std::string *err)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) {
+        if (err) *err = strerror(errno);
+        return false;
+    }
+    *m = rec_manifest();
+    char line[512];
+    int version = 0;
+    bool ok = fgets(line, sizeof(line), f) && sscanf(line, "emg-session %d", &version) == 1 &&
+              version == MANIFEST_VERSION;
+    if (!ok && err) *err = "not a session manifest";
+    while (ok && fgets(line, sizeof(line), f)) {
+        char file[256], state[16];
+        rec_segment s;
+        line[strcspn(line, "\n")] = '\0';
+        if (strcmp(line, "end") == 0) {
+            m->finished = true;
+        } else if (sscanf(line, "segment %255s %15s", file, state) == 2) {
+            s.file = file;
+            s.closed = strcmp(state, "closed") == 0;
+            if (s.closed && sscanf(line, "segment %*s %*s %" SCNu64 " %" SCNd64 " %" SCNd64, &s.frames, &s.t0_ns,
+                                   &s.t1_ns) != 3) {
+                ok = false;
+            }
+            // A file name must stay in the manifest's directory
+            if (s.file.find('/') != std::string::npos || s.file == "." || s.file == "..") {
+                ok = false;
+            }
+            m->segments.push_back(s);
+        } else if (line[0] != '\0' && line[0] != '#') {
+            ok = false;
+        }
+        if (!ok && err) *err = std::string("bad manifest line: ") + line;
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool sync_path(const std::string &path, int flags)
+{
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool rec_manifest_write(const std::string &path, const rec_manifest &m)
+{
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "%s %d\n", MANIFEST_MAGIC, MANIFEST_VERSION);
+    for (const rec_segment &s : m.segments) {
+        if (s.closed) {
+            fprintf(f, "segment %s closed %" PRIu64 " %" PRId64 " %" PRId64 "\n", s.file.c_str(), s.frames, s.t0_ns,
+                    s.t1_ns);
+        } else {
+            fprintf(f, "segment %s open\n", s.file.c_str());
+        }
+    }
+    if (m.finished) {
+        fprintf(f, "end\n");
+    }
+    bool ok = fflush(f) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool rec_manifest_sync(const std::string &path)
+{
+    bool ok = sync_path(path, O_RDONLY);
+    return sync_path(rec_dir_of(path), O_RDONLY | O_DIRECTORY) && ok;
+}
+
+std::string rec_dir_of(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string rec_segment_path(const std::string &manifest_path, const rec_segment &s)
+{
+    std::string path = rec_dir_of(manifest_path) + "/" + s.file;
+    if (!s.closed && access((path + ".part").c_str(), F_OK) == 0) {
+        return path + ".part";
+    }
+    return path;
+}
+
+} // namespace emg
@@ -0,0 +1,59 @@
+/*
+ * Manifest of a segmented recording session (.emgm).
+ *
+ * A session recorded with rollover is a run of ordinary recordings
+ * (recording.h), one per segment, tied together by a small text file:
+ *
+ *   emg-session 1
+ *   segment rigA_mac-a4cf12ab34cd_20250301-101500.0001.emgr closed 7372800 <t0_ns> <t1_ns>
+ *   segment rigA_mac-a4cf12ab34cd_20250301-101500.0002.emgr open
+ *   end
+ *
+ * Segments are listed in recording order by file name, relative to the
+ * manifest's directory. A segment being written, or written but not yet
+ * finalized, is "open" and exists as its name plus ".part"; finalizing it
+ * (summary built, data synced) renames it to its name and records its frame
+ * count and host time range. "end" follows once the session is over and
+ * every segment is closed. The manifest is replaced as a whole by rename(),
+ * so readers never see it half written.
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace emg {
+
+struct rec_segment {
+    std::string file;               // file name once closed, relative to the manifest
+    bool closed = false;
+    uint64_t frames = 0;            // closed segments only
+    int64_t t0_ns = 0;
+    int64_t t1_ns = 0;
+};
+
+struct rec_manifest {
+    std::vector<rec_segment> segments;
+    bool finished = false;          // "end": no more segments will come
+};
+
+/** Read a manifest; on failure err (if given) says why. */
+bool rec_manifest_read(const std::string &path, rec_manifest *m, std::string *err = nullptr);
+
+/** Write a manifest to path through a temporary file and rename(). */
+bool rec_manifest_write(const std::string &path, const rec_manifest &m);
+
+/** Sync the manifest at path and its directory (with every rename in it) to disk. */
+bool rec_manifest_sync(const std::string &path);
+
+/** Directory part of path, "." if it has none. */
+std::string rec_dir_of(const std::string &path);
+
+/**
+ * Path of segment s as it exists now: closed segments under their name,
+ * open ones under their name plus ".part", or under their name if the
+ * rename has happened since the manifest was read.
+ */
+std::string rec_segment_path(const std::string &manifest_path, const rec_segment &s);
+
+} // namespace emg
@@ -0,0 +1,214 @@
+/*
+ * Recording container reader, see rec_reader.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rec_codec.h"
+#include "rec_reader.h"
+
+namespace emg {
+
+rec_reader::~rec_reader()
+{
+    close();
+}
+
+void rec_reader::close()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    blocks_.clear();
+    data_.clear();
+    frames_ = 0;
+    finished_ = false;
+}
+
+/* pread() exactly len bytes */
+static bool read_at(int fd, void *buf, size_t len, uint64_t off)
+{
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        len -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return true;
+}
+
+static uint64_t file_size(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+bool rec_reader::open(const std::string &path, std::string *err)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        if (err) *err = strerror(errno);
+        return false;
+    }
+    if (!read_at(fd_, &hdr_, sizeof(hdr_), 0) ||
+        memcmp(hdr_.magic, REC_FILE_MAGIC, sizeof(hdr_.magic)) != 0) {
+        if (err) *err = "not a recording";
+        close();
+        return false;
+    }
+    if (hdr_.version != REC_VERSION || hdr_.header_size < sizeof(hdr_) ||
+        hdr_.header_crc != crc32c(0, &hdr_, offsetof(rec_file_header, header_crc)) ||
+        rec_frame_bytes(hdr_.sample_format, hdr_.channels) == 0) {
+        if (err) *err = "unsupported version or damaged header";
+        close();
+        return false;
+    }
+    scan_end_ = hdr_.header_size;
+    if (!load_index()) {
+        refresh();
+    }
+    return true;
+}
+
+bool rec_reader::read_header_at(uint64_t off, rec_block_header *h, uint64_t size) const
+{
+    if (off + sizeof(*h) > size || !read_at(fd_, h, sizeof(*h), off)) {
+        return false;
+    }
+    return h->magic == REC_BLOCK_MAGIC &&
+           h->header_crc == crc32c(0, h, offsetof(rec_block_header, header_crc)) &&
+           off + sizeof(*h) + h->payload_len <= size;
+}
+
+void rec_reader::add_block(const rec_index_entry &e)
+{
+    if (e.type == REC_BLOCK_DATA) {
+        data_.push_back((uint32_t)blocks_.size());
+        frames_ += e.frames;
+    }
+    blocks_.push_back(e);
+}
+
+bool rec_reader::load_index()
+{
+    uint64_t size = file_size(fd_);
+    rec_trailer t;
+    if (size < hdr_.header_size + sizeof(t) || !read_at(fd_, &t, sizeof(t), size - sizeof(t)) ||
+        t.magic != REC_TRAILER_MAGIC || t.crc != crc32c(0, &t, offsetof(rec_trailer, crc)) ||
+        t.blocks_end != size - sizeof(t)) {
+        return false;
+    }
+    rec_block_header h;
+    if (!read_header_at(t.index_offset, &h, t.blocks_end) || h.type != REC_BLOCK_INDEX ||
+        h.frames != t.entries || h.payload_len != (uint64_t)t.entries * sizeof(rec_index_entry)) {
+        return false;
+    }
+    std::vector<rec_index_entry> entries(t.entries);
+    if (!read_at(fd_, entries.data(), h.payload_len, t.index_offset + sizeof(h)) ||
+        h.payload_crc != crc32c(0, entries.data(), h.payload_len)) {
+        return false;
+    }
+    blocks_.reserve(entries.size());
+    for (const rec_index_entry &e : entries) {
+        add_block(e);
+    }
+    finished_ = true;
+    scan_end_ = t.blocks_end;
+    return true;
+}
+
+size_t rec_reader::refresh()
+{
+    if (fd_ < 0 || finished_) {
+        return 0;
+    }
+    uint64_t size = file_size(fd_);
+    size_t found = 0;
+    rec_block_header h;
+    while (read_header_at(scan_end_, &h, size)) {
+        if (h.type == REC_BLOCK_INDEX) {
+            // Written by close(): a trailer follows and the file is complete
+            scan_end_ += sizeof(h) + h.payload_len;
+            finished_ = true;
+            break;
+        }
+        add_block({ scan_end_, h.frame0, h.t0_ns, h.t1_ns, h.frames, h.type, h.codec, h.flags });
+        scan_end_ += sizeof(h) + h.payload_len;
+        found++;
+    }
+    return found;
+}
+
+size_t rec_reader::find_time(int64_t t_ns) const
+{
+    auto it = std::lower_bound(data_.begin(), data_.end(), t_ns,
+                               [this](uint32_t b, int64_t t) { return blocks_[b].t1_ns < t; });
+    return (size_t)(it - data_.begin());
+}
+
+bool rec_reader::read_block(size_t i, rec_block_header *h, std::vector<uint8_t> *payload, bool verify) const
+{
+    if (fd_ < 0 || i >= blocks_.size()) {
+        return false;
+    }
+    const rec_index_entry &e = blocks_[i];
+    if (!read_at(fd_, h, sizeof(*h), e.offset) || h->magic != REC_BLOCK_MAGIC ||
+        h->header_crc != crc32c(0, h, offsetof(rec_block_header, header_crc))) {
+        return false;
+    }
+    if (payload) {
+        payload->resize(h->payload_len);
+        if (!read_at(fd_, payload->data(), h->payload_len, e.offset + sizeof(*h))) {
+            return false;
+        }
+        if (verify && h->payload_crc != crc32c(0, payload->data(), h->payload_len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool rec_reader::read_frames(size_t i, rec_block_header *h, std::vector<uint8_t> *frames, bool verify) const
+{
+    if (i >= blocks_.size() || blocks_[i].type != REC_BLOCK_DATA) {
+        return false;
+    }
+    if (blocks_[i].codec == REC_CODEC_NONE) {
+        return read_block(i, h, frames, verify) && h->codec == REC_CODEC_NONE &&
+               h->payload_len == (uint64_t)h->frames * rec_frame_bytes(hdr_.sample_format, hdr_.channels);
+    }
+    thread_local std::vector<uint8_t> stored;
+    if (!read_block(i, h, &stored, verify)) {
+        return false;
+    }
+    frames->resize((size_t)h->frames * rec_frame_bytes(hdr_.sample_format, hdr_.channels));
+    return rec_decode(h->codec, hdr_.sample_format, hdr_.channels, stored.data(), stored.size(), h->frames,
+                      frames->data());
+}
+
+std::vector<rec_event> rec_reader::events() const
+{
+    std::vector<rec_event> out;
+    rec_block_header h;
+    std::vector<uint8_t> payload;
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        if (blocks_[i].type != REC_BLOCK_EVENT || !read_block(i, &h, &payload)) {
+            continue;
+        }
+        size_t n = payload.size() / sizeof(rec_event);
+        size_t at = out.size();
+        out.resize(at + n);
+        memcpy(out.data() + at, payload.data(), n * sizeof(rec_event));
+    }
+    return out;
+}
+
+} // namespace emg
@@ -0,0 +1,86 @@
+/*
+ * Reader for the recording container (recording.h).
+ *
+ * A cleanly closed file is opened from its trailer and index block. A file
+ * that is still being written, or whose writer died, has no trailer; its
+ * blocks are found by walking the block headers from the start, stopping
+ * at the first one that is incomplete or fails its CRC. refresh() continues
+ * the walk from there, so a live file can be followed as it grows.
+ *
+ * Data blocks are kept in time order, which makes a seek by host time a
+ * binary search over them.
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "recording.h"
+
+namespace emg {
+
+class rec_reader {
+public:
+    rec_reader() = default;
+    ~rec_reader();
+
+    rec_reader(const rec_reader &) = delete;
+    rec_reader &operator=(const rec_reader &) = delete;
+
+    /** Open a recording; on failure err (if given) says why. */
+    bool open(const std::string &path, std::string *err = nullptr);
+    void close();
+
+    const rec_file_header &header() const { return hdr_; }
+
+    /** True if the file ends in a valid trailer (the writer closed it). */
+    bool finished() const { return finished_; }
+
+    /** Every data and event block found so far, in file order. */
+    const std::vector<rec_index_entry> &blocks() const { return blocks_; }
+
+    /** Positions in blocks() of the data blocks. */
+    const std::vector<uint32_t> &data_blocks() const { return data_; }
+
+    /** Pick up blocks appended since open() or the last refresh(); returns how many. */
+    size_t refresh();
+
+    /**
+     * Data block holding host time t_ns, or the first one after it: an index
+     * into data_blocks(), or data_blocks().size() if t_ns is past the end.
+     */
+    size_t find_time(int64_t t_ns) const;
+
+    /**
+     * Read block i of blocks(): header and stored payload. With verify the
+     * payload CRC is checked. Returns false on I/O or CRC error.
+     */
+    bool read_block(size_t i, rec_block_header *h, std::vector<uint8_t> *payload, bool verify = true) const;
+
+    /**
+     * Read data block i of blocks() and decode its payload (rec_codec.h) into
+     * h->frames frames. Returns false on I/O or CRC error, if block i is not
+     * a data block or if it does not decode.
+     */
+    bool read_frames(size_t i, rec_block_header *h, std::vector<uint8_t> *frames, bool verify = true) const;
+
+    /** All events, in file order. */
+    std::vector<rec_event> events() const;
+
+    /** Total frames in data blocks. */
+    uint64_t frames() const { return frames_; }
+
+private:
+    bool load_index();
+    bool read_header_at(uint64_t off, rec_block_header *h, uint64_t file_size) const;
+    void add_block(const rec_index_entry &e);
+
+    int fd_ = -1;
+    rec_file_header hdr_ = {};
+    bool finished_ = false;
+    uint64_t scan_end_ = 0;         // offset of the first block not yet seen
+    uint64_t frames_ = 0;
+    std::vector<rec_index_entry> blocks_;
+    std::vector<uint32_t> data_;
+};
+
+} // namespace emg
@@ -0,0 +1,406 @@
+/*
+ * Random access to recorded samples, see rec_session.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "deinterleave.h"
+#include "emg_proto.h"
+#include "rec_codec.h"
+#include "rec_manifest.h"
+#include "rec_session.h"
+
+namespace emg {
+
+// Payload CRC state of a data block
+constexpr uint8_t UNCHECKED = 0, GOOD = 1, BAD = 2;
+
+rec_session::~rec_session()
+{
+    close();
+}
+
+rec_session::part::~part()
+{
+    unmap();
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void rec_session::part::unmap()
+{
+    if (map) {
+        munmap((void *)map, map_len);
+        map = nullptr;
+        map_len = 0;
+    }
+}
+
+/* Map the whole file as it is now, which covers every block the reader has found */
+bool rec_session::part::map_file()
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    if (map && len == map_len) {
+        return true;
+    }
+    void *p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    unmap();
+    map = (const uint8_t *)p;
+    map_len = len;
+    return true;
+}
+
+void rec_session::close()
+{
+    parts_.clear();
+    blocks_.clear();
+    manifest_.clear();
+    manifest_finished_ = false;
+    first_.assign(1, 0);
+    checked_.reset();
+    checked_len_ = 0;
+}
+
+const rec_file_header &rec_session::header() const
+{
+    static const rec_file_header none = {};
+    return parts_.empty() ? none : parts_[0]->rd.header();
+}
+
+bool rec_session::finished() const
+{
+    bool all = !parts_.empty() && (manifest_.empty() || manifest_finished_);
+    for (const std::unique_ptr<part> &p : parts_) {
+        all = all && p->rd.finished();
+    }
+    return all;
+}
+
+bool rec_session::open_part(const std::string &path, std::string *err)
+{
+    std::unique_ptr<part> p(new part());
+    if (!p->rd.open(path, err)) {
+        if (err) *err = path + ": " + *err;
+        return false;
+    }
+    p->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (p->fd < 0 || !p->map_file()) {
+        if (err) *err = path + ": " + strerror(errno);
+        return false;
+    }
+    if (!parts_.empty() && (p->rd.header().channels != header().channels ||
+                            p->rd.header().sample_format != header().sample_format)) {
+        if (err) *err = path + ": channels or sample format differ from the first segment";
+        return false;
+    }
+    parts_.push_back(std::move(p));
+    return true;
+}
+
+static bool ends_with(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool rec_session::open(const std::string &path, bool verify, std::string *err)
+{
+    close();
+    if (ends_with(path, ".emgm")) {
+        rec_manifest m;
+        if (!rec_manifest_read(path, &m, err)) {
+            return false;
+        }
+        if (m.segments.empty()) {
+            if (err) *err = "no segments yet";
+            return false;
+        }
+        manifest_ = path;
+        manifest_finished_ = m.finished;
+        for (const rec_segment &seg : m.segments) {
+            if (!open_part(rec_segment_path(path, seg), err)) {
+                close();
+                return false;
+            }
+            parts_.back()->closed = seg.closed;
+        }
+    } else if (!open_part(path, err)) {
+        return false;
+    }
+    verify_ = verify;
+    frame_bytes_ = rec_frame_bytes(header().sample_format, header().channels);
+    refresh();
+    return true;
+}
+
+size_t rec_session::refresh()
+{
+    if (parts_.empty()) {
+        return 0;
+    }
+    // New segments, and those closed since
+    if (!manifest_.empty()) {
+        rec_manifest m;
+        if (rec_manifest_read(manifest_, &m)) {
+            manifest_finished_ = m.finished;
+            for (size_t i = 0; i < m.segments.size(); i++) {
+                if (i >= parts_.size() && !open_part(rec_segment_path(manifest_, m.segments[i]), nullptr)) {
+                    break;
+                }
+                parts_[i]->closed = m.segments[i].closed;
+            }
+        }
+    }
+
+    // Blocks go in recording order: those of a segment only once every
+    // segment before it is complete, as its writer may still be finishing it
+    // while the next one begins
+    size_t found = 0;
+    for (size_t i = 0; i < parts_.size(); i++) {
+        part &p = *parts_[i];
+        if (!p.rd.finished() && p.rd.refresh() && !p.map_file()) {
+            // Keep what was mapped before; the new blocks show up on a later refresh
+            break;
+        }
+        const std::vector<uint32_t> &data = p.rd.data_blocks();
+        for (; p.added < data.size(); p.added++) {
+            blocks_.push_back({ (uint32_t)i, (uint32_t)p.added });
+            first_.push_back(first_.back() + entry(blocks_.size() - 1).frames);
+            found++;
+        }
+        if (!p.rd.finished() && !p.closed) {
+            break;
+        }
+    }
+    if (blocks_.size() > checked_len_) {
+        std::unique_ptr<std::atomic<uint8_t>[]> c(new std::atomic<uint8_t>[blocks_.size()]);
+        for (size_t d = 0; d < blocks_.size(); d++) {
+            c[d].store(d < checked_len_ ? checked_[d].load(std::memory_order_relaxed) : UNCHECKED,
+                       std::memory_order_relaxed);
+        }
+        checked_ = std::move(c);
+        checked_len_ = blocks_.size();
+    }
+    return found;
+}
+
+int64_t rec_session::start_ns() const
+{
+    return frames() ? entry(0).t0_ns : 0;
+}
+
+int64_t rec_session::end_ns() const
+{
+    return frames() ? entry(first_.size() - 2).t1_ns : 0;
+}
+
+/* Data block holding frame pos */
+size_t rec_session::block_of(uint64_t pos) const
+{
+    return (size_t)(std::upper_bound(first_.begin(), first_.end(), pos) - first_.begin()) - 1;
+}
+
+int64_t rec_session::time_in(size_t d, uint64_t i) const
+{
+    const rec_index_entry &e = entry(d);
+    return e.frames > 1 ? e.t0_ns + (e.t1_ns - e.t0_ns) * (int64_t)i / (int64_t)(e.frames - 1) : e.t0_ns;
+}
+
+int64_t rec_session::frame_time(uint64_t pos) const
+{
+    size_t d = block_of(pos);
+    return time_in(d, pos - first_[d]);
+}
+
+uint64_t rec_session::frame_at(int64_t t_ns) const
+{
+    // The first data block that does not end before t_ns
+    size_t lo = 0, hi = blocks_.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (entry(mid).t1_ns < t_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t d = lo;
+    if (d + 1 >= first_.size()) {
+        return frames();
+    }
+    // The block ends at or after t_ns: its first frame that does not start before it
+    uint64_t i = 0, n = entry(d).frames - 1;
+    while (i < n) {
+        uint64_t mid = (i + n) / 2;
+        if (time_in(d, mid) < t_ns) {
+            i = mid + 1;
+        } else {
+            n = mid;
+        }
+    }
+    return first_[d] + i;
+}
+
+/* Frames of data block d, sample-major in the recording's format. Those of
+ * an encoded block are decoded into a per-thread buffer, valid until the
+ * next call */
+const uint8_t *rec_session::samples(size_t d, std::string *err) const
+{
+    const rec_index_entry &e = entry(d);
+    const part &p = part_of(d);
+    const rec_block_header *h = (const rec_block_header *)(p.map + e.offset);
+    if (e.offset + sizeof(*h) > p.map_len || h->magic != REC_BLOCK_MAGIC ||
+        h->header_crc != crc32c(0, h, offsetof(rec_block_header, header_crc)) ||
+        e.offset + sizeof(*h) + h->payload_len > p.map_len) {
+        if (err) *err = "damaged block header at offset " + std::to_string(e.offset);
+        return nullptr;
+    }
+    const uint8_t *payload = p.map + e.offset + sizeof(*h);
+    if (verify_) {
+        uint8_t state = checked_[d].load(std::memory_order_relaxed);
+        if (state == UNCHECKED) {
+            state = crc32c(0, payload, h->payload_len) == h->payload_crc ? GOOD : BAD;
+            checked_[d].store(state, std::memory_order_relaxed);
+        }
+        if (state == BAD) {
+            if (err) *err = "payload CRC error in block at offset " + std::to_string(e.offset);
+            return nullptr;
+        }
+    }
+    if (h->codec != REC_CODEC_NONE) {
+        thread_local std::vector<uint8_t> decoded;
+        decoded.resize((size_t)h->frames * frame_bytes_);
+        if (!rec_decode(h->codec, header().sample_format, header().channels, payload, h->payload_len, h->frames,
+                        decoded.data())) {
+            if (err) *err = "block at offset " + std::to_string(e.offset) + ": does not decode (" +
+                            rec_codec_name(h->codec) + ")";
+            return nullptr;
+        }
+        return decoded.data();
+    }
+    if (h->payload_len != (uint64_t)h->frames * frame_bytes_) {
+        if (err) *err = "block at offset " + std::to_string(e.offset) + ": payload does not match its frames";
+        return nullptr;
+    }
+    return payload;
+}
+
+/* One channel of n frames, for a few channels out of many */
+static void gather(uint8_t sample_format, const uint8_t *frames, size_t n, size_t channels, size_t c, float *out,
+                   float scale)
+{
+    if (sample_format == REC_FMT_U8_OFFSET) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = ((float)frames[i * channels + c] - EMG_SAMPLE_ZERO) * scale;
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            int16_t s;
+            memcpy(&s, frames + 2 * (i * channels + c), sizeof(s));
+            out[i] = (float)s * scale;
+        }
+    }
+}
+
+bool rec_session::read(uint64_t first, size_t n, const uint16_t *channels, size_t nch, float *out,
+                       size_t out_stride, int64_t *t_ns, float scale, std::string *err) const
+{
+    const size_t all = header().channels;
+    bool in_order = channels == nullptr;
+    if (in_order) {
+        nch = all;
+    } else if (nch == all) {
+        in_order = true;
+        for (size_t k = 0; k < nch && in_order; k++) {
+            in_order = channels[k] == k;
+        }
+    }
+    for (size_t k = 0; !in_order && k < nch; k++) {
+        if (channels[k] >= all) {
+            if (err) *err = "no channel " + std::to_string(channels[k]);
+            return false;
+        }
+    }
+    if (first > frames() || n > frames() - first) {
+        if (err) *err = "frames past the end of the recording";
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+
+    // Ask for every page of the range at once instead of faulting them in one
+    // by one: one call per segment it spans
+    size_t d0 = block_of(first), d1 = block_of(first + n - 1);
+    static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    for (size_t d = d0; d <= d1;) {
+        const part &p = part_of(d);
+        size_t e = d;
+        while (e < d1 && blocks_[e + 1].p == blocks_[d].p) e++;
+        uintptr_t a = (uintptr_t)(p.map + entry(d).offset) & ~(page - 1);
+        bool next = e + 1 < blocks_.size() && blocks_[e + 1].p == blocks_[e].p;
+        uintptr_t b = (uintptr_t)(p.map + (next ? entry(e + 1).offset : p.map_len));
+        madvise((void *)a, b - a, MADV_WILLNEED);
+        d = e + 1;
+    }
+
+    // A few channels are picked out of each frame directly. Larger subsets are
+    // deinterleaved a piece at a time into a scratch area small enough to
+    // stay in cache, and their rows copied out from there
+    thread_local std::vector<float> scratch;
+    size_t piece = std::max<size_t>(64, (16384 / all) & ~(size_t)7);
+    bool pick = !in_order && nch * 4 <= all;
+    float *rows = nullptr;
+    if (!in_order && !pick) {
+        scratch.resize(all * piece + 8);
+        rows = scratch.data() + ((8 - ((uintptr_t)scratch.data() / sizeof(float)) % 8) % 8);
+    }
+
+    size_t done = 0;
+    for (size_t d = d0; d <= d1; d++) {
+        const uint8_t *p = samples(d, err);
+        if (!p) {
+            return false;
+        }
+        uint64_t i0 = std::max(first, first_[d]) - first_[d];
+        uint64_t i1 = std::min(first + n, first_[d + 1]) - first_[d];
+        const uint8_t *src = p + i0 * frame_bytes_;
+        size_t m = (size_t)(i1 - i0);
+        if (in_order) {
+            deinterleave(header().sample_format, src, m, all, out + done, out_stride, scale);
+        } else if (pick) {
+            for (size_t k = 0; k < nch; k++) {
+                gather(header().sample_format, src, m, all, channels[k], out + k * out_stride + done, scale);
+            }
+        } else {
+            for (size_t j = 0; j < m; j += piece) {
+                size_t cnt = std::min(piece, m - j);
+                deinterleave(header().sample_format, src + j * frame_bytes_, cnt, all, rows, piece, scale);
+                for (size_t k = 0; k < nch; k++) {
+                    memcpy(out + k * out_stride + done + j, rows + channels[k] * piece, cnt * sizeof(float));
+                }
+            }
+        }
+        if (t_ns) {
+            for (uint64_t i = i0; i < i1; i++) {
+                t_ns[done + (i - i0)] = time_in(d, i);
+            }
+        }
+        done += m;
+    }
+    return true;
+}
+
+} // namespace emg
@@ -0,0 +1,141 @@
+/*
+ * Random access to the samples of a recording (.emgr), for offline
+ * analysis: "channels 12-20 from 300 s to 310 s" as channel-major float
+ * arrays, without reading the file from the start.
+ *
+ * A segmented session is opened through its manifest (.emgm, see
+ * rec_manifest.h) and reads as one recording: its segments' data blocks
+ * follow one another in segment order. Segments still open are read under
+ * their .part name, and refresh() picks up new segments as well as new
+ * blocks. The segments must agree on channels and sample format.
+ *
+ * The block list comes from rec_reader (the index of a closed file, or a
+ * scan of one still being written); every file is mapped read-only.
+ * Frames are numbered 0 .. frames() - 1 in recording order across all data
+ * blocks, gaps or not. A time is turned into a frame number by a binary
+ * search over the blocks' host time ranges and then over the frames of one
+ * block, whose times are interpolated between its first and last frame.
+ * A read touches only the blocks it overlaps: their pages are asked for in
+ * one go (MADV_WILLNEED), and each block's samples go through the
+ * deinterleave kernels (deinterleave.h) straight from the mapping. Blocks
+ * stored with a codec are decoded when, and only when, a read needs them.
+ *
+ * read() and the lookups may run on several threads at once; open(),
+ * refresh() and close() must not run alongside them.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rec_reader.h"
+
+namespace emg {
+
+class rec_session {
+public:
+    rec_session() = default;
+    ~rec_session();
+
+    rec_session(const rec_session &) = delete;
+    rec_session &operator=(const rec_session &) = delete;
+
+    /**
+     * Open and map a recording, or every segment of a session given its
+     * manifest (a path ending in .emgm). With verify, the payload CRC of
+     * every data block is checked the first time a read touches it.
+     */
+    bool open(const std::string &path, bool verify = false, std::string *err = nullptr);
+    void close();
+
+    /** Pick up blocks appended to a live recording, and new segments, and map them; returns how many blocks. */
+    size_t refresh();
+
+    /** Header of the (first) recording. */
+    const rec_file_header &header() const;
+
+    /** Reader of segment seg (0 for a plain recording). */
+    const rec_reader &reader(size_t seg = 0) const { return parts_[seg]->rd; }
+
+    /** Recordings: 1, or the segments found so far. */
+    size_t segments() const { return parts_.size(); }
+
+    /** Data blocks in all segments. */
+    size_t data_blocks() const { return blocks_.size(); }
+
+    /** True once the recording is closed, or every segment of a finished session. */
+    bool finished() const;
+
+    uint16_t channels() const { return header().channels; }
+
+    /** Frames in data blocks, numbered from 0 in recording order. */
+    uint64_t frames() const { return first_.back(); }
+
+    /** Host time of the first and of the last frame (0 if there are none). */
+    int64_t start_ns() const;
+    int64_t end_ns() const;
+
+    /** Number of the first frame at or after host time t_ns (frames() if none). */
+    uint64_t frame_at(int64_t t_ns) const;
+
+    /** Host time of frame pos (< frames()). */
+    int64_t frame_time(uint64_t pos) const;
+
+    /**
+     * Frames [first, first + n) of channels[0 .. nch - 1] (any order,
+     * repeats allowed; nullptr for all channels in order), as
+     *
+     *   out[k * out_stride + i] = (sample(first + i, channels[k]) - zero) * scale
+     *
+     * with zero as in deinterleave.h. With t_ns, the host time of every frame
+     * goes there too. False (err says why) if the range is past the end, a
+     * channel does not exist, or a block cannot be read, decoded or fails
+     * its CRC; out is then partly written.
+     */
+    bool read(uint64_t first, size_t n, const uint16_t *channels, size_t nch, float *out, size_t out_stride,
+              int64_t *t_ns = nullptr, float scale = 1.0f, std::string *err = nullptr) const;
+
+private:
+    // One recording file: the only one, or a segment
+    struct part {
+        rec_reader rd;
+        int fd = -1;
+        const uint8_t *map = nullptr;
+        size_t map_len = 0;
+        size_t added = 0;           // data blocks of rd in blocks_
+        bool closed = false;        // listed as closed in the manifest
+        ~part();
+        bool map_file();
+        void unmap();
+    };
+    // Data block d of part p
+    struct block_ref {
+        uint32_t p;
+        uint32_t d;
+    };
+
+    bool open_part(const std::string &path, std::string *err);
+    size_t block_of(uint64_t pos) const;
+    const part &part_of(size_t d) const { return *parts_[blocks_[d].p]; }
+    const rec_index_entry &entry(size_t d) const
+    {
+        const rec_reader &rd = part_of(d).rd;
+        return rd.blocks()[rd.data_blocks()[blocks_[d].d]];
+    }
+    int64_t time_in(size_t d, uint64_t i) const;
+    const uint8_t *samples(size_t d, std::string *err) const;
+
+    std::string manifest_;                  // set for a segmented session
+    bool manifest_finished_ = false;
+    std::vector<std::unique_ptr<part>> parts_;
+    std::vector<block_ref> blocks_;         // data blocks of every part, in recording order
+    bool verify_ = false;
+    uint32_t frame_bytes_ = 0;
+    std::vector<uint64_t> first_ = { 0 };   // frame number of each data block's first frame, and the total
+    std::unique_ptr<std::atomic<uint8_t>[]> checked_;   // per data block: 0 unchecked, 1 good, 2 bad
+    size_t checked_len_ = 0;
+};
+
+} // namespace emg
@@ -0,0 +1,495 @@
+/*
+ * Summary pyramid side files, see rec_summary.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "emg_proto.h"
+#include "rec_reader.h"
+#include "rec_summary.h"
+
+namespace emg {
+
+static const size_t WRITE_BATCH = 16384;   // bytes of entries held back per level
+
+std::string rec_summary_path(const std::string &rec_path, int shift)
+{
+    return rec_path + ".sum" + std::to_string(shift);
+}
+
+/* write() everything */
+static bool write_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = write(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += r;
+        len -= (size_t)r;
+    }
+    return true;
+}
+
+/* pread() exactly len bytes */
+static bool read_at(int fd, void *buf, size_t len, uint64_t off)
+{
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        len -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return true;
+}
+
+rec_summary_writer::~rec_summary_writer()
+{
+    close();
+}
+
+void rec_summary_writer::reset(acc *a) const
+{
+    for (uint16_t c = 0; c < channels_; c++) {
+        a[c] = { INT32_MAX, INT32_MIN, 0, 0 };
+    }
+}
+
+bool rec_summary_writer::open(const std::string &rec_path, const rec_file_header &hdr)
+{
+    if (open_ || rec_frame_bytes(hdr.sample_format, hdr.channels) == 0) {
+        return false;
+    }
+    channels_ = hdr.channels;
+    format_ = hdr.sample_format;
+    zero_ = hdr.sample_format == REC_FMT_U8_OFFSET ? EMG_SAMPLE_ZERO : 0;
+    entry_size_ = sizeof(rec_summary_entry) + (size_t)channels_ * sizeof(rec_summary_value);
+    path_ = rec_path;
+    failed_ = false;
+    last_t_ns_ = 0;
+
+    hdr_ = {};
+    memcpy(hdr_.magic, REC_SUMMARY_MAGIC, sizeof(hdr_.magic));
+    hdr_.version = REC_SUMMARY_VERSION;
+    hdr_.header_size = sizeof(rec_summary_header);
+    // u8 samples are within +-128 of the zero: 8 fraction bits still fit 16 bits
+    hdr_.frac_bits = hdr.sample_format == REC_FMT_U8_OFFSET ? 8 : 0;
+    hdr_.channels = channels_;
+    hdr_.rec_header_crc = hdr.header_crc;
+    hdr_.rec_created_ns = hdr.created_ns;
+
+    for (int k = 0; k < REC_SUMMARY_LEVELS; k++) {
+        level &l = levels_[k];
+        l.shift = REC_SUMMARY_BASE_SHIFT + k * REC_SUMMARY_LEVEL_STEP;
+        l.frames = 0;
+        l.entries = 0;
+        l.a.resize(channels_);
+        reset(l.a.data());
+        l.out.clear();
+        l.out.reserve(WRITE_BATCH + entry_size_);
+
+        std::string path = rec_summary_path(rec_path, l.shift);
+        l.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        rec_summary_header h = hdr_;
+        h.shift = (uint8_t)l.shift;
+        h.header_crc = crc32c(0, &h, offsetof(rec_summary_header, header_crc));
+        if (l.fd < 0 || !write_all(l.fd, (const uint8_t *)&h, sizeof(h))) {
+            fprintf(stderr, "rec_summary: cannot create %s: %s\n", path.c_str(), strerror(errno));
+            for (int j = 0; j <= k; j++) {
+                if (levels_[j].fd >= 0) ::close(levels_[j].fd);
+                levels_[j].fd = -1;
+            }
+            return false;
+        }
+    }
+    open_ = true;
+    return true;
+}
+
+/* Append one entry to the level's output, from exact sums */
+void rec_summary_writer::add_entry(level &l, const acc *a, uint64_t frames, int64_t t0_ns, int64_t t1_ns)
+{
+    size_t at = l.out.size();
+    l.out.resize(at + entry_size_);
+    rec_summary_entry e = { t0_ns, t1_ns };
+    memcpy(l.out.data() + at, &e, sizeof(e));
+
+    double scale = (double)(1 << hdr_.frac_bits);
+    auto fix = [&](double v, double lo, double hi) { return std::min(std::max(std::lround(v * scale), (long)lo), (long)hi); };
+    rec_summary_value *v = (rec_summary_value *)(l.out.data() + at + sizeof(e));
+    for (uint16_t c = 0; c < channels_; c++) {
+        rec_summary_value s;
+        s.min = (int16_t)fix(a[c].min, INT16_MIN, INT16_MAX);
+        s.max = (int16_t)fix(a[c].max, INT16_MIN, INT16_MAX);
+        s.mean = (int16_t)fix((double)a[c].sum / (double)frames, INT16_MIN, INT16_MAX);
+        s.rms = (uint16_t)fix(std::sqrt((double)a[c].sumsq / (double)frames), 0, UINT16_MAX);
+        memcpy(&v[c], &s, sizeof(s));
+    }
+    l.entries++;
+    if (l.out.size() >= WRITE_BATCH) {
+        write_out(l);
+    }
+}
+
+/* The entry of level 0 is done: store it and fold it into every level above */
+void rec_summary_writer::emit(level &base)
+{
+    add_entry(base, base.a.data(), base.frames, base.t0_ns, base.t1_ns);
+    for (int k = 1; k < REC_SUMMARY_LEVELS; k++) {
+        level &l = levels_[k];
+        if (l.frames == 0) {
+            l.t0_ns = base.t0_ns;
+        }
+        for (uint16_t c = 0; c < channels_; c++) {
+            acc &d = l.a[c];
+            const acc &s = base.a[c];
+            d.min = std::min(d.min, s.min);
+            d.max = std::max(d.max, s.max);
+            d.sum += s.sum;
+            d.sumsq += s.sumsq;
+        }
+        l.frames += base.frames;
+        l.t1_ns = base.t1_ns;
+        if (l.frames == (1ull << l.shift)) {
+            add_entry(l, l.a.data(), l.frames, l.t0_ns, l.t1_ns);
+            l.frames = 0;
+            reset(l.a.data());
+        }
+    }
+    base.frames = 0;
+    reset(base.a.data());
+}
+
+void rec_summary_writer::append(const uint8_t *frames, uint32_t n, int64_t t_first_ns, int64_t t_last_ns)
+{
+    if (!open_ || failed_) {
+        return;
+    }
+    level &base = levels_[0];
+    const uint64_t full = 1ull << base.shift;
+    size_t frame_bytes = rec_frame_bytes(format_, channels_);
+    for (uint32_t i = 0; i < n; i++) {
+        int64_t t = n > 1 ? t_first_ns + (t_last_ns - t_first_ns) * (int64_t)i / (int64_t)(n - 1) : t_first_ns;
+        t = std::max(t, last_t_ns_);
+        last_t_ns_ = t;
+        if (base.frames == 0) {
+            base.t0_ns = t;
+        }
+        base.t1_ns = t;
+
+        const uint8_t *f = frames + (size_t)i * frame_bytes;
+        acc *a = base.a.data();
+        for (uint16_t c = 0; c < channels_; c++) {
+            int32_t v;
+            if (format_ == REC_FMT_U8_OFFSET) {
+                v = (int32_t)f[c] - zero_;
+            } else {
+                int16_t s;
+                memcpy(&s, f + 2 * c, sizeof(s));
+                v = s;
+            }
+            a[c].min = std::min(a[c].min, v);
+            a[c].max = std::max(a[c].max, v);
+            a[c].sum += v;
+            a[c].sumsq += (uint64_t)((int64_t)v * v);
+        }
+        if (++base.frames == full) {
+            emit(base);
+        }
+    }
+}
+
+bool rec_summary_writer::write_out(level &l)
+{
+    if (l.out.empty() || failed_) {
+        l.out.clear();
+        return !failed_;
+    }
+    if (!write_all(l.fd, l.out.data(), l.out.size())) {
+        // Derived data: give up on it, the recording goes on
+        fprintf(stderr, "rec_summary: write to %s failed: %s\n", rec_summary_path(path_, l.shift).c_str(),
+                strerror(errno));
+        failed_ = true;
+    }
+    l.out.clear();
+    return !failed_;
+}
+
+bool rec_summary_writer::flush()
+{
+    if (!open_) {
+        return true;
+    }
+    bool ok = true;
+    for (level &l : levels_) {
+        ok = write_out(l) && ok;
+    }
+    return ok;
+}
+
+bool rec_summary_writer::close()
+{
+    if (!open_) {
+        return true;
+    }
+    // The partial entries: the base one first, as it feeds the others
+    level &base = levels_[0];
+    uint64_t last_frames[REC_SUMMARY_LEVELS] = {};
+    if (!failed_ && base.frames > 0) {
+        last_frames[0] = base.frames;
+        emit(base);
+    }
+    for (int k = 1; k < REC_SUMMARY_LEVELS && !failed_; k++) {
+        level &l = levels_[k];
+        if (l.frames > 0) {
+            last_frames[k] = l.frames;
+            add_entry(l, l.a.data(), l.frames, l.t0_ns, l.t1_ns);
+            l.frames = 0;
+        }
+    }
+    bool ok = flush();
+
+    for (int k = 0; k < REC_SUMMARY_LEVELS; k++) {
+        level &l = levels_[k];
+        if (ok) {
+            rec_summary_header h = hdr_;
+            h.shift = (uint8_t)l.shift;
+            h.entries = l.entries;
+            h.last_frames = (uint32_t)(last_frames[k] ? last_frames[k] : (l.entries ? 1ull << l.shift : 0));
+            h.header_crc = crc32c(0, &h, offsetof(rec_summary_header, header_crc));
+            ok = pwrite(l.fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+        }
+        if (::close(l.fd) != 0) {
+            ok = false;
+        }
+        l.fd = -1;
+        l.out.clear();
+        l.out.shrink_to_fit();
+    }
+    open_ = false;
+    return ok;
+}
+
+bool rec_summary_build(const rec_reader &rd, const std::string &rec_path)
+{
+    rec_summary_writer sw;
+    if (!sw.open(rec_path, rd.header())) {
+        return false;
+    }
+    rec_block_header bh;
+    std::vector<uint8_t> frames;
+    bool ok = true;
+    for (uint32_t b : rd.data_blocks()) {
+        if (!rd.read_frames(b, &bh, &frames, true)) {
+            fprintf(stderr, "%s: block %u: read, CRC or decode error, left out of the summary\n", rec_path.c_str(),
+                    b);
+            ok = false;
+            continue;
+        }
+        sw.append(frames.data(), bh.frames, bh.t0_ns, bh.t1_ns);
+    }
+    return sw.close() && ok;
+}
+
+rec_summary_reader::~rec_summary_reader()
+{
+    close();
+}
+
+void rec_summary_reader::close()
+{
+    for (level &l : levels_) {
+        ::close(l.fd);
+    }
+    levels_.clear();
+}
+
+bool rec_summary_reader::open(const std::string &rec_path, const rec_file_header &rec, std::string *err)
+{
+    close();
+    frame_rate_hz_ = rec.frame_rate_hz;
+    channels_ = rec.channels;
+    entry_size_ = sizeof(rec_summary_entry) + (size_t)channels_ * sizeof(rec_summary_value);
+    bool stale = false;
+    for (int k = 0; k < REC_SUMMARY_LEVELS; k++) {
+        level l;
+        l.shift = REC_SUMMARY_BASE_SHIFT + k * REC_SUMMARY_LEVEL_STEP;
+        l.fd = ::open(rec_summary_path(rec_path, l.shift).c_str(), O_RDONLY | O_CLOEXEC);
+        if (l.fd < 0) {
+            continue;
+        }
+        const rec_summary_header &h = l.hdr;
+        bool ok = read_at(l.fd, &l.hdr, sizeof(l.hdr), 0) &&
+                  memcmp(h.magic, REC_SUMMARY_MAGIC, sizeof(h.magic)) == 0 && h.version == REC_SUMMARY_VERSION &&
+                  h.header_size >= sizeof(h) && h.header_crc == crc32c(0, &h, offsetof(rec_summary_header, header_crc)) &&
+                  h.shift == l.shift && h.channels == channels_ && h.frac_bits < 16;
+        if (ok && (h.rec_header_crc != rec.header_crc || h.rec_created_ns != rec.created_ns)) {
+            // Left over from another recording of the same name
+            stale = true;
+            ok = false;
+        }
+        if (!ok) {
+            ::close(l.fd);
+            continue;
+        }
+        levels_.push_back(l);
+    }
+    if (levels_.empty()) {
+        if (err) *err = stale ? "summary belongs to another recording" : "no summary";
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> rec_summary_reader::levels() const
+{
+    std::vector<int> out;
+    for (const level &l : levels_) {
+        out.push_back(l.shift);
+    }
+    return out;
+}
+
+uint64_t rec_summary_reader::count(const level &l) const
+{
+    if (l.hdr.entries) {
+        return l.hdr.entries;
+    }
+    // Still being written: the complete entries so far
+    struct stat st;
+    if (fstat(l.fd, &st) != 0 || (uint64_t)st.st_size < l.hdr.header_size) {
+        return 0;
+    }
+    return ((uint64_t)st.st_size - l.hdr.header_size) / entry_size_;
+}
+
+int64_t rec_summary_reader::entries(int shift) const
+{
+    for (const level &l : levels_) {
+        if (l.shift == shift) {
+            return (int64_t)count(l);
+        }
+    }
+    return -1;
+}
+
+bool rec_summary_reader::entry_time(const level &l, uint64_t i, rec_summary_entry *e) const
+{
+    return read_at(l.fd, e, sizeof(*e), l.hdr.header_size + i * entry_size_);
+}
+
+/* First of the n entries whose midpoint is at or after t_ns; midpoints never go backwards */
+uint64_t rec_summary_reader::first_mid_at_or_after(const level &l, uint64_t n, int64_t t_ns) const
+{
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        rec_summary_entry e;
+        if (!entry_time(l, mid, &e)) {
+            return n;
+        }
+        if (e.t0_ns + (e.t1_ns - e.t0_ns) / 2 < t_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool rec_summary_reader::query(int64_t t0_ns, int64_t t1_ns, size_t columns, summary_view *out) const
+{
+    out->columns = 0;
+    out->channels = channels_;
+    out->shift = -1;
+    out->entries_read = 0;
+    if (levels_.empty() || columns == 0 || t1_ns <= t0_ns) {
+        return true;
+    }
+
+    // The coarsest level with at least one entry per column: at most four
+    const level *use = &levels_.front();
+    double column_ns = (double)(t1_ns - t0_ns) / (double)columns;
+    for (const level &l : levels_) {
+        if ((double)(1ull << l.shift) * 1e9 / (double)frame_rate_hz_ <= column_ns) {
+            use = &l;
+        }
+    }
+    uint64_t n = count(*use);
+    uint64_t a = first_mid_at_or_after(*use, n, t0_ns);
+    uint64_t b = first_mid_at_or_after(*use, n, t1_ns);
+    std::vector<uint8_t> &buf = out->entry_buf;
+    buf.resize((size_t)(b - a) * entry_size_);
+    if (b > a && !read_at(use->fd, buf.data(), buf.size(), use->hdr.header_size + a * entry_size_)) {
+        return false;
+    }
+
+    out->columns = columns;
+    out->shift = use->shift;
+    out->entries_read = (size_t)(b - a);
+    out->t0_ns.assign(columns, 0);
+    out->t1_ns.assign(columns, 0);
+    out->frames.assign(columns, 0);
+    out->values.assign(columns * channels_, summary_value{ 0.0f, 0.0f, 0.0f, 0.0f });
+    // Weighted sums of means and of mean squares, per column and channel
+    std::vector<double> &sums = out->sums;
+    sums.assign(2 * columns * channels_, 0.0);
+
+    float scale = 1.0f / (float)(1 << use->hdr.frac_bits);
+    for (uint64_t i = a; i < b; i++) {
+        const uint8_t *p = buf.data() + (size_t)(i - a) * entry_size_;
+        rec_summary_entry e;
+        memcpy(&e, p, sizeof(e));
+        uint64_t frames = 1ull << use->shift;
+        if (i == n - 1 && use->hdr.entries && use->hdr.last_frames) {
+            frames = use->hdr.last_frames;
+        }
+        int64_t mid = e.t0_ns + (e.t1_ns - e.t0_ns) / 2;
+        size_t col = (size_t)std::min<double>((double)(mid - t0_ns) / column_ns, (double)(columns - 1));
+        if (out->frames[col] == 0) {
+            out->t0_ns[col] = e.t0_ns;
+        }
+        out->t1_ns[col] = e.t1_ns;
+        bool first = out->frames[col] == 0;
+        out->frames[col] += frames;
+
+        const rec_summary_value *v = (const rec_summary_value *)(p + sizeof(e));
+        for (uint16_t c = 0; c < channels_; c++) {
+            rec_summary_value s;
+            memcpy(&s, &v[c], sizeof(s));
+            summary_value &o = out->values[col * channels_ + c];
+            float mn = s.min * scale, mx = s.max * scale;
+            o.min = first ? mn : std::min(o.min, mn);
+            o.max = first ? mx : std::max(o.max, mx);
+            double rms = s.rms * (double)scale;
+            double *acc = &sums[2 * (col * channels_ + c)];
+            acc[0] += (double)s.mean * scale * (double)frames;
+            acc[1] += rms * rms * (double)frames;
+        }
+    }
+    for (size_t col = 0; col < columns; col++) {
+        if (out->frames[col] == 0) {
+            continue;
+        }
+        double f = (double)out->frames[col];
+        for (uint16_t c = 0; c < channels_; c++) {
+            summary_value &o = out->values[col * channels_ + c];
+            const double *acc = &sums[2 * (col * channels_ + c)];
+            o.mean = (float)(acc[0] / f);
+            o.rms = (float)std::sqrt(acc[1] / f);
+        }
+    }
+    return true;
+}
+
+} // namespace emg
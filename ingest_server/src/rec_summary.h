@@ -0,0 +1,216 @@
+/*
+ * Summary pyramid of a recording, for zooming through long sessions
+ * without reading their samples.
+ *
+ * Next to rec.emgr the recorder writes one side file per level,
+ * rec.emgr.sum6, rec.emgr.sum8, ... rec.emgr.sum24: level `shift` holds one
+ * entry per 2^shift frames of the recording (in the order they were
+ * recorded, gaps or not) with the host time of its first and last frame and
+ * the min, max, mean and RMS of every channel. Levels are 4x apart, so for
+ * any range and any number of columns there is a level with between one
+ * and four entries per column; a query reads only those, O(columns) bytes
+ * whatever the length of the recording. Columns narrower than 64 frames
+ * come out partly empty: read the samples from the recording there.
+ *
+ * Side file layout:
+ *
+ *   header     64 bytes: rec_summary_header
+ *   entry*     rec_summary_entry (16 bytes) + channels * rec_summary_value
+ *
+ * Entries are appended as they complete; while a recording is being
+ * written the complete entries are what the file size holds. close()
+ * appends the last, partial entry and records the entry count in the
+ * header. Values are relative to the sample zero (128 for REC_FMT_U8_OFFSET)
+ * and fixed point with frac_bits fraction bits; each is rounded once from
+ * exact sums, at every level.
+ *
+ * The summary is derived data: emg_recinfo -S rebuilds it from the
+ * recording. All fields are little-endian.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "recording.h"
+
+namespace emg {
+
+constexpr char     REC_SUMMARY_MAGIC[8] = { 'E', 'M', 'G', 'S', 'U', 'M', '\r', '\n' };
+constexpr uint32_t REC_SUMMARY_VERSION = 1;
+constexpr int      REC_SUMMARY_BASE_SHIFT = 6;   // 64 frames per entry at the finest level
+constexpr int      REC_SUMMARY_LEVEL_STEP = 2;   // 4x between levels
+constexpr int      REC_SUMMARY_LEVELS = 10;      // up to 2^24 frames per entry
+
+struct __attribute__((packed)) rec_summary_header {
+    char     magic[8];          // REC_SUMMARY_MAGIC
+    uint32_t version;           // REC_SUMMARY_VERSION
+    uint32_t header_size;       // entries start here
+    uint8_t  shift;             // 2^shift frames per entry
+    uint8_t  frac_bits;         // fixed point of mean and rms (and min, max)
+    uint16_t channels;
+    uint32_t rec_header_crc;    // header_crc of the recording summarised
+    int64_t  rec_created_ns;    // created_ns of the recording summarised
+    uint64_t entries;           // set by close(); 0 while being written
+    uint32_t last_frames;       // frames in the last entry, set by close()
+    uint8_t  reserved[16];
+    uint32_t header_crc;        // CRC-32C of everything above
+};
+static_assert(sizeof(rec_summary_header) == 64, "rec_summary_header must be 64 bytes");
+
+struct __attribute__((packed)) rec_summary_entry {
+    int64_t  t0_ns;             // host wall clock of the first frame
+    int64_t  t1_ns;             // host wall clock of the last frame
+};
+
+struct __attribute__((packed)) rec_summary_value {
+    int16_t  min;
+    int16_t  max;
+    int16_t  mean;
+    uint16_t rms;               // sqrt(mean of squares), about the sample zero
+};
+static_assert(sizeof(rec_summary_value) == 8, "rec_summary_value must be 8 bytes");
+
+/** Side file of one level: rec_path + ".sum" + shift. */
+std::string rec_summary_path(const std::string &rec_path, int shift);
+
+/** Builds the side files while a recording is written; see the top of this file. */
+class rec_summary_writer {
+public:
+    rec_summary_writer() = default;
+    ~rec_summary_writer();
+
+    rec_summary_writer(const rec_summary_writer &) = delete;
+    rec_summary_writer &operator=(const rec_summary_writer &) = delete;
+
+    /** Create the side files of rec_path (replacing old ones) for a recording with header hdr. */
+    bool open(const std::string &rec_path, const rec_file_header &hdr);
+
+    /**
+     * Add n frames, in the recording's sample format, the first at host time
+     * t_first_ns and the last at t_last_ns (as rec_writer::append()).
+     */
+    void append(const uint8_t *frames, uint32_t n, int64_t t_first_ns, int64_t t_last_ns);
+
+    /** Write out the complete entries held back so far. */
+    bool flush();
+
+    /** Write everything, including partial entries, and finish the headers. */
+    bool close();
+
+    bool is_open() const { return open_; }
+
+private:
+    struct acc {
+        int32_t min, max;
+        int64_t sum;
+        uint64_t sumsq;
+    };
+    struct level {
+        int fd = -1;
+        int shift = 0;
+        uint64_t frames = 0;        // in the entry being filled
+        uint64_t entries = 0;       // complete entries
+        int64_t t0_ns = 0, t1_ns = 0;
+        std::vector<acc> a;         // per channel
+        std::vector<uint8_t> out;   // complete entries not yet written
+    };
+
+    void reset(acc *a) const;
+    void emit(level &l);
+    void add_entry(level &l, const acc *a, uint64_t frames, int64_t t0_ns, int64_t t1_ns);
+    bool write_out(level &l);
+
+    bool open_ = false;
+    bool failed_ = false;
+    std::string path_;
+    rec_summary_header hdr_ = {};
+    uint16_t channels_ = 0;
+    uint8_t format_ = 0;
+    int zero_ = 0;                  // sample zero
+    size_t entry_size_ = 0;
+    int64_t last_t_ns_ = 0;         // entry times never go backwards
+    level levels_[REC_SUMMARY_LEVELS];
+};
+
+/** min, max, mean and RMS of one channel over a column. */
+struct summary_value {
+    float min;
+    float max;
+    float mean;
+    float rms;
+};
+
+/** A time range cut into columns by rec_summary_reader::query(); reuse one to save allocations. */
+struct summary_view {
+    size_t columns = 0;
+    size_t channels = 0;
+    int shift = -1;                     // level read: 2^shift frames per entry
+    size_t entries_read = 0;
+    std::vector<int64_t> t0_ns;         // per column: first and last frame time,
+    std::vector<int64_t> t1_ns;
+    std::vector<uint64_t> frames;       // and frames in it (0: nothing there)
+    std::vector<summary_value> values;  // columns x channels, column by column
+    std::vector<uint8_t> entry_buf;     // scratch of query()
+    std::vector<double> sums;
+
+    const summary_value &at(size_t column, size_t channel) const { return values[column * channels + channel]; }
+};
+
+class rec_reader;
+
+/**
+ * Build the side files of rec_path from the data blocks of its recording,
+ * open in rd. False if they cannot be written or a block cannot be read
+ * (it is then left out).
+ */
+bool rec_summary_build(const rec_reader &rd, const std::string &rec_path);
+
+/** Queries the side files of a recording, finished or still being written. */
+class rec_summary_reader {
+public:
+    rec_summary_reader() = default;
+    ~rec_summary_reader();
+
+    rec_summary_reader(const rec_summary_reader &) = delete;
+    rec_summary_reader &operator=(const rec_summary_reader &) = delete;
+
+    /**
+     * Open the levels of rec_path that belong to the recording with header
+     * rec. False (err says why) if there is no usable level.
+     */
+    bool open(const std::string &rec_path, const rec_file_header &rec, std::string *err = nullptr);
+    void close();
+
+    /** Levels found, as shifts, finest first. */
+    std::vector<int> levels() const;
+
+    /** Entries of level `shift` so far, -1 if there is no such level. */
+    int64_t entries(int shift) const;
+
+    /**
+     * Cut host time [t0_ns, t1_ns) into `columns` equal slices and summarise
+     * every channel over each, from the coarsest level with at least one
+     * entry per column (the finest if none has). An entry belongs to the
+     * column holding its midpoint. False on I/O errors.
+     */
+    bool query(int64_t t0_ns, int64_t t1_ns, size_t columns, summary_view *out) const;
+
+private:
+    struct level {
+        int fd = -1;
+        int shift = 0;
+        rec_summary_header hdr = {};
+    };
+
+    uint64_t count(const level &l) const;
+    bool entry_time(const level &l, uint64_t i, rec_summary_entry *e) const;
+    uint64_t first_mid_at_or_after(const level &l, uint64_t n, int64_t t_ns) const;
+
+    std::vector<level> levels_;
+    uint32_t frame_rate_hz_ = 0;
+    uint16_t channels_ = 0;
+    size_t entry_size_ = 0;
+};
+
+} // namespace emg
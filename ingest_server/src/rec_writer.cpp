@@ -0,0 +1,319 @@
+/*
+ * Recording container writer, see rec_writer.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "rec_codec.h"
+#include "rec_writer.h"
+
+namespace emg {
+
+rec_writer::~rec_writer()
+{
+    close();
+}
+
+/* writev() everything, resuming after short writes */
+static bool write_all(int fd, struct iovec *iov, int n)
+{
+    while (n > 0) {
+        ssize_t r = writev(fd, iov, n);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size_t left = (size_t)r;
+        while (n > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+bool rec_writer::open(const std::string &path, const rec_file_header &hdr, disk_writer *disk)
+{
+    if (fd_ >= 0) {
+        return false;
+    }
+    frame_bytes_ = rec_frame_bytes(hdr.sample_format, hdr.channels);
+    if (frame_bytes_ == 0 || hdr.frame_rate_hz == 0 || hdr.chunk_frames == 0 ||
+        rec_encode_bound(hdr.codec, hdr.sample_format, hdr.channels, hdr.chunk_frames) == 0) {
+        fprintf(stderr, "rec_writer: bad stream description for %s\n", path.c_str());
+        return false;
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "rec_writer: cannot create %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (disk && disk->open_flags()) {
+        // Set afterwards: file systems without O_DIRECT just keep buffered I/O
+        int fl = fcntl(fd, F_GETFL);
+        if (fcntl(fd, F_SETFL, fl | disk->open_flags()) != 0) {
+            fprintf(stderr, "rec_writer: %s: O_DIRECT not supported, writing through the page cache\n",
+                    path.c_str());
+        }
+    }
+
+    hdr_ = hdr;
+    memcpy(hdr_.magic, REC_FILE_MAGIC, sizeof(hdr_.magic));
+    hdr_.version = REC_VERSION;
+    hdr_.header_size = REC_HEADER_SIZE;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr_.created_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    hdr_.header_crc = crc32c(0, &hdr_, offsetof(rec_file_header, header_crc));
+
+    // The header page is written once, before any block
+    std::unique_ptr<uint8_t[]> page(new uint8_t[REC_HEADER_SIZE]());
+    memcpy(page.get(), &hdr_, sizeof(hdr_));
+    struct iovec iov = { page.get(), REC_HEADER_SIZE };
+    if (disk) {
+        file_.reset(new disk_file(*disk));
+        file_->open(fd, 0);
+        file_->append(&iov, 1);
+    } else if (!write_all(fd, &iov, 1)) {
+        fprintf(stderr, "rec_writer: cannot write %s: %s\n", path.c_str(), strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    fd_ = fd;
+    path_ = path;
+    end_ = REC_HEADER_SIZE;
+    seq_ = 0;
+    failed_ = false;
+    index_.clear();
+    events_.clear();
+    buf_.reset(new uint8_t[(size_t)hdr_.chunk_frames * frame_bytes_]);
+    enc_.resize(hdr_.codec == REC_CODEC_NONE
+                    ? 0 : rec_encode_bound(hdr_.codec, hdr_.sample_format, hdr_.channels, hdr_.chunk_frames));
+    pending_ = 0;
+    flags_ = 0;
+    have_next_ = false;
+    last_t_ns_ = 0;
+    return true;
+}
+
+bool rec_writer::put(struct iovec *iov, int n)
+{
+    return file_ ? file_->append(iov, n) : write_all(fd_, iov, n);
+}
+
+bool rec_writer::write_block(rec_block_header &h, const void *payload)
+{
+    if (fd_ < 0 || failed_ || (file_ && file_->failed())) {
+        return false;
+    }
+    h.magic = REC_BLOCK_MAGIC;
+    h.seq = seq_;
+    h.payload_crc = crc32c(0, payload, h.payload_len);
+    h.header_crc = crc32c(0, &h, offsetof(rec_block_header, header_crc));
+
+    struct iovec iov[2] = {
+        { &h, sizeof(h) },
+        { const_cast<void *>(payload), h.payload_len },
+    };
+    if (!put(iov, h.payload_len ? 2 : 1)) {
+        // A torn block ends the readable part of the file; stop here
+        fprintf(stderr, "rec_writer: write to %s failed\n", path_.c_str());
+        failed_ = true;
+        return false;
+    }
+    if (h.type != REC_BLOCK_INDEX) {
+        index_.push_back({ end_, h.frame0, h.t0_ns, h.t1_ns, h.frames, h.type, h.codec, h.flags });
+    }
+    end_ += sizeof(h) + h.payload_len;
+    seq_++;
+    return true;
+}
+
+bool rec_writer::write_data()
+{
+    if (pending_ == 0) {
+        return true;
+    }
+    rec_block_header h = {};
+    h.type = REC_BLOCK_DATA;
+    h.codec = REC_CODEC_NONE;
+    h.flags = flags_;
+    h.frame0 = frame0_;
+    h.frames = pending_;
+    h.payload_len = pending_ * frame_bytes_;
+    h.t0_ns = t0_ns_;
+    h.t1_ns = t1_ns_;
+    h.dev_t0_us = dev_t0_us_;
+    const void *payload = buf_.get();
+    if (hdr_.codec != REC_CODEC_NONE) {
+        // Kept only when smaller: noise that does not compress stays raw
+        size_t len = rec_encode(hdr_.codec, hdr_.sample_format, hdr_.channels, buf_.get(), pending_, enc_.data());
+        if (len != 0 && len < h.payload_len) {
+            h.codec = hdr_.codec;
+            h.payload_len = (uint32_t)len;
+            payload = enc_.data();
+        }
+    }
+    pending_ = 0;
+    flags_ = 0;
+    return write_block(h, payload);
+}
+
+bool rec_writer::write_events()
+{
+    if (events_.empty()) {
+        return true;
+    }
+    rec_block_header h = {};
+    h.type = REC_BLOCK_EVENT;
+    h.frame0 = events_.front().frame;
+    h.frames = (uint32_t)events_.size();
+    h.payload_len = (uint32_t)(events_.size() * sizeof(rec_event));
+    h.t0_ns = events_.front().t_ns;
+    h.t1_ns = events_.back().t_ns;
+    bool ok = write_block(h, events_.data());
+    events_.clear();
+    return ok;
+}
+
+void rec_writer::event(uint8_t kind, uint64_t frame, int64_t t_ns, uint32_t frames, const char *text)
+{
+    rec_event e = {};
+    e.kind = kind;
+    e.frames = frames;
+    e.frame = frame;
+    e.t_ns = t_ns;
+    if (text) {
+        strncpy(e.text, text, sizeof(e.text) - 1);
+    }
+    events_.push_back(e);
+    if (pending_ == 0) {
+        // Not inside a data block: nothing to wait for
+        write_events();
+    }
+}
+
+bool rec_writer::append(const uint8_t *frames, uint32_t n, uint64_t frame0, uint64_t dev_t_us, int64_t t_first_ns,
+                        int64_t t_last_ns)
+{
+    if (fd_ < 0 || failed_) {
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+    auto frame_t = [&](uint32_t i) {
+        return n > 1 ? t_first_ns + (t_last_ns - t_first_ns) * (int64_t)i / (int64_t)(n - 1) : t_first_ns;
+    };
+    bool ok = true;
+
+    if (have_next_ && frame0 != next_frame_) {
+        // Data blocks hold contiguous frames only
+        ok = write_data() && write_events();
+        if (frame0 > next_frame_) {
+            uint64_t missing = frame0 - next_frame_;
+            event(REC_EVENT_GAP, next_frame_, std::max(t_first_ns, last_t_ns_),
+                  (uint32_t)std::min<uint64_t>(missing, UINT32_MAX));
+        }
+        flags_ |= REC_FLAG_DISCONTINUITY;
+    }
+
+    uint32_t done = 0;
+    while (done < n) {
+        if (pending_ == 0) {
+            frame0_ = frame0 + done;
+            dev_t0_us_ = dev_t_us + (uint64_t)done * 1000000 / hdr_.frame_rate_hz;
+            t0_ns_ = std::max(frame_t(done), last_t_ns_);
+        }
+        uint32_t take = std::min(n - done, hdr_.chunk_frames - pending_);
+        memcpy(buf_.get() + (size_t)pending_ * frame_bytes_, frames + (size_t)done * frame_bytes_,
+               (size_t)take * frame_bytes_);
+        pending_ += take;
+        done += take;
+        t1_ns_ = std::max(frame_t(done - 1), t0_ns_);
+        last_t_ns_ = t1_ns_;
+        if (pending_ == hdr_.chunk_frames) {
+            ok = write_data() && write_events() && ok;
+        }
+    }
+    have_next_ = true;
+    next_frame_ = frame0 + n;
+    return ok;
+}
+
+bool rec_writer::flush()
+{
+    bool ok = write_data();
+    ok = write_events() && ok;
+    if (file_) {
+        file_->flush();
+    }
+    return ok;
+}
+
+bool rec_writer::close(std::function<void(bool ok)> closed)
+{
+    if (fd_ < 0) {
+        if (closed) closed(true);
+        return true;
+    }
+    bool ok = write_data();
+    ok = write_events() && ok;
+
+    if (ok && !failed_) {
+        rec_block_header h = {};
+        h.type = REC_BLOCK_INDEX;
+        h.frames = (uint32_t)index_.size();
+        h.payload_len = (uint32_t)(index_.size() * sizeof(rec_index_entry));
+        if (!index_.empty()) {
+            h.frame0 = index_.front().frame0;
+            h.t0_ns = index_.front().t0_ns;
+            h.t1_ns = index_.back().t1_ns;
+        }
+        uint64_t index_offset = end_;
+        ok = write_block(h, index_.data());
+        if (ok) {
+            rec_trailer t = {};
+            t.magic = REC_TRAILER_MAGIC;
+            t.entries = (uint32_t)index_.size();
+            t.index_offset = index_offset;
+            t.blocks_end = end_;
+            t.crc = crc32c(0, &t, offsetof(rec_trailer, crc));
+            struct iovec iov = { &t, sizeof(t) };
+            ok = put(&iov, 1);
+            if (ok) end_ += sizeof(t);
+        }
+    }
+    ok = ok && !failed_;
+    if (file_) {
+        // Synced (per policy) and closed on the I/O thread
+        ok = ok && !file_->failed();
+        if (closed) {
+            file_->close([ok, closed](bool io_ok) { closed(ok && io_ok); });
+        } else {
+            file_->close();
+        }
+        file_.reset();
+    } else {
+        ok = ::close(fd_) == 0 && ok;
+        if (closed) closed(ok);
+    }
+    fd_ = -1;
+    buf_.reset();
+    index_.clear();
+    index_.shrink_to_fit();
+    return ok && !failed_;
+}
+
+} // namespace emg
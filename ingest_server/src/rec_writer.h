@@ -0,0 +1,112 @@
+/*
+ * Append-only writer for the recording container (recording.h).
+ *
+ * Frames are collected into a data block until it holds chunk_frames
+ * frames, then the block is written with one writev(). A block is also
+ * closed early when the frame index jumps (a gap or a device reboot) or on
+ * flush(), so every data block covers contiguous frames. Events are held
+ * until the data block they fall into is written and then follow it as one
+ * event block, which keeps data blocks full-sized across markers.
+ *
+ * close() writes the index block and the trailer; a writer that never gets
+ * there leaves a file the reader recovers by scanning.
+ *
+ * With a codec in the file header (rec_codec.h) every data block is
+ * encoded on its own and stored encoded if that makes it smaller, raw
+ * otherwise.
+ *
+ * Blocks are written with writev() on the calling thread, or, given a
+ * disk_writer, copied into its aggregation buffers and written by its I/O
+ * thread.
+ */
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "disk_writer.h"
+#include "recording.h"
+
+namespace emg {
+
+class rec_writer {
+public:
+    rec_writer() = default;
+    ~rec_writer();
+
+    rec_writer(const rec_writer &) = delete;
+    rec_writer &operator=(const rec_writer &) = delete;
+
+    /**
+     * Create path (it must not exist) and write the file header. channels,
+     * sample_format, frame_rate_hz and chunk_frames must be set in hdr, and
+     * codec may be; magic, version, sizes, created_ns and the CRC are filled
+     * in here. With disk, writes go through it.
+     */
+    bool open(const std::string &path, const rec_file_header &hdr, disk_writer *disk = nullptr);
+
+    /**
+     * Append n frames starting at device frame frame0. t_first_ns and
+     * t_last_ns are the host wall clock of the first and the last of them
+     * (see clock_model.h); frames in between are spread evenly. dev_t_us is
+     * the device clock of the first frame.
+     */
+    bool append(const uint8_t *frames, uint32_t n, uint64_t frame0, uint64_t dev_t_us, int64_t t_first_ns,
+                int64_t t_last_ns);
+
+    /** Queue an event; it is written right after the data block it falls into. */
+    void event(uint8_t kind, uint64_t frame, int64_t t_ns, uint32_t frames = 0, const char *text = nullptr);
+
+    /** Write the partly filled data block and any queued events. */
+    bool flush();
+
+    /**
+     * flush(), then write the index and trailer and close the file. Once the
+     * file is closed, which through a disk_writer happens later on its I/O
+     * thread, closed (if given) is called with whether everything was written.
+     */
+    bool close(std::function<void(bool ok)> closed = nullptr);
+
+    /** Let the disk writer's aggregation buffer go out if it has waited long enough. */
+    void tick(uint64_t now) { if (file_) file_->tick(now); }
+
+    bool is_open() const { return fd_ >= 0; }
+    const std::string &path() const { return path_; }
+    const rec_file_header &header() const { return hdr_; }
+    uint64_t bytes() const { return end_; }
+    uint64_t blocks() const { return seq_; }
+    uint64_t next_frame() const { return next_frame_; }
+
+private:
+    bool put(struct iovec *iov, int n);
+    bool write_block(rec_block_header &h, const void *payload);
+    bool write_data();
+    bool write_events();
+
+    int fd_ = -1;
+    std::unique_ptr<disk_file> file_;   // set when writing through a disk_writer
+    std::string path_;
+    rec_file_header hdr_ = {};
+    uint32_t frame_bytes_ = 0;
+    uint64_t end_ = 0;              // bytes in the file
+    uint64_t seq_ = 0;              // next block number
+    bool failed_ = false;
+    std::vector<rec_index_entry> index_;
+    std::vector<rec_event> events_;
+
+    // data block being filled
+    std::unique_ptr<uint8_t[]> buf_;
+    std::vector<uint8_t> enc_;      // buf_ through hdr_.codec
+    uint32_t pending_ = 0;          // frames in buf_
+    uint64_t frame0_ = 0;
+    uint64_t dev_t0_us_ = 0;
+    int64_t t0_ns_ = 0;
+    int64_t t1_ns_ = 0;
+    uint16_t flags_ = 0;
+    bool have_next_ = false;
+    uint64_t next_frame_ = 0;       // frame index expected next
+    int64_t last_t_ns_ = 0;         // block times never go backwards
+};
+
+} // namespace emg
@@ -0,0 +1,309 @@
+/*
+ * Writer-thread side of the ingest server, see recorder.h.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <time.h>
+#include "recorder.h"
+#include "wire.h"
+
+namespace emg {
+
+static const uint32_t DEFAULT_FRAME_RATE_HZ = 2048;   // firmware default, for devices without hello
+static const uint64_t SUMMARY_FLUSH_NS = 1000000000;  // summaries of live recordings lag at most this
+
+bool parse_segment_limit(const char *s, recorder_config *cfg)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+        return false;
+    }
+    if (strcasecmp(end, "mb") == 0 || strcasecmp(end, "gb") == 0) {
+        cfg->segment_bytes = v << (tolower(end[0]) == 'g' ? 30 : 20);
+        return true;
+    }
+    static const struct { const char *unit; uint64_t ns; } units[] = {
+        { "s", 1000000000ull }, { "min", 60000000000ull }, { "h", 3600000000000ull },
+    };
+    for (const auto &u : units) {
+        if (strcmp(end, u.unit) == 0) {
+            cfg->segment_ns = v * u.ns;
+            return true;
+        }
+    }
+    return false;
+}
+
+recorder::recorder(const recorder_config &cfg, stream_slot *streams, disk_writer *disk, segment_finalizer *finalizer)
+    : cfg_(cfg), streams_(streams), disk_(disk), finalizer_(finalizer),
+      wall_offset_ns_(wall_ns() - (int64_t)now_ns())
+{
+    if (!finalizer_) {
+        cfg_.segment_bytes = cfg_.segment_ns = 0;
+    }
+}
+
+recorder::~recorder()
+{
+    close_all();
+}
+
+void recorder::tick(uint64_t now)
+{
+    bool flush_summary = now - summary_flushed_ns_ >= SUMMARY_FLUSH_NS;
+    for (std::unique_ptr<stream_file> &f : files_) {
+        if (f) {
+            f->writer.tick(now);
+            if (flush_summary) {
+                f->summary.flush();
+            }
+        }
+    }
+    if (flush_summary) {
+        summary_flushed_ns_ = now;
+    }
+}
+
+/* Loss, duplicates and reorders of one device's raw batches over the run */
+void recorder::print_sequence(uint32_t stream, const stream_file &f) const
+{
+    seq_summary s = f.seq.summary();
+    printf("[%s] %llu batches, %llu lost (%.3f%%) in %llu gaps", streams_[stream].name,
+           (unsigned long long)s.received, (unsigned long long)s.lost, s.loss_pct(), (unsigned long long)s.gaps);
+    if (s.longest.count) {
+        time_t t = (time_t)(s.longest.t_ns / 1000000000);
+        struct tm tm;
+        localtime_r(&t, &tm);
+        char when[16];
+        strftime(when, sizeof(when), "%H:%M:%S", &tm);
+        printf(", longest %llu at %s", (unsigned long long)s.longest.count, when);
+    }
+    printf(", %llu duplicates, %llu reordered, %llu restarts\n", (unsigned long long)s.duplicates,
+           (unsigned long long)s.reorders, (unsigned long long)s.restarts);
+}
+
+void recorder::close_all()
+{
+    for (uint32_t i = 0; i < MAX_STREAMS; i++) {
+        std::unique_ptr<stream_file> &f = files_[i];
+        if (f && f->writer.is_open()) {
+            print_sequence(i, *f);
+            close_file(*f, true);
+        }
+        if (f && f->bdf.is_open() && !f->bdf.close()) {
+            fprintf(stderr, "%s.bdf: export incomplete\n", f->base.c_str());
+        }
+    }
+}
+
+/* File name of segment n of the session at base, in the manifest's directory */
+static std::string segment_file(const std::string &base, uint32_t n)
+{
+    char num[16];
+    snprintf(num, sizeof(num), ".%04u.emgr", n);
+    return base.substr(base.rfind('/') + 1) + num;
+}
+
+void recorder::close_file(stream_file &f, bool last)
+{
+    if (segmented()) {
+        // The finalizer takes over once the disk writer has closed the file
+        segment_finalizer *fin = finalizer_;
+        std::string manifest = f.base + ".emgm", file = segment_file(f.base, f.segment);
+        f.writer.close([fin, manifest, file, last](bool) { fin->closed(manifest, file, last); });
+    } else {
+        f.writer.close();
+        f.summary.close();
+    }
+}
+
+/* Segment f.segment of a segmented recording, written as its name plus ".part" until finalized */
+bool recorder::open_segment(stream_file &f, const rec_file_header &hdr)
+{
+    std::string file = segment_file(f.base, f.segment);
+    if (!f.writer.open(rec_dir_of(f.base) + "/" + file + ".part", hdr, disk_)) {
+        return false;
+    }
+    f.segment_t0_ns = 0;
+    if (!finalizer_->opened(f.base + ".emgm", file)) {
+        fprintf(stderr, "%s.emgm: cannot update the manifest\n", f.base.c_str());
+    }
+    return true;
+}
+
+bool recorder::open_stream(uint32_t stream, stream_file &f)
+{
+    const stream_slot &s = streams_[stream];
+    rec_file_header hdr = {};
+    memcpy(hdr.device_id, s.device_id, sizeof(hdr.device_id));
+    memcpy(hdr.name, s.name, sizeof(hdr.name));
+    hdr.channels = EMG_NUM_CHANNELS;
+    hdr.sample_format = REC_FMT_U8_OFFSET;
+    hdr.codec = cfg_.codec;
+    hdr.frame_rate_hz = DEFAULT_FRAME_RATE_HZ;
+    hdr.chunk_frames = cfg_.block_frames;
+    if (f.has_hello) {
+        memcpy(hdr.mac, f.hello.mac, sizeof(hdr.mac));
+        hdr.channels = f.hello.channels ? f.hello.channels : EMG_NUM_CHANNELS;
+        hdr.frame_rate_hz = f.hello.frame_rate_hz ? f.hello.frame_rate_hz : DEFAULT_FRAME_RATE_HZ;
+        hdr.boot_id = f.hello.boot_id;
+        hdr.layout = f.hello.layout;
+        hdr.spatial = f.hello.spatial;
+    }
+
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    f.base = cfg_.out_dir + "/" + s.name + "_" + stamp;
+    std::string err;
+    if (cfg_.bdf && !f.bdf.open(f.base + ".bdf", hdr, bdf_options(), &err)) {
+        fprintf(stderr, "%s.bdf: %s\n", f.base.c_str(), err.c_str());
+    }
+    if (segmented()) {
+        // Summaries of segments are built by the finalizer
+        f.segment = 1;
+        if (!open_segment(f, hdr)) {
+            return false;
+        }
+        printf("Recording %s to segments of %s.emgm\n", s.name, f.base.c_str());
+        return true;
+    }
+    std::string path = f.base + ".emgr";
+    if (!f.writer.open(path, hdr, disk_)) {
+        return false;
+    }
+    printf("Recording %s to %s\n", s.name, path.c_str());
+    if (cfg_.summary && !f.summary.open(path, f.writer.header())) {
+        // The recording does not need it; emg_recinfo -S can build it later
+        fprintf(stderr, "Recording %s without a summary\n", s.name);
+    }
+    return true;
+}
+
+/* First message of a connection: the hello, if the firmware sends one */
+void recorder::connected(uint32_t stream, stream_file &f, const emg_msg_hdr_t &h, const uint8_t *payload)
+{
+    f.online = true;
+    bool reboot = false;
+    if (h.type == EMG_MSG_HELLO && h.len >= sizeof(emg_hello_msg_t)) {
+        emg_hello_msg_t hello;
+        memcpy(&hello, payload, sizeof(hello));
+        reboot = f.has_hello && hello.boot_id != f.hello.boot_id;
+        if (reboot) {
+            f.clock.reset();
+            f.seq.restart();
+        }
+        f.hello = hello;
+        f.has_hello = true;
+    }
+    if (!f.writer.is_open() && !f.open_failed && !open_stream(stream, f)) {
+        f.open_failed = true;
+        streams_[stream].stats.write_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (f.writer.is_open()) {
+        int64_t t = wall_ns();
+        if (reboot) {
+            f.writer.event(REC_EVENT_REBOOT, h.frame0, t);
+            f.bdf.annotate(h.frame0, t, 0, "reboot");
+        }
+        f.writer.event(REC_EVENT_CONNECT, h.frame0, t, 0, streams_[stream].peer);
+        f.bdf.annotate(h.frame0, t, 0, (std::string("connect ") + streams_[stream].peer).c_str());
+    }
+}
+
+void recorder::handle(const chunk &c)
+{
+    std::unique_ptr<stream_file> &fp = files_[c.stream];
+    if (!fp) {
+        fp.reset(new stream_file());
+    }
+    stream_file &f = *fp;
+    stream_stats &st = streams_[c.stream].stats;
+
+    if (c.flags & CHUNK_END_OF_STREAM) {
+        // The device may be gone for a while; a reconnect continues the file
+        if (f.writer.is_open()) {
+            int64_t t = wall_ns();
+            f.writer.event(REC_EVENT_DISCONNECT, f.writer.next_frame(), t);
+            f.bdf.annotate(f.writer.next_frame(), t, 0, "disconnect");
+            if (!f.writer.flush()) {
+                st.write_errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            f.summary.flush();
+        }
+        f.online = false;
+        f.open_failed = false;
+    } else {
+        bool ok = true;
+        for_each_message(c.data, c.len, [&](const emg_msg_hdr_t &h, const uint8_t *payload) {
+            if (!f.online) {
+                connected(c.stream, f, h, payload);
+            }
+            // Only raw samples are recorded; features can be recomputed from them
+            if (h.type != EMG_MSG_RAW_BATCH) {
+                return;
+            }
+            seq_verdict v = f.seq.add(h.seq, (int64_t)c.recv_ns + wall_offset_ns_);
+            if (v == SEQ_DUPLICATE || v == SEQ_REORDER) {
+                return;     // already recorded, or the recording has moved past it
+            }
+            if (h.count > 0 && f.writer.is_open()) {
+                // The batch went out once its last frame was in
+                uint32_t rate = f.writer.header().frame_rate_hz;
+                int64_t dev_last = batch_frame_dev_ns(h, h.count - 1, rate);
+                f.clock.add(dev_last, (int64_t)c.recv_ns);
+                int64_t t_first = f.clock.to_host(batch_frame_dev_ns(h, 0, rate)) + wall_offset_ns_;
+                int64_t t_last = f.clock.to_host(dev_last) + wall_offset_ns_;
+                if (segmented() && f.segment_t0_ns &&
+                    ((cfg_.segment_bytes && f.writer.bytes() >= cfg_.segment_bytes) ||
+                     (cfg_.segment_ns && t_first - f.segment_t0_ns >= (int64_t)cfg_.segment_ns))) {
+                    rec_file_header hdr = f.writer.header();
+                    close_file(f, false);
+                    f.segment++;
+                    if (!open_segment(f, hdr)) {
+                        ok = false;
+                        return;
+                    }
+                }
+                if (!f.segment_t0_ns) {
+                    f.segment_t0_ns = t_first;
+                }
+                if (v == SEQ_GAP) {
+                    const seq_gap &g = f.seq.last_gap();
+                    char text[40];
+                    if (g.count == 1) {
+                        snprintf(text, sizeof(text), "batch %llu", (unsigned long long)g.seq);
+                    } else {
+                        snprintf(text, sizeof(text), "batches %llu-%llu", (unsigned long long)g.seq,
+                                 (unsigned long long)(g.seq + g.count - 1));
+                    }
+                    uint32_t n = (uint32_t)std::min<uint64_t>(g.count, UINT32_MAX);
+                    f.writer.event(REC_EVENT_LOSS, h.frame0, t_first, n, text);
+                    f.bdf.annotate(h.frame0, t_first, 0, (std::string("loss ") + text).c_str());
+                }
+                ok = f.writer.append(payload, h.count, h.frame0, h.t_us, t_first, t_last) && ok;
+                f.summary.append(payload, h.count, t_first, t_last);
+                if (f.bdf.is_open() && !f.bdf.append(payload, h.count, h.frame0, t_first)) {
+                    ok = false;
+                }
+            }
+        });
+        if (!ok) {
+            st.write_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        seq_summary seq = f.seq.summary();
+        st.seq_lost.store(seq.lost, std::memory_order_relaxed);
+        st.seq_duplicates.store(seq.duplicates, std::memory_order_relaxed);
+        st.seq_reorders.store(seq.reorders, std::memory_order_relaxed);
+        // End-of-stream markers carry no receive time
+        st.writer_lag_ns.store(now_ns() - c.recv_ns, std::memory_order_relaxed);
+    }
+}
+
+} // namespace emg
@@ -0,0 +1,112 @@
+/*
+ * Writer-thread side of the ingest server: puts received data on disk.
+ *
+ * Every device gets one recording (recording.h) in the output directory per
+ * server run, named after the device and the time it first connected. The
+ * file header is filled from the device's hello message; raw batches go
+ * into fixed-size data blocks and connects, disconnects, reboots and frame
+ * gaps are recorded as events. Reconnects continue the same file. Block
+ * times come from a per-device clock model (clock_model.h) fed with the
+ * device timestamps and the arrival times, so every frame has its own host
+ * time rather than that of the read that brought it in. Unless turned off,
+ * every recording gets a summary pyramid (rec_summary.h) built alongside,
+ * and its data blocks may be compressed (rec_codec.h).
+ *
+ * With a segment limit, a recording is instead a session of segments tied
+ * together by a manifest (rec_manifest.h): once the segment being written
+ * reaches the size or duration limit, it is closed and the next one begins
+ * with the following batch. Closed segments are summarised, synced and
+ * renamed by a segment_finalizer in the background.
+ *
+ * Raw batch sequence numbers are accounted per device (seq_tracker.h):
+ * batches missing by number are recorded as loss events, duplicates and
+ * batches arriving after later ones are counted and left out, so the
+ * frames of a recording only go forward. A summary per device is printed
+ * when the recordings are closed.
+ *
+ * Optionally every recording is also exported as it is received to BDF+
+ * (bdf_writer.h), one file per recording across segments, with connects,
+ * disconnects, reboots and losses as annotations.
+ */
+#pragma once
+#include <memory>
+#include <string>
+#include "bdf_writer.h"
+#include "buffer_pool.h"
+#include "clock_model.h"
+#include "rec_summary.h"
+#include "rec_writer.h"
+#include "segment_finalizer.h"
+#include "seq_tracker.h"
+#include "stream_table.h"
+
+namespace emg {
+
+struct recorder_config {
+    std::string out_dir = ".";
+    uint32_t block_frames = 2048;       // frames per recording data block
+    bool summary = true;                // write summary pyramids next to recordings
+    uint8_t codec = REC_CODEC_NONE;     // codec of recording data blocks (rec_codec.h)
+    uint64_t segment_bytes = 0;         // roll over to a new segment at this size, 0 = never
+    uint64_t segment_ns = 0;            // or after this much recorded time, 0 = never
+    bool bdf = false;                   // also write every recording as BDF+ (.bdf)
+};
+
+/** Parse a segment limit: "<N>MB", "<N>GB", "<T>s", "<T>min" or "<T>h". */
+bool parse_segment_limit(const char *s, recorder_config *cfg);
+
+class recorder {
+public:
+    /**
+     * With disk, recordings are written through its I/O thread. Segmented
+     * recordings (cfg.segment_bytes or cfg.segment_ns set) need finalizer.
+     */
+    recorder(const recorder_config &cfg, stream_slot *streams, disk_writer *disk = nullptr,
+             segment_finalizer *finalizer = nullptr);
+    ~recorder();
+
+    recorder(const recorder &) = delete;
+    recorder &operator=(const recorder &) = delete;
+
+    /** Record the messages of one chunk, or mark the device offline on end-of-stream. */
+    void handle(const chunk &c);
+
+    /** Push out data that has waited in aggregation buffers for too long. */
+    void tick(uint64_t now);
+
+    /** Finish every open recording (index and trailer). */
+    void close_all();
+
+private:
+    struct stream_file {
+        rec_writer writer;
+        rec_summary_writer summary;
+        bdf_writer bdf;
+        std::string base;           // path without extension, set by the first open
+        uint32_t segment = 0;       // number of the segment being written
+        int64_t segment_t0_ns = 0;  // host time of its first frame
+        bool online = false;        // between the first message of a connection and its end
+        bool open_failed = false;   // do not retry until the next connection
+        bool has_hello = false;
+        emg_hello_msg_t hello = {};
+        clock_model clock;
+        seq_tracker seq;            // raw batch numbers since the last reboot
+    };
+
+    bool segmented() const { return cfg_.segment_bytes || cfg_.segment_ns; }
+    bool open_stream(uint32_t stream, stream_file &f);
+    bool open_segment(stream_file &f, const rec_file_header &hdr);
+    void close_file(stream_file &f, bool last);
+    void connected(uint32_t stream, stream_file &f, const emg_msg_hdr_t &h, const uint8_t *payload);
+    void print_sequence(uint32_t stream, const stream_file &f) const;
+
+    recorder_config cfg_;
+    stream_slot *streams_;
+    disk_writer *disk_;
+    segment_finalizer *finalizer_;
+    uint64_t summary_flushed_ns_ = 0;
+    int64_t wall_offset_ns_;        // CLOCK_REALTIME - CLOCK_MONOTONIC
+    std::unique_ptr<stream_file> files_[MAX_STREAMS];
+};
+
+} // namespace emg
@@ -0,0 +1,51 @@
+/*
+ * Shared helpers of the recording container, see recording.h.
+ */
+#include "recording.h"
+
+namespace emg {
+
+/* Slicing-by-8 tables for the reflected Castagnoli polynomial */
+struct crc32c_tables {
+    uint32_t t[8][256];
+
+    crc32c_tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+static const crc32c_tables s_crc;
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = s_crc.t[7][lo & 0xFF] ^ s_crc.t[6][(lo >> 8) & 0xFF] ^
+              s_crc.t[5][(lo >> 16) & 0xFF] ^ s_crc.t[4][lo >> 24] ^
+              s_crc.t[3][hi & 0xFF] ^ s_crc.t[2][(hi >> 8) & 0xFF] ^
+              s_crc.t[1][(hi >> 16) & 0xFF] ^ s_crc.t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ s_crc.t[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+} // namespace emg
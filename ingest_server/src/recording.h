@@ -0,0 +1,149 @@
+/*
+ * EMG recording container (.emgr).
+ *
+ * Layout:
+ *
+ *   file header     4096 bytes: rec_file_header, zero padded
+ *   block*          rec_block_header (64 bytes) + payload_len bytes
+ *   [trailer]       32 bytes, only after a clean close
+ *
+ * Blocks are data chunks (a fixed number of frames, sample-major and
+ * stored raw or through a codec of rec_codec.h, plus sequence number,
+ * frame range, host time range and CRCs), event blocks
+ * (connects, gaps, markers) and, at close, one index block listing every
+ * block with its offset and time range. The trailer points at the index, so
+ * a finished file opens with two reads and seeks by time in O(log n).
+ *
+ * The file is only ever appended to and every block carries its own header
+ * and payload CRC, so a file that is still being written or whose writer
+ * crashed is read by walking the block headers up to the first incomplete
+ * block; nothing before it can be damaged by a torn write.
+ *
+ * All fields are little-endian.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace emg {
+
+constexpr char     REC_FILE_MAGIC[8] = { 'E', 'M', 'G', 'R', 'E', 'C', '\r', '\n' };
+constexpr uint32_t REC_VERSION = 1;
+constexpr uint32_t REC_HEADER_SIZE = 4096;
+constexpr uint32_t REC_BLOCK_MAGIC = 0x4B4C4245;     // "EBLK"
+constexpr uint32_t REC_TRAILER_MAGIC = 0x4C525445;   // "ETRL"
+
+enum : uint8_t {
+    REC_FMT_U8_OFFSET = 1,    // uint8, offset binary around 128 (the ESP32 stream)
+    REC_FMT_I16 = 2,          // int16 little-endian
+};
+
+enum : uint8_t {
+    REC_BLOCK_DATA  = 1,      // payload: frames * channels samples, sample-major
+    REC_BLOCK_EVENT = 2,      // payload: rec_event[]
+    REC_BLOCK_INDEX = 3,      // payload: rec_index_entry[] for every block before it
+};
+
+enum : uint8_t {
+    REC_CODEC_NONE = 0,
+    REC_CODEC_DELTA_BP = 1,   // delta + bit packing per group of 8 channels (rec_codec.h)
+    REC_CODEC_LZ = 2,         // LZ4 block format (rec_codec.h)
+};
+
+enum : uint16_t {
+    REC_FLAG_DISCONTINUITY = 1u << 0,   // frame0 does not follow the previous data block
+};
+
+struct __attribute__((packed)) rec_file_header {
+    char     magic[8];          // REC_FILE_MAGIC
+    uint32_t version;           // REC_VERSION
+    uint32_t header_size;       // REC_HEADER_SIZE; blocks start here
+    char     device_id[32];     // NUL padded
+    char     name[64];          // NUL padded
+    uint8_t  mac[6];
+    uint16_t channels;
+    uint8_t  sample_format;     // REC_FMT_*
+    uint8_t  layout;            // EMG_LAYOUT_*
+    uint8_t  spatial;           // spatial filter used on the device for features
+    uint8_t  codec;             // default codec of data blocks
+    uint32_t frame_rate_hz;     // nominal
+    uint32_t boot_id;           // device boot id when the file was created
+    uint32_t chunk_frames;      // frames per full data block
+    int64_t  created_ns;        // wall clock (UNIX ns) at creation
+    uint8_t  reserved[108];
+    uint32_t header_crc;        // CRC-32C of everything above
+};
+static_assert(sizeof(rec_file_header) == 256, "rec_file_header must be 256 bytes");
+
+struct __attribute__((packed)) rec_block_header {
+    uint32_t magic;             // REC_BLOCK_MAGIC
+    uint8_t  type;              // REC_BLOCK_*
+    uint8_t  codec;             // REC_CODEC_* (data blocks)
+    uint16_t flags;             // REC_FLAG_*
+    uint64_t seq;               // block number in the file, from 0
+    uint64_t frame0;            // device frame index of the first frame
+    uint32_t frames;            // frames covered (data) or entries (event, index)
+    uint32_t payload_len;       // stored payload bytes after this header
+    uint32_t payload_crc;       // CRC-32C of the stored payload
+    int64_t  t0_ns;             // host wall clock (UNIX ns) of the first frame
+    int64_t  t1_ns;             // host wall clock of the last frame
+    uint64_t dev_t0_us;         // device clock of the first frame
+    uint32_t header_crc;        // CRC-32C of the 60 bytes above
+};
+static_assert(sizeof(rec_block_header) == 64, "rec_block_header must be 64 bytes");
+
+enum : uint8_t {
+    REC_EVENT_CONNECT = 1,      // device (re)connected
+    REC_EVENT_DISCONNECT = 2,
+    REC_EVENT_REBOOT = 3,       // boot id changed: frame indices restart
+    REC_EVENT_GAP = 4,          // frames missing: [frame, frame + frames)
+    REC_EVENT_MARKER = 5,       // user annotation
+    REC_EVENT_LOSS = 6,         // raw batches missing by sequence number before frame: frames = how many
+};
+
+struct __attribute__((packed)) rec_event {
+    uint8_t  kind;              // REC_EVENT_*
+    uint8_t  reserved[3];
+    uint32_t frames;            // length of a gap (batches for a loss), else 0
+    uint64_t frame;             // device frame index the event refers to
+    int64_t  t_ns;              // host wall clock
+    char     text[40];          // NUL padded
+};
+static_assert(sizeof(rec_event) == 64, "rec_event must be 64 bytes");
+
+struct __attribute__((packed)) rec_index_entry {
+    uint64_t offset;            // file offset of the block header
+    uint64_t frame0;
+    int64_t  t0_ns;
+    int64_t  t1_ns;
+    uint32_t frames;
+    uint8_t  type;
+    uint8_t  codec;
+    uint16_t flags;
+};
+static_assert(sizeof(rec_index_entry) == 40, "rec_index_entry must be 40 bytes");
+
+struct __attribute__((packed)) rec_trailer {
+    uint32_t magic;             // REC_TRAILER_MAGIC
+    uint32_t entries;           // index entries
+    uint64_t index_offset;      // file offset of the index block header
+    uint64_t blocks_end;        // file offset just past the last block
+    uint32_t reserved;
+    uint32_t crc;               // CRC-32C of the 28 bytes above
+};
+static_assert(sizeof(rec_trailer) == 32, "rec_trailer must be 32 bytes");
+
+/** CRC-32C (Castagnoli), continuing from crc (0 to start). */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/** Bytes per frame for a sample format, 0 if unknown. */
+inline uint32_t rec_frame_bytes(uint8_t sample_format, uint16_t channels)
+{
+    switch (sample_format) {
+    case REC_FMT_U8_OFFSET: return channels;
+    case REC_FMT_I16: return 2u * channels;
+    default: return 0;
+    }
+}
+
+} // namespace emg
@@ -0,0 +1,161 @@
+/*
+ * Background finalization of recording segments, see segment_finalizer.h.
+ */
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "rec_reader.h"
+#include "rec_summary.h"
+#include "segment_finalizer.h"
+
+namespace emg {
+
+segment_finalizer::~segment_finalizer()
+{
+    stop();
+}
+
+/* Lowest CPU priority and the idle I/O class for the calling thread */
+static void lower_priority()
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t)tid, 19);
+#ifdef SYS_ioprio_set
+    const int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13;
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+void segment_finalizer::start()
+{
+    if (!thread_.joinable()) {
+        stop_ = false;
+        thread_ = std::thread([this] {
+            lower_priority();
+            run();
+        });
+    }
+}
+
+void segment_finalizer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    } else {
+        run();
+    }
+}
+
+size_t segment_finalizer::pending() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return jobs_.size() + (busy_ ? 1 : 0);
+}
+
+bool segment_finalizer::opened(const std::string &manifest, const std::string &file)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    session &s = sessions_[manifest];
+    rec_segment seg;
+    seg.file = file;
+    s.m.segments.push_back(seg);
+    return rec_manifest_write(manifest, s.m);
+}
+
+void segment_finalizer::closed(const std::string &manifest, const std::string &file, bool last)
+{
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        jobs_.push_back({ manifest, file, last });
+    }
+    cv_.notify_all();
+}
+
+void segment_finalizer::run()
+{
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+        cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+        job j = jobs_.front();
+        jobs_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        finalize(j);
+        lock.lock();
+        busy_ = false;
+    }
+}
+
+void segment_finalizer::finalize(const job &j)
+{
+    const std::string path = rec_dir_of(j.manifest) + "/" + j.file, part = path + ".part";
+    rec_segment done;
+    done.file = j.file;
+
+    rec_reader rd;
+    std::string err;
+    if (rd.open(part, &err)) {
+        // The summary is named after the final path, so it is complete when that appears
+        if (summary_ && !rec_summary_build(rd, path)) {
+            fprintf(stderr, "%s: summary incomplete\n", part.c_str());
+        }
+        const std::vector<uint32_t> &data = rd.data_blocks();
+        done.frames = rd.frames();
+        if (!data.empty()) {
+            done.t0_ns = rd.blocks()[data.front()].t0_ns;
+            done.t1_ns = rd.blocks()[data.back()].t1_ns;
+        }
+        rd.close();
+
+        // Data first, then the name: a crash never leaves a renamed segment with lost data
+        int fd = ::open(part.c_str(), O_RDONLY | O_CLOEXEC);
+        bool synced = fd >= 0 && fdatasync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        done.closed = synced && rename(part.c_str(), path.c_str()) == 0;
+        if (!done.closed) {
+            fprintf(stderr, "%s: cannot sync or rename: %s\n", part.c_str(), strerror(errno));
+        }
+    } else {
+        fprintf(stderr, "%s: %s, segment left open\n", part.c_str(), err.c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        session &s = sessions_[j.manifest];
+        bool all_closed = true;
+        for (rec_segment &seg : s.m.segments) {
+            if (seg.file == j.file && done.closed) {
+                seg = done;
+            }
+            all_closed = all_closed && seg.closed;
+        }
+        s.ended = s.ended || j.last;
+        s.m.finished = s.ended && all_closed;
+        if (!rec_manifest_write(j.manifest, s.m)) {
+            fprintf(stderr, "%s: cannot write the manifest\n", j.manifest.c_str());
+        }
+        if (s.ended) {
+            sessions_.erase(j.manifest);
+        }
+    }
+    // Outside the lock: the writer thread may be listing a new segment meanwhile
+    rec_manifest_sync(j.manifest);
+    if (done.closed) {
+        finalized.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace emg
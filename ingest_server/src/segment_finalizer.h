@@ -0,0 +1,88 @@
+/*
+ * Background finalization of recording segments (rec_manifest.h).
+ *
+ * The recorder rolls a session over to a new segment by closing the
+ * current one (index and trailer are written from memory, on the writer
+ * thread) and creating the next. Everything else a finished segment needs
+ * happens here, on a thread running at the lowest CPU and I/O priority so
+ * that it only uses what recording leaves idle: the summary pyramid
+ * (rec_summary.h) is built from the segment, its data is synced, it is
+ * renamed from name.part to name, and the manifest is updated with its
+ * frame count and time range. Until then the segment is listed as open and
+ * readers find it under its .part name.
+ *
+ * opened() may be called from any thread (the recorder's writer thread),
+ * closed() too (the disk writer's I/O thread once the file is closed); both
+ * return at once.
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "rec_manifest.h"
+
+namespace emg {
+
+class segment_finalizer {
+public:
+    /** With summary, finalizing builds the segment's summary pyramid. */
+    explicit segment_finalizer(bool summary = true) : summary_(summary) {}
+    ~segment_finalizer();
+
+    segment_finalizer(const segment_finalizer &) = delete;
+    segment_finalizer &operator=(const segment_finalizer &) = delete;
+
+    void start();
+
+    /** Finalize every segment closed so far, then join the thread. */
+    void stop();
+
+    /**
+     * Segment file (a name in the manifest's directory) of the session with
+     * the given manifest has been created as file + ".part": list it as open.
+     */
+    bool opened(const std::string &manifest, const std::string &file);
+
+    /**
+     * The writer of the segment has closed it; finalize it. With last, the
+     * session ends with it and the manifest is marked finished once it is
+     * finalized.
+     */
+    void closed(const std::string &manifest, const std::string &file, bool last);
+
+    /** Segments closed and not yet finalized. */
+    size_t pending() const;
+
+    std::atomic<uint64_t> finalized{0};
+    std::atomic<uint64_t> errors{0};        // segments left open: unreadable or not renamed
+
+private:
+    struct job {
+        std::string manifest;
+        std::string file;
+        bool last;
+    };
+    struct session {
+        rec_manifest m;
+        bool ended = false;
+    };
+
+    void run();
+    void finalize(const job &j);
+
+    bool summary_;
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<job> jobs_;
+    std::map<std::string, session> sessions_;   // by manifest path
+    bool busy_ = false;                         // a job is being finalized
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace emg
@@ -0,0 +1,132 @@
+/*
+ * Batch sequence accounting, see seq_tracker.h.
+ */
+#include "seq_tracker.h"
+
+namespace emg {
+
+void seq_tracker::restart()
+{
+    first_ = 0;
+    count_ = 0;
+}
+
+/* Open room at position i, moving the intervals from i on one place up */
+void seq_tracker::insert(size_t i, interval v)
+{
+    for (size_t k = count_; k > i; k--) {
+        at(k) = at(k - 1);
+    }
+    at(i) = v;
+    count_++;
+}
+
+void seq_tracker::erase(size_t i)
+{
+    for (size_t k = i; k + 1 < count_; k++) {
+        at(k) = at(k + 1);
+    }
+    count_--;
+}
+
+/* Close the oldest gaps for good while there are too many or they are too old */
+void seq_tracker::settle()
+{
+    uint64_t newest = at(count_ - 1).hi;
+    while (count_ > MAX_OPEN + 1 || (count_ > 1 && newest - at(1).lo >= HORIZON)) {
+        first_ = (first_ + 1) % RING;
+        count_--;
+    }
+}
+
+seq_verdict seq_tracker::add(uint32_t seq, int64_t t_ns)
+{
+    uint64_t s = seq;
+    if (count_ > 0) {
+        // Nearest 64-bit number to the newest with these low 32 bits
+        uint64_t newest = at(count_ - 1).hi - 1;
+        int64_t d = (int32_t)(seq - (uint32_t)newest);
+        s = d < 0 && (uint64_t)-d > newest ? UINT64_MAX : newest + d;
+    }
+    if (count_ == 0 || s < at(0).lo || s == UINT64_MAX) {
+        seq_verdict v = count_ == 0 ? SEQ_IN_ORDER : SEQ_RESTART;
+        if (v == SEQ_RESTART) {
+            sum_.restarts++;
+            s = seq;
+        }
+        first_ = 0;
+        count_ = 1;
+        at(0) = { s, s + 1 };
+        sum_.received++;
+        return v;
+    }
+
+    interval &last = at(count_ - 1);
+    if (s == last.hi) {
+        last.hi++;
+        sum_.received++;
+        settle();
+        return SEQ_IN_ORDER;
+    }
+    if (s > last.hi) {
+        seq_gap g = { last.hi, s - last.hi, t_ns };
+        history_[history_next_] = g;
+        history_next_ = (history_next_ + 1) % MAX_HISTORY;
+        if (g.count > sum_.longest.count) {
+            sum_.longest = g;
+        }
+        sum_.gaps++;
+        sum_.lost += g.count;
+        sum_.received++;
+        insert(count_, { s, s + 1 });
+        settle();
+        return SEQ_GAP;
+    }
+
+    // Behind the newest: find the last interval starting at or before s
+    size_t lo = 0, hi = count_;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (at(mid).lo <= s) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    interval &a = at(lo);
+    if (s < a.hi) {
+        sum_.duplicates++;
+        return SEQ_DUPLICATE;
+    }
+
+    // In the gap before the next interval
+    interval &b = at(lo + 1);
+    sum_.lost--;
+    sum_.reorders++;
+    sum_.received++;
+    if (s == a.hi && s + 1 == b.lo) {
+        a.hi = b.hi;
+        erase(lo + 1);
+    } else if (s == a.hi) {
+        a.hi++;
+    } else if (s + 1 == b.lo) {
+        b.lo--;
+    } else {
+        insert(lo + 1, { s, s + 1 });
+        settle();
+    }
+    return SEQ_REORDER;
+}
+
+std::vector<seq_gap> seq_tracker::recent_gaps() const
+{
+    size_t n = sum_.gaps < MAX_HISTORY ? (size_t)sum_.gaps : MAX_HISTORY;
+    std::vector<seq_gap> out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        out.push_back(history_[(history_next_ + MAX_HISTORY - n + i) % MAX_HISTORY]);
+    }
+    return out;
+}
+
+} // namespace emg
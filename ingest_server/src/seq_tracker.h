@@ -0,0 +1,106 @@
+/*
+ * Per-device accounting of raw batch sequence numbers.
+ *
+ * The firmware numbers the messages of every type from boot (seq in the
+ * message header); the numbers carry on across reconnects, so a batch the
+ * device could not queue, or one it threw away when the connection broke,
+ * shows up here as a missing number. The tracker keeps the numbers
+ * received as a set of intervals and classifies every batch:
+ *
+ *   in order    the next number after the newest
+ *   gap         further on: the numbers skipped are counted lost
+ *   reorder     fills part of an earlier gap; no longer lost
+ *   duplicate   already received
+ *   restart     before everything still tracked: the device restarted
+ *               its numbering, tracking starts over from it
+ *
+ * An in-order batch extends the newest interval, so the usual cost is O(1).
+ * Only gaps still open are kept: at most MAX_OPEN of them, and none whose
+ * end is HORIZON or more numbers behind the newest; older ones are settled
+ * as lost for good and a late batch before them counts as a restart. The
+ * last MAX_HISTORY gaps are kept with their times, totals for all of them,
+ * so memory is fixed however long the device streams.
+ *
+ * Sequence numbers are 32 bits and extended to 64 relative to the newest,
+ * so they may wrap. Not thread-safe: one tracker per device, used by the
+ * thread that sees its batches in order (the writer thread).
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace emg {
+
+enum seq_verdict : uint8_t {
+    SEQ_IN_ORDER,
+    SEQ_GAP,
+    SEQ_REORDER,
+    SEQ_DUPLICATE,
+    SEQ_RESTART,
+};
+
+/** Numbers [seq, seq + count) missing, noticed at host time t_ns. */
+struct seq_gap {
+    uint64_t seq;
+    uint64_t count;
+    int64_t t_ns;
+};
+
+struct seq_summary {
+    uint64_t received;          // batches, duplicates left out
+    uint64_t lost;              // numbers missing, less those that came late
+    uint64_t gaps;
+    uint64_t duplicates;
+    uint64_t reorders;
+    uint64_t restarts;
+    seq_gap longest;            // count 0 if there was no gap
+
+    /** Percentage of the batches sent that never arrived. */
+    double loss_pct() const { return received + lost ? 100.0 * (double)lost / (double)(received + lost) : 0.0; }
+};
+
+class seq_tracker {
+public:
+    static const size_t MAX_OPEN = 64;          // gaps a late batch may still fill
+    static const uint64_t HORIZON = 1 << 16;    // numbers behind the newest a gap stays open
+    static const size_t MAX_HISTORY = 256;      // recent gaps kept with their times
+
+    /** Account for batch number seq, received at host time t_ns. */
+    seq_verdict add(uint32_t seq, int64_t t_ns);
+
+    /** The gap found by the last add() that returned SEQ_GAP. */
+    const seq_gap &last_gap() const { return history_[(history_next_ + MAX_HISTORY - 1) % MAX_HISTORY]; }
+
+    /** Forget the numbers tracked (the device rebooted); totals stay. */
+    void restart();
+
+    seq_summary summary() const { return sum_; }
+
+    /** The most recent gaps, oldest first, at most MAX_HISTORY. */
+    std::vector<seq_gap> recent_gaps() const;
+
+private:
+    struct interval {
+        uint64_t lo, hi;        // received [lo, hi)
+    };
+
+    void settle();
+    void insert(size_t i, interval v);
+    void erase(size_t i);
+
+    // Received numbers from the oldest open gap on, in order and apart: a
+    // ring with room for one more than the MAX_OPEN + 1 kept, first_ the oldest
+    static const size_t RING = MAX_OPEN + 2;
+    interval iv_[RING] = {};
+    size_t first_ = 0;
+    size_t count_ = 0;
+    interval &at(size_t i) { return iv_[(first_ + i) % RING]; }
+    const interval &at(size_t i) const { return iv_[(first_ + i) % RING]; }
+
+    seq_summary sum_ = {};
+    seq_gap history_[MAX_HISTORY] = {};
+    size_t history_next_ = 0;
+};
+
+} // namespace emg
@@ -0,0 +1,335 @@
+/*
+ * Shared-memory live ring, see shm_ring.h.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "recording.h"
+#include "shm_ring.h"
+#include "wire.h"
+
+namespace emg {
+
+static long futex(const std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, nullptr, 0);
+}
+
+static std::string sys_error(const char *what, const std::string &name)
+{
+    return std::string(what) + " " + name + ": " + strerror(errno);
+}
+
+/*
+ * Map header_size + data bytes of fd with the data mapped a second time
+ * right after itself. Returns the start of the header or nullptr.
+ */
+static uint8_t *map_mirrored(int fd, size_t header_size, size_t data, int prot)
+{
+    size_t len = header_size + 2 * data;
+    void *base = mmap(nullptr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    uint8_t *p = (uint8_t *)base;
+    if (mmap(p, header_size + data, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(p + header_size + data, data, prot, MAP_SHARED | MAP_FIXED, fd, (off_t)header_size) == MAP_FAILED) {
+        munmap(base, len);
+        return nullptr;
+    }
+    return p;
+}
+
+std::string shm_ring_name(const std::string &prefix, const char *device_name)
+{
+    return "/" + prefix + "." + device_name;
+}
+
+/* ---- writer ---- */
+
+shm_ring::~shm_ring()
+{
+    if (!hdr_) {
+        return;
+    }
+    flags_ = SHM_RING_CLOSED;
+    publish();
+    if (!shm_name_.empty()) {
+        shm_unlink(shm_name_.c_str());
+    }
+    munmap(hdr_, map_len_);
+}
+
+bool shm_ring::create(const std::string &shm_name, const char *device_id, const char *name,
+                      size_t capacity_frames, uint32_t frame_bytes, uint32_t frame_rate_hz, std::string *err)
+{
+    // A power of two of at least a page of frames, so that the data region
+    // is a whole number of pages and can be mapped twice
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = 1;
+    while (cap < capacity_frames || cap * frame_bytes < page || (cap * frame_bytes) % page) {
+        cap <<= 1;
+    }
+    size_t data = cap * frame_bytes;
+
+    int fd;
+    if (shm_name.empty()) {
+        fd = memfd_create("emg-ring", MFD_CLOEXEC);
+    } else {
+        // A ring left by a previous run is replaced, not reused: readers
+        // still attached to it keep the old one
+        shm_unlink(shm_name.c_str());
+        fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        *err = sys_error("cannot create", shm_name.empty() ? "ring" : shm_name);
+        return false;
+    }
+    uint8_t *p = nullptr;
+    if (ftruncate(fd, (off_t)(SHM_RING_HEADER_SIZE + data)) == 0) {
+        p = map_mirrored(fd, SHM_RING_HEADER_SIZE, data, PROT_READ | PROT_WRITE);
+    }
+    if (!p) {
+        *err = sys_error("cannot map", shm_name.empty() ? "ring" : shm_name);
+        close(fd);
+        if (!shm_name.empty()) shm_unlink(shm_name.c_str());
+        return false;
+    }
+    close(fd);
+
+    shm_name_ = shm_name;
+    hdr_ = (shm_ring_header *)p;
+    data_ = p + SHM_RING_HEADER_SIZE;
+    map_len_ = SHM_RING_HEADER_SIZE + 2 * data;
+    cap_ = cap;
+    frame_bytes_ = frame_bytes;
+    frame_rate_hz_ = frame_rate_hz;
+    frame_ps_ = 1000000000000ull / frame_rate_hz;
+
+    // The file is fresh and zero filled, so only the fixed fields need setting
+    hdr_->version = SHM_RING_VERSION;
+    hdr_->header_size = SHM_RING_HEADER_SIZE;
+    hdr_->capacity = cap;
+    hdr_->frame_bytes = frame_bytes;
+    hdr_->channels = EMG_NUM_CHANNELS;
+    hdr_->sample_format = REC_FMT_U8_OFFSET;
+    hdr_->writer_pid = (int32_t)getpid();
+    hdr_->created_ns = wall_ns();
+    memcpy(hdr_->device_id, device_id, strnlen(device_id, sizeof(hdr_->device_id) - 1));
+    memcpy(hdr_->name, name, strnlen(name, sizeof(hdr_->name) - 1));
+    hdr_->frame_rate_hz.store(frame_rate_hz, std::memory_order_relaxed);
+    hdr_->frame_ps.store(frame_ps_, std::memory_order_relaxed);
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(hdr_->magic, SHM_RING_MAGIC, sizeof(hdr_->magic));
+    return true;
+}
+
+/* Publish the live fields under the sequence lock and wake waiting readers */
+void shm_ring::publish()
+{
+    uint32_t s = hdr_->seq.load(std::memory_order_relaxed);
+    hdr_->seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr_->written.store(written_, std::memory_order_relaxed);
+    hdr_->next_frame.store(next_frame_, std::memory_order_relaxed);
+    hdr_->gaps.store(gaps_, std::memory_order_relaxed);
+    hdr_->t_ns.store(t_ns_, std::memory_order_relaxed);
+    hdr_->frame_rate_hz.store(frame_rate_hz_, std::memory_order_relaxed);
+    hdr_->flags.store(flags_, std::memory_order_relaxed);
+    hdr_->frame_ps.store(frame_ps_, std::memory_order_relaxed);
+    hdr_->seq.store(s + 2, std::memory_order_release);
+
+    // Readers cannot register as waiters (their mapping is read-only), so
+    // wake unconditionally; without waiters this is a cheap system call,
+    // made once per batch
+    hdr_->futex.fetch_add(1, std::memory_order_release);
+    futex(&hdr_->futex, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+void shm_ring::append(const uint8_t *frames, size_t n, uint64_t frame0, int64_t t_ns)
+{
+    if (n == 0) {
+        return;
+    }
+    if (written_ && frame0 != next_frame_) {
+        gaps_++;
+    }
+    next_frame_ = frame0 + n;
+    t_ns_ = t_ns;
+    flags_ |= SHM_RING_CONNECTED;
+
+    uint64_t end = written_ + n;
+    // Only the newest cap_ frames can survive
+    if (n > cap_) {
+        frames += (n - cap_) * frame_bytes_;
+        n = cap_;
+    }
+    // Frames older than end - cap_ are fair game from here on; readers see
+    // claim move before they can see any of the new bytes
+    hdr_->claim.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(data_ + ((end - n) & (cap_ - 1)) * frame_bytes_, frames, n * frame_bytes_);
+    written_ = end;
+    publish();
+}
+
+void shm_ring::set_connected(bool connected)
+{
+    uint32_t f = connected ? (flags_ | SHM_RING_CONNECTED) : (flags_ & ~SHM_RING_CONNECTED);
+    if (hdr_ && f != flags_) {
+        flags_ = f;
+        publish();
+    }
+}
+
+void shm_ring::set_frame_rate(uint32_t hz)
+{
+    if (hdr_ && hz != frame_rate_hz_) {
+        frame_rate_hz_ = hz;
+        frame_ps_ = 1000000000000ull / hz;
+        publish();
+    }
+}
+
+const uint8_t *shm_ring::latest(size_t n, size_t *got) const
+{
+    n = std::min(n, stored());
+    *got = n;
+    return data_ + ((written_ - n) & (cap_ - 1)) * frame_bytes_;
+}
+
+/* ---- reader ---- */
+
+bool shm_ring_reader::attach(const std::string &shm_name, std::string *err)
+{
+    detach();
+    int fd = shm_open(shm_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        *err = sys_error("cannot open", shm_name);
+        return false;
+    }
+    struct stat st;
+    shm_ring_header h;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+        *err = sys_error("cannot read", shm_name);
+        close(fd);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    size_t data = h.capacity * h.frame_bytes;
+    if (memcmp(h.magic, SHM_RING_MAGIC, sizeof(h.magic)) != 0 || h.version != SHM_RING_VERSION ||
+        h.header_size != SHM_RING_HEADER_SIZE || h.capacity == 0 || (h.capacity & (h.capacity - 1)) ||
+        h.frame_bytes == 0 || (uint64_t)st.st_size != h.header_size + data) {
+        *err = shm_name + ": not a live ring (or not ready yet)";
+        close(fd);
+        return false;
+    }
+    uint8_t *p = map_mirrored(fd, h.header_size, data, PROT_READ);
+    close(fd);
+    if (!p) {
+        *err = sys_error("cannot map", shm_name);
+        return false;
+    }
+    hdr_ = (const shm_ring_header *)p;
+    data_ = p + h.header_size;
+    map_len_ = h.header_size + 2 * data;
+    cap_ = h.capacity;
+    frame_bytes_ = h.frame_bytes;
+    return true;
+}
+
+void shm_ring_reader::detach()
+{
+    if (hdr_) {
+        munmap((void *)hdr_, map_len_);
+        hdr_ = nullptr;
+        data_ = nullptr;
+    }
+}
+
+shm_ring_state shm_ring_reader::state() const
+{
+    shm_ring_state s;
+    for (unsigned spins = 0;; spins++) {
+        uint32_t s0 = hdr_->seq.load(std::memory_order_acquire);
+        if (!(s0 & 1)) {
+            s.written = hdr_->written.load(std::memory_order_relaxed);
+            s.next_frame = hdr_->next_frame.load(std::memory_order_relaxed);
+            s.gaps = hdr_->gaps.load(std::memory_order_relaxed);
+            s.t_ns = hdr_->t_ns.load(std::memory_order_relaxed);
+            s.frame_rate_hz = hdr_->frame_rate_hz.load(std::memory_order_relaxed);
+            s.flags = hdr_->flags.load(std::memory_order_relaxed);
+            s.frame_ps = hdr_->frame_ps.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (hdr_->seq.load(std::memory_order_relaxed) == s0) {
+                return s;
+            }
+        }
+        // The writer holds the lock for a handful of stores; if it got
+        // preempted there, let it run
+        if (spins >= 64) sched_yield();
+    }
+}
+
+const uint8_t *shm_ring_reader::latest(size_t n, uint64_t *first, size_t *got) const
+{
+    uint64_t w = hdr_->written.load(std::memory_order_acquire);
+    n = (size_t)std::min<uint64_t>({ (uint64_t)n, w, (uint64_t)cap_ });
+    *first = w - n;
+    *got = n;
+    return data_ + (*first & (cap_ - 1)) * frame_bytes_;
+}
+
+const uint8_t *shm_ring_reader::since(uint64_t seq, size_t max, uint64_t *first, size_t *got) const
+{
+    uint64_t w = hdr_->written.load(std::memory_order_acquire);
+    uint64_t oldest = w > cap_ ? w - cap_ : 0;
+    uint64_t s = seq < oldest ? std::min(oldest + cap_ / 8, w) : std::min(seq, w);
+    *first = s;
+    *got = (size_t)std::min<uint64_t>(w - s, max);
+    return data_ + (s & (cap_ - 1)) * frame_bytes_;
+}
+
+bool shm_ring_reader::valid(uint64_t seq) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return hdr_->claim.load(std::memory_order_relaxed) <= seq + cap_;
+}
+
+bool shm_ring_reader::wait(uint64_t seq, int timeout_ms) const
+{
+    uint64_t deadline = timeout_ms >= 0 ? now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+    for (;;) {
+        // Read the futex word first: a publish after this changes it and
+        // FUTEX_WAIT returns at once instead of sleeping through it
+        uint32_t f = hdr_->futex.load(std::memory_order_acquire);
+        if (hdr_->written.load(std::memory_order_acquire) > seq) {
+            return true;
+        }
+        if (hdr_->flags.load(std::memory_order_acquire) & SHM_RING_CLOSED) {
+            return false;
+        }
+        struct timespec ts, *tp = nullptr;
+        if (timeout_ms >= 0) {
+            uint64_t now = now_ns();
+            if (now >= deadline) {
+                return false;
+            }
+            ts.tv_sec = (time_t)((deadline - now) / 1000000000ull);
+            ts.tv_nsec = (long)((deadline - now) % 1000000000ull);
+            tp = &ts;
+        }
+        futex(&hdr_->futex, FUTEX_WAIT, f, tp);
+    }
+}
+
+} // namespace emg
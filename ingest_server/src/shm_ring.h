@@ -0,0 +1,213 @@
+/*
+ * Per-device live ring of raw frames in POSIX shared memory.
+ *
+ * The consumer thread publishes every raw frame of a device into
+ * /dev/shm/<prefix>.<device name>; any number of local processes (plotter,
+ * analysis, classifier) attach read-only and look at the frames in place.
+ * The writer never waits for a reader: a reader that falls more than a
+ * ring behind finds out by checking valid() after using its view.
+ *
+ * Layout:
+ *
+ *   header      4096 bytes: shm_ring_header, zero padded
+ *   data        capacity * frame_bytes, sample-major frames as received
+ *
+ * Every frame published gets the next sequence number, counting from 0; the
+ * frame with sequence s lives in slot s % capacity. Readers map the data
+ * region twice, back to back, so any run of up to capacity frames is one
+ * contiguous array, whatever its position in the ring.
+ *
+ * The header's live fields (frames written, device frame index, time,
+ * state) are published under a sequence lock: the writer makes seq odd,
+ * updates them and makes it even again, and a reader retries until it read
+ * them between two equal, even values. Before overwriting slots the writer
+ * advances claim, so frames from sequence s on are intact as long as
+ * claim - capacity <= s. futex is bumped after every publish and can be
+ * waited on with FUTEX_WAIT (shared, not private) for new frames.
+ *
+ * t_ns and frame_ps, from the server's clock model, put every frame on the
+ * host clock: frame s was acquired at t_ns - (written - 1 - s) * frame_ps /
+ * 1000 unless there is a device gap between s and the newest frame.
+ *
+ * All fields are native-endian; readers are on the same machine.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace emg {
+
+constexpr char     SHM_RING_MAGIC[8] = { 'E', 'M', 'G', 'R', 'I', 'N', 'G', '\n' };
+constexpr uint32_t SHM_RING_VERSION = 1;
+constexpr uint32_t SHM_RING_HEADER_SIZE = 4096;
+
+enum : uint32_t {
+    SHM_RING_CONNECTED = 1u << 0,   // the device is connected
+    SHM_RING_CLOSED    = 1u << 1,   // the writer has gone; nothing more will be published
+};
+
+struct shm_ring_header {
+    // Fixed; set before the magic
+    char     magic[8];          // SHM_RING_MAGIC
+    uint32_t version;           // SHM_RING_VERSION
+    uint32_t header_size;       // SHM_RING_HEADER_SIZE; data starts here
+    uint64_t capacity;          // frames, a power of two
+    uint32_t frame_bytes;
+    uint16_t channels;
+    uint8_t  sample_format;     // REC_FMT_*
+    uint8_t  reserved0;
+    int32_t  writer_pid;
+    uint32_t reserved1;
+    int64_t  created_ns;        // wall clock (UNIX ns)
+    char     device_id[32];     // NUL padded
+    char     name[64];          // NUL padded
+    uint8_t  reserved2[48];
+
+    // Live; own cache lines
+    std::atomic<uint32_t> seq;          // sequence lock over the fields below it
+    std::atomic<uint32_t> futex;        // incremented after every publish
+    std::atomic<uint64_t> claim;        // frames up to here may be being written
+    std::atomic<uint64_t> written;      // frames published in total
+    std::atomic<uint64_t> next_frame;   // device frame index after the newest frame
+    std::atomic<uint64_t> gaps;         // discontinuities in device frame index
+    std::atomic<int64_t>  t_ns;         // host wall clock of the newest frame (clock_model.h)
+    std::atomic<uint32_t> frame_rate_hz;
+    std::atomic<uint32_t> flags;        // SHM_RING_*
+    std::atomic<uint64_t> frame_ps;     // frame period on the host clock, picoseconds
+};
+static_assert(sizeof(shm_ring_header) == 256, "shm_ring_header must be 256 bytes");
+static_assert(offsetof(shm_ring_header, seq) == 192, "live fields must start a cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+/** Consistent snapshot of a ring's live fields. */
+struct shm_ring_state {
+    uint64_t written;
+    uint64_t next_frame;
+    uint64_t gaps;
+    int64_t t_ns;
+    uint32_t frame_rate_hz;
+    uint32_t flags;
+    uint64_t frame_ps;
+};
+
+/** Shared memory name of a device's ring: "/<prefix>.<name>". */
+std::string shm_ring_name(const std::string &prefix, const char *device_name);
+
+/**
+ * Writing side, owned by one thread.
+ */
+class shm_ring {
+public:
+    shm_ring() = default;
+    ~shm_ring();
+
+    shm_ring(const shm_ring &) = delete;
+    shm_ring &operator=(const shm_ring &) = delete;
+
+    /**
+     * Create the ring shm_name (see shm_ring_name()), replacing any left
+     * behind, with room for at least capacity_frames. An empty shm_name
+     * gives a ring in private memory that no other process can see.
+     */
+    bool create(const std::string &shm_name, const char *device_id, const char *name,
+                size_t capacity_frames, uint32_t frame_bytes, uint32_t frame_rate_hz, std::string *err);
+
+    /**
+     * Publish n frames whose first device frame index is frame0; t_ns is
+     * the host time of the last of them.
+     */
+    void append(const uint8_t *frames, size_t n, uint64_t frame0, int64_t t_ns);
+
+    void set_connected(bool connected);
+    void set_frame_rate(uint32_t hz);
+    /** Frame period on the host clock, published with the next append(). */
+    void set_frame_period(uint64_t ps) { frame_ps_ = ps; }
+
+    /** Newest min(n, stored()) frames, oldest first, in place. */
+    const uint8_t *latest(size_t n, size_t *got) const;
+
+    const std::string &shm_name() const { return shm_name_; }
+    size_t capacity() const { return cap_; }
+    size_t stored() const { return written_ < cap_ ? written_ : cap_; }
+    uint64_t written() const { return written_; }
+    uint64_t next_frame() const { return next_frame_; }
+    uint64_t gaps() const { return gaps_; }
+
+private:
+    void publish();
+
+    std::string shm_name_;
+    shm_ring_header *hdr_ = nullptr;
+    uint8_t *data_ = nullptr;
+    size_t map_len_ = 0;
+    size_t cap_ = 0;
+    uint32_t frame_bytes_ = 0;
+    uint64_t written_ = 0;
+    uint64_t next_frame_ = 0;
+    uint64_t gaps_ = 0;
+    int64_t t_ns_ = 0;
+    uint32_t frame_rate_hz_ = 0;
+    uint32_t flags_ = 0;
+    uint64_t frame_ps_ = 0;
+};
+
+/**
+ * Reading side: a read-only, zero-copy view of a ring, possibly in another
+ * process. Pointers returned stay mapped until detach(), but the frames
+ * they point at are overwritten once the writer has gone a ring further;
+ * check valid() after using them.
+ */
+class shm_ring_reader {
+public:
+    shm_ring_reader() = default;
+    ~shm_ring_reader() { detach(); }
+
+    shm_ring_reader(const shm_ring_reader &) = delete;
+    shm_ring_reader &operator=(const shm_ring_reader &) = delete;
+
+    bool attach(const std::string &shm_name, std::string *err);
+    void detach();
+    bool attached() const { return hdr_ != nullptr; }
+
+    const shm_ring_header &header() const { return *hdr_; }
+    size_t capacity() const { return cap_; }
+    uint32_t frame_bytes() const { return frame_bytes_; }
+
+    shm_ring_state state() const;
+
+    /**
+     * The newest min(n, stored) frames, oldest first.
+     * @param first  sequence number of the first frame returned
+     * @param got    frames returned
+     */
+    const uint8_t *latest(size_t n, uint64_t *first, size_t *got) const;
+
+    /**
+     * Frames from sequence seq on, at most max. If seq has already been
+     * overwritten, *first > seq tells how many were lost: the view then
+     * starts an eighth of the ring after the oldest frame still stored, so
+     * that the writer's next batches do not overrun it straight away.
+     */
+    const uint8_t *since(uint64_t seq, size_t max, uint64_t *first, size_t *got) const;
+
+    /** True while frames from sequence seq on have not been overwritten. */
+    bool valid(uint64_t seq) const;
+
+    /**
+     * Wait until more than seq frames have been written, the writer closes
+     * the ring, or timeout_ms passes (< 0: no timeout).
+     * @return true if more than seq frames have been written
+     */
+    bool wait(uint64_t seq, int timeout_ms) const;
+
+private:
+    const shm_ring_header *hdr_ = nullptr;
+    const uint8_t *data_ = nullptr;
+    size_t map_len_ = 0;
+    size_t cap_ = 0;
+    uint32_t frame_bytes_ = 0;
+};
+
+} // namespace emg
@@ -0,0 +1,79 @@
+/*
+ * Bounded single-producer / single-consumer queue.
+ *
+ * Lock-free ring with one atomic index per side; each side keeps a cached
+ * copy of the other's index so the common case touches no shared cache line.
+ * Used to hand chunks from the network thread to the writer and consumer
+ * threads.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace emg {
+
+template <typename T>
+class spsc_queue {
+public:
+    // capacity is rounded up to a power of two
+    explicit spsc_queue(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+
+    spsc_queue(const spsc_queue &) = delete;
+    spsc_queue &operator=(const spsc_queue &) = delete;
+
+    /** Producer side. Returns false when full. */
+    bool push(const T &v)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = v;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer side. Returns false when empty. */
+    bool pop(T &out)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        out = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Approximate fill level, callable from any thread. */
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+
+    alignas(64) std::atomic<size_t> head_{0};   // written by the consumer
+    size_t tail_cache_ = 0;                     // consumer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0};   // written by the producer
+    size_t head_cache_ = 0;                     // producer's view of head_
+};
+
+} // namespace emg
@@ -0,0 +1,66 @@
+/*
+ * Fixed table of device streams shared by the ingest threads.
+ *
+ * A slot belongs to one device for the lifetime of the server. It is claimed
+ * by the network thread the first time the device connects, identified by
+ * the MAC address in its hello message (or by its IP address if it sends
+ * none), and a reconnect of the same device reattaches to the same slot, so
+ * its file, ring buffer and counters simply continue.
+ *
+ * Identity fields are written once, before the slot is marked in_use, and
+ * are read-only afterwards. Counters are relaxed atomics written by one
+ * thread and read by the reporting thread.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include "emg_proto.h"
+
+namespace emg {
+
+constexpr uint32_t MAX_STREAMS = 64;
+constexpr uint32_t NO_STREAM = UINT32_MAX;
+
+struct stream_stats {
+    // network thread
+    std::atomic<uint64_t> bytes{0};           // protocol bytes accepted
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> frames{0};          // raw frames received
+    std::atomic<uint64_t> resync_bytes{0};    // garbage skipped while looking for a header
+    std::atomic<uint64_t> stalls{0};          // reads deferred because no chunk was free
+    std::atomic<uint64_t> consumer_drops{0};  // chunks not offered to the consumer (queue full)
+    std::atomic<uint64_t> last_recv_ns{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> reboots{0};         // reconnects with a new boot id
+    std::atomic<uint64_t> disconnect_ns{0};   // when the device last went away
+    // writer thread
+    std::atomic<uint64_t> write_errors{0};
+    std::atomic<uint64_t> writer_lag_ns{0};   // newest chunk: write time - receive time
+    std::atomic<uint64_t> seq_lost{0};        // raw batches missing by sequence number (seq_tracker.h)
+    std::atomic<uint64_t> seq_duplicates{0};
+    std::atomic<uint64_t> seq_reorders{0};
+
+    void reset()
+    {
+        for (std::atomic<uint64_t> *c : { &bytes, &messages, &frames, &resync_bytes, &stalls,
+                                          &consumer_drops, &last_recv_ns, &connects, &reboots,
+                                          &disconnect_ns, &write_errors, &writer_lag_ns, &seq_lost,
+                                          &seq_duplicates, &seq_reorders }) {
+            c->store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct stream_slot {
+    std::atomic<bool> in_use{false};
+    std::atomic<bool> connected{false};
+    char device_id[32] = {0};   // "mac-a4cf12ab34cd" or "ip-10.0.0.7"
+    char name[64] = {0};        // file-safe name: optional label + device id
+    char peer[64] = {0};        // current or last peer address, for display
+    emg_hello_msg_t hello = {}; // most recent hello (network thread only)
+    bool has_hello = false;
+    stream_stats stats;
+};
+
+} // namespace emg
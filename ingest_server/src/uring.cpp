@@ -0,0 +1,154 @@
+/*
+ * Minimal io_uring wrapper, see uring.h.
+ */
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "uring.h"
+
+namespace emg {
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int sys_register(int fd, unsigned op, const void *arg, unsigned n)
+{
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+uring::~uring()
+{
+    if (sqes_) munmap(sqes_, sqes_len_);
+    if (cq_map_ && cq_map_ != sq_map_) munmap(cq_map_, cq_map_len_);
+    if (sq_map_) munmap(sq_map_, sq_map_len_);
+    if (fd_ >= 0) close(fd_);
+}
+
+bool uring::init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd_ = sys_setup(entries, &p);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    sq_map_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sq_map_len_ = cq_map_len_ = sq_map_len_ > cq_map_len_ ? sq_map_len_ : cq_map_len_;
+    }
+    sq_map_ = mmap(nullptr, sq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED) {
+        sq_map_ = nullptr;
+        return false;
+    }
+    if (single) {
+        cq_map_ = sq_map_;
+    } else {
+        cq_map_ = mmap(nullptr, cq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_map_ == MAP_FAILED) {
+            cq_map_ = nullptr;
+            return false;
+        }
+    }
+    sqes_len_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe *)mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        return false;
+    }
+
+    uint8_t *sq = (uint8_t *)sq_map_;
+    uint8_t *cq = (uint8_t *)cq_map_;
+    sq_head_ = (unsigned *)(sq + p.sq_off.head);
+    sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask_ = (unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *)(sq + p.sq_off.array);
+    cq_head_ = (unsigned *)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask_ = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    sq_entries_ = p.sq_entries;
+    local_tail_ = submitted_tail_ = *sq_tail_;
+    return true;
+}
+
+bool uring::register_buffers(const struct iovec *iov, unsigned n)
+{
+    return sys_register(fd_, IORING_REGISTER_BUFFERS, iov, n) == 0;
+}
+
+bool uring::register_files(const int *fds, unsigned n)
+{
+    return sys_register(fd_, IORING_REGISTER_FILES, fds, n) == 0;
+}
+
+bool uring::update_file(unsigned slot, int fd)
+{
+    struct io_uring_files_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = slot;
+    up.fds = (uint64_t)(uintptr_t)&fd;
+    return sys_register(fd_, IORING_REGISTER_FILES_UPDATE, &up, 1) == 1;
+}
+
+bool uring::register_eventfd(int efd)
+{
+    return sys_register(fd_, IORING_REGISTER_EVENTFD, &efd, 1) == 0;
+}
+
+struct io_uring_sqe *uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (local_tail_ - head >= sq_entries_) {
+        return nullptr;
+    }
+    unsigned idx = local_tail_ & *sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    local_tail_++;
+    return sqe;
+}
+
+int uring::submit(unsigned wait_nr)
+{
+    unsigned n = local_tail_ - submitted_tail_;
+    if (n) {
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+        submitted_tail_ = local_tail_;
+    }
+    if (n == 0 && wait_nr == 0) {
+        return 0;
+    }
+    int r;
+    do {
+        r = sys_enter(fd_, n, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+bool uring::peek(struct io_uring_cqe *out)
+{
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *out = cqes_[head & *cq_mask_];
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+} // namespace emg
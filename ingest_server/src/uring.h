@@ -0,0 +1,69 @@
+/*
+ * Minimal io_uring wrapper on the raw system calls (no liburing).
+ *
+ * Only what the disk writer needs: one submission and one completion ring,
+ * registered buffers and files, and an eventfd signalled on completions.
+ * init() fails cleanly where io_uring is missing or disabled (old kernels,
+ * seccomp, io_uring_disabled), and the caller falls back to pwrite().
+ */
+#pragma once
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace emg {
+
+class uring {
+public:
+    uring() = default;
+    ~uring();
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    /** Set up rings with at least entries slots; false (errno set) if unavailable. */
+    bool init(unsigned entries);
+
+    bool register_buffers(const struct iovec *iov, unsigned n);
+    /** Register a table of n files; -1 entries are empty slots. */
+    bool register_files(const int *fds, unsigned n);
+    /** Replace the file in slot (-1 to empty it). */
+    bool update_file(unsigned slot, int fd);
+    /** Signal efd whenever a completion is posted. */
+    bool register_eventfd(int efd);
+
+    /** Next free submission entry, zeroed, or nullptr if the ring is full. */
+    struct io_uring_sqe *get_sqe();
+
+    /** Submit prepared entries and wait for at least wait_nr completions. */
+    int submit(unsigned wait_nr = 0);
+
+    /** Pop one completion; false if there is none. */
+    bool peek(struct io_uring_cqe *out);
+
+    unsigned entries() const { return sq_entries_; }
+
+private:
+    int fd_ = -1;
+    void *sq_map_ = nullptr;
+    void *cq_map_ = nullptr;
+    size_t sq_map_len_ = 0;
+    size_t cq_map_len_ = 0;
+    struct io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_len_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    struct io_uring_cqe *cqes_ = nullptr;
+
+    unsigned sq_entries_ = 0;
+    unsigned local_tail_ = 0;       // entries handed out by get_sqe()
+    unsigned submitted_tail_ = 0;   // entries published to the kernel
+};
+
+} // namespace emg
@@ -0,0 +1,49 @@
+/*
+ * Sleep/wake signal for a thread draining a lock-free queue.
+ *
+ * Backed by an eventfd: notify() increments the counter, wait() blocks until
+ * it is non-zero and clears it. A notify that races with the consumer going
+ * to sleep is never lost, so the queue itself needs no lock.
+ */
+#pragma once
+#include <cstdint>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace emg {
+
+class wakeup {
+public:
+    wakeup() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~wakeup() { if (fd_ >= 0) close(fd_); }
+
+    wakeup(const wakeup &) = delete;
+    wakeup &operator=(const wakeup &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+
+    void notify()
+    {
+        uint64_t one = 1;
+        ssize_t r = write(fd_, &one, sizeof(one));
+        (void)r;   // only fails if the counter would overflow, i.e. already signalled
+    }
+
+    /** Block until notified or timeout_ms elapses (-1 = forever). Returns true if notified. */
+    bool wait(int timeout_ms)
+    {
+        struct pollfd p = { fd_, POLLIN, 0 };
+        if (poll(&p, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        uint64_t v;
+        return read(fd_, &v, sizeof(v)) == (ssize_t)sizeof(v);
+    }
+
+private:
+    int fd_;
+};
+
+} // namespace emg
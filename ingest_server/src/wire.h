@@ -0,0 +1,66 @@
+/*
+ * Host-side helpers for the wire protocol in tcp_client/main/emg_proto.h.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <time.h>
+#include "emg_proto.h"
+
+namespace emg {
+
+constexpr size_t MSG_HDR_SIZE = sizeof(emg_msg_hdr_t);
+
+// Largest payload accepted; anything bigger is treated as stream corruption
+constexpr uint32_t MSG_MAX_PAYLOAD = 128 * 1024;
+
+inline bool header_valid(const emg_msg_hdr_t &h)
+{
+    return h.magic == EMG_MSG_MAGIC && h.version == EMG_PROTO_VERSION &&
+           h.type != 0 && h.type < EMG_MSG_TYPE_COUNT && h.len <= MSG_MAX_PAYLOAD &&
+           (h.type != EMG_MSG_RAW_BATCH || h.len == (uint64_t)h.count * EMG_FRAME_BYTES);
+}
+
+inline emg_msg_hdr_t load_header(const uint8_t *p)
+{
+    emg_msg_hdr_t h;
+    memcpy(&h, p, sizeof(h));
+    return h;
+}
+
+/**
+ * Call fn(hdr, payload) for every message in a buffer of whole, already
+ * validated messages (the contents of a chunk).
+ */
+template <typename Fn>
+void for_each_message(const uint8_t *data, size_t len, Fn &&fn)
+{
+    size_t pos = 0;
+    while (len - pos >= MSG_HDR_SIZE) {
+        emg_msg_hdr_t h = load_header(data + pos);
+        if (len - pos - MSG_HDR_SIZE < h.len) {
+            break;
+        }
+        fn(h, data + pos + MSG_HDR_SIZE);
+        pos += MSG_HDR_SIZE + h.len;
+    }
+}
+
+/** Monotonic clock in nanoseconds. */
+inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/** Wall clock (UNIX time) in nanoseconds. */
+inline int64_t wall_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace emg
@@ -0,0 +1,308 @@
+/*
+ * BDF+ export read back by a small BDF+ parser: streams of frames written
+ * in random batches with a short gap (zero filled), a long gap and a
+ * reboot (new records, BDF+D), markers and a flood of annotations, for
+ * uint8 and int16 recordings. Checks the header fields, the patched record
+ * count and file type, every sample of every record at the position its
+ * time-keeping annotation gives (records never overlap), and the onset, duration and text of every
+ * annotation.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "bdf_writer.h"
+#include "emg_proto.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                      \
+    do {                                                                                                      \
+        if (!(cond)) {                                                                                        \
+            fprintf(stderr, "FAIL: " __VA_ARGS__);                                                            \
+            fprintf(stderr, "\n");                                                                            \
+            failures++;                                                                                       \
+        }                                                                                                     \
+    } while (0)
+
+struct annotation {
+    double onset, duration;
+    std::string text;
+};
+
+/* What a BDF+ reader sees */
+struct bdf_file {
+    std::string reserved;
+    long records = 0;
+    double record_s = 0;
+    std::vector<std::string> labels;
+    std::vector<long> spr, dig_min, dig_max;
+    std::vector<double> onsets;                 // time-keeping annotation of every record
+    std::vector<std::vector<int32_t>> samples;  // per signal, all records
+    std::vector<annotation> notes;
+};
+
+static std::string text(const std::string &h, size_t off, size_t len)
+{
+    std::string s = h.substr(off, len);
+    s.erase(s.find_last_not_of(' ') + 1);
+    return s;
+}
+
+static bool parse(const std::string &path, bdf_file &f)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    std::string d;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) d.append(buf, n);
+    fclose(fp);
+    if (d.size() < 256 || (uint8_t)d[0] != 0xff || d.compare(1, 7, "BIOSEMI") != 0) return false;
+    size_t hbytes = (size_t)atol(text(d, 184, 8).c_str());
+    f.reserved = text(d, 192, 44);
+    f.records = atol(text(d, 236, 8).c_str());
+    f.record_s = atof(text(d, 244, 8).c_str());
+    size_t ns = (size_t)atol(text(d, 252, 4).c_str());
+    if (hbytes != 256 * (ns + 1) || d.size() < hbytes) return false;
+    size_t base = 256, rec_bytes = 0;
+    for (size_t i = 0; i < ns; i++) {
+        f.labels.push_back(text(d, base + 16 * i, 16));
+        f.dig_min.push_back(atol(text(d, base + ns * 120 + 8 * i, 8).c_str()));
+        f.dig_max.push_back(atol(text(d, base + ns * 128 + 8 * i, 8).c_str()));
+        f.spr.push_back(atol(text(d, base + ns * 216 + 8 * i, 8).c_str()));
+        rec_bytes += 3 * (size_t)f.spr.back();
+    }
+    if ((d.size() - hbytes) % rec_bytes != 0 || (long)((d.size() - hbytes) / rec_bytes) != f.records) return false;
+    f.samples.assign(ns, {});
+    for (long r = 0; r < f.records; r++) {
+        const uint8_t *p = (const uint8_t *)d.data() + hbytes + r * rec_bytes;
+        for (size_t i = 0; i < ns; i++) {
+            if (f.labels[i] == "BDF Annotations") {
+                // TALs: +onset[\x15duration]\x14text\x14...\0
+                std::string a((const char *)p, 3 * (size_t)f.spr[i]);
+                size_t pos = 0;
+                bool first = true;
+                while (pos < a.size() && a[pos] != '\0') {
+                    size_t end = a.find('\0', pos);
+                    std::string tal = a.substr(pos, end - pos);
+                    size_t t1 = tal.find('\x14');
+                    std::string head = tal.substr(0, t1), body = tal.substr(t1 + 1);
+                    size_t dur = head.find('\x15');
+                    annotation an;
+                    an.onset = atof(head.substr(0, dur).c_str());
+                    an.duration = dur == std::string::npos ? 0 : atof(head.substr(dur + 1).c_str());
+                    an.text = body.substr(0, body.find('\x14'));
+                    if (first) {
+                        f.onsets.push_back(an.onset);
+                        if (!an.text.empty()) return false;
+                    } else {
+                        f.notes.push_back(an);
+                    }
+                    first = false;
+                    pos = end + 1;
+                }
+                if (first) return false;
+            } else {
+                for (long k = 0; k < f.spr[i]; k++) {
+                    int32_t v = p[3 * k] | p[3 * k + 1] << 8 | (int32_t)(int8_t)p[3 * k + 2] << 16;
+                    f.samples[i].push_back(v);
+                }
+            }
+            p += 3 * (size_t)f.spr[i];
+        }
+    }
+    return true;
+}
+
+static bool has_note(const bdf_file &f, const char *text, double onset, double duration)
+{
+    for (const annotation &a : f.notes) {
+        if (a.text == text && std::fabs(a.onset - onset) < 1e-5 && std::fabs(a.duration - duration) < 1e-5) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int run(const std::string &dir, uint8_t format, uint16_t channels, uint32_t rate, double record_s,
+               std::mt19937 &rng)
+{
+    std::string path = dir + "/export.bdf";
+    emg::rec_file_header hdr = {};
+    hdr.channels = channels;
+    hdr.sample_format = format;
+    hdr.frame_rate_hz = rate;
+    snprintf(hdr.name, sizeof(hdr.name), "rig A");
+    emg::bdf_options opt;
+    opt.record_s = record_s;
+    opt.lsb_uv = format == emg::REC_FMT_I16 ? 0.5 : 0.0;
+    emg::bdf_writer w;
+    std::string err;
+    if (!w.open(path, hdr, opt, &err)) {
+        CHECK(false, "open: %s", err.c_str());
+        return 1;
+    }
+    const uint32_t spr = (uint32_t)std::lround(rate * record_s);
+    const uint32_t fb = emg::rec_frame_bytes(format, channels);
+    const int64_t t0 = 1740823200123456789ll;           // first frame, host time
+    const int64_t ns_per_frame = 1000000000ll / rate;   // host times only place the reboot
+    const double first_s = (double)(t0 % 1000000000) / 1e9;
+
+    std::map<uint64_t, std::vector<int32_t>> expect;    // position -> digital values
+    std::vector<uint8_t> batch;
+    // Write frames [f0, f1) at positions from p0, in random batches
+    auto write = [&](uint64_t f0, uint64_t f1, uint64_t p0, int64_t t_first) {
+        for (uint64_t f = f0; f < f1;) {
+            uint32_t n = (uint32_t)std::min<uint64_t>(f1 - f, 1 + rng() % (spr + 7));
+            batch.resize((size_t)n * fb);
+            for (uint32_t i = 0; i < n; i++) {
+                std::vector<int32_t> &v = expect[p0 + (f - f0) + i];
+                for (size_t c = 0; c < channels; c++) {
+                    if (format == emg::REC_FMT_U8_OFFSET) {
+                        uint8_t s = (uint8_t)rng();
+                        batch[(size_t)i * fb + c] = s;
+                        v.push_back(s - EMG_SAMPLE_ZERO);
+                    } else {
+                        int16_t s = (int16_t)rng();
+                        memcpy(&batch[(size_t)i * fb + 2 * c], &s, 2);
+                        v.push_back(s);
+                    }
+                }
+            }
+            CHECK(w.append(batch.data(), n, f, t_first + (int64_t)(f - f0) * ns_per_frame), "append");
+            f += n;
+        }
+    };
+
+    w.annotate(0, t0 - 250000000, 0, "connect 10.0.0.7");          // before any frame: by host time
+    write(1000, 1000 + 3 * spr + spr / 3, 0, t0);
+    uint64_t pos = 3 * spr + spr / 3;
+    // A gap inside a record: zeros, no new record
+    uint64_t small = spr / 5;
+    write(1000 + pos + small, 1000 + pos + small + spr, pos + small, t0 + (int64_t)(pos + small) * ns_per_frame);
+    w.annotate(1000 + pos + small + 10, 0, 5, "marker \x14one\n");   // by frame; control characters go
+    double gap1 = first_s + (double)pos / rate;
+    pos += small + spr;
+    // A gap past the end of the record: the next record starts at the gap's end
+    uint64_t big = 5 * spr / 2;
+    double gap2 = first_s + (double)pos / rate;
+    write(1000 + pos + big, 1000 + pos + big + spr + 3, pos + big, t0 + (int64_t)(pos + big) * ns_per_frame);
+    pos += big + spr + 3;
+    // Reboot: frames restart at 0, placed by host time, after a pad to the record's end
+    double pad_at = first_s + (double)pos / rate, pad_len = (double)(spr - (spr + 3) % spr) / rate;
+    uint64_t reboot = pos + 10 * spr;
+    write(0, 2 * spr + 1, reboot, t0 + (int64_t)reboot * ns_per_frame);
+    pos = reboot + 2 * spr + 1;
+    CHECK(w.close(), "close");
+
+    bdf_file f;
+    CHECK(parse(path, f), "%s does not parse as BDF+", path.c_str());
+    int checks = 1;
+    CHECK(f.reserved == "BDF+D", "file type '%s', want BDF+D", f.reserved.c_str());
+    CHECK(f.labels.size() == (size_t)channels + 1 && f.labels[0] == "EMG0" && f.labels.back() == "BDF Annotations",
+          "signal labels");
+    CHECK(f.spr.size() == f.labels.size() && f.spr[0] == (long)spr && std::fabs(f.record_s - record_s) < 1e-9,
+          "samples per record %ld, record %g s", f.spr.empty() ? 0 : f.spr[0], f.record_s);
+    CHECK((uint64_t)f.records == w.records() && f.records > 0, "%ld records in the header, %llu written", f.records,
+          (unsigned long long)w.records());
+    long dmin = format == emg::REC_FMT_U8_OFFSET ? -128 : -32768, dmax = -dmin - 1;
+    CHECK(!f.dig_min.empty() && f.dig_min[0] == dmin && f.dig_max[0] == dmax, "digital range");
+    checks += 5;
+
+    // Every record at the position its onset gives: written frames, zero elsewhere
+    int bad = 0;
+    for (long r = 0; r < f.records && bad < 5; r++) {
+        double at = (f.onsets[r] - first_s) * rate;
+        uint64_t p0 = (uint64_t)std::llround(at);
+        if (std::fabs(at - (double)p0) > 1e-3) {
+            fprintf(stderr, "FAIL: record %ld at onset %.6f\n", r, f.onsets[r]);
+            bad++;
+            continue;
+        }
+        if (r > 0 && f.onsets[r] < f.onsets[r - 1] + record_s - 1e-6) bad++;
+        for (uint32_t i = 0; i < spr; i++) {
+            auto it = expect.find(p0 + i);
+            for (size_t c = 0; c < channels; c++) {
+                int32_t want = it == expect.end() ? 0 : it->second[c];
+                if (f.samples[c][(size_t)r * spr + i] != want) bad++;
+            }
+        }
+    }
+    CHECK(bad == 0, "record samples or onsets differ");
+    // Every written frame is in some record
+    size_t covered = 0;
+    for (double o : f.onsets) {
+        uint64_t p0 = (uint64_t)std::llround((o - first_s) * rate);
+        for (uint32_t i = 0; i < spr; i++) covered += expect.count(p0 + i);
+    }
+    CHECK(covered == expect.size(), "%zu of %zu frames in records", covered, expect.size());
+    CHECK(f.onsets.size() == (size_t)f.records, "record without time-keeping annotation");
+    checks += 3;
+
+    CHECK(has_note(f, "connect 10.0.0.7", first_s - 0.25, 0), "connect annotation");
+    CHECK(has_note(f, "gap", gap1, (double)small / rate), "short gap annotation");
+    CHECK(has_note(f, "gap", gap2, (double)big / rate), "long gap annotation");
+    CHECK(has_note(f, "marker  one ", first_s + (double)(3 * spr + spr / 3 + small + 10) / rate, 5.0 / rate),
+          "marker annotation");
+    CHECK(has_note(f, "no data", pad_at, pad_len), "pad annotation");
+    CHECK(f.notes.size() == 5, "%zu annotations, want 5", f.notes.size());
+    checks += 6;
+    unlink(path.c_str());
+    return checks;
+}
+
+/* Continuous: BDF+C; and a flood of annotations is capped, not buffered */
+static int flood(const std::string &dir)
+{
+    std::string path = dir + "/flood.bdf";
+    emg::rec_file_header hdr = {};
+    hdr.channels = 4;
+    hdr.sample_format = emg::REC_FMT_U8_OFFSET;
+    hdr.frame_rate_hz = 2048;
+    emg::bdf_writer w;
+    CHECK(w.open(path, hdr), "open");
+    std::vector<uint8_t> frames(4 * 2048, 128);
+    size_t notes = 3 * emg::bdf_writer::MAX_PENDING;
+    for (size_t i = 0; i < notes; i++) {
+        w.annotate(0, 1740823200000000000ll, 0, "n");
+    }
+    for (int s = 0; s < 4; s++) {
+        w.append(frames.data(), 2048, (uint64_t)s * 2048, 1740823200000000000ll + s * 1000000000ll);
+    }
+    CHECK(w.close(), "close");
+    bdf_file f;
+    CHECK(parse(path, f), "flood file does not parse");
+    CHECK(f.reserved == "BDF+C" && f.records == 4, "continuous file: %s, %ld records", f.reserved.c_str(), f.records);
+    CHECK(f.notes.size() + w.dropped() == notes && w.dropped() >= notes - emg::bdf_writer::MAX_PENDING,
+          "%zu annotations written, %llu dropped of %zu", f.notes.size(), (unsigned long long)w.dropped(), notes);
+    unlink(path.c_str());
+
+    // No frames at all: a valid file with no records
+    CHECK(w.open(path, hdr) && w.close() && parse(path, f) && f.records == 0, "empty export");
+    unlink(path.c_str());
+    return 5;
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_bdf_writer.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(47);
+    int checks = 0;
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 64, 2048, 1.0, rng);
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 3, 1000, 0.5, rng);
+    checks += run(dir, emg::REC_FMT_I16, 7, 500, 2.0, rng);
+    checks += flood(dir);
+    rmdir(dir);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Clock model against simulated devices: crystal drift, a fixed minimum
+ * delay with exponential jitter and rare long delays on top, stalls that
+ * deliver a backlog in a burst, reboots and clock steps.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "clock_model.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                             \
+    do {                                                                                                             \
+        if (!(cond)) {                                                                                               \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);                                                     \
+            fprintf(stderr, __VA_ARGS__);                                                                            \
+            fprintf(stderr, "\n");                                                                                   \
+            failures++;                                                                                              \
+        }                                                                                                            \
+    } while (0)
+
+static const int64_t BATCH_NS = 15625000;       // 32 frames at 2048 Hz
+static const int64_t MIN_DELAY_NS = 3000000;
+
+/* A device whose clock runs drift_ppm slow against the host's, sending one batch per BATCH_NS */
+struct sim {
+    double drift_ppm;
+    int64_t dev0_ns;
+    int64_t host0_ns;
+    std::mt19937_64 rng{ 42 };
+
+    int64_t dev_ns(int64_t k) const { return dev0_ns + k * BATCH_NS; }
+
+    /* When batch k was acquired, on the host clock */
+    int64_t acquired(int64_t k) const { return host0_ns + (int64_t)llround(k * BATCH_NS * (1.0 + drift_ppm * 1e-6)); }
+
+    int64_t delay()
+    {
+        std::exponential_distribution<double> jitter(1.0 / 1e6);    // mean 1 ms
+        double d = MIN_DELAY_NS + jitter(rng);
+        if (std::uniform_int_distribution<int>(0, 99)(rng) < 5) {
+            d += std::uniform_real_distribution<double>(20e6, 200e6)(rng);
+        }
+        return (int64_t)d;
+    }
+};
+
+/* Worst mapping error (ns) against acquisition + minimum delay over batches [k0, k1) */
+static int64_t worst_error(const emg::clock_model &m, const sim &s, int64_t k0, int64_t k1)
+{
+    int64_t worst = 0;
+    for (int64_t k = k0; k < k1; k++) {
+        int64_t err = m.to_host(s.dev_ns(k)) - (s.acquired(k) + MIN_DELAY_NS);
+        worst = std::max(worst, err < 0 ? -err : err);
+    }
+    return worst;
+}
+
+static void drift(double ppm)
+{
+    sim s{ ppm, 5000000000, 123000000000 };
+    emg::clock_model m;
+    int64_t n = 120 * 1000000000ll / BATCH_NS;
+    for (int64_t k = 0; k < n; k++) {
+        CHECK(m.add(s.dev_ns(k), s.acquired(k) + s.delay()), "drift %+g: reset at batch %lld", ppm, (long long)k);
+        if (k == 64) {
+            // Before the drift is known: offset only, still within a few ms
+            CHECK(!m.locked(), "drift %+g: locked after 1 s", ppm);
+            int64_t err = worst_error(m, s, 0, k);
+            CHECK(err < 1000000, "drift %+g: error %lld ns after 1 s", ppm, (long long)err);
+        }
+    }
+    CHECK(m.locked(), "drift %+g: not locked", ppm);
+    CHECK(std::fabs(m.drift_ppm() - ppm) < 1.0, "drift %+g: fitted %+.3f ppm", ppm, m.drift_ppm());
+    int64_t err = worst_error(m, s, n - 4000, n + 200);
+    CHECK(err < 300000, "drift %+g: mapping error %lld ns", ppm, (long long)err);
+    emg::clock_jitter j = m.take_jitter();
+    CHECK(j.count == (uint64_t)n - 1 && j.max_ns > 20000000, "drift %+g: jitter n=%llu max=%lld", ppm,
+          (unsigned long long)j.count, (long long)j.max_ns);
+    CHECK(m.take_jitter().count == 0, "drift %+g: jitter not cleared", ppm);
+    printf("drift %+6.1f ppm: fitted %+.3f ppm, error %lld us, jitter rms %.2f ms, %zu buckets rejected\n", ppm,
+           m.drift_ppm(), (long long)err / 1000, j.rms_ns * 1e-6, m.rejected());
+}
+
+/* A 3 s stall, then the backlog in one burst: late, but no reason to start over */
+static void stall()
+{
+    sim s{ 20.0, 0, 0 };
+    emg::clock_model m;
+    int64_t n = 60 * 1000000000ll / BATCH_NS;
+    int64_t stall0 = n / 2, stall1 = stall0 + 3000000000ll / BATCH_NS;
+    int64_t resume = s.acquired(stall1) + MIN_DELAY_NS;
+    for (int64_t k = 0; k < n; k++) {
+        int64_t t = s.acquired(k) + s.delay();
+        if (k >= stall0 && k < stall1) {
+            t = std::max(t, resume + (k - stall0) * 10000);
+        }
+        CHECK(m.add(s.dev_ns(k), t), "stall: reset at batch %lld", (long long)k);
+    }
+    int64_t err = worst_error(m, s, 0, n);
+    CHECK(err < 1000000, "stall: mapping error %lld ns", (long long)err);
+    CHECK(m.resets() == 0, "stall: %llu resets", (unsigned long long)m.resets());
+}
+
+/* Device clock back to zero; host clock steps either way */
+static void steps()
+{
+    sim s{ -30.0, 700000000000, 0 };
+    emg::clock_model m;
+    int64_t k = 0;
+    for (; k < 1000; k++) {
+        m.add(s.dev_ns(k), s.acquired(k) + s.delay());
+    }
+
+    // Reboot: the device clock starts again near 0
+    sim r{ -30.0, 1000000, s.acquired(k) };
+    CHECK(!m.add(r.dev_ns(0), r.acquired(0) + MIN_DELAY_NS), "reboot not detected");
+    CHECK(m.resets() == 1 && !m.locked(), "reboot: resets=%llu", (unsigned long long)m.resets());
+    for (k = 1; k < 1000; k++) {
+        m.add(r.dev_ns(k), r.acquired(k) + r.delay());
+    }
+    int64_t err = worst_error(m, r, 900, 1000);
+    CHECK(err < 1000000, "reboot: mapping error %lld ns", (long long)err);
+
+    // Host 1 s ahead for good: restarts once LATE_RESET buckets were late
+    int64_t ahead = 1000000000;
+    int64_t first_late = k;
+    bool restarted = false;
+    for (; k < first_late + 1000 && !restarted; k++) {
+        restarted = !m.add(r.dev_ns(k), r.acquired(k) + ahead + r.delay());
+    }
+    int64_t took = (k - first_late) * BATCH_NS;
+    CHECK(restarted && took >= emg::clock_model::LATE_RESET * emg::clock_model::BUCKET_NS &&
+              took <= (emg::clock_model::LATE_RESET + 2) * emg::clock_model::BUCKET_NS,
+          "late step: restarted=%d after %lld ms", restarted, (long long)took / 1000000);
+    CHECK(m.resets() == 2, "late step: resets=%llu", (unsigned long long)m.resets());
+    int64_t k0 = k;
+    for (; k < k0 + 1000; k++) {
+        m.add(r.dev_ns(k), r.acquired(k) + ahead + r.delay());
+    }
+
+    // Host 1 s behind: two early arrivals are ignored, the third starts over
+    int64_t back = 1000000000;
+    CHECK(m.add(r.dev_ns(k), r.acquired(k) + ahead + MIN_DELAY_NS - back), "early one-off reset");
+    k++;
+    CHECK(m.add(r.dev_ns(k), r.acquired(k) + ahead + MIN_DELAY_NS - back), "early two-off reset");
+    k++;
+    CHECK(!m.add(r.dev_ns(k), r.acquired(k) + ahead + MIN_DELAY_NS - back), "early step not detected");
+    CHECK(m.resets() == 3, "early step: resets=%llu", (unsigned long long)m.resets());
+    int64_t mapped = m.to_host(r.dev_ns(k));
+    CHECK(std::llabs(mapped - (r.acquired(k) + ahead + MIN_DELAY_NS - back)) < 1000000, "early step: not re-anchored");
+}
+
+int main()
+{
+    for (double ppm : { 0.0, 40.0, -25.0, 150.0 }) {
+        drift(ppm);
+    }
+    stall();
+    steps();
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Decimation pyramid against brute force over the same frames: envelopes
+ * and min/max LTTB for random ranges, column counts and channel counts,
+ * across ring wrap-arounds, appends larger than the ring, and clipping.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "decimate.h"
+#include "emg_proto.h"
+
+static int failures = 0;
+
+/* Everything appended so far, as stored: sample - zero */
+struct history {
+    size_t channels;
+    std::vector<std::vector<float>> rows;
+
+    float at(size_t c, uint64_t s) const { return rows[c][s]; }
+};
+
+static void check_envelope(const emg::minmax_pyramid &p, const history &h, size_t channel, uint64_t first, size_t n,
+                           size_t columns)
+{
+    std::vector<emg::envelope_column> out(columns + 1);
+    size_t got = p.envelope(channel, first, n, columns, out.data());
+
+    uint64_t lo = p.written() - p.stored();
+    uint64_t a = std::max(first, lo), b = std::min<uint64_t>(first + n, p.written());
+    size_t want = a < b ? std::min<size_t>(columns, b - a) : 0;
+    if (got != want) {
+        fprintf(stderr, "FAIL envelope [%llu, +%zu) x %zu: %zu columns, want %zu\n", (unsigned long long)first, n,
+                columns, got, want);
+        failures++;
+        return;
+    }
+    uint64_t expect = a;
+    for (size_t i = 0; i < got; i++) {
+        const emg::envelope_column &col = out[i];
+        if (col.first != expect || col.count == 0) {
+            fprintf(stderr, "FAIL envelope column %zu covers [%llu, +%u), want it to start at %llu\n", i,
+                    (unsigned long long)col.first, col.count, (unsigned long long)expect);
+            failures++;
+            return;
+        }
+        float mn = h.at(channel, col.first), mx = mn;
+        double sum = 0.0;
+        for (uint64_t s = col.first; s < col.first + col.count; s++) {
+            mn = std::min(mn, h.at(channel, s));
+            mx = std::max(mx, h.at(channel, s));
+            sum += h.at(channel, s);
+        }
+        double mean = sum / col.count;
+        if (col.min != mn || col.max != mx || std::fabs(col.mean - mean) > 1e-3 * (1.0 + std::fabs(mean))) {
+            fprintf(stderr, "FAIL envelope column %zu [%llu, +%u): %g/%g/%g, want %g/%g/%g\n", i,
+                    (unsigned long long)col.first, col.count, col.min, col.max, col.mean, mn, mx, mean);
+            failures++;
+            return;
+        }
+        expect = col.first + col.count;
+    }
+    if (got && expect != b) {
+        fprintf(stderr, "FAIL envelope ends at %llu, want %llu\n", (unsigned long long)expect, (unsigned long long)b);
+        failures++;
+    }
+}
+
+/* Min/max LTTB by brute force: leftmost minimum and maximum of every bucket */
+static void reference_lttb(const history &h, size_t channel, uint64_t first, size_t n, size_t points,
+                           std::vector<uint64_t> &seq, std::vector<float> &value)
+{
+    seq.assign(1, first);
+    value.assign(1, h.at(channel, first));
+    size_t buckets = points - 2;
+    uint64_t inner = first + 1, inner_n = n - 2;
+    double ax = 0.0, ay = value[0];
+    for (size_t i = 0; i < buckets; i++) {
+        uint64_t a = inner + i * inner_n / buckets, b = inner + (i + 1) * inner_n / buckets;
+        double cx, cy;
+        if (i + 1 < buckets) {
+            uint64_t na = b, nb = inner + (i + 2) * inner_n / buckets;
+            float sum = 0.0f;
+            for (uint64_t s = na; s < nb; s++) {
+                sum += h.at(channel, s);
+            }
+            cx = (double)(na - first) + (double)(nb - na - 1) / 2.0;
+            cy = sum / (double)(nb - na);
+        } else {
+            cx = (double)(n - 1);
+            cy = h.at(channel, first + n - 1);
+        }
+        uint64_t lo = a, hi = a;
+        for (uint64_t s = a; s < b; s++) {
+            if (h.at(channel, s) < h.at(channel, lo)) lo = s;
+            if (h.at(channel, s) > h.at(channel, hi)) hi = s;
+        }
+        auto area = [&](uint64_t s) {
+            double x = (double)(s - first);
+            return std::fabs((ax - cx) * (h.at(channel, s) - ay) - (ax - x) * (cy - ay));
+        };
+        uint64_t pick = area(hi) > area(lo) ? hi : lo;
+        seq.push_back(pick);
+        value.push_back(h.at(channel, pick));
+        ax = (double)(pick - first);
+        ay = value.back();
+    }
+    seq.push_back(first + n - 1);
+    value.push_back(h.at(channel, first + n - 1));
+}
+
+static void check_lttb(const emg::minmax_pyramid &p, const history &h, size_t channel, uint64_t first, size_t n,
+                       size_t points)
+{
+    std::vector<uint64_t> seq(points + 1);
+    std::vector<float> value(points + 1);
+    size_t got = p.lttb(channel, first, n, points, seq.data(), value.data());
+
+    uint64_t lo = p.written() - p.stored();
+    uint64_t a = std::max(first, lo), b = std::min<uint64_t>(first + n, p.written());
+    if (a >= b) {
+        if (got != 0) {
+            fprintf(stderr, "FAIL lttb of an empty range: %zu points\n", got);
+            failures++;
+        }
+        return;
+    }
+    std::vector<uint64_t> want_seq;
+    std::vector<float> want_value;
+    if (b - a <= points) {
+        for (uint64_t s = a; s < b; s++) {
+            want_seq.push_back(s);
+            want_value.push_back(h.at(channel, s));
+        }
+    } else {
+        reference_lttb(h, channel, a, (size_t)(b - a), points, want_seq, want_value);
+    }
+    seq.resize(got);
+    value.resize(got);
+    if (seq != want_seq || value != want_value) {
+        fprintf(stderr, "FAIL lttb [%llu, +%zu) to %zu points: %zu points differ from the reference (%zu)\n",
+                (unsigned long long)a, (size_t)(b - a), points, got, want_seq.size());
+        failures++;
+    }
+}
+
+static int run(size_t channels, size_t capacity, bool as_float, std::mt19937 &rng)
+{
+    emg::minmax_pyramid p(channels, capacity);
+    history h{ channels, std::vector<std::vector<float>>(channels) };
+    int checks = 0;
+    std::vector<uint8_t> frames;
+    std::vector<float> floats;
+
+    for (int round = 0; round < 40; round++) {
+        // Mostly small batches, now and then one larger than the ring
+        size_t n = rng() % 8 == 0 ? p.capacity() + rng() % 100 : rng() % (p.capacity() / 2 + 2);
+        frames.resize(n * channels);
+        floats.resize(n * channels);
+        for (size_t i = 0; i < n * channels; i++) {
+            frames[i] = (uint8_t)rng();
+            floats[i] = (float)(int)(rng() % 2001) - 1000.0f;
+        }
+        if (as_float) {
+            p.append_f32(floats.data(), n);
+        } else {
+            p.append_u8(frames.data(), n);
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (size_t c = 0; c < channels; c++) {
+                float v = as_float ? floats[i * channels + c] : (float)frames[i * channels + c] - EMG_SAMPLE_ZERO;
+                h.rows[c].push_back(v);
+            }
+        }
+
+        for (int q = 0; q < 20; q++) {
+            size_t c = rng() % channels;
+            uint64_t w = p.written();
+            // Ranges reaching before the oldest frame and past the newest get clipped
+            uint64_t first = w > 0 ? rng() % (w + 10) : 0;
+            if (q % 4 == 0 && w > p.stored()) {
+                first = w - p.stored() - std::min<uint64_t>(rng() % 20, w - p.stored());
+            }
+            size_t len = rng() % (p.capacity() + 50);
+            size_t columns = 1 + rng() % 300;
+            check_envelope(p, h, c, first, len, columns);
+            check_lttb(p, h, c, first, len, 3 + rng() % 300);
+            checks += 2;
+        }
+    }
+    // The whole window, as a plot asks for it
+    for (size_t c = 0; c < channels; c++) {
+        check_envelope(p, h, c, p.written() - p.stored(), p.stored(), 1000);
+        check_lttb(p, h, c, p.written() - p.stored(), p.stored(), 1000);
+        checks += 2;
+    }
+    return checks;
+}
+
+int main()
+{
+    std::mt19937 rng(99);
+    int checks = 0;
+    for (size_t channels : { 1, 3, 64 }) {
+        for (size_t capacity : { 1, 2, 64, 1000, 4096 }) {
+            checks += run(channels, capacity, false, rng);
+            checks += run(channels, capacity, true, rng);
+        }
+    }
+
+    emg::minmax_pyramid p(2, 16);
+    p.clear();
+    emg::envelope_column col;
+    uint64_t seq;
+    float value;
+    if (p.envelope(0, 0, 10, 5, &col) != 0 || p.lttb(0, 0, 10, 5, &seq, &value) != 0 ||
+        p.envelope(2, 0, 10, 5, &col) != 0) {
+        fprintf(stderr, "FAIL: query of an empty pyramid or a missing channel returned data\n");
+        failures++;
+    }
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Deinterleave kernels against a plain reference, for every instruction set
+ * the CPU supports, sample format, and awkward channel and frame counts
+ * (tile remainders, a single frame, strides wider than the batch).
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+#include "deinterleave.h"
+#include "emg_proto.h"
+#include "recording.h"
+
+static int failures = 0;
+
+template <typename T>
+static float reference(T x, float scale)
+{
+    float zero = sizeof(T) == 1 ? (float)EMG_SAMPLE_ZERO : 0.0f;
+    return ((float)x - zero) * scale;
+}
+
+template <typename T>
+static void check(emg::simd_isa isa, size_t n, size_t channels, size_t stride, float scale, std::mt19937 &rng)
+{
+    std::vector<T> frames(n * channels);
+    for (T &x : frames) {
+        x = (T)rng();
+    }
+    // Padding between rows must be left alone. 32-byte aligned, so that
+    // strides that are a multiple of 8 take the AVX2 path
+    const float GUARD = -12345.0f;
+    size_t len = channels * stride + 1;
+    std::unique_ptr<float, decltype(&free)> buf((float *)aligned_alloc(32, (len * sizeof(float) + 31) & ~(size_t)31),
+                                                &free);
+    float *out = buf.get();
+    std::fill(out, out + len, GUARD);
+    uint8_t fmt = sizeof(T) == 1 ? emg::REC_FMT_U8_OFFSET : emg::REC_FMT_I16;
+    emg::deinterleave(fmt, frames.data(), n, channels, out, stride, scale, isa);
+
+    for (size_t c = 0; c < channels; c++) {
+        for (size_t i = 0; i < stride; i++) {
+            float want = i < n ? reference(frames[i * channels + c], scale) : GUARD;
+            float got = out[c * stride + i];
+            if (memcmp(&want, &got, sizeof(float)) != 0) {
+                fprintf(stderr, "FAIL %s %s n=%zu channels=%zu stride=%zu scale=%g: [%zu][%zu] = %g, want %g\n",
+                        emg::isa_name(isa), sizeof(T) == 1 ? "u8" : "i16", n, channels, stride, scale, c, i, got,
+                        want);
+                failures++;
+                return;
+            }
+        }
+    }
+    if (out[channels * stride] != GUARD) {
+        fprintf(stderr, "FAIL %s: wrote past the end\n", emg::isa_name(isa));
+        failures++;
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(1234);
+    static const size_t channel_counts[] = { 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 64, 65 };
+    static const size_t frame_counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 63, 64, 65, 127, 200, 1000 };
+    static const float scales[] = { 1.0f, 0.195f };
+    int checks = 0;
+
+    for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+        if (!emg::isa_supported(isa)) {
+            printf("%s: not supported here, skipped\n", emg::isa_name(isa));
+            continue;
+        }
+        for (size_t channels : channel_counts) {
+            for (size_t n : frame_counts) {
+                size_t aligned = (n + 7) & ~(size_t)7;
+                for (size_t stride : { n, n + 5, aligned, aligned + 8 }) {
+                    for (float scale : scales) {
+                        check<uint8_t>(isa, n, channels, stride, scale, rng);
+                        check<int16_t>(isa, n, channels, stride, scale, rng);
+                        checks += 2;
+                    }
+                }
+            }
+        }
+        printf("%s: ok\n", emg::isa_name(isa));
+    }
+
+    if (emg::deinterleave(0, nullptr, 0, 0, nullptr, 0)) {
+        fprintf(stderr, "FAIL: unknown sample format accepted\n");
+        failures++;
+    }
+    printf("%d checks, %d failures (best: %s)\n", checks, failures, emg::isa_name(emg::best_isa()));
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * Synthetic HD-EMG against its own ground truth: the same frames and
+ * firings for a seed however they are asked for, the output rebuilt from
+ * the MUAP templates at the reported firings, firing rates and interval
+ * spread as configured, noise and mains at their set levels, nothing
+ * firing while the muscle rests, and the spec parser. Also prints how much
+ * faster than real time one device is made.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "muap_synth.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                             \
+    do {                                                                                                             \
+        if (!(cond)) {                                                                                               \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);                                                     \
+            fprintf(stderr, __VA_ARGS__);                                                                            \
+            fprintf(stderr, "\n");                                                                                   \
+            failures++;                                                                                              \
+        }                                                                                                            \
+    } while (0)
+
+using emg::muap_synth;
+using emg::synth_config;
+using emg::synth_spike;
+
+static const double PI = 3.141592653589793;
+
+static std::vector<uint8_t> run(muap_synth &s, size_t n, std::vector<synth_spike> *spikes, size_t step = 0)
+{
+    std::vector<uint8_t> out(n * EMG_FRAME_BYTES);
+    size_t sizes[] = { 1, 7, 300, 1500, 64 };
+    for (size_t done = 0, i = 0; done < n; i++) {
+        size_t k = std::min(n - done, step ? step : sizes[i % 5]);
+        s.generate(&out[done * EMG_FRAME_BYTES], k, spikes);
+        done += k;
+    }
+    return out;
+}
+
+static bool same_spikes(const std::vector<synth_spike> &a, const std::vector<synth_spike> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].unit != b[i].unit || a[i].frame != b[i].frame) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* One seed, one output: in one call or in odd pieces; another seed differs */
+static int determinism()
+{
+    synth_config cfg;
+    const size_t n = 10000;
+    muap_synth a(cfg), b(cfg);
+    std::vector<synth_spike> sa, sb;
+    std::vector<uint8_t> fa = run(a, n, &sa, n), fb = run(b, n, &sb);
+    CHECK(fa == fb, "frames differ with the request size");
+    CHECK(same_spikes(sa, sb), "firings differ with the request size: %zu vs %zu", sa.size(), sb.size());
+    CHECK(a.position() == n && b.position() == n, "position %llu/%llu", (unsigned long long)a.position(),
+          (unsigned long long)b.position());
+    bool ordered = true;
+    for (size_t i = 1; i < sa.size(); i++) {
+        ordered = ordered && sa[i - 1].frame <= sa[i].frame;
+    }
+    CHECK(ordered && !sa.empty() && sa.back().frame < n, "%zu firings, not in order or past the end", sa.size());
+
+    cfg.seed = 2;
+    muap_synth c(cfg);
+    std::vector<synth_spike> sc;
+    CHECK(run(c, n, &sc) != fa && !same_spikes(sa, sc), "seed 2 gives the frames of seed 1");
+    return 5;
+}
+
+/* Without noise or mains the output is the templates summed at the firings, quantised */
+static int reconstruction()
+{
+    synth_config cfg;
+    cfg.noise_uv = 0;
+    cfg.mains_uv = 0;
+    cfg.units = 30;
+    muap_synth s(cfg);
+    const size_t n = 20000, extra = s.muap_frames();
+    std::vector<synth_spike> spikes;
+    std::vector<uint8_t> out = run(s, n + extra, &spikes);
+
+    // Firings past n still reach back into it
+    std::vector<double> sum(n * EMG_NUM_CHANNELS, 0.0);
+    for (const synth_spike &k : spikes) {
+        const float *t = s.muap(k.unit);
+        for (uint32_t f = 0; f < s.muap_frames(); f++) {
+            int64_t at = (int64_t)k.frame - s.muap_center() + f;
+            if (at < 0 || at >= (int64_t)n) {
+                continue;
+            }
+            for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+                sum[(size_t)at * EMG_NUM_CHANNELS + ch] += t[(size_t)f * EMG_NUM_CHANNELS + ch];
+            }
+        }
+    }
+    size_t off = 0, worst = 0, signal = 0;
+    for (size_t i = 0; i < n * EMG_NUM_CHANNELS; i++) {
+        double want = floor(sum[i] / cfg.lsb_uv + EMG_SAMPLE_ZERO + 0.5);
+        size_t d = (size_t)fabs(want - out[i]);
+        off += d != 0;
+        worst = std::max(worst, d);
+        signal += out[i] != EMG_SAMPLE_ZERO;
+    }
+    // Float sums in another order may land either side of a rounding boundary
+    CHECK(worst <= 1 && off * 10000 < n * EMG_NUM_CHANNELS, "%zu samples off, by up to %zu counts", off, worst);
+    CHECK(signal > n * EMG_NUM_CHANNELS / 4, "only %zu samples away from zero", signal);
+    CHECK(s.clipped() == 0, "%llu clipped", (unsigned long long)s.clipped());
+
+    // The largest unit's biggest template value is about its peak, right above it
+    const emg::synth_unit &big = s.units().back();
+    const float *t = s.muap(cfg.units - 1);
+    float top = 0;
+    for (size_t i = 0; i < (size_t)s.muap_frames() * EMG_NUM_CHANNELS; i++) {
+        top = std::max(top, t[i]);
+    }
+    CHECK(top <= big.peak_uv * 1.0001 && top > big.peak_uv * 0.2, "largest unit peaks at %.1f uV, set %.1f", top,
+          big.peak_uv);
+    return 4;
+}
+
+/* Mean interval 1/rate and its spread isi_cov, per unit, over ten minutes */
+static int firing_statistics()
+{
+    synth_config cfg;
+    cfg.units = 8;
+    cfg.noise_uv = 0;
+    cfg.mains_uv = 0;
+    muap_synth s(cfg);
+    std::vector<synth_spike> spikes;
+    run(s, (size_t)cfg.frame_rate_hz * 600, &spikes, 65536);
+
+    int checks = 0;
+    for (uint32_t u = 0; u < cfg.units; u++) {
+        double sum = 0, sq = 0, last = -1;
+        size_t n = 0;
+        for (const synth_spike &k : spikes) {
+            if (k.unit != u) {
+                continue;
+            }
+            if (last >= 0) {
+                double isi = (k.frame - last) / cfg.frame_rate_hz;
+                sum += isi;
+                sq += isi * isi;
+                n++;
+            }
+            last = (double)k.frame;
+        }
+        double mean = sum / n, cov = sqrt(sq / n - mean * mean) / mean;
+        double want = 1.0 / s.units()[u].rate_hz;
+        CHECK(fabs(mean - want) < 0.02 * want, "unit %u: mean interval %.4f s, want %.4f", u, mean, want);
+        CHECK(fabs(cov - cfg.isi_cov) < 0.02, "unit %u: interval CoV %.3f, want %.3f", u, cov, cfg.isi_cov);
+        checks += 2;
+    }
+    CHECK(s.units().front().rate_hz == cfg.rate_max_hz && s.units().back().rate_hz == cfg.rate_min_hz &&
+              s.units().front().peak_uv == cfg.peak_min_uv,
+          "smallest unit does not fire fastest");
+    return checks + 1;
+}
+
+/* Amplitude of f Hz in x, by Goertzel */
+static double tone(const std::vector<double> &x, double f, double fs)
+{
+    double w = 2 * PI * f / fs, c = 2 * cos(w), s1 = 0, s2 = 0;
+    for (double v : x) {
+        double s0 = v + c * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    double re = s1 - s2 * cos(w), im = s2 * sin(w);
+    return 2 * sqrt(re * re + im * im) / x.size();
+}
+
+/* No units: noise at its RMS with a zero mean, mains at its level, growing across the grid */
+static int noise_and_mains()
+{
+    synth_config cfg;
+    cfg.units = 0;
+    cfg.lsb_uv = 0.5;
+    cfg.noise_uv = 8;
+    cfg.mains_hz = 60;
+    cfg.mains_uv = 20;
+    muap_synth s(cfg);
+    const size_t n = cfg.frame_rate_hz * 16;   // a whole number of mains cycles
+    std::vector<uint8_t> out = run(s, n, nullptr);
+
+    double mains_sum = 0, low = 0, high = 0;
+    std::vector<double> x(n);
+    int checks = 0;
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        for (size_t i = 0; i < n; i++) {
+            x[i] = ((double)out[i * EMG_FRAME_BYTES + ch] - EMG_SAMPLE_ZERO) * cfg.lsb_uv;
+        }
+        double a = tone(x, cfg.mains_hz, cfg.frame_rate_hz);
+        mains_sum += a;
+        low = ch == 0 ? a : std::min(low, a);
+        high = std::max(high, a);
+
+        // What is left once the mains is taken out is the noise
+        double w = 2 * PI * cfg.mains_hz / cfg.frame_rate_hz, sc = 0, cc = 0;
+        for (size_t i = 0; i < n; i++) {
+            sc += x[i] * sin(w * i);
+            cc += x[i] * cos(w * i);
+        }
+        double mean = 0, sq = 0;
+        for (size_t i = 0; i < n; i++) {
+            double r = x[i] - 2.0 / n * (sc * sin(w * i) + cc * cos(w * i));
+            mean += r;
+            sq += r * r;
+        }
+        mean /= n;
+        double rms = sqrt(sq / n - mean * mean);
+        CHECK(fabs(rms - cfg.noise_uv) < 0.05 * cfg.noise_uv && fabs(mean) < 0.5,
+              "channel %d: noise %.2f uV RMS, mean %.2f", ch, rms, mean);
+        checks++;
+    }
+    double mean = mains_sum / EMG_NUM_CHANNELS;
+    CHECK(fabs(mean - cfg.mains_uv) < 0.03 * cfg.mains_uv, "mains %.2f uV over the grid, want %.2f", mean,
+          cfg.mains_uv);
+    CHECK(low < 0.6 * cfg.mains_uv && high > 1.4 * cfg.mains_uv, "mains from %.1f to %.1f uV across the grid", low,
+          high);
+    CHECK(s.clipped() == 0, "%llu clipped", (unsigned long long)s.clipped());
+    return checks + 3;
+}
+
+/* 2 s on, 1 s off: firings only while on, and flat once the last MUAPs have passed */
+static int contraction()
+{
+    synth_config cfg;
+    cfg.noise_uv = 0;
+    cfg.mains_uv = 0;
+    cfg.contract_s = 2;
+    cfg.rest_s = 1;
+    muap_synth s(cfg);
+    const uint64_t on = 2 * cfg.frame_rate_hz, period = 3 * cfg.frame_rate_hz, n = 10 * period;
+    std::vector<synth_spike> spikes;
+    std::vector<uint8_t> out = run(s, n, &spikes);
+
+    size_t resting = 0, busy = 0;
+    for (const synth_spike &k : spikes) {
+        resting += k.frame % period > on;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t phase = i % period;
+        if (phase < on + s.muap_frames() || phase + s.muap_frames() >= period) {
+            continue;
+        }
+        for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+            busy += out[i * EMG_FRAME_BYTES + ch] != EMG_SAMPLE_ZERO;
+        }
+    }
+    CHECK(resting == 0 && spikes.size() > 200, "%zu of %zu firings during rest", resting, spikes.size());
+    CHECK(busy == 0, "%zu samples off zero during rest", busy);
+    return 2;
+}
+
+static int parsing()
+{
+    synth_config cfg;
+    std::string err;
+    bool ok = emg::parse_synth_spec("fs=4096,layout=13x5,ied=10,units=40,rate=6:25,cov=0.2,peak=10:300,"
+                                    "depth=1:15,cv=3.5,contract=5:2.5,noise=3,mains=60:40,lsb=2,seconds=90,seed=77",
+                                    &cfg, &err);
+    CHECK(ok, "%s", err.c_str());
+    CHECK(cfg.frame_rate_hz == 4096 && cfg.layout == EMG_LAYOUT_13X5 && cfg.ied_mm == 10 && cfg.units == 40 &&
+              cfg.rate_min_hz == 6 && cfg.rate_max_hz == 25 && cfg.isi_cov == 0.2 && cfg.peak_min_uv == 10 &&
+              cfg.peak_max_uv == 300 && cfg.depth_min_mm == 1 && cfg.depth_max_mm == 15 && cfg.cv_m_s == 3.5 &&
+              cfg.contract_s == 5 && cfg.rest_s == 2.5 && cfg.noise_uv == 3 && cfg.mains_hz == 60 &&
+              cfg.mains_uv == 40 && cfg.lsb_uv == 2 && cfg.seconds == 90 && cfg.seed == 77,
+          "spec not applied");
+    int checks = 2;
+
+    const char *bad[] = { "units=", "rate=20:8", "rate=8", "layout=4x4", "cov=1", "noise=-1", "fs=2048x",
+                          "color=red", "units=10,,", "peak=0:10" };
+    for (const char *b : bad) {
+        synth_config c;
+        err.clear();
+        CHECK(!emg::parse_synth_spec(b, &c, &err) && !err.empty(), "'%s' accepted", b);
+        checks++;
+    }
+    CHECK(emg::parse_synth_spec("", &cfg, &err), "empty spec rejected");
+    return checks + 1;
+}
+
+/* One device's worth of signal, timed: the point is to feed many at once */
+static int speed()
+{
+    synth_config cfg;
+    cfg.units = 30;
+    muap_synth s(cfg);
+    const double seconds = 60;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<synth_spike> spikes;
+    run(s, (size_t)(seconds * cfg.frame_rate_hz), &spikes, 256);
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%.0f s of 64 channels, %u units in %.1f ms: %.0fx real time\n", seconds, cfg.units, t * 1e3,
+           seconds / t);
+    CHECK(seconds / t > 10, "only %.1fx real time", seconds / t);
+    return 1;
+}
+
+int main()
+{
+    int checks = determinism();
+    checks += reconstruction();
+    checks += firing_statistics();
+    checks += noise_and_mains();
+    checks += contraction();
+    checks += parsing();
+    checks += speed();
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
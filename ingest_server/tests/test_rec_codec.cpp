@@ -0,0 +1,220 @@
+/*
+ * Recording block codecs: every codec round trip through every decoder the
+ * CPU supports, for both sample formats, channel counts on and off the
+ * 8-channel groups and frame counts on and off the 32-frame groups, with
+ * noise, flat lines, random bytes and full-scale swings. Then a hand-made
+ * LZ4 block, and damaged input, which must be refused or at least never
+ * written past the frames asked for.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "emg_proto.h"
+#include "rec_codec.h"
+
+static int failures = 0;
+
+static const uint8_t GUARD = 0xA5;
+static const size_t GUARD_BYTES = 64;
+
+enum signal { NOISE, FLAT, RANDOM, SWING };
+
+static const char *signal_name(signal s)
+{
+    switch (s) {
+    case NOISE: return "noise";
+    case FLAT: return "flat";
+    case RANDOM: return "random";
+    default: return "swing";
+    }
+}
+
+static std::vector<uint8_t> make_frames(uint8_t fmt, size_t channels, uint32_t n, signal sig, std::mt19937 &rng)
+{
+    const size_t count = (size_t)n * channels;
+    std::vector<uint8_t> frames(count * emg::rec_frame_bytes(fmt, 1));
+    std::vector<int32_t> level(channels);
+    for (size_t i = 0; i < count; i++) {
+        int32_t v;
+        size_t c = i % channels;
+        switch (sig) {
+        case NOISE:
+            // A wandering baseline with noise a few bits deep on top
+            level[c] += (int32_t)(rng() % 5) - 2;
+            v = level[c] + (int32_t)(rng() % 32) - 16;
+            break;
+        case FLAT: v = (int32_t)c - 3; break;
+        case RANDOM: v = (int32_t)rng(); break;
+        default: v = (i / channels + c) % 2 ? 1 << 30 : -(1 << 30); break;
+        }
+        if (fmt == emg::REC_FMT_U8_OFFSET) {
+            frames[i] = sig == RANDOM ? (uint8_t)v : (uint8_t)std::clamp(v + EMG_SAMPLE_ZERO, 0, 255);
+        } else {
+            int16_t s = sig == RANDOM ? (int16_t)v : (int16_t)std::clamp(v, -32768, 32767);
+            memcpy(&frames[2 * i], &s, sizeof(s));
+        }
+    }
+    return frames;
+}
+
+static bool decode_into(uint8_t codec, uint8_t fmt, size_t channels, const uint8_t *in, size_t len, uint32_t n,
+                        std::vector<uint8_t> &out, emg::simd_isa isa)
+{
+    size_t raw = (size_t)n * emg::rec_frame_bytes(fmt, (uint16_t)channels);
+    out.assign(raw + GUARD_BYTES, GUARD);
+    bool ok = emg::rec_decode(codec, fmt, (uint16_t)channels, in, len, n, out.data(), isa);
+    for (size_t i = raw; i < out.size(); i++) {
+        if (out[i] != GUARD) {
+            fprintf(stderr, "FAIL %s %s: wrote past the end of %zu bytes\n", emg::rec_codec_name(codec),
+                    emg::isa_name(isa), raw);
+            failures++;
+            break;
+        }
+    }
+    out.resize(raw);
+    return ok;
+}
+
+static int check(uint8_t codec, uint8_t fmt, size_t channels, uint32_t n, signal sig, std::mt19937 &rng)
+{
+    std::vector<uint8_t> frames = make_frames(fmt, channels, n, sig, rng);
+    size_t bound = emg::rec_encode_bound(codec, fmt, (uint16_t)channels, n);
+    std::vector<uint8_t> enc(bound + GUARD_BYTES, GUARD);
+    size_t len = emg::rec_encode(codec, fmt, (uint16_t)channels, frames.data(), n, enc.data());
+    const char *what = fmt == emg::REC_FMT_U8_OFFSET ? "u8" : "i16";
+    if ((len == 0) != (n == 0) || len > bound || enc[bound] != GUARD) {
+        fprintf(stderr, "FAIL %s %s channels=%zu n=%u %s: encoded %zu bytes, bound %zu\n",
+                emg::rec_codec_name(codec), what, channels, n, signal_name(sig), len, bound);
+        failures++;
+        return 1;
+    }
+    int checks = 1;
+    std::vector<uint8_t> out;
+    for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+        if (!emg::isa_supported(isa)) continue;
+        if (!decode_into(codec, fmt, channels, enc.data(), len, n, out, isa) || out != frames) {
+            fprintf(stderr, "FAIL %s %s %s channels=%zu n=%u %s: round trip differs\n", emg::rec_codec_name(codec),
+                    emg::isa_name(isa), what, channels, n, signal_name(sig));
+            failures++;
+        }
+        // One byte short or one too many is damage, not a shorter block
+        if (n != 0 && (decode_into(codec, fmt, channels, enc.data(), len - 1, n, out, isa) ||
+                       decode_into(codec, fmt, channels, enc.data(), len + 1, n, out, isa))) {
+            fprintf(stderr, "FAIL %s %s %s channels=%zu n=%u: truncated or padded input accepted\n",
+                    emg::rec_codec_name(codec), emg::isa_name(isa), what, channels, n);
+            failures++;
+        }
+        checks += 2;
+    }
+    return checks;
+}
+
+/* Random damage: anything may come out, but only into the frames asked for */
+static int check_damage(uint8_t codec, uint8_t fmt, size_t channels, uint32_t n, std::mt19937 &rng)
+{
+    std::vector<uint8_t> frames = make_frames(fmt, channels, n, NOISE, rng);
+    std::vector<uint8_t> enc(emg::rec_encode_bound(codec, fmt, (uint16_t)channels, n));
+    size_t len = emg::rec_encode(codec, fmt, (uint16_t)channels, frames.data(), n, enc.data());
+    enc.resize(len);
+    std::vector<uint8_t> out;
+    int checks = 0;
+    for (int trial = 0; trial < 300; trial++) {
+        std::vector<uint8_t> bad = enc;
+        for (int k = 1 + (int)(rng() % 4); k > 0; k--) {
+            bad[rng() % bad.size()] ^= (uint8_t)(1 + rng() % 255);
+        }
+        bad.resize(bad.size() - (trial % 3 == 0 ? rng() % std::min<size_t>(bad.size(), 40) : 0));
+        for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+            if (!emg::isa_supported(isa)) continue;
+            decode_into(codec, fmt, channels, bad.data(), bad.size(), n, out, isa);
+            checks++;
+        }
+    }
+    return checks;
+}
+
+/* Widths past what the format can need are refused */
+static int check_widths()
+{
+    int checks = 0;
+    for (uint8_t fmt : { emg::REC_FMT_U8_OFFSET, emg::REC_FMT_I16 }) {
+        unsigned width = fmt == emg::REC_FMT_U8_OFFSET ? 10 : 18;
+        std::vector<uint8_t> in(1 + width * 32, 0);
+        in[0] = (uint8_t)width;
+        std::vector<uint8_t> out;
+        for (emg::simd_isa isa : { emg::simd_isa::scalar, emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+            if (!emg::isa_supported(isa)) continue;
+            if (decode_into(emg::REC_CODEC_DELTA_BP, fmt, 8, in.data(), in.size(), 32, out, isa)) {
+                fprintf(stderr, "FAIL delta %s: width %u accepted\n", emg::isa_name(isa), width);
+                failures++;
+            }
+            checks++;
+        }
+    }
+    return checks;
+}
+
+/* An LZ4 block written by hand: literals, an overlapping match, the closing literals */
+static int check_lz4_block()
+{
+    static const uint8_t block[] = { 0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x50, 'x', 'y', 'z', 'a', 'b' };
+    static const char want[] = "abcdabcdabcdxyzab";
+    std::vector<uint8_t> out;
+    uint32_t n = sizeof(want) - 1;
+    if (!decode_into(emg::REC_CODEC_LZ, emg::REC_FMT_U8_OFFSET, 1, block, sizeof(block), n, out,
+                     emg::simd_isa::scalar) ||
+        memcmp(out.data(), want, n) != 0) {
+        fprintf(stderr, "FAIL lz: hand-made LZ4 block\n");
+        failures++;
+    }
+    // The same block with an offset reaching before the start
+    uint8_t far[sizeof(block)];
+    memcpy(far, block, sizeof(block));
+    far[5] = 0x05;
+    if (decode_into(emg::REC_CODEC_LZ, emg::REC_FMT_U8_OFFSET, 1, far, sizeof(far), n, out, emg::simd_isa::scalar)) {
+        fprintf(stderr, "FAIL lz: offset before the start accepted\n");
+        failures++;
+    }
+    return 2;
+}
+
+int main()
+{
+    std::mt19937 rng(45);
+    static const size_t channel_counts[] = { 1, 3, 7, 8, 9, 16, 17, 64, 65 };
+    static const uint32_t frame_counts[] = { 0, 1, 31, 32, 33, 100, 2048 };
+    int checks = 0;
+
+    for (emg::simd_isa isa : { emg::simd_isa::sse2, emg::simd_isa::avx2 }) {
+        if (!emg::isa_supported(isa)) printf("%s: not supported here, skipped\n", emg::isa_name(isa));
+    }
+    for (uint8_t codec : { emg::REC_CODEC_NONE, emg::REC_CODEC_DELTA_BP, emg::REC_CODEC_LZ }) {
+        for (uint8_t fmt : { emg::REC_FMT_U8_OFFSET, emg::REC_FMT_I16 }) {
+            for (size_t channels : channel_counts) {
+                for (uint32_t n : frame_counts) {
+                    for (signal sig : { NOISE, FLAT, RANDOM, SWING }) {
+                        checks += check(codec, fmt, channels, n, sig, rng);
+                    }
+                }
+            }
+            checks += check_damage(codec, fmt, 9, 100, rng);
+            checks += check_damage(codec, fmt, 64, 2048, rng);
+        }
+    }
+    checks += check_widths();
+    checks += check_lz4_block();
+
+    uint8_t codec;
+    if (!emg::rec_codec_from_name("delta", &codec) || codec != emg::REC_CODEC_DELTA_BP ||
+        emg::rec_codec_from_name("zip", &codec) || emg::rec_encode_bound(7, emg::REC_FMT_I16, 8, 32) != 0) {
+        fprintf(stderr, "FAIL: codec names\n");
+        failures++;
+    }
+    checks++;
+
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
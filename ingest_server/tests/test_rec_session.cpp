@@ -0,0 +1,322 @@
+/*
+ * Random access to recordings against brute force over the same file:
+ * recordings written in random batches (with frame gaps, time jumps and
+ * events between blocks), then random frame and time ranges read for
+ * random channel sets while the file is still being written, after more
+ * blocks arrive, and after close, for uint8 and int16 recordings, raw and
+ * compressed. Checks
+ * every sample and frame time, the time lookup, and that a damaged block
+ * fails only the reads that touch it.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "emg_proto.h"
+#include "rec_codec.h"
+#include "rec_reader.h"
+#include "rec_session.h"
+#include "rec_writer.h"
+
+static int failures = 0;
+
+/* Every data frame of a file, read block by block with rec_reader */
+struct reference {
+    size_t channels = 0;
+    std::vector<float> v;           // frame by frame, less the sample zero
+    std::vector<int64_t> t;         // interpolated inside each block
+};
+
+static reference load(const std::string &path)
+{
+    reference r;
+    emg::rec_reader rd;
+    if (!rd.open(path)) {
+        return r;
+    }
+    r.channels = rd.header().channels;
+    emg::rec_block_header h;
+    std::vector<uint8_t> payload;
+    for (uint32_t b : rd.data_blocks()) {
+        if (!rd.read_frames(b, &h, &payload)) {
+            fprintf(stderr, "FAIL: block %u of %s unreadable\n", b, path.c_str());
+            failures++;
+            continue;
+        }
+        for (uint32_t i = 0; i < h.frames; i++) {
+            for (size_t c = 0; c < r.channels; c++) {
+                if (rd.header().sample_format == emg::REC_FMT_U8_OFFSET) {
+                    r.v.push_back((float)payload[i * r.channels + c] - EMG_SAMPLE_ZERO);
+                } else {
+                    int16_t s;
+                    memcpy(&s, &payload[2 * (i * r.channels + c)], 2);
+                    r.v.push_back(s);
+                }
+            }
+            r.t.push_back(h.frames > 1 ? h.t0_ns + (h.t1_ns - h.t0_ns) * (int64_t)i / (int64_t)(h.frames - 1)
+                                       : h.t0_ns);
+        }
+    }
+    return r;
+}
+
+static void check_read(const emg::rec_session &s, const reference &r, uint64_t first, size_t n,
+                       const std::vector<uint16_t> *channels, size_t stride_pad)
+{
+    size_t nch = channels ? channels->size() : r.channels;
+    size_t stride = n + stride_pad;
+    std::vector<float> out(nch * stride + 1, -9999.0f);
+    std::vector<int64_t> t(n + 1, -1);
+    std::string err;
+    if (!s.read(first, n, channels ? channels->data() : nullptr, nch, out.data(), stride, t.data(), 0.5f, &err)) {
+        fprintf(stderr, "FAIL read [%llu, +%zu) x %zu channels: %s\n", (unsigned long long)first, n, nch,
+                err.c_str());
+        failures++;
+        return;
+    }
+    for (size_t k = 0; k < nch; k++) {
+        size_t c = channels ? (*channels)[k] : k;
+        for (size_t i = 0; i < n; i++) {
+            float want = r.v[(first + i) * r.channels + c] * 0.5f;
+            if (out[k * stride + i] != want) {
+                fprintf(stderr, "FAIL read [%llu, +%zu): frame %zu channel %zu is %g, want %g\n",
+                        (unsigned long long)first, n, i, c, out[k * stride + i], want);
+                failures++;
+                return;
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (t[i] != r.t[first + i]) {
+            fprintf(stderr, "FAIL read [%llu, +%zu): frame %zu at %lld ns, want %lld\n", (unsigned long long)first,
+                    n, i, (long long)t[i], (long long)r.t[first + i]);
+            failures++;
+            return;
+        }
+    }
+    if (out[nch * stride] != -9999.0f || t[n] != -1) {
+        fprintf(stderr, "FAIL read [%llu, +%zu) wrote past its output\n", (unsigned long long)first, n);
+        failures++;
+    }
+}
+
+static int check_all(const emg::rec_session &s, const reference &r, std::mt19937 &rng)
+{
+    int checks = 0;
+    if (s.frames() != r.t.size()) {
+        fprintf(stderr, "FAIL: session has %llu frames, file %zu\n", (unsigned long long)s.frames(), r.t.size());
+        failures++;
+        return 1;
+    }
+    if (r.t.empty()) {
+        return 0;
+    }
+    for (int q = 0; q < 150; q++) {
+        // Ranges of a few frames up to many blocks
+        size_t n = 1 + rng() % std::min<size_t>(r.t.size(), q % 3 == 0 ? 20 : 5000);
+        uint64_t first = rng() % (r.t.size() - n + 1);
+        std::vector<uint16_t> ch;
+        switch (q % 4) {
+        case 0: break;                                      // all, in order
+        case 1:
+            for (size_t c = 0; c < r.channels; c++) ch.push_back((uint16_t)c);
+            break;
+        case 2:                                             // a run, as "channels 12-20"
+            for (size_t c = rng() % r.channels, e = c + 1 + rng() % (r.channels - c); c < e; c++) {
+                ch.push_back((uint16_t)c);
+            }
+            break;
+        default:                                            // any order, repeats
+            for (size_t k = 0, m = 1 + rng() % (2 * r.channels); k < m; k++) ch.push_back(rng() % r.channels);
+        }
+        check_read(s, r, first, n, q % 4 ? &ch : nullptr, rng() % 3 == 0 ? rng() % 50 : 0);
+        checks++;
+
+        // A time lookup lands on the first frame not before it
+        int64_t t = r.t.front() - 1000000 + (int64_t)(rng() % (uint64_t)(r.t.back() - r.t.front() + 2000000));
+        uint64_t want = (uint64_t)(std::lower_bound(r.t.begin(), r.t.end(), t) - r.t.begin());
+        if (s.frame_at(t) != want || (want < r.t.size() && s.frame_time(want) != r.t[want])) {
+            fprintf(stderr, "FAIL frame_at(%lld) = %llu, want %llu\n", (long long)t,
+                    (unsigned long long)s.frame_at(t), (unsigned long long)want);
+            failures++;
+        }
+        checks++;
+    }
+
+    // Out of range
+    float f;
+    uint16_t bad = (uint16_t)r.channels;
+    if (s.read(r.t.size(), 1, nullptr, 0, &f, 1) || s.read(0, 1, &bad, 1, &f, 1) ||
+        !s.read(r.t.size(), 0, nullptr, 0, &f, 1)) {
+        fprintf(stderr, "FAIL: reads past the end or of a missing channel not refused\n");
+        failures++;
+    }
+    if (s.start_ns() != r.t.front() || s.end_ns() != r.t.back() || s.frame_at(r.t.back() + 1) != r.t.size()) {
+        fprintf(stderr, "FAIL: session spans %lld..%lld, want %lld..%lld\n", (long long)s.start_ns(),
+                (long long)s.end_ns(), (long long)r.t.front(), (long long)r.t.back());
+        failures++;
+    }
+    return checks + 1;
+}
+
+/* With compressible, low-level noise and flat stretches instead of random bytes */
+static bool write_frames(emg::rec_writer &w, size_t frame_bytes, uint8_t format, int batches, uint64_t &frame,
+                         int64_t &t, std::mt19937 &rng, bool compressible = false)
+{
+    std::vector<uint8_t> buf;
+    for (int b = 0; b < batches; b++) {
+        uint32_t n = 1 + rng() % 300;
+        buf.resize((size_t)n * frame_bytes);
+        for (size_t i = 0; i < buf.size(); i++) buf[i] = (uint8_t)rng();
+        if (compressible) {
+            bool flat = rng() % 3 == 0;
+            for (size_t i = 0; i < buf.size(); i++) {
+                if (format == emg::REC_FMT_U8_OFFSET) {
+                    buf[i] = (uint8_t)(flat ? 130 : 120 + rng() % 16);
+                } else if (flat) {
+                    buf[i] = i % 2 ? 0x01 : 0x20;
+                } else if (i % 2) {
+                    buf[i] = rng() % 2 ? 0x00 : 0xFF;
+                }
+            }
+        } else if (format == emg::REC_FMT_I16 && rng() % 4 == 0) {
+            // Extremes of the int16 range
+            for (size_t i = 0; i + 1 < buf.size(); i += 2) buf[i + 1] = rng() % 2 ? 0x80 : 0x7F;
+        }
+        if (rng() % 15 == 0) frame += 1 + rng() % 1000;         // lost frames
+        if (rng() % 25 == 0) t += (int64_t)(rng() % 3000) * 1000000;
+        if (rng() % 10 == 0) w.event(emg::REC_EVENT_MARKER, frame, t, 0, "mark");
+        int64_t last = t + (int64_t)n * 488281 + (int64_t)(rng() % 200000) - 100000;
+        if (!w.append(buf.data(), n, frame, frame * 488, t, last)) {
+            return false;
+        }
+        frame += n;
+        t += (int64_t)n * 488281;
+    }
+    return true;
+}
+
+static int run(const std::string &dir, uint8_t format, uint16_t channels, uint32_t chunk, uint8_t codec,
+               std::mt19937 &rng)
+{
+    std::string path = dir + "/rec" + std::to_string(format) + "_" + std::to_string(channels) + "_" +
+                       emg::rec_codec_name(codec) + ".emgr";
+    const bool compressible = codec != emg::REC_CODEC_NONE;
+    emg::rec_file_header hdr = {};
+    hdr.channels = channels;
+    hdr.sample_format = format;
+    hdr.codec = codec;
+    hdr.frame_rate_hz = 2048;
+    hdr.chunk_frames = chunk;
+    emg::rec_writer w;
+    if (!w.open(path, hdr)) {
+        fprintf(stderr, "FAIL: cannot create %s\n", path.c_str());
+        failures++;
+        return 0;
+    }
+    size_t frame_bytes = emg::rec_frame_bytes(format, channels);
+    uint64_t frame = 1000;
+    int64_t t = 1700000000000000000ll;
+    int checks = 0;
+
+    // Still being written: the session sees the blocks flushed so far, then picks up more
+    write_frames(w, frame_bytes, format, 40, frame, t, rng, compressible);
+    w.flush();
+    emg::rec_session s;
+    std::string err;
+    if (!s.open(path, true, &err)) {
+        fprintf(stderr, "FAIL: cannot open %s: %s\n", path.c_str(), err.c_str());
+        failures++;
+        return 0;
+    }
+    checks += check_all(s, load(path), rng);
+    write_frames(w, frame_bytes, format, 60, frame, t, rng, compressible);
+    w.flush();
+    if (s.refresh() == 0) {
+        fprintf(stderr, "FAIL: refresh found no new blocks\n");
+        failures++;
+    }
+    checks += check_all(s, load(path), rng);
+    write_frames(w, frame_bytes, format, 30, frame, t, rng, compressible);
+    w.close();
+    s.refresh();
+    checks += check_all(s, load(path), rng);
+
+    // Closed: opened from the index
+    if (!s.open(path, true, &err) || !s.reader().finished()) {
+        fprintf(stderr, "FAIL: cannot reopen %s: %s\n", path.c_str(), err.c_str());
+        failures++;
+        return checks;
+    }
+    reference r = load(path);
+    checks += check_all(s, r, rng);
+    if (compressible) {
+        size_t encoded = 0;
+        for (uint32_t b : s.reader().data_blocks()) encoded += s.reader().blocks()[b].codec == codec;
+        if (encoded == 0) {
+            fprintf(stderr, "FAIL: no data block of %s stored with codec %s\n", path.c_str(), emg::rec_codec_name(codec));
+            failures++;
+        }
+    }
+
+    // A damaged payload fails the reads that touch it, and only those
+    const emg::rec_reader &rd = s.reader();
+    size_t d = rd.data_blocks().size() / 2;
+    const emg::rec_index_entry e = rd.blocks()[rd.data_blocks()[d]];   // the reader goes with the reopen
+    uint64_t first = 0;
+    for (size_t i = 0; i < d; i++) first += rd.blocks()[rd.data_blocks()[i]].frames;
+    int fd = open(path.c_str(), O_RDWR);
+    uint8_t byte;
+    if (fd < 0 || pread(fd, &byte, 1, (off_t)(e.offset + sizeof(emg::rec_block_header) + 3)) != 1) {
+        fprintf(stderr, "FAIL: cannot damage %s\n", path.c_str());
+        failures++;
+        return checks;
+    }
+    byte ^= 0x10;
+    if (pwrite(fd, &byte, 1, (off_t)(e.offset + sizeof(emg::rec_block_header) + 3)) != 1) failures++;
+    close(fd);
+    std::vector<float> out((size_t)channels * (e.frames + 2));
+    s.open(path, true);
+    if (s.read(first + e.frames / 2, 2, nullptr, 0, out.data(), 2) ||
+        !s.read(first - 1, 1, nullptr, 0, out.data(), 1) ||
+        !s.read(first + e.frames, 1, nullptr, 0, out.data(), 1)) {
+        fprintf(stderr, "FAIL: damaged block %zu not refused alone\n", d);
+        failures++;
+    }
+    s.open(path, false);
+    if (e.codec == emg::REC_CODEC_NONE && !s.read(first, e.frames, nullptr, 0, out.data(), e.frames)) {
+        fprintf(stderr, "FAIL: read without verify refused\n");
+        failures++;
+    }
+    checks++;
+    s.close();
+    unlink(path.c_str());
+    return checks;
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_rec_session.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(44);
+    int checks = 0;
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 64, 256, emg::REC_CODEC_NONE, rng);
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 3, 100, emg::REC_CODEC_NONE, rng);
+    checks += run(dir, emg::REC_FMT_I16, 5, 512, emg::REC_CODEC_NONE, rng);
+    checks += run(dir, emg::REC_FMT_I16, 32, 64, emg::REC_CODEC_NONE, rng);
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 64, 256, emg::REC_CODEC_DELTA_BP, rng);
+    checks += run(dir, emg::REC_FMT_I16, 13, 100, emg::REC_CODEC_DELTA_BP, rng);
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 20, 512, emg::REC_CODEC_LZ, rng);
+    checks += run(dir, emg::REC_FMT_I16, 32, 64, emg::REC_CODEC_LZ, rng);
+    rmdir(dir);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Summary pyramid against brute force over the same frames: side files
+ * written in random batches (with time gaps), then random time ranges and
+ * column counts queried while the files are still being written and after
+ * close, for uint8 and int16 recordings. Checks every column's frames,
+ * times, min, max, mean and RMS, and that a query reads O(columns) entries.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "emg_proto.h"
+#include "rec_summary.h"
+
+static int failures = 0;
+
+struct history {
+    size_t channels;
+    std::vector<int32_t> v;         // frame by frame, relative to the sample zero
+    std::vector<int64_t> t;         // host time of every frame
+
+    int32_t at(uint64_t frame, size_t c) const { return v[frame * channels + c]; }
+};
+
+struct column_ref {
+    uint64_t frames = 0;
+    int64_t t0 = 0, t1 = 0;
+    std::vector<int32_t> mn, mx;
+    std::vector<double> sum, sumsq;
+};
+
+static void check(const emg::rec_summary_reader &rd, const history &h, bool closed, int64_t t0, int64_t t1,
+                  size_t columns, uint32_t rate, double tol)
+{
+    emg::summary_view v;
+    if (!rd.query(t0, t1, columns, &v)) {
+        fprintf(stderr, "FAIL query [%lld, %lld) x %zu: read error\n", (long long)t0, (long long)t1, columns);
+        failures++;
+        return;
+    }
+    if (v.columns != columns || v.shift < emg::REC_SUMMARY_BASE_SHIFT) {
+        fprintf(stderr, "FAIL query: %zu columns at level %d\n", v.columns, v.shift);
+        failures++;
+        return;
+    }
+
+    // Which level: the coarsest with at least one entry per column
+    double column_ns = (double)(t1 - t0) / (double)columns;
+    int want_shift = emg::REC_SUMMARY_BASE_SHIFT;
+    for (int k = 0; k < emg::REC_SUMMARY_LEVELS; k++) {
+        int s = emg::REC_SUMMARY_BASE_SHIFT + k * emg::REC_SUMMARY_LEVEL_STEP;
+        if ((double)(1ull << s) * 1e9 / rate <= column_ns) want_shift = s;
+    }
+    if (v.shift != want_shift) {
+        fprintf(stderr, "FAIL query x %zu over %.3f s: level %d, want %d\n", columns, (t1 - t0) * 1e-9, v.shift,
+                want_shift);
+        failures++;
+        return;
+    }
+
+    std::vector<column_ref> ref(columns);
+    for (column_ref &r : ref) {
+        r.mn.assign(h.channels, 0);
+        r.mx.assign(h.channels, 0);
+        r.sum.assign(h.channels, 0.0);
+        r.sumsq.assign(h.channels, 0.0);
+    }
+    uint64_t per = 1ull << v.shift, total = h.t.size();
+    uint64_t entries = closed ? (total + per - 1) / per : total / per;
+    size_t in_range = 0;
+    for (uint64_t e = 0; e < entries; e++) {
+        uint64_t a = e * per, b = std::min(a + per, total);
+        int64_t mid = h.t[a] + (h.t[b - 1] - h.t[a]) / 2;
+        if (mid < t0 || mid >= t1) continue;
+        in_range++;
+        size_t col = (size_t)std::min<double>((double)(mid - t0) / column_ns, (double)(columns - 1));
+        column_ref &r = ref[col];
+        if (r.frames == 0) {
+            r.t0 = h.t[a];
+            for (size_t c = 0; c < h.channels; c++) {
+                r.mn[c] = r.mx[c] = h.at(a, c);
+            }
+        }
+        r.t1 = h.t[b - 1];
+        r.frames += b - a;
+        for (uint64_t f = a; f < b; f++) {
+            for (size_t c = 0; c < h.channels; c++) {
+                int32_t x = h.at(f, c);
+                r.mn[c] = std::min(r.mn[c], x);
+                r.mx[c] = std::max(r.mx[c], x);
+                r.sum[c] += x;
+                r.sumsq[c] += (double)x * x;
+            }
+        }
+    }
+    if (v.entries_read != in_range) {
+        fprintf(stderr, "FAIL query read %zu entries, want %zu\n", v.entries_read, in_range);
+        failures++;
+    }
+    if (v.shift > emg::REC_SUMMARY_BASE_SHIFT && in_range > 4 * columns + 2) {
+        fprintf(stderr, "FAIL query read %zu entries for %zu columns\n", in_range, columns);
+        failures++;
+    }
+
+    for (size_t col = 0; col < columns; col++) {
+        const column_ref &r = ref[col];
+        if (v.frames[col] != r.frames || (r.frames && (v.t0_ns[col] != r.t0 || v.t1_ns[col] != r.t1))) {
+            fprintf(stderr, "FAIL column %zu: %llu frames over [%lld, %lld], want %llu over [%lld, %lld]\n", col,
+                    (unsigned long long)v.frames[col], (long long)v.t0_ns[col], (long long)v.t1_ns[col],
+                    (unsigned long long)r.frames, (long long)r.t0, (long long)r.t1);
+            failures++;
+            return;
+        }
+        if (!r.frames) continue;
+        for (size_t c = 0; c < h.channels; c++) {
+            const emg::summary_value &s = v.at(col, c);
+            double mean = r.sum[c] / r.frames, rms = std::sqrt(r.sumsq[c] / r.frames);
+            if (s.min != r.mn[c] || s.max != r.mx[c] || std::fabs(s.mean - mean) > tol ||
+                std::fabs(s.rms - rms) > tol) {
+                fprintf(stderr, "FAIL column %zu channel %zu: %g/%g/%g/%g, want %d/%d/%g/%g\n", col, c, s.min, s.max,
+                        s.mean, s.rms, r.mn[c], r.mx[c], mean, rms);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+static int run(const std::string &dir, uint8_t format, size_t channels, uint64_t total_frames, std::mt19937 &rng)
+{
+    const uint32_t rate = 2048;
+    std::string path = dir + "/rec" + std::to_string(format) + "_" + std::to_string(channels) + ".emgr";
+    emg::rec_file_header hdr = {};
+    hdr.channels = (uint16_t)channels;
+    hdr.sample_format = format;
+    hdr.frame_rate_hz = rate;
+    hdr.created_ns = 1700000000000000000ll + (int64_t)rng();
+    hdr.header_crc = (uint32_t)rng();
+
+    emg::rec_summary_writer sw;
+    if (!sw.open(path, hdr)) {
+        fprintf(stderr, "FAIL: cannot create the summary of %s\n", path.c_str());
+        failures++;
+        return 0;
+    }
+    history h{ channels, {}, {} };
+    size_t frame_bytes = emg::rec_frame_bytes(format, (uint16_t)channels);
+    std::vector<uint8_t> buf;
+    int64_t t = hdr.created_ns, last = 0;
+    const int64_t period = 1000000000ll / rate;
+    while (h.t.size() < total_frames) {
+        uint32_t n = 1 + rng() % 700;
+        buf.resize((size_t)n * frame_bytes);
+        for (uint32_t i = 0; i < n; i++) {
+            for (size_t c = 0; c < channels; c++) {
+                int32_t x;
+                if (format == emg::REC_FMT_U8_OFFSET) {
+                    uint8_t s = (uint8_t)rng();
+                    buf[(size_t)i * frame_bytes + c] = s;
+                    x = (int32_t)s - EMG_SAMPLE_ZERO;
+                } else {
+                    int16_t s = (int16_t)(rng() % 65536 - 32768);
+                    memcpy(&buf[(size_t)i * frame_bytes + 2 * c], &s, 2);
+                    x = s;
+                }
+                h.v.push_back(x);
+            }
+        }
+        // Jittered batches, now and then a device that was away for a while
+        // or a clock that stepped back (times must still never decrease)
+        int64_t first = t, last_t = t + (int64_t)(n - 1) * period + (int64_t)(rng() % 200000) - 100000;
+        if (rng() % 20 == 0) first -= 50000000;
+        for (uint32_t i = 0; i < n; i++) {
+            int64_t ti = n > 1 ? first + (last_t - first) * (int64_t)i / (int64_t)(n - 1) : first;
+            last = std::max(ti, last);
+            h.t.push_back(last);
+        }
+        sw.append(buf.data(), n, first, last_t);
+        t += (int64_t)n * period + (rng() % 30 == 0 ? (int64_t)(rng() % 5000) * 1000000 : 0);
+    }
+
+    int checks = 0;
+    double tol = format == emg::REC_FMT_U8_OFFSET ? 1.0 / 256 : 1.0;
+    for (int pass = 0; pass < 2; pass++) {
+        bool closed = pass == 1;
+        if (closed) {
+            sw.close();
+        } else {
+            sw.flush();
+        }
+        emg::rec_summary_reader rd;
+        std::string err;
+        if (!rd.open(path, hdr, &err) || rd.levels().size() != emg::REC_SUMMARY_LEVELS) {
+            fprintf(stderr, "FAIL: cannot open the summary of %s: %s\n", path.c_str(), err.c_str());
+            failures++;
+            return checks;
+        }
+        int64_t begin = h.t.front(), end = h.t.back() + 1;
+        for (int q = 0; q < 60; q++) {
+            // From a few frames to the whole recording and beyond it
+            int64_t span = (int64_t)(std::pow(10.0, 6.0 + (rng() % 1000) / 1000.0 * 5.0));
+            int64_t a = begin - span / 4 + (int64_t)(rng() % (uint64_t)(end - begin + span / 2));
+            size_t columns = 1 + rng() % 2000;
+            check(rd, h, closed, a, a + span, columns, rate, tol);
+            checks++;
+        }
+        check(rd, h, closed, begin, end, 1000, rate, tol);
+        checks++;
+    }
+
+    // Side files of another recording by the same name are not used
+    emg::rec_file_header other = hdr;
+    other.header_crc ^= 1;
+    emg::rec_summary_reader rd;
+    std::string err;
+    if (rd.open(path, other, &err)) {
+        fprintf(stderr, "FAIL: summary opened for the wrong recording\n");
+        failures++;
+    }
+    for (int k = 0; k < emg::REC_SUMMARY_LEVELS; k++) {
+        unlink(emg::rec_summary_path(path, emg::REC_SUMMARY_BASE_SHIFT + k * emg::REC_SUMMARY_LEVEL_STEP).c_str());
+    }
+    return checks;
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_rec_summary.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(43);
+    int checks = 0;
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 64, 300000, rng);
+    checks += run(dir, emg::REC_FMT_U8_OFFSET, 3, 1000, rng);
+    checks += run(dir, emg::REC_FMT_I16, 5, 200000, rng);
+    rmdir(dir);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Segmented sessions: segments written the way the recorder writes them
+ * (rec_writer on name.part, listed with segment_finalizer::opened(), handed
+ * over with closed()) and finalized in the background. Checks that every
+ * segment ends up renamed, synced and summarised, that the manifest lists
+ * them closed with their frame counts and time ranges and is marked
+ * finished, and that rec_session over the manifest reads the same frames
+ * and times as the segments one after the other: while the session is
+ * still being written, after refresh() picks up new blocks and segments,
+ * and once it is finished. Also the segment limit parser.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "emg_proto.h"
+#include "rec_manifest.h"
+#include "rec_session.h"
+#include "rec_summary.h"
+#include "rec_writer.h"
+#include "recorder.h"
+#include "segment_finalizer.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                      \
+    do {                                                                                                      \
+        if (!(cond)) {                                                                                        \
+            fprintf(stderr, "FAIL: " __VA_ARGS__);                                                            \
+            fprintf(stderr, "\n");                                                                            \
+            failures++;                                                                                       \
+        }                                                                                                     \
+    } while (0)
+
+static bool exists(const std::string &path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+/* Frames written so far, and the host time of each as the writer spreads it */
+struct reference {
+    std::vector<uint8_t> frames;
+    std::vector<int64_t> t;
+};
+
+/* Every sample and frame time of the session against what was written */
+static int check_session(emg::rec_session &s, const reference &r, size_t channels, std::mt19937 &rng)
+{
+    uint64_t n = r.t.size();
+    CHECK(s.frames() == n, "session has %llu frames, %llu written", (unsigned long long)s.frames(),
+          (unsigned long long)n);
+    if (s.frames() != n || n == 0) {
+        return 1;
+    }
+    std::vector<float> out(channels * n);
+    std::vector<int64_t> t(n);
+    std::string err;
+    bool ok = s.read(0, n, nullptr, 0, out.data(), n, t.data(), 1.0f, &err);
+    CHECK(ok, "read of the whole session: %s", err.c_str());
+    int bad = 0;
+    for (uint64_t i = 0; ok && i < n && bad < 5; i++) {
+        for (size_t c = 0; c < channels; c++) {
+            if (out[c * n + i] != (float)r.frames[i * channels + c] - EMG_SAMPLE_ZERO) bad++;
+        }
+        if (t[i] != r.t[i]) bad++;
+    }
+    CHECK(bad == 0, "session samples or times differ from those written");
+
+    // Random windows of a few channels, and time lookups, across segment boundaries
+    int checks = 2;
+    for (int k = 0; k < 200; k++) {
+        uint64_t first = rng() % n;
+        size_t m = 1 + rng() % (size_t)std::min<uint64_t>(n - first, 3000);
+        std::vector<uint16_t> ch = { (uint16_t)(rng() % channels), (uint16_t)(rng() % channels) };
+        std::vector<float> w(2 * m);
+        ok = s.read(first, m, ch.data(), 2, w.data(), m, nullptr, 1.0f, &err);
+        for (size_t i = 0; ok && i < m; i++) {
+            for (size_t j = 0; j < 2; j++) {
+                ok = w[j * m + i] == (float)r.frames[(first + i) * channels + ch[j]] - EMG_SAMPLE_ZERO;
+            }
+        }
+        CHECK(ok, "window [%llu, +%zu) of channels %u, %u", (unsigned long long)first, m, ch[0], ch[1]);
+
+        int64_t when = r.t[0] - 1000 + (int64_t)(rng() % (uint64_t)(r.t.back() - r.t[0] + 2000));
+        uint64_t want = 0;
+        while (want < n && r.t[want] < when) want++;
+        CHECK(s.frame_at(when) == want, "frame_at(%lld) = %llu, want %llu", (long long)when,
+              (unsigned long long)s.frame_at(when), (unsigned long long)want);
+        checks += 2;
+    }
+    return checks;
+}
+
+/* A session of several segments, read while being written and once finalized */
+static int run(const std::string &dir, uint16_t channels, uint32_t block_frames, uint8_t codec, std::mt19937 &rng)
+{
+    const std::string base = dir + "/dev_20250301-101500", manifest = base + ".emgm";
+    const int SEGMENTS = 4, BLOCKS = 5;
+    emg::segment_finalizer fin;
+    fin.start();
+
+    emg::rec_file_header hdr = {};
+    hdr.channels = channels;
+    hdr.sample_format = emg::REC_FMT_U8_OFFSET;
+    hdr.codec = codec;
+    hdr.frame_rate_hz = 2048;
+    hdr.chunk_frames = block_frames;
+
+    reference r;
+    emg::rec_session s;
+    int checks = 0;
+    uint64_t frame = 0;
+    int64_t t = 1700000000000000000ll;
+    std::vector<uint8_t> batch;
+    std::vector<std::string> files;
+    for (int seg = 1; seg <= SEGMENTS; seg++) {
+        char name[64];
+        snprintf(name, sizeof(name), "dev_20250301-101500.%04d.emgr", seg);
+        files.push_back(name);
+        std::string path = dir + "/" + name;
+        emg::rec_writer w;
+        if (!w.open(path + ".part", hdr) || !fin.opened(manifest, name)) {
+            CHECK(false, "cannot open segment %s", name);
+            return checks;
+        }
+        // Whole blocks, so that the times the writer spreads are those of the batch
+        for (int b = 0; b < BLOCKS; b++) {
+            uint32_t n = block_frames;
+            batch.resize((size_t)n * channels);
+            for (size_t i = 0; i < batch.size(); i++) {
+                batch[i] = (uint8_t)(128 + (int)(rng() % 41) - 20);
+            }
+            int64_t t_last = t + (int64_t)(n - 1) * 488281;
+            w.append(batch.data(), n, frame, frame * 488, t, t_last);
+            r.frames.insert(r.frames.end(), batch.begin(), batch.end());
+            for (uint32_t i = 0; i < n; i++) {
+                r.t.push_back(n > 1 ? t + (t_last - t) * (int64_t)i / (int64_t)(n - 1) : t);
+            }
+            frame += n;
+            t = t_last + 488281 + (b == 2 ? 5000000000ll : 0);     // a gap in time
+        }
+        w.flush();
+
+        // Live: the open segment is read under its .part name
+        if (seg == 2) {
+            std::string err;
+            CHECK(s.open(manifest, true, &err), "open of the live session: %s", err.c_str());
+            CHECK(!s.finished(), "live session reads as finished");
+            checks += check_session(s, r, channels, rng);
+        } else if (seg > 2) {
+            s.refresh();
+            checks += check_session(s, r, channels, rng);
+        }
+        w.close([&fin, manifest, name, seg](bool ok) {
+            CHECK(ok, "segment %d not closed cleanly", seg);
+            fin.closed(manifest, name, seg == SEGMENTS);
+        });
+    }
+    fin.stop();
+    CHECK(fin.finalized == (uint64_t)SEGMENTS && fin.errors == 0, "%llu segments finalized, %llu errors",
+          (unsigned long long)fin.finalized.load(), (unsigned long long)fin.errors.load());
+
+    // Renamed, summarised, and listed closed with their frames and times
+    emg::rec_manifest m;
+    std::string err;
+    CHECK(emg::rec_manifest_read(manifest, &m, &err), "manifest unreadable: %s", err.c_str());
+    CHECK(m.finished && m.segments.size() == (size_t)SEGMENTS, "manifest not finished or %zu segments",
+          m.segments.size());
+    uint64_t frames = 0;
+    for (size_t i = 0; i < m.segments.size() && i < files.size(); i++) {
+        const emg::rec_segment &seg = m.segments[i];
+        std::string path = dir + "/" + files[i];
+        CHECK(seg.file == files[i] && seg.closed, "segment %zu is %s, %s", i, seg.file.c_str(),
+              seg.closed ? "closed" : "open");
+        CHECK(exists(path) && !exists(path + ".part"), "%s not renamed", files[i].c_str());
+        CHECK(exists(emg::rec_summary_path(path, 6)), "%s has no summary", files[i].c_str());
+        CHECK(seg.frames == (uint64_t)BLOCKS * block_frames, "segment %zu lists %llu frames", i,
+              (unsigned long long)seg.frames);
+        CHECK(seg.t0_ns == r.t[frames] && seg.t1_ns == r.t[frames + seg.frames - 1],
+              "segment %zu time range", i);
+        frames += seg.frames;
+        checks += 5;
+    }
+
+    // The session opened before the renames follows them, and so does a fresh one
+    s.refresh();
+    CHECK(s.finished() && s.segments() == (size_t)SEGMENTS, "session not finished after the last segment");
+    checks += check_session(s, r, channels, rng);
+    s.close();
+    CHECK(s.open(manifest, true, &err), "open of the finished session: %s", err.c_str());
+    CHECK(s.finished() && s.data_blocks() == (size_t)SEGMENTS * BLOCKS, "finished session has %zu blocks",
+          s.data_blocks());
+    checks += check_session(s, r, channels, rng) + 2;
+    s.close();
+
+    DIR *d = opendir(dir.c_str());
+    while (struct dirent *e = d ? readdir(d) : nullptr) {
+        if (e->d_name[0] != '.') unlink((dir + "/" + e->d_name).c_str());
+    }
+    if (d) closedir(d);
+    return checks;
+}
+
+static int limits()
+{
+    struct {
+        const char *s;
+        bool ok;
+        uint64_t bytes, ns;
+    } cases[] = {
+        { "512MB", true, 512ull << 20, 0 },  { "2gb", true, 2ull << 30, 0 },
+        { "30s", true, 0, 30000000000ull },  { "10min", true, 0, 600000000000ull },
+        { "1h", true, 0, 3600000000000ull }, { "0s", false, 0, 0 },
+        { "10", false, 0, 0 },               { "MB", false, 0, 0 },
+        { "5ms", false, 0, 0 },
+    };
+    for (const auto &c : cases) {
+        emg::recorder_config cfg;
+        bool ok = emg::parse_segment_limit(c.s, &cfg);
+        CHECK(ok == c.ok && (!ok || (cfg.segment_bytes == c.bytes && cfg.segment_ns == c.ns)),
+              "segment limit '%s'", c.s);
+    }
+    return (int)(sizeof(cases) / sizeof(cases[0]));
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_segments.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(46);
+    int checks = limits();
+    checks += run(dir, 64, 512, emg::REC_CODEC_NONE, rng);
+    checks += run(dir, 7, 100, emg::REC_CODEC_DELTA_BP, rng);
+    rmdir(dir);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
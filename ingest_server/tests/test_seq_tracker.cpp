@@ -0,0 +1,309 @@
+/*
+ * Batch sequence accounting against a plain set of every number seen:
+ * random loss, duplicates and late batches, sequence numbers wrapping at
+ * 32 bits, restarts, gaps settled by age and by count, and a multi-day
+ * stream to check the totals and that the cost stays flat. Then through
+ * the recorder: loss events in the recording, duplicates and late batches
+ * left out of it.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <random>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "rec_reader.h"
+#include "recorder.h"
+#include "seq_tracker.h"
+#include "wire.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                             \
+    do {                                                                                                             \
+        if (!(cond)) {                                                                                               \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);                                                     \
+            fprintf(stderr, __VA_ARGS__);                                                                            \
+            fprintf(stderr, "\n");                                                                                   \
+            failures++;                                                                                              \
+        }                                                                                                            \
+    } while (0)
+
+using emg::seq_tracker;
+
+/* Sequences sent in order from first, some dropped, repeated or held back a few places */
+static int random_stream(uint32_t first, std::mt19937 &rng)
+{
+    const int n = 200000;
+    std::vector<uint32_t> sent;
+    for (int i = 0; i < n; i++) {
+        uint32_t s = first + (uint32_t)i;
+        unsigned r = rng() % 1000;
+        if (r < 20) {
+            continue;                               // lost
+        }
+        if (r < 30 && i > 0 && i + 5 < n) {
+            sent.push_back(first + (uint32_t)(i + 1 + rng() % 4));     // held back: the later one first
+        }
+        sent.push_back(s);
+        if (r < 35) {
+            sent.push_back(s);                      // duplicate
+        }
+    }
+
+    seq_tracker t;
+    std::set<uint64_t> seen;
+    uint64_t dups = 0, reorders = 0, gaps = 0;
+    uint64_t newest = 0;
+    int checks = 0;
+    for (size_t k = 0; k < sent.size(); k++) {
+        uint64_t s = sent[k] - first;               // unwrapped, from 0
+        emg::seq_verdict v = t.add(sent[k], (int64_t)k);
+        bool dup = !seen.insert(s).second;
+        emg::seq_verdict want;
+        if (dup) {
+            want = emg::SEQ_DUPLICATE;
+        } else if (k == 0 || s == newest + 1) {
+            want = emg::SEQ_IN_ORDER;
+        } else if (s > newest) {
+            want = emg::SEQ_GAP;
+        } else {
+            want = emg::SEQ_REORDER;
+        }
+        if (k == 0 || s > newest) newest = s;
+        dups += want == emg::SEQ_DUPLICATE;
+        reorders += want == emg::SEQ_REORDER;
+        gaps += want == emg::SEQ_GAP;
+        CHECK(v == want, "batch %zu (seq %u): verdict %d, want %d", k, sent[k], v, want);
+        if (v != want) {
+            return checks + 1;
+        }
+        checks++;
+    }
+    emg::seq_summary sum = t.summary();
+    uint64_t lost = newest + 1 - seen.size();
+    CHECK(sum.received == seen.size(), "received %llu, want %zu", (unsigned long long)sum.received, seen.size());
+    CHECK(sum.lost == lost, "lost %llu, want %llu", (unsigned long long)sum.lost, (unsigned long long)lost);
+    CHECK(sum.duplicates == dups && sum.reorders == reorders && sum.gaps == gaps,
+          "duplicates %llu reorders %llu gaps %llu, want %llu %llu %llu", (unsigned long long)sum.duplicates,
+          (unsigned long long)sum.reorders, (unsigned long long)sum.gaps, (unsigned long long)dups,
+          (unsigned long long)reorders, (unsigned long long)gaps);
+    double pct = 100.0 * lost / (newest + 1);
+    CHECK(sum.loss_pct() > pct - 1e-9 && sum.loss_pct() < pct + 1e-9, "loss %.4f%%, want %.4f%%", sum.loss_pct(), pct);
+    std::vector<emg::seq_gap> recent = t.recent_gaps();
+    CHECK(recent.size() == seq_tracker::MAX_HISTORY, "%zu recent gaps", recent.size());
+    for (size_t i = 1; i < recent.size(); i++) {
+        CHECK(recent[i].t_ns > recent[i - 1].t_ns, "recent gaps out of order at %zu", i);
+    }
+    return checks + 4;
+}
+
+/* Specific cases: longest gap, fills from either side, restarts, settling */
+static int cases()
+{
+    int checks = 0;
+    {
+        seq_tracker t;
+        CHECK(t.add(10, 0) == emg::SEQ_IN_ORDER, "first batch");
+        CHECK(t.add(11, 1) == emg::SEQ_IN_ORDER, "second batch");
+        CHECK(t.add(15, 2) == emg::SEQ_GAP, "gap 12-14");
+        CHECK(t.last_gap().seq == 12 && t.last_gap().count == 3 && t.last_gap().t_ns == 2,
+              "gap 12-14 found as %llu+%llu", (unsigned long long)t.last_gap().seq,
+              (unsigned long long)t.last_gap().count);
+        CHECK(t.add(30, 3) == emg::SEQ_GAP, "gap 16-29");
+        CHECK(t.add(12, 4) == emg::SEQ_REORDER, "12 from below");
+        CHECK(t.add(14, 5) == emg::SEQ_REORDER, "14 from above");
+        CHECK(t.add(13, 6) == emg::SEQ_REORDER, "13 joins");
+        CHECK(t.add(13, 7) == emg::SEQ_DUPLICATE, "13 again");
+        CHECK(t.add(20, 8) == emg::SEQ_REORDER, "20 in the middle of a gap");
+        CHECK(t.add(20, 9) == emg::SEQ_DUPLICATE, "20 again");
+        CHECK(t.add(5, 10) == emg::SEQ_RESTART, "before the start");
+        CHECK(t.add(6, 11) == emg::SEQ_IN_ORDER, "after the restart");
+        emg::seq_summary s = t.summary();
+        CHECK(s.received == 10 && s.lost == 13 && s.gaps == 2 && s.duplicates == 2 && s.reorders == 4 &&
+              s.restarts == 1, "summary %llu %llu %llu %llu %llu %llu", (unsigned long long)s.received,
+              (unsigned long long)s.lost, (unsigned long long)s.gaps, (unsigned long long)s.duplicates,
+              (unsigned long long)s.reorders, (unsigned long long)s.restarts);
+        CHECK(s.longest.seq == 16 && s.longest.count == 14 && s.longest.t_ns == 3, "longest gap %llu+%llu",
+              (unsigned long long)s.longest.seq, (unsigned long long)s.longest.count);
+        t.restart();
+        CHECK(t.add(0, 12) == emg::SEQ_IN_ORDER, "after restart()");
+        CHECK(t.summary().restarts == 1 && t.summary().received == 11, "totals kept over restart()");
+        checks += 17;
+    }
+    {
+        // Numbers wrap at 32 bits
+        seq_tracker t;
+        t.add(UINT32_MAX - 1, 0);
+        CHECK(t.add(UINT32_MAX, 1) == emg::SEQ_IN_ORDER, "to the last");
+        CHECK(t.add(0, 2) == emg::SEQ_IN_ORDER, "wrapped");
+        CHECK(t.add(3, 3) == emg::SEQ_GAP && t.last_gap().count == 2, "gap over the wrap");
+        CHECK(t.add(UINT32_MAX, 4) == emg::SEQ_DUPLICATE, "before the wrap again");
+        CHECK(t.add(1, 5) == emg::SEQ_REORDER, "into the gap");
+        CHECK(t.summary().lost == 1, "lost %llu", (unsigned long long)t.summary().lost);
+        checks += 6;
+    }
+    {
+        // A gap far enough behind is settled: a batch for it is no longer a reorder
+        seq_tracker t;
+        t.add(0, 0);
+        t.add(2, 1);
+        for (uint32_t s = 3; s < 1 + seq_tracker::HORIZON; s++) {
+            t.add(s, 2);
+        }
+        CHECK(t.add(1, 3) == emg::SEQ_REORDER, "gap just inside the horizon");
+        t.add(3 + seq_tracker::HORIZON, 4);
+        t.add(5 + seq_tracker::HORIZON, 4);
+        for (uint32_t s = 6 + seq_tracker::HORIZON; s < 6 + 2 * seq_tracker::HORIZON; s++) {
+            t.add(s, 5);
+        }
+        CHECK(t.add(4 + seq_tracker::HORIZON, 6) == emg::SEQ_RESTART, "gap beyond the horizon");
+        checks += 2;
+    }
+    {
+        // Only MAX_OPEN gaps stay open
+        seq_tracker t;
+        uint32_t s = 0;
+        for (size_t g = 0; g < seq_tracker::MAX_OPEN + 2; g++, s += 2) {
+            t.add(s, 0);
+        }
+        CHECK(t.add(1, 1) == emg::SEQ_RESTART, "oldest of %zu gaps settled", seq_tracker::MAX_OPEN + 1);
+        seq_tracker u;
+        for (size_t g = 0, s = 0; g < seq_tracker::MAX_OPEN + 2; g++, s += 2) {
+            u.add((uint32_t)s, 0);
+        }
+        CHECK(u.add(3, 1) == emg::SEQ_REORDER, "second oldest still open");
+        checks += 2;
+    }
+    return checks;
+}
+
+/* Eight batches a second for a week, one lost in every 10000 */
+static int long_run()
+{
+    const uint64_t n = 8ull * 86400 * 7;
+    seq_tracker t;
+    uint64_t lost = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < n; i++) {
+        if (i % 10000 == 9999) {
+            lost++;
+            continue;
+        }
+        t.add((uint32_t)i, (int64_t)i * 125000000);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    emg::seq_summary sum = t.summary();
+    CHECK(sum.received == n - lost && sum.lost == lost && sum.gaps == lost, "week: %llu received %llu lost",
+          (unsigned long long)sum.received, (unsigned long long)sum.lost);
+    CHECK(sum.longest.count == 1 && sum.longest.seq == 9999, "week: longest gap %llu at %llu",
+          (unsigned long long)sum.longest.count, (unsigned long long)sum.longest.seq);
+    printf("week of batches: %.1f ns per batch, %zu bytes of state\n", s * 1e9 / n, sizeof(seq_tracker));
+    return 2;
+}
+
+/* Raw batches of 4 frames with the given sequence numbers, frame indices following them */
+static std::vector<uint8_t> batches(const std::vector<uint32_t> &seqs)
+{
+    std::vector<uint8_t> out;
+    for (uint32_t s : seqs) {
+        emg_msg_hdr_t h = {};
+        h.magic = EMG_MSG_MAGIC;
+        h.version = EMG_PROTO_VERSION;
+        h.type = EMG_MSG_RAW_BATCH;
+        h.len = 4 * EMG_FRAME_BYTES;
+        h.seq = s;
+        h.count = 4;
+        h.frame0 = (uint64_t)s * 4;
+        h.t_us = h.frame0 * 1000000 / 2048;
+        out.insert(out.end(), (const uint8_t *)&h, (const uint8_t *)&h + sizeof(h));
+        out.insert(out.end(), h.len, (uint8_t)s);
+    }
+    return out;
+}
+
+static int through_recorder(const char *dir)
+{
+    static emg::stream_slot streams[emg::MAX_STREAMS];
+    strcpy(streams[0].name, "dev");
+    strcpy(streams[0].device_id, "ip-127.0.0.1");
+    emg::recorder_config cfg;
+    cfg.out_dir = dir;
+    cfg.summary = false;
+    std::string path;
+    {
+        emg::recorder rec(cfg, streams);
+        // 3-4 lost, 2 late, 5 twice
+        std::vector<uint8_t> data = batches({ 0, 1, 2, 5, 2, 5, 6, 7, 8 });
+        emg::chunk c;
+        c.data = data.data();
+        c.capacity = c.len = (uint32_t)data.size();
+        c.stream = 0;
+        c.flags = 0;
+        c.recv_ns = emg::now_ns();
+        c.messages = 9;
+        rec.handle(c);
+        const emg::stream_stats &st = streams[0].stats;
+        CHECK(st.seq_lost.load() == 2 && st.seq_duplicates.load() == 2 && st.seq_reorders.load() == 0,
+              "stats lost %llu dup %llu reord %llu", (unsigned long long)st.seq_lost.load(),
+              (unsigned long long)st.seq_duplicates.load(), (unsigned long long)st.seq_reorders.load());
+        data = batches({ 3 });
+        c.data = data.data();
+        c.capacity = c.len = (uint32_t)data.size();
+        rec.handle(c);
+        CHECK(st.seq_lost.load() == 1 && st.seq_reorders.load() == 1, "stats after a late batch: lost %llu reord %llu",
+              (unsigned long long)st.seq_lost.load(), (unsigned long long)st.seq_reorders.load());
+        rec.close_all();
+    }
+
+    std::vector<std::string> files;
+    if (DIR *d = opendir(dir)) {
+        while (struct dirent *e = readdir(d)) {
+            if (e->d_name[0] != '.') {
+                files.push_back(std::string(dir) + "/" + e->d_name);
+            }
+        }
+        closedir(d);
+    }
+    CHECK(files.size() == 1, "%zu files written", files.size());
+    if (files.size() != 1) {
+        return 3;
+    }
+    emg::rec_reader rd;
+    std::string err;
+    CHECK(rd.open(files[0], &err), "%s: %s", files[0].c_str(), err.c_str());
+    CHECK(rd.frames() == 7 * 4, "%llu frames recorded, want 28", (unsigned long long)rd.frames());
+    int losses = 0;
+    for (const emg::rec_event &e : rd.events()) {
+        if (e.kind == emg::REC_EVENT_LOSS) {
+            losses++;
+            CHECK(e.frame == 20 && e.frames == 2 && strcmp(e.text, "batches 3-4") == 0, "loss at %llu +%u '%.40s'",
+                  (unsigned long long)e.frame, e.frames, e.text);
+        }
+    }
+    CHECK(losses == 1, "%d loss events", losses);
+    unlink(files[0].c_str());
+    return 7;
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_seq_tracker.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(48);
+    int checks = cases();
+    checks += random_stream(1000, rng);
+    checks += random_stream(UINT32_MAX - 50000, rng);
+    checks += long_run();
+    checks += through_recorder(dir);
+    rmdir(dir);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
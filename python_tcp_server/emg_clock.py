@@ -0,0 +1,180 @@
+"""Device-to-host clock model: a host timestamp for every received frame.
+
+Every message header carries the device's own time of its first frame
+(t_us, esp_timer) and its frame index. The host only knows when a batch
+arrived: that time shifted by an unknown offset, stretched by the drift
+between the two crystals, and delayed by Wi-Fi and TCP, usually by about the
+minimum but now and then by tens of milliseconds more. Stamping every sample
+of a read with the arrival time piles a whole batch onto one instant and
+hides the latency.
+
+ClockModel fits host = dev + offset + slope * dev to the lower envelope of
+the arrivals, like the ingest server's clock_model.h: arrivals are grouped
+into 250 ms buckets of device time, each bucket keeps its earliest arrival,
+and a least squares line through the last 60 s of buckets (without those
+more than 4 median deviations off the current line) gives the offset and
+the drift. The drift is only fitted once the buckets span 10 s. It starts
+over when the device clock goes backwards (a reboot) or when arrivals keep
+landing 5 ms or more off the line.
+
+    clock = ClockModel()
+    dev = batch_frame_times(t_us, frame0, count, rate)    # device seconds
+    clock.add(dev[-1], time.perf_counter())               # sent after its last frame
+    host = clock.to_host(dev)                             # per-frame host seconds
+"""
+import numpy as np
+
+BUCKET_S = 0.25
+WINDOW = 240                # buckets: 60 s
+MIN_SLOPE_SPAN_S = 10.0
+REJECT_MADS = 4.0
+REJECT_FLOOR_S = 50e-6
+STEP_S = 5e-3
+EARLY_RESET = 3             # arrivals in a row
+LATE_RESET = 20             # buckets in a row (5 s)
+
+
+def batch_frame_times(t_us, frame0, count, rate):
+    """Device time (s) of every frame of a raw batch: from its t_us or, if it has none, its frame index."""
+    base = t_us * 1e-6 if t_us else frame0 / rate
+    return base + np.arange(count, dtype=np.float64) / rate
+
+
+def batch_frame_span(t_us, frame0, count, rate):
+    """Device time (s) of the first and the last frame of a raw batch, as batch_frame_times()."""
+    base = t_us * 1e-6 if t_us else frame0 / rate
+    return base, base + (count - 1) / rate
+
+
+class ClockModel:
+    def __init__(self):
+        self.resets = 0
+        self._have_ref = False
+        self.locked = False
+        self._jit = []
+
+    def reset(self):
+        """Forget everything, e.g. when the device reboots."""
+        if self._have_ref:
+            self.resets += 1
+        self._have_ref = False
+        self.locked = False
+
+    def _start(self, dev, host):
+        self._have_ref = True
+        self.locked = False
+        self._dev0 = dev
+        self._host0 = host
+        self._last_dev = dev
+        self._offset = 0.0
+        self._slope = 0.0
+        self._buckets = []              # (x, d), oldest first
+        self._open = (0.0, 0.0)
+        self._open_index = 0
+        self._early = 0
+        self._late = 0
+        self.rejected = 0
+
+    @property
+    def valid(self):
+        return self._have_ref
+
+    @property
+    def drift_ppm(self):
+        return self._slope * 1e6 if self._have_ref else 0.0
+
+    @property
+    def rate(self):
+        """Host seconds per device second: 1 + drift."""
+        return 1.0 + (self._slope if self._have_ref else 0.0)
+
+    def to_host(self, dev):
+        """Host time of device time(s) `dev` (a float or an array)."""
+        x = np.asarray(dev, dtype=np.float64) - self._dev0
+        return self._host0 + x + self._offset + self._slope * x
+
+    def add(self, dev, host):
+        """Add one arrival: the frame at device time `dev` arrived at host time `host`.
+
+        Returns False if it made the model start over.
+        """
+        if not self._have_ref:
+            self._start(dev, host)
+            return True
+        if dev < self._last_dev:
+            # The device clock restarted: a reboot
+            self.reset()
+            self._start(dev, host)
+            return False
+        self._last_dev = dev
+
+        x = dev - self._dev0
+        d = host - self._host0 - x
+        r = d - (self._offset + self._slope * x)
+        if r < -STEP_S and self._buckets:
+            # Earlier than any delay allows: a one-off is ignored, a run is a clock step
+            self._early += 1
+            if self._early >= EARLY_RESET:
+                self.reset()
+                self._start(dev, host)
+                return False
+            return True
+        self._early = 0
+        self._jit.append(r)
+
+        index = int(x // BUCKET_S)
+        if index != self._open_index:
+            if not self._close_bucket():
+                self.reset()
+                self._start(dev, host)
+                return False
+            self._open_index = index
+            self._open = (x, d)
+        elif d < self._open[1]:
+            self._open = (x, d)
+        if not self._buckets:
+            # No bucket closed yet: the earliest arrival so far sets the offset
+            self._offset = min(self._offset, d)
+        return True
+
+    def _close_bucket(self):
+        x, d = self._open
+        if self._buckets and d - (self._offset + self._slope * x) > STEP_S:
+            self._late += 1
+            if self._late >= LATE_RESET:
+                return False
+        else:
+            self._late = 0
+        self._buckets.append(self._open)
+        if len(self._buckets) > WINDOW:
+            del self._buckets[0]
+        self._fit()
+        return True
+
+    def _fit(self):
+        xs, ds = np.array(self._buckets).T
+        free_slope = len(xs) >= 3 and xs[-1] - xs[0] >= MIN_SLOPE_SPAN_S
+
+        # Leave out buckets far off the current line, which a stall's worth
+        # of late buckets cannot drag along the way they would a fresh fit
+        r = ds - (self._offset + self._slope * xs)
+        med = np.median(r)
+        limit = max(REJECT_MADS * 1.4826 * np.median(np.abs(r - med)), REJECT_FLOOR_S)
+        keep = np.abs(r - med) <= limit
+        self.rejected = int(len(xs) - keep.sum())
+        xs, ds = xs[keep], ds[keep]
+
+        if free_slope:
+            u = xs - xs.mean()
+            sxx = np.dot(u, u)
+            if sxx > 0.0:
+                self._slope = float(np.dot(u, ds - ds.mean()) / sxx)
+        self._offset = float(ds.mean() - self._slope * xs.mean())
+        self.locked = free_slope
+
+    def take_jitter(self):
+        """(arrivals, rms, max) of the arrival delay over the line since the previous call, in seconds."""
+        jit, self._jit = np.array(self._jit), []
+        if len(jit) == 0:
+            return 0, 0.0, 0.0
+        return len(jit), float(np.sqrt(np.mean(jit * jit))), float(jit.max())
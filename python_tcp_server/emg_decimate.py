@@ -0,0 +1,149 @@
+"""Min/max decimation of a live window, for plots that keep up at any rate.
+
+A plot a couple of thousand pixels wide cannot show more points than that,
+but a 5 s window at 2 kHz is 10,000 samples per channel and at 32 kHz
+160,000: handing them all to matplotlib every batch is what makes a live
+plot fall behind. Decimator keeps the newest `capacity` frames of every
+channel in libemg_decimate.so (ingest_server/src/decimate.h), together
+with a min/max pyramid over them, and answers a window with as many points
+as there are pixels, in time that grows only with the log of the window:
+
+    dec = Decimator(channels=64, capacity=5 * rate)
+    dec.append(frames)                     # uint8 (n, 64) or bytes, or float32 (n, channels)
+    first = dec.written - 5 * rate
+    cols = dec.envelope(0, first, 5 * rate, columns=1920)
+    x, y = envelope_polyline(cols)         # min/max zig-zag: every peak shows
+    seq, y = dec.lttb(0, first, 5 * rate, points=1920)
+
+Frames are numbered in the order they were appended, from 0; uint8 frames
+are stored less 128. The arrays returned are views of buffers reused by
+the next query of the same kind. Not thread-safe: a plot drawing from
+another thread must hold a lock around appends and queries.
+
+The library is looked for in $EMG_DECIMATE_LIB, then in
+ingest_server/build, then on the system library path.
+"""
+import ctypes
+
+import numpy as np
+
+from emg_native import load_library
+
+ENVELOPE_DTYPE = np.dtype([('first', '<u8'), ('count', '<u4'), ('min', '<f4'), ('max', '<f4'),
+                           ('mean', '<f4')])   # emg_envelope_column
+
+
+def _load_library():
+    lib = load_library('emg_decimate', 'EMG_DECIMATE_LIB')
+    vp = ctypes.c_void_p
+    size = ctypes.c_size_t
+    u64 = ctypes.c_uint64
+    lib.emg_decimator_create.restype = vp
+    lib.emg_decimator_create.argtypes = [size, size]
+    lib.emg_decimator_destroy.restype = None
+    lib.emg_decimator_destroy.argtypes = [vp]
+    lib.emg_decimator_append_u8.restype = None
+    lib.emg_decimator_append_u8.argtypes = [vp, vp, size]
+    lib.emg_decimator_append_f32.restype = None
+    lib.emg_decimator_append_f32.argtypes = [vp, vp, size]
+    lib.emg_decimator_clear.restype = None
+    lib.emg_decimator_clear.argtypes = [vp]
+    lib.emg_decimator_written.restype = u64
+    lib.emg_decimator_written.argtypes = [vp]
+    lib.emg_decimator_capacity.restype = size
+    lib.emg_decimator_capacity.argtypes = [vp]
+    lib.emg_decimator_envelope.restype = size
+    lib.emg_decimator_envelope.argtypes = [vp, size, u64, size, size, vp]
+    lib.emg_decimator_lttb.restype = size
+    lib.emg_decimator_lttb.argtypes = [vp, size, u64, size, size, vp, vp]
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+class Decimator:
+    def __init__(self, channels, capacity):
+        """Hold the newest `capacity` frames (rounded up to a power of two) of `channels` samples."""
+        self._lib = _library()
+        self._d = self._lib.emg_decimator_create(channels, max(int(capacity), 1))
+        if not self._d:
+            raise MemoryError(f'decimator of {channels} x {capacity} frames')
+        self.channels = channels
+        self.capacity = self._lib.emg_decimator_capacity(self._d)
+        self._columns = np.empty(0, dtype=ENVELOPE_DTYPE)
+        self._seq = np.empty(0, dtype=np.uint64)
+        self._value = np.empty(0, dtype=np.float32)
+
+    def close(self):
+        if self._d:
+            self._lib.emg_decimator_destroy(self._d)
+            self._d = None
+
+    def __del__(self):
+        self.close()
+
+    @property
+    def written(self):
+        """Frames appended so far: the number the next one gets."""
+        return self._lib.emg_decimator_written(self._d)
+
+    def clear(self):
+        self._lib.emg_decimator_clear(self._d)
+
+    def append(self, frames):
+        """Append whole frames: offset-binary uint8 (or bytes), or float32 shaped (n, channels)."""
+        if isinstance(frames, (bytes, bytearray, memoryview)):
+            frames = np.frombuffer(frames, dtype=np.uint8)
+        if frames.dtype == np.uint8:
+            fn = self._lib.emg_decimator_append_u8
+        else:
+            frames = np.asarray(frames, dtype=np.float32)
+            fn = self._lib.emg_decimator_append_f32
+        frames = np.ascontiguousarray(frames)
+        n = frames.size // self.channels
+        if n:
+            fn(self._d, frames.ctypes.data, n)
+
+    def envelope(self, channel, first, n, columns):
+        """ENVELOPE_DTYPE records (first, count, min, max, mean) of up to `columns`
+        equal slices of frames [first, first + n), clipped to the frames held."""
+        if len(self._columns) < columns:
+            self._columns = np.empty(columns, dtype=ENVELOPE_DTYPE)
+        got = self._lib.emg_decimator_envelope(self._d, channel, max(int(first), 0), max(int(n), 0), columns,
+                                               self._columns.ctypes.data)
+        return self._columns[:got]
+
+    def lttb(self, channel, first, n, points):
+        """(frame numbers, values) of frames [first, first + n) cut down to `points` by min/max LTTB."""
+        if len(self._seq) < points:
+            self._seq = np.empty(points, dtype=np.uint64)
+            self._value = np.empty(points, dtype=np.float32)
+        got = self._lib.emg_decimator_lttb(self._d, channel, max(int(first), 0), max(int(n), 0), points,
+                                           self._seq.ctypes.data, self._value.ctypes.data)
+        return self._seq[:got], self._value[:got]
+
+
+def envelope_polyline(columns, x=None, y=None):
+    """(frame positions, values) tracing each column's min then max: a line that
+    reaches every peak of the window with two points per column. Written into
+    x and y (float arrays at least 2 * len(columns) long) if given."""
+    m = 2 * len(columns)
+    x = np.empty(m, dtype=np.float64) if x is None else x[:m]
+    y = np.empty(m, dtype=np.float32) if y is None else y[:m]
+    mid = x[0::2]
+    mid[:] = columns['count']
+    mid -= 1
+    mid *= 0.5
+    mid += columns['first']
+    x[1::2] = mid
+    y[0::2] = columns['min']
+    y[1::2] = columns['max']
+    return x, y
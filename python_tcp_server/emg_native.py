@@ -0,0 +1,20 @@
+"""Loading the native helper libraries built with the ingest server.
+
+Each library is looked for in the environment variable given, then in
+ingest_server/build next to this directory, then on the system library path.
+"""
+import ctypes
+import ctypes.util
+import os
+
+
+def load_library(name, env):
+    """ctypes.CDLL of lib<name>.so; OSError if it is nowhere to be found."""
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [os.environ.get(env),
+                  os.path.join(here, '..', 'ingest_server', 'build', f'lib{name}.so'),
+                  ctypes.util.find_library(name)]
+    for path in candidates:
+        if path and (os.path.exists(path) or not os.path.dirname(path)):
+            return ctypes.CDLL(path)
+    raise OSError(f'lib{name}.so not found: build ingest_server/ or set {env}')
@@ -0,0 +1,208 @@
+"""Zero-copy NumPy views of the ingest server's live rings.
+
+The native ingest server (ingest_server/) publishes every device's raw
+frames into a ring in shared memory, /dev/shm/emg.<device>. This module
+attaches to one read-only through libemg_ring.so (ingest_server/src/
+emg_ring.h, built with the server) and hands out NumPy arrays shaped
+(samples, channels) that point straight into the shared mapping: the
+sample data is never copied, whatever the rate.
+
+    ring = LiveRing('rigA_mac-a4cf12ab34cd')
+    seq = ring.written
+    while ring.wait(seq, timeout=1.0):
+        first, frames = ring.since(seq)     # uint8, offset binary around 128
+        process(frames)
+        if not ring.valid(first):           # overwritten while in use
+            ...                             # discard the result
+        seq = first + len(frames)
+
+Every frame has a sequence number, counting from 0 when the server
+created the ring. The server never waits for readers: a reader that falls
+more than `capacity` frames behind gets `first > seq` from since() (the
+frames in between are lost), and valid() tells whether a view was
+overwritten while it was being used. Views are read-only; they keep the
+ring mapped, but must not be used after an explicit close().
+
+times() gives the host time of each frame, from the server's clock model
+(device timestamps fitted against arrival times), not the time a read
+happened to return it.
+
+The library is looked for in $EMG_RING_LIB, then in ingest_server/build,
+then on the system library path.
+"""
+import ctypes
+import os
+import time
+
+import numpy as np
+
+from emg_native import load_library
+
+SHM_DIR = '/dev/shm'
+RING_CONNECTED = 1 << 0
+RING_CLOSED = 1 << 1
+
+_SAMPLE_DTYPES = {1: np.dtype(np.uint8), 2: np.dtype('<i2')}   # REC_FMT_U8_OFFSET, REC_FMT_I16
+
+
+class RingInfo(ctypes.Structure):
+    _fields_ = [('capacity', ctypes.c_uint64),
+                ('frame_bytes', ctypes.c_uint32),
+                ('channels', ctypes.c_uint16),
+                ('sample_format', ctypes.c_uint8),
+                ('reserved', ctypes.c_uint8),
+                ('frame_rate_hz', ctypes.c_uint32),
+                ('flags', ctypes.c_uint32),
+                ('written', ctypes.c_uint64),
+                ('next_frame', ctypes.c_uint64),
+                ('gaps', ctypes.c_uint64),
+                ('t_ns', ctypes.c_int64),
+                ('device_id', ctypes.c_char * 32),
+                ('name', ctypes.c_char * 64),
+                ('frame_ps', ctypes.c_uint64)]
+
+
+def _load_library():
+    lib = load_library('emg_ring', 'EMG_RING_LIB')
+    u8p = ctypes.POINTER(ctypes.c_uint8)
+    size_p = ctypes.POINTER(ctypes.c_size_t)
+    u64_p = ctypes.POINTER(ctypes.c_uint64)
+    lib.emg_ring_open.restype = ctypes.c_void_p
+    lib.emg_ring_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.emg_ring_close.restype = None
+    lib.emg_ring_close.argtypes = [ctypes.c_void_p]
+    lib.emg_ring_get_info.restype = None
+    lib.emg_ring_get_info.argtypes = [ctypes.c_void_p, ctypes.POINTER(RingInfo)]
+    lib.emg_ring_latest.restype = u8p
+    lib.emg_ring_latest.argtypes = [ctypes.c_void_p, ctypes.c_size_t, u64_p, size_p]
+    lib.emg_ring_since.restype = u8p
+    lib.emg_ring_since.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_size_t, u64_p, size_p]
+    lib.emg_ring_valid.restype = ctypes.c_int
+    lib.emg_ring_valid.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.emg_ring_wait.restype = ctypes.c_int
+    lib.emg_ring_wait.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int]
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+def list_rings(prefix='emg'):
+    """Device names with a live ring under `prefix`."""
+    head = prefix + '.'
+    try:
+        names = os.listdir(SHM_DIR)
+    except FileNotFoundError:
+        return []
+    return sorted(n[len(head):] for n in names if n.startswith(head))
+
+
+class LiveRing:
+    def __init__(self, device, prefix='emg'):
+        self._lib = _library()
+        err = ctypes.create_string_buffer(256)
+        self._h = self._lib.emg_ring_open(f'/{prefix}.{device}'.encode(), err, len(err))
+        if not self._h:
+            raise OSError(err.value.decode(errors='replace'))
+        info = self.info()
+        self.device = device
+        self.device_id = info.device_id.decode()
+        self.capacity = info.capacity
+        self.channels = info.channels
+        self.frame_bytes = info.frame_bytes
+        self.dtype = _SAMPLE_DTYPES[info.sample_format]
+        self._first = ctypes.c_uint64()
+        self._got = ctypes.c_size_t()
+
+    def close(self):
+        if self._h:
+            self._lib.emg_ring_close(self._h)
+            self._h = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def info(self):
+        """RingInfo: fixed fields and a consistent snapshot of the live ones."""
+        out = RingInfo()
+        self._lib.emg_ring_get_info(self._h, ctypes.byref(out))
+        return out
+
+    @property
+    def written(self):
+        """Frames published so far; the sequence number of the next frame."""
+        return self.info().written
+
+    @property
+    def frame_rate(self):
+        return self.info().frame_rate_hz
+
+    @property
+    def connected(self):
+        return bool(self.info().flags & RING_CONNECTED)
+
+    def _view(self, ptr):
+        n = self._got.value
+        if n == 0:
+            return np.empty((0, self.channels), dtype=self.dtype)
+        addr = ctypes.cast(ptr, ctypes.c_void_p).value
+        buf = (ctypes.c_uint8 * (n * self.frame_bytes)).from_address(addr)
+        buf._ring = self                    # keeps the mapping alive as long as the view
+        frames = np.frombuffer(buf, dtype=self.dtype).reshape(n, self.channels)
+        frames.flags.writeable = False      # the mapping is read-only
+        return frames
+
+    def latest(self, n):
+        """(first_seq, frames): the newest min(n, stored) frames, oldest first."""
+        ptr = self._lib.emg_ring_latest(self._h, n, ctypes.byref(self._first), ctypes.byref(self._got))
+        return self._first.value, self._view(ptr)
+
+    def since(self, seq, max_frames=None):
+        """(first_seq, frames) from sequence `seq` on; first_seq > seq if frames were lost."""
+        limit = self.capacity if max_frames is None else min(max_frames, self.capacity)
+        ptr = self._lib.emg_ring_since(self._h, seq, limit, ctypes.byref(self._first), ctypes.byref(self._got))
+        return self._first.value, self._view(ptr)
+
+    def times(self, first, n):
+        """Host wall clock (UNIX seconds) of frames first .. first + n - 1.
+
+        Counted back from the newest frame at the host frame period, so a
+        device gap after `first` shifts these times by its length.
+        """
+        info = self.info()
+        back = (info.written - 1 - first) - np.arange(n, dtype=np.float64)
+        return (info.t_ns - back * (info.frame_ps / 1000.0)) * 1e-9
+
+    def valid(self, seq):
+        """True while frames from sequence `seq` on have not been overwritten."""
+        return bool(self._lib.emg_ring_valid(self._h, seq))
+
+    def wait(self, seq, timeout=None):
+        """Block until more than `seq` frames are written; False on timeout or when the server closes the ring.
+
+        Waits in slices of 100 ms (without the GIL) so that Ctrl-C still works.
+        """
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            slice_ms = 100
+            if deadline is not None:
+                slice_ms = min(slice_ms, max(1, int((deadline - time.monotonic()) * 1000)))
+            if self._lib.emg_ring_wait(self._h, seq, slice_ms):
+                return True
+            if self.info().flags & RING_CLOSED:
+                return False
+            if deadline is not None and time.monotonic() >= deadline:
+                return False
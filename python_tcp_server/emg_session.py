@@ -0,0 +1,164 @@
+"""Random access to recorded sessions (.emgr) for offline analysis.
+
+The ingest server records every device to a .emgr file (ingest_server/src/
+recording.h): blocks of frames with host timestamps and an index. Session
+opens one through libemg_session.so (ingest_server/src/emg_session.h, built
+with the server), which maps the file and reads any window of any channels
+straight from the blocks that hold it, whatever the size of the file:
+
+    rec = Session('rigA_mac-a4cf12ab34cd_20250301-101500.emgr')
+    x = rec.read(300.0, 310.0, channels=range(12, 21))   # float32 (9, n)
+    x, t_ns = rec.read(300.0, 310.0, times=True)         # all channels, and frame times
+
+Times are seconds from the first frame; read_ns() takes host wall clock
+times (UNIX ns) and read_frames() frame numbers, counting every recorded
+frame from 0. Samples come out channel-major as float32, less the sample
+zero (128 for the ESP32's offset-binary uint8) and times `scale`. A file
+that is still being written can be read too; refresh() picks up what was
+appended since. A session recorded in segments (emg_ingest --segment) is
+opened through its manifest, rigA_..._20250301-101500.emgm, and reads as
+one recording across all of its segments.
+
+The library is looked for in $EMG_SESSION_LIB, then in ingest_server/build,
+then on the system library path.
+"""
+import ctypes
+
+import numpy as np
+
+from emg_native import load_library
+
+
+class SessionInfo(ctypes.Structure):
+    _fields_ = [('channels', ctypes.c_uint16),
+                ('sample_format', ctypes.c_uint8),
+                ('finished', ctypes.c_uint8),
+                ('frame_rate_hz', ctypes.c_uint32),
+                ('frames', ctypes.c_uint64),
+                ('blocks', ctypes.c_uint64),
+                ('start_ns', ctypes.c_int64),
+                ('end_ns', ctypes.c_int64),
+                ('created_ns', ctypes.c_int64),
+                ('device_id', ctypes.c_char * 32),
+                ('name', ctypes.c_char * 64)]
+
+
+def _load_library():
+    lib = load_library('emg_session', 'EMG_SESSION_LIB')
+    vp = ctypes.c_void_p
+    size = ctypes.c_size_t
+    lib.emg_session_open.restype = vp
+    lib.emg_session_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p, size]
+    lib.emg_session_close.restype = None
+    lib.emg_session_close.argtypes = [vp]
+    lib.emg_session_refresh.restype = size
+    lib.emg_session_refresh.argtypes = [vp]
+    lib.emg_session_get_info.restype = None
+    lib.emg_session_get_info.argtypes = [vp, ctypes.POINTER(SessionInfo)]
+    lib.emg_session_frame_at.restype = ctypes.c_uint64
+    lib.emg_session_frame_at.argtypes = [vp, ctypes.c_int64]
+    lib.emg_session_read.restype = ctypes.c_int
+    lib.emg_session_read.argtypes = [vp, ctypes.c_uint64, size, vp, size, vp, size, vp, ctypes.c_float,
+                                     ctypes.c_char_p, size]
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+class Session:
+    def __init__(self, path, verify=False):
+        """Open the recording at `path`; with verify, every block's CRC is checked the first time it is read."""
+        self._lib = _library()
+        err = ctypes.create_string_buffer(256)
+        self._s = self._lib.emg_session_open(str(path).encode(), 1 if verify else 0, err, len(err))
+        if not self._s:
+            raise OSError(f'{path}: {err.value.decode(errors="replace")}')
+        self.path = path
+        self._update()
+
+    def _update(self):
+        info = SessionInfo()
+        self._lib.emg_session_get_info(self._s, ctypes.byref(info))
+        self.info = info
+        self.channels = info.channels
+        self.rate = info.frame_rate_hz
+        self.device_id = info.device_id.decode(errors='replace')
+        self.name = info.name.decode(errors='replace')
+
+    def close(self):
+        if self._s:
+            self._lib.emg_session_close(self._s)
+            self._s = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def refresh(self):
+        """Pick up blocks appended to a file still being written; returns how many."""
+        found = self._lib.emg_session_refresh(self._s)
+        self._update()
+        return found
+
+    @property
+    def frames(self):
+        return self.info.frames
+
+    @property
+    def duration(self):
+        """Seconds from the first frame to the last, on the host clock."""
+        return (self.info.end_ns - self.info.start_ns) * 1e-9
+
+    def frame_at(self, t_ns):
+        """Number of the first frame at or after host time t_ns (`frames` if none)."""
+        return self._lib.emg_session_frame_at(self._s, int(t_ns))
+
+    def read(self, start, stop, channels=None, times=False, scale=1.0, out=None):
+        """Frames from `start` to `stop` seconds after the first frame; see read_frames()."""
+        t0 = self.info.start_ns
+        return self.read_ns(t0 + int(round(start * 1e9)), t0 + int(round(stop * 1e9)), channels, times, scale, out)
+
+    def read_ns(self, t0_ns, t1_ns, channels=None, times=False, scale=1.0, out=None):
+        """Frames with host times in [t0_ns, t1_ns); see read_frames()."""
+        first = self.frame_at(t0_ns)
+        return self.read_frames(first, self.frame_at(t1_ns) - first, channels, times, scale, out)
+
+    def read_frames(self, first, n, channels=None, times=False, scale=1.0, out=None):
+        """float32 array (len(channels), n) of frames [first, first + n), clipped
+        to the recording; channels is any sequence of channel numbers (None:
+        all). With times, returns (samples, host time of every frame in ns).
+        With out (float32, C-contiguous, at least that shape) it is written
+        there and a view of it returned."""
+        first = min(max(int(first), 0), self.frames)
+        n = min(max(int(n), 0), self.frames - first)
+        if channels is None:
+            ch, nch = None, self.channels
+        else:
+            ch = np.ascontiguousarray(channels, dtype=np.uint16)
+            nch = len(ch)
+        if out is None:
+            out = np.empty((nch, n), dtype=np.float32)
+        elif out.dtype != np.float32 or not out.flags.c_contiguous or out.ndim != 2 or \
+                out.shape[0] < nch or out.shape[1] < n:
+            raise ValueError(f'out must be a C-contiguous float32 array of at least ({nch}, {n})')
+        t = np.empty(n, dtype=np.int64) if times else None
+        err = ctypes.create_string_buffer(256)
+        if self._lib.emg_session_read(self._s, first, n, None if ch is None else ch.ctypes.data, nch,
+                                      out.ctypes.data, out.shape[1], None if t is None else t.ctypes.data,
+                                      scale, err, len(err)) != 0:
+            raise OSError(f'{self.path}: {err.value.decode(errors="replace")}')
+        view = out[:nch, :n]
+        return (view, t) if times else view
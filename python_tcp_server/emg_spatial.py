@@ -0,0 +1,117 @@
+"""Spatial filters over the HD-EMG electrode grid (host side).
+
+Mirrors tcp_client/main/emg_spatial.c: the same layout tables, modes and
+output ordering, so host results match what the ESP32 computes on device.
+A layout and mode are compiled once into a gather plan (an index array and
+fixed weights); applying it to a batch of frames is a handful of vectorized
+numpy operations whose cost does not depend on the grid geometry.
+"""
+import numpy as np
+
+NUM_CHANNELS = 64
+SAMPLE_ZERO = 128
+
+MODES = ('none', 'car', 'sd', 'dd', 'ndd')
+
+
+def _layout_8x8():
+    return np.arange(64, dtype=np.int16).reshape(8, 8)
+
+
+def _layout_13x5():
+    # Top-left corner empty; channels numbered down each column, left to right.
+    grid = np.full((13, 5), -1, dtype=np.int16)
+    k = 0
+    for c in range(5):
+        for r in range(13):
+            if r == 0 and c == 0:
+                continue
+            grid[r, c] = k
+            k += 1
+    return grid
+
+
+LAYOUTS = {
+    '8x8': _layout_8x8(),
+    '13x5': _layout_13x5(),
+}
+
+# Tap offsets (row, column) and weights per mode; "longitudinal" runs along rows.
+_TAPS = {
+    'none': ([(0, 0)], [1]),
+    'car': ([(0, 0)], [1]),
+    'sd': ([(0, 0), (1, 0)], [-1, 1]),
+    'dd': ([(0, 0), (-1, 0), (1, 0)], [-2, 1, 1]),
+    'ndd': ([(0, 0), (-1, 0), (1, 0), (0, -1), (0, 1)], [4, -1, -1, -1, -1]),
+}
+
+
+class SpatialFilter:
+    """Compiled spatial filter for one layout and mode."""
+
+    def __init__(self, layout='8x8', mode='car'):
+        if mode not in MODES:
+            raise ValueError(f"unknown spatial filter mode {mode!r}")
+        grid = LAYOUTS[layout] if isinstance(layout, str) else np.asarray(layout)
+        offsets, weights = _TAPS[mode]
+        rows, cols = grid.shape
+
+        idx, pos = [], []
+        for r in range(rows):
+            for c in range(cols):
+                taps = []
+                for dr, dc in offsets:
+                    rr, cc = r + dr, c + dc
+                    if 0 <= rr < rows and 0 <= cc < cols and grid[rr, cc] >= 0:
+                        taps.append(int(grid[rr, cc]))
+                if len(taps) == len(offsets):
+                    idx.append(taps)
+                    pos.append((r, c))
+
+        self.mode = mode
+        self.idx = np.array(idx, dtype=np.intp)          # (n_out, taps)
+        self.weights = np.array(weights, dtype=np.int32)
+        self.positions = pos                             # grid (row, col) of each output
+        self.n_out = len(idx)
+        self._x = None                                   # scratch, grown to the largest batch
+
+    def apply(self, frames, out=None):
+        """Filter raw frames.
+
+        frames: uint8 array shaped (n, 64) or flat bytes of whole frames.
+        Returns int32 array shaped (n, n_out), in counts. With `out`, an
+        array of that shape of any numeric dtype, the result is written
+        there instead and nothing is allocated but scratch space the first
+        time a batch this large comes along.
+        """
+        u8 = np.frombuffer(frames, dtype=np.uint8) if isinstance(frames, (bytes, bytearray, memoryview)) \
+            else np.asarray(frames, dtype=np.uint8)
+        u8 = u8.reshape(-1, NUM_CHANNELS)
+        n = len(u8)
+        if self._x is None or len(self._x) < n:
+            self._x = np.empty((n, NUM_CHANNELS), dtype=np.int32)
+            self._acc = np.empty((n, self.n_out), dtype=np.int32)
+            self._tap = np.empty((n, self.n_out), dtype=np.int32)
+            self._mean = np.empty(n, dtype=np.float64)
+        x, acc, tap = self._x[:n], self._acc[:n], self._tap[:n]
+        np.copyto(x, u8)
+        x -= SAMPLE_ZERO
+        # mode='clip' (the indices are valid anyway) lets take() write into out unbuffered
+        np.take(x, self.idx[:, 0], axis=1, out=acc, mode='clip')
+        if self.mode == 'car':
+            # Integer mean truncated toward zero, as on the device
+            mean = self._mean[:n]
+            np.sum(acc, axis=1, out=mean)
+            mean /= self.n_out
+            np.trunc(mean, out=mean)
+            np.subtract(acc, mean[:, None], out=acc, casting='unsafe')
+        else:
+            acc *= self.weights[0]
+            for t in range(1, self.idx.shape[1]):
+                np.take(x, self.idx[:, t], axis=1, out=tap, mode='clip')
+                tap *= self.weights[t]
+                acc += tap
+        if out is None:
+            return acc.copy()
+        np.copyto(out, acc, casting='unsafe')
+        return out
@@ -0,0 +1,87 @@
+"""Incremental reader for a file that another process keeps appending to.
+
+TailReader maps the file and, on every read(), hands out the whole items
+(frames of `channels` numbers) added since the last call as one NumPy array
+over the mapping: no per-sample parsing and no copy, so a poll costs the
+same however many samples arrived. A trailing partial item, the writer
+being mid-way through it, is left in the file for the next call.
+
+    tail = TailReader('received_data.bin', np.float32, backlog=100000)
+    while True:
+        new = tail.read()          # (n, channels), valid until the next read()
+        if tail.restarted:         # the file was truncated or replaced
+            ...                    # forget what came before
+        process(new)
+
+The first read() returns at most `backlog` items, the newest ones already
+in the file; later ones return only what is new. If the file is truncated
+or replaced it is read again from the start.
+"""
+import mmap
+import os
+
+import numpy as np
+
+
+class TailReader:
+    def __init__(self, path, dtype, channels=1, backlog=0):
+        self.path = path
+        self.dtype = np.dtype(dtype)
+        self.channels = channels
+        self.item = self.dtype.itemsize * channels
+        self.backlog = backlog
+        self.position = None        # byte offset of the next item; None before the first read
+        self.restarted = False      # the last read() started the file over
+        self._f = None
+        self._ino = None
+        self._mm = None
+        self._mapped = 0
+        self._empty = np.empty((0, channels), dtype=self.dtype)
+
+    def close(self):
+        if self._f is not None:
+            self._f.close()
+        # Arrays handed out keep their own reference to the mapping
+        self._f = self._mm = None
+        self._mapped = 0
+
+    def _open(self):
+        try:
+            self._f = open(self.path, 'rb')
+        except FileNotFoundError:
+            return False
+        self._ino = os.fstat(self._f.fileno()).st_ino
+        return True
+
+    def read(self):
+        """Items appended since the last call, shaped (n, channels)."""
+        self.restarted = False
+        if self._f is None and not self._open():
+            return self._empty
+        try:
+            st = os.stat(self.path)
+        except FileNotFoundError:
+            return self._empty
+        if st.st_ino != self._ino or (self.position is not None and st.st_size < self.position):
+            # Replaced or truncated: a new recording
+            self.close()
+            if not self._open():
+                return self._empty
+            self.position = 0
+            self.restarted = True
+            st = os.fstat(self._f.fileno())
+
+        size = st.st_size
+        end = size - size % self.item
+        if self.position is None:
+            self.position = end - min(self.backlog, end // self.item) * self.item
+        if end <= self.position:
+            return self._empty
+        if end > self._mapped:
+            # Mappings cannot grow; the old one lives on while arrays use it
+            self._mm = mmap.mmap(self._f.fileno(), size, access=mmap.ACCESS_READ)
+            self._mapped = size
+        n = (end - self.position) // self.item
+        data = np.frombuffer(self._mm, dtype=self.dtype, count=n * self.channels, offset=self.position)
+        self.position = end
+        return data.reshape(n, self.channels)
@@ -0,0 +1,182 @@
+"""Batched background file writer for the receive loop.
+
+The receive thread only copies into a large aggregation buffer; full
+buffers are written by a dedicated thread, so disk latency never reaches
+the socket. `buffers` buffers of `buffer_size` bytes make up the burst
+reserve: while one is free, write() returns immediately however slow the
+disk is. When all of them are queued, write() blocks, which lets TCP flow
+control slow the sender down instead of dropping data.
+
+Durability is a policy:
+    'none'    leave it to the OS page cache
+    '<N>MB'   os.fdatasync() after every N MB written
+    '<T>ms'   os.fdatasync() at most T ms after data was written
+
+A partly filled buffer is handed off by the first write() after it has
+waited `flush_ms`, or by flush(). stats() returns throughput, queue depth
+and write / fsync latency histograms (power-of-two microsecond buckets).
+"""
+import os
+import queue
+import threading
+import time
+
+import numpy as np
+
+
+def parse_sync_policy(policy):
+    """'none' -> (None, 0); '64MB' -> ('bytes', 64 << 20); '500ms' -> ('ms', 0.5)."""
+    p = policy.strip().lower()
+    if p == 'none':
+        return None, 0
+    if p.endswith('mb'):
+        return 'bytes', int(p[:-2]) << 20
+    if p.endswith('ms'):
+        return 'ms', int(p[:-2]) / 1000.0
+    raise ValueError(f"bad sync policy {policy!r}")
+
+
+class LatencyHistogram:
+    BUCKETS = 32
+
+    def __init__(self):
+        self.counts = np.zeros(self.BUCKETS, dtype=np.int64)
+        self.max_s = 0.0
+
+    def add(self, seconds):
+        us = int(seconds * 1e6)
+        self.counts[min(us.bit_length(), self.BUCKETS - 1)] += 1
+        self.max_s = max(self.max_s, seconds)
+
+    def quantile_us(self, q):
+        n = self.counts.sum()
+        if n == 0:
+            return 0
+        k = int(np.searchsorted(np.cumsum(self.counts), q * n, side='right'))
+        return 1 << min(k, self.BUCKETS - 1)
+
+
+class BatchedWriter:
+    def __init__(self, path, buffer_size=4 << 20, buffers=3, sync='none', flush_ms=1000):
+        self._fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+        self._size = buffer_size
+        self._sync_kind, self._sync_arg = parse_sync_policy(sync)
+        self._flush_s = flush_ms / 1000.0
+        if self._sync_kind == 'ms':
+            self._flush_s = min(self._flush_s, self._sync_arg)
+
+        self._free = queue.Queue()
+        for _ in range(max(2, buffers)):
+            self._free.put(bytearray(buffer_size))
+        self._full = queue.Queue()          # (buffer, length) or None to stop
+        self._cur = self._free.get()
+        self._fill = 0
+        self._dirty_since = None
+
+        self.bytes_written = 0
+        self.waits = 0
+        self.write_latency = LatencyHistogram()
+        self.sync_latency = LatencyHistogram()
+        self._unsynced = 0
+        self._unsynced_since = None
+        self._started = time.monotonic()
+        self._error = None
+        self._thread = threading.Thread(target=self._run, name='emg-writer', daemon=True)
+        self._thread.start()
+
+    # ---- receive thread ----
+
+    def write(self, data):
+        if self._error:
+            raise self._error
+        view = memoryview(data)
+        while len(view):
+            if self._fill == 0:
+                self._dirty_since = time.monotonic()
+            n = min(len(view), self._size - self._fill)
+            self._cur[self._fill:self._fill + n] = view[:n]
+            self._fill += n
+            view = view[n:]
+            if self._fill == self._size:
+                self._hand_off()
+        if self._fill and time.monotonic() - self._dirty_since >= self._flush_s:
+            self._hand_off()
+
+    def flush(self):
+        """Queue the partly filled buffer now."""
+        if self._fill:
+            self._hand_off()
+
+    def close(self):
+        self.flush()
+        self._full.put(None)
+        self._thread.join()
+        os.close(self._fd)
+        if self._error:
+            raise self._error
+
+    def stats(self):
+        elapsed = max(time.monotonic() - self._started, 1e-9)
+        return {
+            'mb_per_s': self.bytes_written / elapsed / 1e6,
+            'queued': self._full.qsize(),
+            'free_buffers': self._free.qsize(),
+            'waits': self.waits,
+            'write_p50_us': self.write_latency.quantile_us(0.5),
+            'write_p99_us': self.write_latency.quantile_us(0.99),
+            'fsync_p50_us': self.sync_latency.quantile_us(0.5),
+            'fsync_p99_us': self.sync_latency.quantile_us(0.99),
+            'fsync_max_ms': self.sync_latency.max_s * 1000.0,
+            'write_hist': self.write_latency.counts.copy(),
+            'fsync_hist': self.sync_latency.counts.copy(),
+        }
+
+    def _hand_off(self):
+        self._full.put((self._cur, self._fill))
+        try:
+            self._cur = self._free.get_nowait()
+        except queue.Empty:
+            self.waits += 1
+            self._cur = self._free.get()
+        self._fill = 0
+
+    # ---- writer thread ----
+
+    def _sync(self):
+        t0 = time.perf_counter()
+        os.fdatasync(self._fd)
+        self.sync_latency.add(time.perf_counter() - t0)
+        self._unsynced = 0
+        self._unsynced_since = None
+
+    def _run(self):
+        timeout = self._sync_arg if self._sync_kind == 'ms' else None
+        while True:
+            try:
+                item = self._full.get(timeout=timeout)
+            except queue.Empty:
+                item = False
+            if item:
+                buf, n = item
+                try:
+                    t0 = time.perf_counter()
+                    view = memoryview(buf)[:n]
+                    while len(view):
+                        view = view[os.write(self._fd, view):]
+                    self.write_latency.add(time.perf_counter() - t0)
+                    self.bytes_written += n
+                    self._unsynced += n
+                    if self._unsynced_since is None:
+                        self._unsynced_since = time.monotonic()
+                    if self._sync_kind == 'bytes' and self._unsynced >= self._sync_arg:
+                        self._sync()
+                except OSError as e:
+                    self._error = e
+                self._free.put(buf)
+            if (self._sync_kind == 'ms' and self._unsynced_since is not None and
+                    time.monotonic() - self._unsynced_since >= self._sync_arg):
+                self._sync()
+            if item is None:
+                if self._sync_kind and self._unsynced:
+                    self._sync()
+                return
@@ -1,22 +1,47 @@
-import struct
+import sys
+import time
 import matplotlib.pyplot as plt
 import matplotlib.animation as animation
+import numpy as np
 from collections import deque
-from datetime import datetime, timedelta
+
+from emg_decimate import Decimator, envelope_polyline
+from emg_tail import TailReader
 
 # Configuration
 DATA_FILE = 'received_data.bin'
 WINDOW_SECONDS = 10  # Show last 10 seconds of data
 REFRESH_RATE = 1000  # Refresh every 1000ms (1 second)
 NUMBER_FORMAT = 'f'  # 'f' for float, 'd' for double, 'i' for int, etc.
+FRAME_NUMBERS = 1    # numbers per frame in DATA_FILE; the first one is plotted
+RING_FRAMES = 1 << 21  # newest frames kept: 10 s at up to 200k frames/s
+
+# Live mode: with the native ingest server running, read its shared-memory
+# ring instead of polling DATA_FILE (python simple_plotter.py --live [DEVICE]).
+LIVE_REFRESH_MS = 50
+LIVE_CHANNELS = [0, 1, 2, 3]
+SAMPLE_ZERO = 128
 
 class RealtimePlotter:
+    """Plot the newest window_seconds of DATA_FILE as it grows.
+
+    New frames are read in bulk from a mapping of the file (emg_tail.py) into
+    a fixed ring that is decimated to about one min/max pair per pixel column
+    (emg_decimate.py). The file holds no timestamps: every refresh marks the
+    frames it read with the time it read them, and the frames in between
+    are spread evenly. A refresh costs the same at any sample rate.
+    """
+
     def __init__(self, window_seconds, refresh_rate):
         self.window_seconds = window_seconds
         self.refresh_rate = refresh_rate
-        self.data_points = deque()  # Stores (timestamp, value) tuples
-        self.last_position = 0
-        
+        self.tail = TailReader(DATA_FILE, np.dtype(NUMBER_FORMAT), FRAME_NUMBERS, backlog=RING_FRAMES)
+        self.ring = Decimator(1, RING_FRAMES)
+        # (frames written, time) after each read that found any: the time index
+        self.marks = deque()
+        self.x = np.empty(0)
+        self.y = np.empty(0, dtype=np.float32)
+
         # Set up the plot
         self.fig, self.ax = plt.subplots(figsize=(10, 6))
         self.line, = self.ax.plot([], [], 'b-', linewidth=2)
@@ -24,55 +49,59 @@ class RealtimePlotter:
         self.ax.set_ylabel('Value')
         self.ax.set_title('Real-time Data Plot')
         self.ax.grid(True, alpha=0.3)
-        
-    def read_new_data(self):
+
+    def read_new_data(self, now):
         """Read new data from file since last read"""
         try:
-            with open(DATA_FILE, 'rb') as f:
-                f.seek(self.last_position)
-                new_data = f.read()
-                self.last_position = f.tell()
-                
-            # Parse binary data as numbers
-            bytes_per_number = struct.calcsize(NUMBER_FORMAT)
-            current_time = datetime.now()
-            
-            for i in range(0, len(new_data), bytes_per_number):
-                if i + bytes_per_number <= len(new_data):
-                    value = struct.unpack(NUMBER_FORMAT, new_data[i:i+bytes_per_number])[0]
-                    self.data_points.append((current_time, value))
-                    
-        except FileNotFoundError:
-            pass
-        except Exception as e:
+            new = self.tail.read()
+        except (OSError, ValueError) as e:
             print(f"Error reading data: {e}")
-    
+            return
+        if self.tail.restarted:
+            self.ring.clear()
+            self.marks.clear()
+        if not len(new):
+            return
+        if not self.marks:
+            # What was already there is spread over one refresh before now
+            self.marks.append((0, now - self.refresh_rate / 1000.0))
+        self.ring.append(new[:, :1].astype(np.float32))
+        self.marks.append((self.ring.written, now))
+
     def update_plot(self, frame):
         """Update plot with new data"""
-        # Read any new data
-        self.read_new_data()
-        
-        # Remove data older than window_seconds
-        cutoff_time = datetime.now() - timedelta(seconds=self.window_seconds)
-        while self.data_points and self.data_points[0][0] < cutoff_time:
-            self.data_points.popleft()
-        
-        # Prepare data for plotting
-        if self.data_points:
-            current_time = datetime.now()
-            times = [-(current_time - ts).total_seconds() for ts, _ in self.data_points]
-            values = [val for _, val in self.data_points]
-            
+        now = time.monotonic()
+        self.read_new_data(now)
+
+        # Forget marks older than the window, keeping one to interpolate from
+        cutoff = now - self.window_seconds
+        while len(self.marks) > 2 and self.marks[1][1] <= cutoff:
+            self.marks.popleft()
+        if len(self.marks) < 2:
+            return self.line,
+        seqs = np.array([m[0] for m in self.marks], dtype=np.float64)
+        times = np.array([m[1] for m in self.marks])
+
+        first = int(np.ceil(np.interp(cutoff, times, seqs - 1.0)))
+        columns = max(int(self.ax.bbox.width), 2)
+        if len(self.x) < 2 * columns:
+            self.x = np.empty(2 * columns)
+            self.y = np.empty(2 * columns, dtype=np.float32)
+        cols = self.ring.envelope(0, first, self.ring.written - first, columns)
+        if len(cols):
+            x, y = envelope_polyline(cols, self.x, self.y)
+            x[:] = np.interp(x, seqs - 1.0, times)
+            x -= now
+
             # Update line data
-            self.line.set_data(times, values)
-            
+            self.line.set_data(x, y)
+
             # Auto-scale axes
             self.ax.set_xlim(-self.window_seconds, 0)
-            if values:
-                y_min, y_max = min(values), max(values)
-                margin = (y_max - y_min) * 0.1 if y_max != y_min else 1
-                self.ax.set_ylim(y_min - margin, y_max + margin)
-        
+            y_min, y_max = float(cols['min'].min()), float(cols['max'].max())
+            margin = (y_max - y_min) * 0.1 if y_max != y_min else 1
+            self.ax.set_ylim(y_min - margin, y_max + margin)
+
         return self.line,
     
     def start(self):
@@ -86,7 +115,65 @@ class RealtimePlotter:
         )
         plt.show()
 
+class LivePlotter:
+    """Plot the newest WINDOW_SECONDS of a device straight from its live ring."""
+
+    def __init__(self, ring, window_seconds, refresh_ms, channels):
+        self.ring = ring
+        self.window_seconds = window_seconds
+        self.refresh_ms = refresh_ms
+        self.channels = channels
+
+        self.fig, self.ax = plt.subplots(figsize=(10, 6))
+        self.lines = [self.ax.plot([], [], linewidth=1, label=f'ch {c}')[0] for c in channels]
+        self.ax.set_xlabel('Time (seconds ago)')
+        self.ax.set_ylabel('Sample (offset from midscale)')
+        self.ax.set_title(f'Live: {ring.device}')
+        self.ax.set_xlim(-window_seconds, 0)
+        self.ax.set_ylim(-SAMPLE_ZERO, SAMPLE_ZERO)
+        self.ax.grid(True, alpha=0.3)
+        self.ax.legend(loc='upper left')
+
+    def update_plot(self, frame):
+        rate = self.ring.frame_rate or 2048
+        first, frames = self.ring.latest(int(self.window_seconds * rate))
+        # frames is a view of the shared ring; only the plotted columns are copied
+        ys = [frames[:, c].astype(np.float32) - SAMPLE_ZERO for c in self.channels]
+        if not self.ring.valid(first):
+            return self.lines       # overwritten while copying: keep the previous picture
+        xs = (np.arange(len(frames)) - len(frames)) / rate
+        for line, y in zip(self.lines, ys):
+            line.set_data(xs, y)
+        return self.lines
+
+    def start(self):
+        ani = animation.FuncAnimation(
+            self.fig,
+            self.update_plot,
+            interval=self.refresh_ms,
+            blit=True,
+            cache_frame_data=False
+        )
+        plt.show()
+
+
+def start_live(device):
+    from emg_ring import LiveRing, list_rings
+
+    if device is None:
+        rings = list_rings()
+        if not rings:
+            sys.exit('No live rings in /dev/shm: is emg_ingest running?')
+        device = rings[0]
+    ring = LiveRing(device)
+    print(f"Live plot of {device} ({ring.channels} channels, ring of {ring.capacity} frames)")
+    LivePlotter(ring, WINDOW_SECONDS, LIVE_REFRESH_MS, LIVE_CHANNELS).start()
+
+
 if __name__ == '__main__':
+    if len(sys.argv) > 1 and sys.argv[1] == '--live':
+        start_live(sys.argv[2] if len(sys.argv) > 2 else None)
+        sys.exit(0)
     plotter = RealtimePlotter(WINDOW_SECONDS, REFRESH_RATE)
     print(f"Starting real-time plotter...")
     print(f"Window: {WINDOW_SECONDS} seconds")
@@ -1,29 +1,348 @@
 import socket
+import struct
+import threading
 import matplotlib.pyplot as plt
 import numpy as np
 import time
 
+from emg_clock import ClockModel, batch_frame_span
+from emg_decimate import Decimator, envelope_polyline
+from emg_spatial import SpatialFilter
+from emg_writer import BatchedWriter
+
 # Configuration
 HOST = '172.20.10.3'
 PORT = 3333
-BUFFER_SIZE = 16384
 DATA_FILE = 'received_data.bin'
 
+# The recording is written by a background thread in 4 MB batches (see
+# emg_writer.py). WRITE_SYNC: 'none', '<N>MB' or '<T>ms' (fdatasync policy).
+WRITE_BUFFERS = 3
+WRITE_SYNC = 'none'
+
 WINDOW_MS = 5000      # show last 5 seconds on the plot
-Y_MIN, Y_MAX = 0, 256
+DEFAULT_RATE_HZ = 2048    # until the device's hello says otherwise
+STATUS_S = 1.0            # print throughput, clock drift and jitter this often
+Y_MIN, Y_MAX = -128, 128  # samples are plotted less the 128 midscale
+
+# The plot shows PLOT_CHANNELS decimated to about one point per pixel column
+# (see emg_decimate.py), so drawing costs the same at any sample rate.
+# PLOT_MODE: 'envelope' (min/max of every column, shows every peak) or 'lttb'.
+PLOT_CHANNELS = [0, 1, 2, 3]
+PLOT_MODE = 'envelope'
+# Receiving runs on its own thread; the plot is redrawn PLOT_FPS times a
+# second whatever the batch rate, and skips frames if drawing is slower.
+PLOT_FPS = 30
+
+# Spatial filter for the plotted signal: None (raw bytes), 'car', 'sd', 'dd' or 'ndd'.
+# The recording on disk is always the raw stream.
+SPATIAL_FILTER = None
+ELECTRODE_LAYOUT = '8x8'   # or '13x5', see emg_spatial.py
+
+# Wire protocol (see tcp_client/main/emg_proto.h): every message is a 32-byte
+# header followed by `len` payload bytes.
+MSG_HDR = struct.Struct('<HBBIIIQQ')   # magic, version, type, len, seq, count, frame0, t_us
+MSG_MAGIC = 0x4D45
+MSG_MAX_PAYLOAD = 128 * 1024   # as the ingest server: anything longer is a corrupt header
+MSG_RAW_BATCH = 1
+MSG_FEATURES = 2
+MSG_SUMMARY = 3
+MSG_SPECTRAL = 4
+MSG_QUALITY = 5
+MSG_HELLO = 6
+
+FEATURES_HDR = struct.Struct('<HHBBH')  # window, hop, channels, frac_bits, reserved
+SPECTRAL_HDR = struct.Struct('<HHBBH')  # fft_size, hop, channels, frac_bits, reserved
+SUMMARY_HDR = struct.Struct('<IIBBH')   # frames, captures, channels, frac_bits, reserved
+HELLO = struct.Struct('<6sBBIIBBH16s')  # mac, channels, sample_bits, rate, boot_id, layout, spatial, reserved, name
+QUALITY_HDR = struct.Struct('<QQQQQIBBH')  # bad, saturated, lead_off, mains, noisy masks, frames, channels, frac_bits, reserved
+QUALITY_DTYPE = np.dtype([('saturated', '<u2'), ('flat_run', '<u2'), ('mains_pct', 'u1'), ('reserved', 'u1'),
+                          ('noise_rms', '<u2')])
+FEATURE_DTYPE = np.dtype([('rms', '<u2'), ('mav', '<u2'), ('wl', '<u2'), ('zc', '<u2'), ('ssc', '<u2')])
+
+
+class ReceiveBuffer:
+    """Preallocated receive buffer, parsed in place.
+
+    recv_into() reads straight into the free end of one bytearray and
+    messages() hands out each complete message's payload as a memoryview of
+    it, valid until the next recv_into(). The unparsed tail (less than one
+    message) is moved back to the front only once the free space could no
+    longer hold a whole message, so nothing is allocated or copied per
+    message.
+    """
+
+    def __init__(self, size=4 * (MSG_HDR.size + MSG_MAX_PAYLOAD)):
+        self.buf = bytearray(size)
+        self.view = memoryview(self.buf)
+        self.start = 0      # first unparsed byte
+        self.end = 0        # end of the received bytes
+
+    def recv_into(self, sock):
+        """One recv() into the free space; returns the byte count (0 at EOF)."""
+        if len(self.buf) - self.end < MSG_HDR.size + MSG_MAX_PAYLOAD:
+            tail = self.end - self.start
+            self.view[:tail] = self.view[self.start:self.end]
+            self.start, self.end = 0, tail
+        n = sock.recv_into(self.view[self.end:])
+        self.end += n
+        return n
+
+    def messages(self):
+        """Yield (type, header tuple, payload memoryview) for every complete
+        message, resynchronising on the magic if the stream is corrupted."""
+        while self.end - self.start >= MSG_HDR.size:
+            pos = self.start
+            hdr = MSG_HDR.unpack_from(self.buf, pos)
+            if hdr[0] != MSG_MAGIC or hdr[3] > MSG_MAX_PAYLOAD:
+                nxt = self.buf.find(b'\x45\x4d', pos + 1, self.end)
+                # A trailing 0x45 may be the start of the next header
+                self.start = nxt if nxt >= 0 else max(pos + 1, self.end - 1)
+                print(f"Bad header, skipping {self.start - pos} bytes")
+                continue
+            end = pos + MSG_HDR.size + hdr[3]
+            if end > self.end:
+                break
+            self.start = end
+            yield hdr[2], hdr, self.view[pos + MSG_HDR.size:end]
+
+
+def decode_features(payload):
+    """Return (window, hop, dict of per-channel feature arrays, amplitudes in counts)."""
+    window, hop, channels, frac_bits, _ = FEATURES_HDR.unpack_from(payload)
+    raw = np.frombuffer(payload, dtype=FEATURE_DTYPE, count=channels, offset=FEATURES_HDR.size)
+    scale = 1.0 / (1 << frac_bits)
+    return window, hop, {
+        'rms': raw['rms'] * scale,
+        'mav': raw['mav'] * scale,
+        'wl': raw['wl'] * scale,
+        'zc': raw['zc'],
+        'ssc': raw['ssc'],
+    }
+
+def decode_summary(payload):
+    """Return (idle frames, captures so far, mean envelope, peak envelope) in counts."""
+    frames, captures, channels, frac_bits, _ = SUMMARY_HDR.unpack_from(payload)
+    env = np.frombuffer(payload, dtype='<u2', count=2 * 64, offset=SUMMARY_HDR.size)
+    scale = 1.0 / (1 << frac_bits)
+    return frames, captures, env[:channels] * scale, env[64:64 + channels] * scale
+
+
+def decode_spectral(payload):
+    """Return (fft size, mean power frequency, median power frequency) per channel in Hz."""
+    fft_size, hop, channels, frac_bits, _ = SPECTRAL_HDR.unpack_from(payload)
+    freqs = np.frombuffer(payload, dtype='<u2', count=2 * 64, offset=SPECTRAL_HDR.size)
+    scale = 1.0 / (1 << frac_bits)
+    return fft_size, freqs[:channels] * scale, freqs[64:64 + channels] * scale
+
+
+def decode_quality(payload):
+    """Return (list of bad channel indices, per-channel record array with noise_rms in counts)."""
+    bad, _, _, _, _, frames, channels, frac_bits, _ = QUALITY_HDR.unpack_from(payload)
+    ch = np.frombuffer(payload, dtype=QUALITY_DTYPE, count=64, offset=QUALITY_HDR.size)[:channels]
+    noise = ch['noise_rms'] / float(1 << frac_bits)
+    return [c for c in range(channels) if bad >> c & 1], ch, noise
+
+
+class LiveView:
+    """The plotted window, shared by the receive thread and the render loop.
+
+    The receive thread appends every raw batch to a Decimator, a fixed ring
+    holding the last WINDOW_MS of every channel, and notes where its newest
+    frame sits on the host clock. The render loop reads at most a plot
+    width of points per channel out of it into buffers of its own. Neither
+    side allocates anything the size of the window; the Decimator is only
+    made again when the frame size or the rate changes.
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.dec = None
+        self.window_frames = 0
+        self.newest_ms = 0.0          # host time of the newest frame
+        self.period_ms = 1000.0 / DEFAULT_RATE_HZ
+
+    def append(self, frames, rate, newest_ms, period_ms):
+        """Receive thread: add frames (n, channels), the newest at host time newest_ms."""
+        window_frames = WINDOW_MS * rate // 1000
+        with self.lock:
+            if self.dec is None or self.dec.channels != frames.shape[1] or self.dec.capacity < window_frames:
+                self.dec = Decimator(frames.shape[1], window_frames)
+            self.window_frames = window_frames
+            self.dec.append(frames)
+            self.newest_ms = newest_ms
+            self.period_ms = period_ms
+
+    def points(self, channel, columns, x, y):
+        """Render loop, lock held: write the plot of `channel` into x (ms) and y
+        (each at least 2 * columns long); returns the number of points."""
+        dec = self.dec
+        if dec is None or channel >= dec.channels:
+            return 0
+        first = dec.written - self.window_frames
+        if PLOT_MODE == 'lttb':
+            seq, value = dec.lttb(channel, first, self.window_frames, columns)
+            m = len(seq)
+            x[:m] = seq
+            y[:m] = value
+        else:
+            m = len(envelope_polyline(dec.envelope(channel, first, self.window_frames, columns), x, y)[0])
+        # Frames are placed back from the newest one at the frame period on the host clock
+        xs = x[:m]
+        xs -= dec.written - 1
+        xs *= self.period_ms
+        xs += self.newest_ms
+        return m
+
+
+def receive(client_socket, view, f, stop):
+    """Receive thread: parse, record and hand raw batches to the view until
+    the client disconnects or `stop` is set."""
+    start = time.perf_counter()
+    rx = ReceiveBuffer()
+    spatial = SpatialFilter(ELECTRODE_LAYOUT, SPATIAL_FILTER) if SPATIAL_FILTER else None
+    filtered = np.empty((0, spatial.n_out if spatial else 0), dtype=np.float32)   # grown to the largest batch
+    # Samples are placed on the host clock from the device timestamps, see emg_clock.py
+    clock = ClockModel()
+    rate = DEFAULT_RATE_HZ
+    boot_id = None
+    # Messages are only counted here and reported every STATUS_S, with the
+    # latest features, spectral and quality values and the idle frames summed
+    batches = frames = nbytes = 0
+    n_feat = n_spec = n_qual = n_summ = 0
+    feat_last = spec_last = qual_last = None
+    summ_frames = summ_captures = 0
+    summ_peak = 0.0
+    last_frame = 0
+    delay_ms = 0.0
+    next_status = start + STATUS_S
+
+    client_socket.settimeout(0.25)    # to notice `stop`
+    while not stop.is_set():
+        try:
+            n = rx.recv_into(client_socket)
+        except socket.timeout:
+            continue
+        t_recv = time.perf_counter()
+
+        if not n:
+            print("Client disconnected")
+            break
+
+        for msg_type, hdr, payload in rx.messages():
+            if msg_type == MSG_FEATURES:
+                # Only scalars are kept: the arrays may be views of the receive buffer
+                window, hop, feats = decode_features(payload)
+                feat_last = (window, hop, feats['rms'].mean(), feats['zc'].mean())
+                n_feat += 1
+                continue
+            if msg_type == MSG_SPECTRAL:
+                fft_size, mnf, mdf = decode_spectral(payload)
+                spec_last = (fft_size, mnf.mean(), mdf.mean())
+                n_spec += 1
+                continue
+            if msg_type == MSG_HELLO:
+                mac, channels, bits, hello_rate, boot, layout, _, _, name = HELLO.unpack_from(payload)
+                label = name.rstrip(b'\0').decode(errors='replace')
+                print(f"Hello from {mac.hex()} {label!r}: "
+                      f"{channels} ch x {bits} bit @ {hello_rate} Hz, boot {boot:08x}")
+                rate = hello_rate or DEFAULT_RATE_HZ
+                if boot_id is not None and boot != boot_id:
+                    clock.reset()
+                boot_id = boot
+                continue
+            if msg_type == MSG_QUALITY:
+                bad, _, noise = decode_quality(payload)
+                qual_last = (bad, np.median(noise))
+                n_qual += 1
+                continue
+            if msg_type == MSG_SUMMARY:
+                idle_frames, captures, env_mean, env_max = decode_summary(payload)
+                n_summ += 1
+                summ_frames += idle_frames
+                summ_captures = captures
+                summ_peak = max(summ_peak, float(env_max.max()))
+                continue
+            if msg_type != MSG_RAW_BATCH or hdr[5] == 0:
+                continue
+
+            count = hdr[5]
+            if spatial is not None:
+                if len(filtered) < count:
+                    filtered = np.empty((count, spatial.n_out), dtype=np.float32)
+                new_arr = spatial.apply(payload, out=filtered[:count])
+            else:
+                new_arr = np.frombuffer(payload, dtype=np.uint8).reshape(count, -1)
+
+            # Every frame gets its own host time: the device time of the
+            # frame through the clock model, fed with this batch's arrival
+            _, dev_last = batch_frame_span(hdr[7], hdr[6], count, rate)
+            clock.add(dev_last, t_recv)
+            now_ms = (clock.to_host(dev_last) - start) * 1000.0
+            delay_ms = (t_recv - start) * 1000.0 - now_ms
+            view.append(new_arr, rate, now_ms, 1000.0 / rate * clock.rate)
+
+            f.write(payload)
+            batches += 1
+            frames += count
+            nbytes += len(payload)
+            last_frame = hdr[6] + count - 1
+
+        if t_recv >= next_status:
+            elapsed = t_recv - next_status + STATUS_S
+            n, rms, worst = clock.take_jitter()
+            drift = f"{clock.drift_ppm:+.1f} ppm" if clock.locked else "fitting"
+            print(f"Received {batches} batches, {frames / elapsed:.0f} frames/s, {nbytes / elapsed / 1e6:.2f} MB/s, "
+                  f"up to frame {last_frame}, last {delay_ms:+.2f} ms over the clock line")
+            print(f"Clock: drift {drift}, jitter rms {rms * 1e3:.2f} ms max {worst * 1e3:.2f} ms "
+                  f"over {n} batches, {clock.resets} restarts")
+            if n_feat:
+                window, hop, rms, zc = feat_last
+                print(f"Features: {n_feat} messages, last window={window} hop={hop} "
+                      f"mean RMS={rms:.2f} mean ZC={zc:.1f}")
+            if n_spec:
+                fft_size, mnf, mdf = spec_last
+                print(f"Spectral: {n_spec} messages, last fft={fft_size} mean MNF={mnf:.1f} Hz "
+                      f"mean MDF={mdf:.1f} Hz")
+            if n_qual:
+                bad, noise = qual_last
+                print(f"Quality: {n_qual} messages, last bad channels {bad if bad else 'none'}, "
+                      f"median noise floor {noise:.2f}")
+            if n_summ:
+                print(f"Idle summaries: {n_summ} messages, {summ_frames} idle frames, {summ_captures} captures so far, "
+                      f"peak envelope {summ_peak:.2f}")
+            batches = frames = nbytes = 0
+            n_feat = n_spec = n_qual = n_summ = 0
+            summ_frames = 0
+            summ_peak = 0.0
+            next_status = t_recv + STATUS_S
+
+
+def render(view, ax, lines, bufs):
+    """Redraw the lines from the view; bufs holds one (x, y) pair per line."""
+    columns = max(int(ax.bbox.width), 2)
+    if len(bufs[0][0]) < 2 * columns:
+        bufs[:] = [(np.empty(2 * columns), np.empty(2 * columns, dtype=np.float32)) for _ in lines]
+    with view.lock:
+        for line, c, (x, y) in zip(lines, PLOT_CHANNELS, bufs):
+            m = view.points(c, columns, x, y)
+            line.set_data(x[:m], y[:m])
+        now_ms = view.newest_ms
+    ax.set_xlim([max(0.0, now_ms - WINDOW_MS), max(WINDOW_MS, now_ms)])
+
 
 def main():
     plt.ion()
     fig, ax = plt.subplots()
 
-    # Rolling buffers
-    xs = np.array([], dtype=np.float64)   # timestamps in ms
-    ys = np.array([], dtype=np.uint8)     # received bytes
-
-    line, = ax.plot(xs, ys, linestyle='-', marker='')  # no markers for speed
+    view = LiveView()
+    lines = [ax.plot([], [], linestyle='-', marker='', linewidth=0.8, label=f'ch {c}')[0]
+             for c in PLOT_CHANNELS]
+    bufs = [(np.empty(0), np.empty(0, dtype=np.float32)) for _ in lines]
     ax.set_ylim([Y_MIN, Y_MAX])
     ax.set_xlabel('Time (ms)')
-    ax.set_ylabel('Data (byte)')
+    ax.set_ylabel('Sample (counts from midscale)')
+    ax.legend(loc='upper left')
     ax.set_title('Realtime Data Plot')
 
     # Create a TCP socket
@@ -36,53 +355,42 @@ def main():
     client_socket, client_address = server_socket.accept()
     print(f"Client connected from {client_address}")
 
-    start = time.perf_counter()
-    message_counter = 0
-
-    with open(DATA_FILE, 'wb') as f:
-        try:
-            while True:
-                new_data = client_socket.recv(BUFFER_SIZE)
-
-                if not new_data:
-                    print("Client disconnected")
-                    break
-
-                now_ms = (time.perf_counter() - start) * 1000.0
-
-                new_arr = np.frombuffer(new_data, dtype=np.uint8)
-
-                # Timestamp all samples in this chunk with the receive time.
-                # (If you know sample rate, you can spread them out—see note below.)
-                new_x = np.full(new_arr.shape, now_ms, dtype=np.float64)
-
-                xs = np.concatenate([xs, new_x])
-                ys = np.concatenate([ys, new_arr])
-
-                # Keep only last WINDOW_MS
-                cutoff = now_ms - WINDOW_MS
-                keep = xs >= cutoff
-                xs = xs[keep]
-                ys = ys[keep]
-
-                # Update plot limits + data
-                ax.set_xlim([max(0.0, now_ms - WINDOW_MS), max(WINDOW_MS, now_ms)])
-                line.set_data(xs, ys)
-
-                fig.canvas.draw_idle()
-                fig.canvas.flush_events()
-
-                message_counter += 1
-                f.write(new_data)
-                f.flush()
-                print(f"Message #{message_counter}: Received and wrote {len(new_data)} bytes @ {now_ms:.1f} ms")
+    f = BatchedWriter(DATA_FILE, buffers=WRITE_BUFFERS, sync=WRITE_SYNC)
+    stop = threading.Event()
+    rx = threading.Thread(target=receive, args=(client_socket, view, f, stop), name='receive', daemon=True)
+    rx.start()
+    frame_s = 1.0 / PLOT_FPS
+    frames_drawn = 0
+    frames_late = 0
+    try:
+        next_frame = time.perf_counter()
+        while rx.is_alive():
+            render(view, ax, lines, bufs)
+            fig.canvas.draw_idle()
+            fig.canvas.flush_events()
+            frames_drawn += 1
+            next_frame += frame_s
+            wait = next_frame - time.perf_counter()
+            if wait > 0:
+                fig.canvas.start_event_loop(wait)
+            else:
+                # Drawing takes longer than a frame: drop frames, never batches
+                frames_late += 1
+                next_frame = time.perf_counter()
 
-        except KeyboardInterrupt:
-            print("\nServer shutting down...")
-        finally:
-            client_socket.close()
-            server_socket.close()
-            print("Server closed")
+    except KeyboardInterrupt:
+        print("\nServer shutting down...")
+    finally:
+        stop.set()
+        rx.join()
+        client_socket.close()
+        server_socket.close()
+        f.close()
+        st = f.stats()
+        print(f"Disk: {st['mb_per_s']:.2f} MB/s, {st['waits']} waits for a free buffer, "
+              f"write p99 {st['write_p99_us']} us, fsync p99 {st['fsync_p99_us']} us")
+        print(f"Plot: {frames_drawn} frames drawn, {frames_late} late")
+        print("Server closed")
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,151 @@
+/*
+ * Sliding-window EMG feature engine, see emg_features.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "emg_features.h"
+
+static inline int16_t iabs16(int v)
+{
+    return (int16_t)(v < 0 ? -v : v);
+}
+
+int emg_features_init(emg_features_t *f, uint16_t window, uint16_t hop, uint16_t threshold)
+{
+    memset(f, 0, sizeof(*f));
+    if (window < 4 || hop == 0 || window > 4096) {
+        return -1;
+    }
+
+    f->window = window;
+    f->hop = hop;
+    f->threshold = threshold;
+    f->ring_len = window + 3;
+    f->ring = (int16_t *)malloc((size_t)f->ring_len * EMG_NUM_CHANNELS * sizeof(int16_t));
+    if (!f->ring) {
+        return -1;
+    }
+
+    emg_features_reset(f);
+    return 0;
+}
+
+void emg_features_free(emg_features_t *f)
+{
+    free(f->ring);
+    f->ring = NULL;
+}
+
+void emg_features_reset(emg_features_t *f)
+{
+    memset(f->ring, 0, (size_t)f->ring_len * EMG_NUM_CHANNELS * sizeof(int16_t));
+    memset(f->sumsq, 0, sizeof(f->sumsq));
+    memset(f->sumabs, 0, sizeof(f->sumabs));
+    memset(f->wl, 0, sizeof(f->wl));
+    memset(f->zc, 0, sizeof(f->zc));
+    memset(f->ssc, 0, sizeof(f->ssc));
+    f->head = 0;
+    f->count = 0;
+    f->since_emit = 0;
+}
+
+static inline uint16_t slot_back(const emg_features_t *f, uint16_t slot, uint16_t back)
+{
+    return (uint16_t)((slot + f->ring_len - back) % f->ring_len);
+}
+
+bool emg_features_push(emg_features_t *f, const int16_t *x)
+{
+    const int th = f->threshold;
+    const uint32_t n = f->count;              // index of the sample being added (saturated)
+    const bool leaving = n >= f->window;      // sample n - window drops out this frame
+
+    uint16_t slot = (uint16_t)((f->head + 1) % f->ring_len);
+    int16_t *cur = f->ring + (size_t)slot * EMG_NUM_CHANNELS;
+    const int16_t *p1 = f->ring + (size_t)slot_back(f, slot, 1) * EMG_NUM_CHANNELS;
+    const int16_t *p2 = f->ring + (size_t)slot_back(f, slot, 2) * EMG_NUM_CHANNELS;
+
+    // Rows of the leaving sample and its two predecessors. The ring holds
+    // window + 3 rows, so none of them has been overwritten by `cur` yet.
+    const int16_t *o0 = f->ring + (size_t)slot_back(f, slot, f->window) * EMG_NUM_CHANNELS;
+    const int16_t *o1 = f->ring + (size_t)slot_back(f, slot, f->window + 1) * EMG_NUM_CHANNELS;
+    const int16_t *o2 = f->ring + (size_t)slot_back(f, slot, f->window + 2) * EMG_NUM_CHANNELS;
+    // Index of the leaving sample; only compared against 1 and 2, so the
+    // saturated count is exact enough.
+    const uint32_t m = leaving ? n - f->window : 0;
+
+    memcpy(cur, x, EMG_NUM_CHANNELS * sizeof(int16_t));
+
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        int c = cur[ch];
+        f->sumsq[ch] += (uint32_t)(c * c);
+        f->sumabs[ch] += (uint32_t)iabs16(c);
+
+        if (n >= 1) {
+            int p = p1[ch];
+            int d = c - p;
+            f->wl[ch] += (uint32_t)iabs16(d);
+            if (((c > 0 && p < 0) || (c < 0 && p > 0)) && iabs16(d) >= th) f->zc[ch]++;
+            if (n >= 2) {
+                int pp = p2[ch];
+                int a = p - pp, b = p - c;
+                if (a * b > 0 && (iabs16(a) >= th || iabs16(b) >= th)) f->ssc[ch]++;
+            }
+        }
+
+        if (leaving) {
+            c = o0[ch];
+            f->sumsq[ch] -= (uint32_t)(c * c);
+            f->sumabs[ch] -= (uint32_t)iabs16(c);
+
+            if (m >= 1) {
+                int p = o1[ch];
+                int d = c - p;
+                f->wl[ch] -= (uint32_t)iabs16(d);
+                if (((c > 0 && p < 0) || (c < 0 && p > 0)) && iabs16(d) >= th) f->zc[ch]--;
+                if (m >= 2) {
+                    int pp = o2[ch];
+                    int a = p - pp, b = p - c;
+                    if (a * b > 0 && (iabs16(a) >= th || iabs16(b) >= th)) f->ssc[ch]--;
+                }
+            }
+        }
+    }
+
+    f->head = slot;
+    if (f->count < f->ring_len) f->count++;
+
+    if (f->since_emit < f->hop) f->since_emit++;
+    if (f->count >= f->window && f->since_emit >= f->hop) {
+        f->since_emit = 0;
+        return true;
+    }
+    return false;
+}
+
+static inline uint16_t sat_u16(uint32_t v)
+{
+    return (uint16_t)(v > 0xFFFF ? 0xFFFF : v);
+}
+
+void emg_features_fill(const emg_features_t *f, emg_features_msg_t *msg)
+{
+    const uint32_t w = f->window;
+    const float one = (float)(1u << EMG_FEATURE_FRAC_BITS);
+
+    msg->window = f->window;
+    msg->hop = f->hop;
+    msg->channels = EMG_NUM_CHANNELS;
+    msg->frac_bits = EMG_FEATURE_FRAC_BITS;
+    msg->reserved = 0;
+
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        float rms = sqrtf((float)f->sumsq[ch] / (float)w) * one;
+        msg->ch[ch].rms = sat_u16((uint32_t)(rms + 0.5f));
+        msg->ch[ch].mav = sat_u16((f->sumabs[ch] << EMG_FEATURE_FRAC_BITS) / w);
+        msg->ch[ch].wl  = sat_u16((f->wl[ch] << EMG_FEATURE_FRAC_BITS) / w);
+        msg->ch[ch].zc  = f->zc[ch];
+        msg->ch[ch].ssc = f->ssc[ch];
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Sliding-window EMG feature engine.
+ *
+ * Keeps RMS, MAV, waveform length, zero crossings and slope sign changes for
+ * every channel over the last `window` frames. Each pushed frame adds the
+ * newest sample's contribution and subtracts the one leaving the window, so
+ * the cost is O(1) per sample per channel regardless of window length.
+ *
+ * Plain C, no ESP-IDF dependencies.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "emg_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint16_t window;        // frames per window
+    uint16_t hop;           // frames between emitted messages
+    uint16_t threshold;     // dead zone for ZC/SSC, in counts
+    uint16_t ring_len;      // window + 3: the window plus two samples of slope history
+    uint16_t head;          // ring slot of the newest sample
+    uint16_t since_emit;    // frames since the last emitted message
+    uint32_t count;         // frames pushed, saturating at ring_len
+    int16_t *ring;          // ring_len rows of EMG_NUM_CHANNELS samples (frame-major)
+
+    uint32_t sumsq[EMG_NUM_CHANNELS];
+    uint32_t sumabs[EMG_NUM_CHANNELS];
+    uint32_t wl[EMG_NUM_CHANNELS];
+    uint16_t zc[EMG_NUM_CHANNELS];
+    uint16_t ssc[EMG_NUM_CHANNELS];
+} emg_features_t;
+
+/**
+ * @brief Allocate the sample history and reset all accumulators.
+ *
+ * @return 0 on success, -1 if the parameters are invalid or allocation failed.
+ */
+int emg_features_init(emg_features_t *f, uint16_t window, uint16_t hop, uint16_t threshold);
+
+void emg_features_free(emg_features_t *f);
+
+/** @brief Forget all history, e.g. after the stream was interrupted. */
+void emg_features_reset(emg_features_t *f);
+
+/**
+ * @brief Push one frame of zero-centred samples (EMG_NUM_CHANNELS values).
+ *
+ * @return true when the window is full and `hop` frames have passed since the
+ *         last message, i.e. the caller should emit one now.
+ */
+bool emg_features_push(emg_features_t *f, const int16_t *x);
+
+/** @brief Convert the current accumulators into a wire message. */
+void emg_features_fill(const emg_features_t *f, emg_features_msg_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Wire protocol between the ESP32 acquisition client and the host receivers.
+ *
+ * Every message on the TCP stream is a fixed 32-byte header followed by
+ * `len` payload bytes. All fields are little-endian (native on both the
+ * ESP32 and x86/ARM hosts). This header is plain C with no ESP-IDF
+ * dependencies so the host tools can include it directly.
+ */
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ======= Frame layout ======= */
+#define EMG_NUM_CHANNELS     64
+#define EMG_FRAME_BYTES      64      // one uint8 sample per channel, sample-major
+#define EMG_SAMPLE_ZERO      128     // offset-binary midscale of a uint8 sample
+
+/* ======= Message framing ======= */
+#define EMG_MSG_MAGIC        0x4D45  // "EM" on the wire
+#define EMG_PROTO_VERSION    1
+
+enum {
+    EMG_MSG_RAW_BATCH = 1,  // payload: count * EMG_FRAME_BYTES raw frames
+    EMG_MSG_FEATURES  = 2,  // payload: emg_features_msg_t
+    EMG_MSG_SUMMARY   = 3,  // payload: emg_summary_msg_t (idle heartbeat in trigger mode)
+    EMG_MSG_SPECTRAL  = 4,  // payload: emg_spectral_msg_t
+    EMG_MSG_QUALITY   = 5,  // payload: emg_quality_msg_t
+    EMG_MSG_HELLO     = 6,  // payload: emg_hello_msg_t, first message on every connection
+    EMG_MSG_TYPE_COUNT
+};
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;     // EMG_MSG_MAGIC
+    uint8_t  version;   // EMG_PROTO_VERSION
+    uint8_t  type;      // EMG_MSG_*
+    uint32_t len;       // payload bytes following this header
+    uint32_t seq;       // per-type message counter, +1 per message sent
+    uint32_t count;     // frames covered by this message
+    uint64_t frame0;    // device frame index of the first covered frame
+    uint64_t t_us;      // device time (esp_timer) of the first covered frame
+} emg_msg_hdr_t;
+
+/* ======= Feature message ======= */
+#define EMG_FEATURE_FRAC_BITS 6      // fixed-point fraction bits of rms/mav/wl
+
+typedef struct __attribute__((packed)) {
+    uint16_t rms;       // root mean square, counts << EMG_FEATURE_FRAC_BITS
+    uint16_t mav;       // mean absolute value, same scale
+    uint16_t wl;        // waveform length per sample, same scale
+    uint16_t zc;        // zero crossings in the window
+    uint16_t ssc;       // slope sign changes in the window
+} emg_feature_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t window;    // frames per window
+    uint16_t hop;       // frames between successive messages
+    uint8_t  channels;  // valid entries in ch[]
+    uint8_t  frac_bits; // EMG_FEATURE_FRAC_BITS
+    uint16_t reserved;
+    emg_feature_t ch[EMG_NUM_CHANNELS];
+} emg_features_msg_t;
+
+/* ======= Idle summary message ======= */
+/* Sent periodically while activity-triggered capture is idle, instead of raw
+ * frames. Envelopes use the same fixed point as the feature message. */
+typedef struct __attribute__((packed)) {
+    uint32_t frames;    // idle frames covered by this summary
+    uint32_t captures;  // triggered captures since boot
+    uint8_t  channels;  // valid entries in env_mean[] / env_max[]
+    uint8_t  frac_bits; // EMG_FEATURE_FRAC_BITS
+    uint16_t reserved;
+    uint16_t env_mean[EMG_NUM_CHANNELS];  // mean rectified envelope
+    uint16_t env_max[EMG_NUM_CHANNELS];   // peak rectified envelope
+} emg_summary_msg_t;
+
+/* ======= Spectral (fatigue) message ======= */
+#define EMG_SPECTRAL_FRAC_BITS 4     // fixed-point fraction bits of mnf/mdf (Hz)
+
+typedef struct __attribute__((packed)) {
+    uint16_t fft_size;  // frames per analysis window
+    uint16_t hop;       // frames between successive windows
+    uint8_t  channels;  // valid entries in mnf[] / mdf[]
+    uint8_t  frac_bits; // EMG_SPECTRAL_FRAC_BITS
+    uint16_t reserved;
+    uint16_t mnf[EMG_NUM_CHANNELS];   // mean power frequency, Hz << frac_bits
+    uint16_t mdf[EMG_NUM_CHANNELS];   // median power frequency, Hz << frac_bits
+} emg_spectral_msg_t;
+
+/* ======= Channel quality message ======= */
+#define EMG_QUALITY_FRAC_BITS 4      // fixed-point fraction bits of noise_rms (counts)
+
+typedef struct __attribute__((packed)) {
+    uint16_t saturated;  // samples at either rail in the period
+    uint16_t flat_run;   // longest run without any change, in frames (saturating)
+    uint8_t  mains_pct;  // share of power at 50 + 60 Hz, percent
+    uint8_t  reserved;
+    uint16_t noise_rms;  // estimated noise floor RMS, counts << EMG_QUALITY_FRAC_BITS
+} emg_quality_ch_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t bad;        // union of the masks below
+    uint64_t saturated;  // saturation above the configured fraction
+    uint64_t lead_off;   // flat line for at least the configured time
+    uint64_t mains;      // mains ratio above the configured level
+    uint64_t noisy;      // noise floor above the configured level
+    uint32_t frames;     // frames covered by this report
+    uint8_t  channels;   // valid entries in ch[]
+    uint8_t  frac_bits;  // EMG_QUALITY_FRAC_BITS
+    uint16_t reserved;
+    emg_quality_ch_t ch[EMG_NUM_CHANNELS];
+} emg_quality_msg_t;
+
+/* ======= Hello message ======= */
+enum {
+    EMG_LAYOUT_8X8  = 0,    // emg_layout_8x8 in emg_spatial.h
+    EMG_LAYOUT_13X5 = 1,    // emg_layout_13x5
+};
+
+#define EMG_HELLO_NAME_LEN 16
+
+typedef struct __attribute__((packed)) {
+    uint8_t  mac[6];          // base MAC address: the device's stable identity
+    uint8_t  channels;        // EMG_NUM_CHANNELS
+    uint8_t  sample_bits;     // bits per raw sample (8, offset binary)
+    uint32_t frame_rate_hz;   // nominal frame rate
+    uint32_t boot_id;         // random per boot; frame indices restart when it changes
+    uint8_t  layout;          // EMG_LAYOUT_*
+    uint8_t  spatial;         // spatial filter used for features (raw data is always monopolar)
+    uint16_t reserved;
+    char     name[EMG_HELLO_NAME_LEN];  // optional label, NUL padded
+} emg_hello_msg_t;
+
+#ifdef __cplusplus
+static_assert(sizeof(emg_msg_hdr_t) == 32, "emg_msg_hdr_t must be 32 bytes");
+#else
+_Static_assert(sizeof(emg_msg_hdr_t) == 32, "emg_msg_hdr_t must be 32 bytes");
+#endif
+
+#ifdef __cplusplus
+}
+#endif
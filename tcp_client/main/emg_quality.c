@@ -0,0 +1,201 @@
+/*
+ * Continuous per-channel signal quality monitor, see emg_quality.h.
+ */
+#include <string.h>
+#include <math.h>
+#include "emg_quality.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define NOISE_FLOOR_RISE 1.02f   // per block; lets the floor recover after a quiet spell
+
+/* 0x80 in every byte of w that is zero, 0 elsewhere (exact, no carries between lanes) */
+static inline uint32_t zero_bytes(uint32_t w)
+{
+    return ~(((w & 0x7F7F7F7Fu) + 0x7F7F7F7Fu) | w | 0x7F7F7F7Fu);
+}
+
+int emg_quality_init(emg_quality_t *q, uint32_t rate_hz, uint32_t report_ms, uint16_t sat_permille,
+                     uint32_t leadoff_ms, uint8_t mains_pct, uint16_t noise_limit)
+{
+    memset(q, 0, sizeof(*q));
+    if (rate_hz == 0 || report_ms == 0) {
+        return -1;
+    }
+
+    // About 1/8 s per block, capped so the byte-lane counters cannot wrap
+    uint32_t block = rate_hz / 8;
+    if (block > 255) block = 255;
+    if (block < 16) block = 16;
+    q->block = (uint16_t)block;
+
+    uint32_t report_frames = (uint32_t)((uint64_t)report_ms * rate_hz / 1000);
+    q->report_blocks = (uint16_t)(report_frames / block ? report_frames / block : 1);
+    q->sat_limit = (uint32_t)((uint64_t)q->report_blocks * block * sat_permille / 1000);
+    if (q->sat_limit == 0) q->sat_limit = 1;
+    q->leadoff_frames = (uint32_t)((uint64_t)leadoff_ms * rate_hz / 1000);
+    q->mains_pct_limit = mains_pct;
+    q->noise_limit = (uint16_t)(noise_limit << EMG_QUALITY_FRAC_BITS);
+    q->coef50 = 2.0f * cosf(2.0f * (float)M_PI * 50.0f / rate_hz);
+    q->coef60 = 2.0f * cosf(2.0f * (float)M_PI * 60.0f / rate_hz);
+
+    emg_quality_reset(q);
+    return 0;
+}
+
+static void block_reset(emg_quality_t *q)
+{
+    q->in_block = 0;
+    memset(q->changed, 0, sizeof(q->changed));
+    memset(q->sat_lanes, 0, sizeof(q->sat_lanes));
+    memset(q->sum, 0, sizeof(q->sum));
+    memset(q->sumsq, 0, sizeof(q->sumsq));
+    memset(q->g50, 0, sizeof(q->g50));
+    memset(q->g60, 0, sizeof(q->g60));
+}
+
+static void report_reset(emg_quality_t *q)
+{
+    q->blocks = 0;
+    memset(q->sat_count, 0, sizeof(q->sat_count));
+    memset(q->mains_acc, 0, sizeof(q->mains_acc));
+    // An ongoing flat run carries over into the next report
+    memcpy(q->flat_max, q->flat_run, sizeof(q->flat_max));
+}
+
+void emg_quality_reset(emg_quality_t *q)
+{
+    q->have_prev = false;
+    memset(q->prev, 0, sizeof(q->prev));
+    memset(q->dc, 0, sizeof(q->dc));
+    memset(q->flat_run, 0, sizeof(q->flat_run));
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        q->noise_floor[ch] = -1.0f;   // unset until the first block
+    }
+    block_reset(q);
+    report_reset(q);
+}
+
+/* Fold one finished block into the per-report accumulators */
+static void block_end(emg_quality_t *q)
+{
+    const float n = (float)q->block;
+
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        const int w = ch >> 2;
+        const int lane = (ch & 3) * 8;
+
+        // Lead-off: no byte change anywhere in the block
+        if (((q->changed[w] >> lane) & 0xFF) == 0) {
+            q->flat_run[ch] += q->block;
+        } else {
+            q->flat_run[ch] = 0;
+        }
+        if (q->flat_run[ch] > q->flat_max[ch]) q->flat_max[ch] = q->flat_run[ch];
+
+        q->sat_count[ch] += (q->sat_lanes[w] >> lane) & 0xFF;
+
+        // Block statistics
+        float sum = (float)q->sum[ch];
+        float mean = sum / n;
+        float var = (float)q->sumsq[ch] / n - mean * mean;
+        float rms = var > 0.0f ? sqrtf(var) : 0.0f;
+
+        // Energy of (x - dc), the sequence the Goertzel filters saw
+        float dc = q->dc[ch];
+        float energy = (float)q->sumsq[ch] - 2.0f * dc * sum + n * dc * dc;
+
+        float s1 = q->g50[ch][0], s2 = q->g50[ch][1];
+        float p50 = s1 * s1 + s2 * s2 - q->coef50 * s1 * s2;
+        s1 = q->g60[ch][0];
+        s2 = q->g60[ch][1];
+        float p60 = s1 * s1 + s2 * s2 - q->coef60 * s1 * s2;
+
+        // A pure tone at f gives |X(f)|^2 = N * E / 2, so this is its power share
+        float ratio = energy > 0.0f ? 2.0f * (p50 + p60) / (n * energy) : 0.0f;
+        q->mains_acc[ch] += ratio > 1.0f ? 1.0f : ratio;
+
+        float floor = q->noise_floor[ch];
+        q->noise_floor[ch] = (floor < 0.0f || rms < floor * NOISE_FLOOR_RISE) ? rms : floor * NOISE_FLOOR_RISE;
+
+        q->dc[ch] = mean;
+    }
+
+    block_reset(q);
+}
+
+bool emg_quality_push(emg_quality_t *q, const uint8_t *raw)
+{
+    // Saturation and change detection, four channels per word
+    for (int k = 0; k < EMG_QUALITY_WORDS; k++) {
+        uint32_t w;
+        memcpy(&w, raw + 4 * k, sizeof(w));
+        q->changed[k] |= w ^ q->prev[k];
+        q->prev[k] = w;
+        uint32_t sat = zero_bytes(w) | zero_bytes(~w);
+        q->sat_lanes[k] += sat >> 7;
+    }
+    if (!q->have_prev) {
+        // Nothing to compare the first frame against
+        memset(q->changed, 0xFF, sizeof(q->changed));
+        q->have_prev = true;
+    }
+
+    // Moments and mains Goertzel filters, straight-line per channel
+    const float c50 = q->coef50, c60 = q->coef60;
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        int32_t x = (int32_t)raw[ch] - EMG_SAMPLE_ZERO;
+        q->sum[ch] += x;
+        q->sumsq[ch] += (uint32_t)(x * x);
+
+        float xf = (float)x - q->dc[ch];
+        float s = xf + c50 * q->g50[ch][0] - q->g50[ch][1];
+        q->g50[ch][1] = q->g50[ch][0];
+        q->g50[ch][0] = s;
+        s = xf + c60 * q->g60[ch][0] - q->g60[ch][1];
+        q->g60[ch][1] = q->g60[ch][0];
+        q->g60[ch][0] = s;
+    }
+
+    if (++q->in_block < q->block) {
+        return false;
+    }
+    block_end(q);
+    return ++q->blocks >= q->report_blocks;
+}
+
+static inline uint16_t sat_u16(uint32_t v)
+{
+    return (uint16_t)(v > 0xFFFF ? 0xFFFF : v);
+}
+
+void emg_quality_fill(emg_quality_t *q, emg_quality_msg_t *msg)
+{
+    const float blocks = q->blocks ? (float)q->blocks : 1.0f;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->frames = (uint32_t)q->blocks * q->block;
+    msg->channels = EMG_NUM_CHANNELS;
+    msg->frac_bits = EMG_QUALITY_FRAC_BITS;
+
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        const uint64_t bit = 1ull << ch;
+        emg_quality_ch_t *c = &msg->ch[ch];
+
+        float floor = q->noise_floor[ch] > 0.0f ? q->noise_floor[ch] : 0.0f;
+        c->saturated = sat_u16(q->sat_count[ch]);
+        c->flat_run = sat_u16(q->flat_max[ch]);
+        c->mains_pct = (uint8_t)(100.0f * q->mains_acc[ch] / blocks + 0.5f);
+        c->noise_rms = sat_u16((uint32_t)(floor * (1 << EMG_QUALITY_FRAC_BITS) + 0.5f));
+
+        if (q->sat_count[ch] >= q->sat_limit) msg->saturated |= bit;
+        if (q->leadoff_frames && q->flat_max[ch] >= q->leadoff_frames) msg->lead_off |= bit;
+        if (c->mains_pct >= q->mains_pct_limit) msg->mains |= bit;
+        if (c->noise_rms >= q->noise_limit) msg->noisy |= bit;
+    }
+    msg->bad = msg->saturated | msg->lead_off | msg->mains | msg->noisy;
+
+    report_reset(q);
+}
@@ -0,0 +1,87 @@
+/*
+ * Continuous per-channel signal quality monitor.
+ *
+ * Checks every channel of every raw frame for rail saturation and flat lines
+ * (lead-off), and estimates the 50/60 Hz mains share and the RMS noise floor.
+ * Results are reported periodically as bitmasks plus per-channel metrics.
+ *
+ * The ESP32 has no SIMD unit, so the per-sample checks are done SWAR-style:
+ * four channels per 32-bit word, with per-byte change and saturation
+ * detection and byte-lane counters. Per-channel bookkeeping only happens once
+ * per block of frames. Mains share uses two Goertzel filters per channel
+ * over each block; the noise floor is a slowly rising minimum of block RMS.
+ *
+ * Plain C, no ESP-IDF dependencies.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "emg_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMG_QUALITY_WORDS (EMG_FRAME_BYTES / 4)
+
+typedef struct {
+    /* configuration */
+    uint16_t block;             // frames per block, <= 255 so byte lanes cannot overflow
+    uint16_t report_blocks;     // blocks per report
+    uint32_t sat_limit;         // saturated samples per report that flag a channel
+    uint32_t leadoff_frames;    // flat run that flags lead-off
+    uint8_t  mains_pct_limit;
+    uint16_t noise_limit;       // counts << EMG_QUALITY_FRAC_BITS
+    float    coef50, coef60;    // Goertzel 2 cos(w)
+
+    /* per-frame state, four channels per word */
+    bool     have_prev;
+    uint32_t prev[EMG_QUALITY_WORDS];
+    uint32_t changed[EMG_QUALITY_WORDS];    // OR of byte changes within the block
+    uint32_t sat_lanes[EMG_QUALITY_WORDS];  // per-byte saturated sample counts within the block
+
+    /* per-frame arithmetic, one entry per channel */
+    int32_t  sum[EMG_NUM_CHANNELS];
+    uint32_t sumsq[EMG_NUM_CHANNELS];
+    float    dc[EMG_NUM_CHANNELS];          // previous block mean, removed before Goertzel
+    float    g50[EMG_NUM_CHANNELS][2];
+    float    g60[EMG_NUM_CHANNELS][2];
+    uint16_t in_block;
+
+    /* per-report accumulators */
+    uint16_t blocks;
+    uint32_t flat_run[EMG_NUM_CHANNELS];
+    uint32_t flat_max[EMG_NUM_CHANNELS];
+    uint32_t sat_count[EMG_NUM_CHANNELS];
+    float    mains_acc[EMG_NUM_CHANNELS];
+    float    noise_floor[EMG_NUM_CHANNELS];
+} emg_quality_t;
+
+/**
+ * @brief Configure the monitor.
+ *
+ * @param sat_permille   saturated samples (per mille of the report) that flag a channel
+ * @param leadoff_ms     flat-line duration that flags lead-off
+ * @param mains_pct      mains share (percent) that flags a channel
+ * @param noise_limit    noise floor RMS (counts) that flags a channel
+ * @return 0 on success, -1 on invalid parameters
+ */
+int emg_quality_init(emg_quality_t *q, uint32_t rate_hz, uint32_t report_ms, uint16_t sat_permille,
+                     uint32_t leadoff_ms, uint8_t mains_pct, uint16_t noise_limit);
+
+/** @brief Forget all history, e.g. after the stream was interrupted. */
+void emg_quality_reset(emg_quality_t *q);
+
+/**
+ * @brief Check one raw frame (EMG_FRAME_BYTES offset-binary samples).
+ *
+ * @return true when a report is due; call emg_quality_fill().
+ */
+bool emg_quality_push(emg_quality_t *q, const uint8_t *raw);
+
+/** @brief Fill a report and start the next period. */
+void emg_quality_fill(emg_quality_t *q, emg_quality_msg_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
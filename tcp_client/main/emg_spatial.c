@@ -0,0 +1,166 @@
+/*
+ * Spatial filters over the HD-EMG electrode grid, see emg_spatial.h.
+ */
+#include <string.h>
+#include "emg_spatial.h"
+
+/* Channel = row * 8 + column. */
+const emg_layout_t emg_layout_8x8 = {
+    .name = "8x8",
+    .rows = 8,
+    .cols = 8,
+    .ch = {
+         0,  1,  2,  3,  4,  5,  6,  7,
+         8,  9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23,
+        24, 25, 26, 27, 28, 29, 30, 31,
+        32, 33, 34, 35, 36, 37, 38, 39,
+        40, 41, 42, 43, 44, 45, 46, 47,
+        48, 49, 50, 51, 52, 53, 54, 55,
+        56, 57, 58, 59, 60, 61, 62, 63,
+    },
+};
+
+/* 13 x 5 grid with the top-left corner empty; channels numbered down each
+ * column, left to right. */
+const emg_layout_t emg_layout_13x5 = {
+    .name = "13x5",
+    .rows = 13,
+    .cols = 5,
+    .ch = {
+        -1, 12, 25, 38, 51,
+         0, 13, 26, 39, 52,
+         1, 14, 27, 40, 53,
+         2, 15, 28, 41, 54,
+         3, 16, 29, 42, 55,
+         4, 17, 30, 43, 56,
+         5, 18, 31, 44, 57,
+         6, 19, 32, 45, 58,
+         7, 20, 33, 46, 59,
+         8, 21, 34, 47, 60,
+         9, 22, 35, 48, 61,
+        10, 23, 36, 49, 62,
+        11, 24, 37, 50, 63,
+    },
+};
+
+/* Channel at (r, c), or -1 if off-grid or no electrode there. */
+static int layout_at(const emg_layout_t *l, int r, int c)
+{
+    if (r < 0 || c < 0 || r >= l->rows || c >= l->cols) {
+        return -1;
+    }
+    return l->ch[r * l->cols + c];
+}
+
+int emg_spatial_init(emg_spatial_t *s, const emg_layout_t *layout, emg_spatial_mode_t mode)
+{
+    memset(s, 0, sizeof(*s));
+    s->mode = mode;
+
+    if ((int)layout->rows * layout->cols > EMG_LAYOUT_MAX_POS) {
+        return -1;
+    }
+
+    switch (mode) {
+    case EMG_SPATIAL_NONE:
+    case EMG_SPATIAL_CAR: s->taps = 1; break;
+    case EMG_SPATIAL_SD:  s->taps = 2; break;
+    case EMG_SPATIAL_DD:  s->taps = 3; break;
+    case EMG_SPATIAL_NDD: s->taps = 5; break;
+    default: return -1;
+    }
+
+    for (int r = 0; r < layout->rows; r++) {
+        for (int c = 0; c < layout->cols; c++) {
+            int tap[EMG_SPATIAL_MAX_TAPS];
+            tap[0] = layout_at(layout, r, c);
+
+            switch (mode) {
+            case EMG_SPATIAL_SD:
+                tap[1] = layout_at(layout, r + 1, c);
+                break;
+            case EMG_SPATIAL_DD:
+                tap[1] = layout_at(layout, r - 1, c);
+                tap[2] = layout_at(layout, r + 1, c);
+                break;
+            case EMG_SPATIAL_NDD:
+                tap[1] = layout_at(layout, r - 1, c);
+                tap[2] = layout_at(layout, r + 1, c);
+                tap[3] = layout_at(layout, r, c - 1);
+                tap[4] = layout_at(layout, r, c + 1);
+                break;
+            default:
+                break;
+            }
+
+            // Outputs exist only where every tap lands on an electrode
+            int ok = 1;
+            for (int t = 0; t < s->taps; t++) {
+                if (tap[t] < 0 || tap[t] >= EMG_NUM_CHANNELS) ok = 0;
+            }
+            if (!ok || s->n_out >= EMG_NUM_CHANNELS) {
+                continue;
+            }
+
+            for (int t = 0; t < s->taps; t++) {
+                s->idx[s->n_out][t] = (uint8_t)tap[t];
+            }
+            s->out_pos[s->n_out] = (uint8_t)(r * layout->cols + c);
+            s->n_out++;
+        }
+    }
+
+    return s->n_out > 0 ? 0 : -1;
+}
+
+uint8_t emg_spatial_apply(const emg_spatial_t *s, const int16_t *in, int16_t *out)
+{
+    const int n = s->n_out;
+    const uint8_t (*idx)[EMG_SPATIAL_MAX_TAPS] = s->idx;
+
+    // One tight loop per mode, so the tap count and weights are constants
+    switch (s->mode) {
+    case EMG_SPATIAL_NONE:
+        for (int i = 0; i < n; i++) {
+            out[i] = in[idx[i][0]];
+        }
+        break;
+
+    case EMG_SPATIAL_CAR: {
+        int32_t sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += in[idx[i][0]];
+        }
+        int16_t mean = (int16_t)(sum / n);
+        for (int i = 0; i < n; i++) {
+            out[i] = (int16_t)(in[idx[i][0]] - mean);
+        }
+        break;
+    }
+
+    case EMG_SPATIAL_SD:
+        for (int i = 0; i < n; i++) {
+            out[i] = (int16_t)(in[idx[i][1]] - in[idx[i][0]]);
+        }
+        break;
+
+    case EMG_SPATIAL_DD:
+        for (int i = 0; i < n; i++) {
+            out[i] = (int16_t)(in[idx[i][1]] - 2 * in[idx[i][0]] + in[idx[i][2]]);
+        }
+        break;
+
+    case EMG_SPATIAL_NDD:
+        for (int i = 0; i < n; i++) {
+            out[i] = (int16_t)(4 * in[idx[i][0]] - in[idx[i][1]] - in[idx[i][2]]
+                               - in[idx[i][3]] - in[idx[i][4]]);
+        }
+        break;
+    }
+
+    for (int i = n; i < EMG_NUM_CHANNELS; i++) {
+        out[i] = 0;
+    }
+    return (uint8_t)n;
+}
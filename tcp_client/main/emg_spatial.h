@@ -0,0 +1,71 @@
+/*
+ * Spatial filters over the HD-EMG electrode grid.
+ *
+ * An electrode layout maps grid positions (row, column) to channel indices of
+ * the 64-byte frame. emg_spatial_init() compiles a layout and a filter mode
+ * into a fixed gather plan: every output channel is the same weighted sum of
+ * a fixed number of input channels, so emg_spatial_apply() costs the same for
+ * every frame and has no branches on the geometry.
+ *
+ * "Longitudinal" is along the row index (down a column of the grid); orient
+ * the grid so its rows follow the muscle fibres.
+ *
+ * Plain C, no ESP-IDF dependencies. python_tcp_server/emg_spatial.py mirrors
+ * the same layouts and modes on the host.
+ */
+#pragma once
+#include <stdint.h>
+#include "emg_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMG_LAYOUT_MAX_POS   128     // rows * cols
+#define EMG_SPATIAL_MAX_TAPS 5
+
+typedef struct {
+    const char *name;
+    uint8_t rows;
+    uint8_t cols;
+    int8_t  ch[EMG_LAYOUT_MAX_POS];  // ch[r * cols + c]: channel index, -1 = no electrode
+} emg_layout_t;
+
+extern const emg_layout_t emg_layout_8x8;
+extern const emg_layout_t emg_layout_13x5;
+
+typedef enum {
+    EMG_SPATIAL_NONE = 0,   // monopolar, channels passed through in layout order
+    EMG_SPATIAL_CAR,        // common average reference
+    EMG_SPATIAL_SD,         // longitudinal single differential: x[r+1] - x[r]
+    EMG_SPATIAL_DD,         // longitudinal double differential: x[r-1] - 2 x[r] + x[r+1]
+    EMG_SPATIAL_NDD,        // normal double differential (Laplacian): 4 x - N - S - W - E
+} emg_spatial_mode_t;
+
+typedef struct {
+    emg_spatial_mode_t mode;
+    uint8_t n_out;                                  // valid output channels
+    uint8_t taps;                                   // inputs per output
+    uint8_t idx[EMG_NUM_CHANNELS][EMG_SPATIAL_MAX_TAPS];
+    uint8_t out_pos[EMG_NUM_CHANNELS];              // grid position of each output
+} emg_spatial_t;
+
+/**
+ * @brief Build the gather plan for `layout` and `mode`.
+ *
+ * @return 0 on success, -1 if the layout is invalid or yields no outputs.
+ */
+int emg_spatial_init(emg_spatial_t *s, const emg_layout_t *layout, emg_spatial_mode_t mode);
+
+/**
+ * @brief Filter one frame of zero-centred samples.
+ *
+ * @param in  EMG_NUM_CHANNELS input samples, indexed by channel
+ * @param out EMG_NUM_CHANNELS outputs; entries past n_out are set to 0
+ * @return number of valid outputs (s->n_out)
+ */
+uint8_t emg_spatial_apply(const emg_spatial_t *s, const int16_t *in, int16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,232 @@
+/*
+ * Periodic per-channel spectral analysis, see emg_spectral.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "emg_spectral.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#define TABLE_ALLOC(sz)  heap_caps_malloc((sz), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define TABLE_FREE(p)    heap_caps_free(p)
+#define FFT_ATTR         IRAM_ATTR
+#else
+#define TABLE_ALLOC(sz)  malloc(sz)
+#define TABLE_FREE(p)    free(p)
+#define FFT_ATTR
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void emg_spectral_free(emg_spectral_t *s)
+{
+    TABLE_FREE(s->window);
+    TABLE_FREE(s->twiddle);
+    TABLE_FREE(s->bitrev);
+    TABLE_FREE(s->work);
+    TABLE_FREE(s->psd);
+    free(s->ring);
+    memset(s, 0, sizeof(*s));
+}
+
+int emg_spectral_init(emg_spectral_t *s, uint16_t n, uint16_t hop, float rate_hz,
+                      float band_lo_hz, float band_hi_hz)
+{
+    memset(s, 0, sizeof(*s));
+    if (n < 64 || n > 1024 || (n & (n - 1)) || hop == 0 || hop > n || rate_hz <= 0) {
+        return -1;
+    }
+
+    s->n = n;
+    s->hop = hop;
+    s->ring_len = 2u * n;
+    s->rate_hz = rate_hz;
+
+    // Analysis band in bins, never including DC, never past Nyquist
+    float df = rate_hz / n;
+    int lo = (int)ceilf(band_lo_hz / df);
+    int hi = (int)floorf(band_hi_hz / df);
+    if (lo < 1) lo = 1;
+    if (hi > n / 2) hi = n / 2;
+    if (hi < lo) {
+        return -1;
+    }
+    s->bin_lo = (uint16_t)lo;
+    s->bin_hi = (uint16_t)hi;
+
+    s->window  = (float *)TABLE_ALLOC(n * sizeof(float));
+    s->twiddle = (float *)TABLE_ALLOC(n * sizeof(float));
+    s->bitrev  = (uint16_t *)TABLE_ALLOC(n * sizeof(uint16_t));
+    s->work    = (float *)TABLE_ALLOC(2 * n * sizeof(float));
+    s->psd     = (float *)TABLE_ALLOC(2 * (n / 2 + 1) * sizeof(float));
+    s->ring    = (int8_t *)malloc((size_t)s->ring_len * EMG_NUM_CHANNELS);
+    if (!s->window || !s->twiddle || !s->bitrev || !s->work || !s->psd || !s->ring) {
+        emg_spectral_free(s);
+        return -1;
+    }
+
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+
+    for (int i = 0; i < n; i++) {
+        s->window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / n);
+
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        }
+        s->bitrev[i] = (uint16_t)r;
+    }
+    for (int k = 0; k < n / 2; k++) {
+        s->twiddle[2 * k]     = cosf(2.0f * (float)M_PI * k / n);
+        s->twiddle[2 * k + 1] = -sinf(2.0f * (float)M_PI * k / n);
+    }
+
+    emg_spectral_reset(s);
+    return 0;
+}
+
+void emg_spectral_reset(emg_spectral_t *s)
+{
+    s->written = 0;
+    s->since_window = 0;
+}
+
+bool emg_spectral_push(emg_spectral_t *s, const uint8_t *raw)
+{
+    // Offset binary to two's complement is a flip of the top bit
+    uint32_t *dst = (uint32_t *)(s->ring + (size_t)(s->written % s->ring_len) * EMG_NUM_CHANNELS);
+    for (int k = 0; k < EMG_NUM_CHANNELS / 4; k++) {
+        uint32_t w;
+        memcpy(&w, raw + 4 * k, sizeof(w));
+        dst[k] = w ^ 0x80808080u;
+    }
+    s->written++;
+
+    if (s->since_window < s->hop) s->since_window++;
+    if (s->written >= s->n && s->since_window >= s->hop) {
+        s->since_window = 0;
+        return true;
+    }
+    return false;
+}
+
+/* In-place iterative radix-2 decimation-in-time FFT on interleaved complex data */
+static void FFT_ATTR fft_radix2(float *x, int n, const float *tw, const uint16_t *rev)
+{
+    for (int i = 0; i < n; i++) {
+        int j = rev[i];
+        if (i < j) {
+            float tr = x[2 * i], ti = x[2 * i + 1];
+            x[2 * i] = x[2 * j];
+            x[2 * i + 1] = x[2 * j + 1];
+            x[2 * j] = tr;
+            x[2 * j + 1] = ti;
+        }
+    }
+
+    for (int size = 2; size <= n; size <<= 1) {
+        int half = size >> 1;
+        int step = n / size;
+        for (int start = 0; start < n; start += size) {
+            for (int k = 0; k < half; k++) {
+                float wr = tw[2 * k * step], wi = tw[2 * k * step + 1];
+                float *a = x + 2 * (start + k);
+                float *b = a + 2 * half;
+                float tr = wr * b[0] - wi * b[1];
+                float ti = wr * b[1] + wi * b[0];
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/* Mean and median frequency (Hz) of one power spectrum over the analysis band */
+static void band_metrics(const emg_spectral_t *s, const float *p, float *mnf, float *mdf)
+{
+    const float df = s->rate_hz / s->n;
+    float total = 0.0f, moment = 0.0f;
+    for (int k = s->bin_lo; k <= s->bin_hi; k++) {
+        total += p[k];
+        moment += p[k] * k;
+    }
+    if (total <= 0.0f) {
+        *mnf = *mdf = 0.0f;
+        return;
+    }
+    *mnf = moment / total * df;
+
+    // Median: the frequency splitting the band power in half, interpolated within the bin
+    float half = 0.5f * total, cum = 0.0f;
+    *mdf = s->bin_hi * df;
+    for (int k = s->bin_lo; k <= s->bin_hi; k++) {
+        if (cum + p[k] >= half) {
+            float frac = p[k] > 0.0f ? (half - cum) / p[k] : 0.0f;
+            *mdf = (k - 0.5f + frac) * df;
+            break;
+        }
+        cum += p[k];
+    }
+}
+
+static inline uint16_t hz_fixed(float hz)
+{
+    float v = hz * (1 << EMG_SPECTRAL_FRAC_BITS) + 0.5f;
+    return (uint16_t)(v < 0.0f ? 0.0f : (v > 65535.0f ? 65535.0f : v));
+}
+
+bool emg_spectral_compute(emg_spectral_t *s, uint32_t end, emg_spectral_msg_t *msg)
+{
+    const int n = s->n;
+    const int nb = n / 2 + 1;
+    float *z = s->work;
+    float *pa = s->psd, *pb = s->psd + nb;
+    const uint32_t first = end - n;
+
+    msg->fft_size = s->n;
+    msg->hop = s->hop;
+    msg->channels = EMG_NUM_CHANNELS;
+    msg->frac_bits = EMG_SPECTRAL_FRAC_BITS;
+    msg->reserved = 0;
+
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch += 2) {
+        // Channel ch in the real part, ch + 1 in the imaginary part
+        for (int t = 0; t < n; t++) {
+            const int8_t *row = s->ring + (size_t)((first + t) % s->ring_len) * EMG_NUM_CHANNELS;
+            z[2 * t]     = s->window[t] * row[ch];
+            z[2 * t + 1] = s->window[t] * row[ch + 1];
+        }
+
+        fft_radix2(z, n, s->twiddle, s->bitrev);
+
+        // Separate the two real spectra: A = (Z[k] + conj Z[n-k]) / 2, B = (Z[k] - conj Z[n-k]) / 2i
+        for (int k = 0; k < nb; k++) {
+            int m = (n - k) & (n - 1);
+            float zr = z[2 * k], zi = z[2 * k + 1];
+            float cr = z[2 * m], ci = z[2 * m + 1];
+            float ar = zr + cr, ai = zi - ci;
+            float br = zi + ci, bi = zr - cr;
+            pa[k] = 0.25f * (ar * ar + ai * ai);
+            pb[k] = 0.25f * (br * br + bi * bi);
+        }
+
+        float mnf, mdf;
+        band_metrics(s, pa, &mnf, &mdf);
+        msg->mnf[ch] = hz_fixed(mnf);
+        msg->mdf[ch] = hz_fixed(mdf);
+        band_metrics(s, pb, &mnf, &mdf);
+        msg->mnf[ch + 1] = hz_fixed(mnf);
+        msg->mdf[ch + 1] = hz_fixed(mdf);
+    }
+
+    // The producer may have lapped us; the window's oldest row is reused at end + n
+    uint32_t written = s->written;
+    return written >= end && written - end <= (uint32_t)n;
+}
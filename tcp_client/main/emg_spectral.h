@@ -0,0 +1,88 @@
+/*
+ * Periodic per-channel spectral analysis for fatigue tracking.
+ *
+ * The producer (spi_task) appends every raw frame to a history ring with
+ * emg_spectral_push(), which is a 64-byte copy. When a window is due, the
+ * consumer (a low-priority task) runs emg_spectral_compute(): Hann window,
+ * radix-2 FFT and mean/median power frequency for every channel. Two real
+ * channels share one complex FFT, so a window costs 32 FFTs of fft_size.
+ *
+ * The ring holds 2 * fft_size frames, so the consumer has fft_size frames of
+ * time after a window becomes ready before the producer overwrites it;
+ * emg_spectral_compute() detects when it was too slow and discards the
+ * result instead of reporting a torn window.
+ *
+ * Analysis runs on the monopolar channels (one result per electrode). The
+ * 8-bit samples are stored losslessly as signed bytes.
+ *
+ * Plain C; on ESP-IDF the tables are placed in internal DRAM and the FFT
+ * kernel in IRAM.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "emg_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint16_t n;             // FFT size, power of two (256 or 512)
+    uint16_t hop;           // frames between windows
+    uint32_t ring_len;      // 2 * n frames
+    float    rate_hz;       // frame rate
+    uint16_t bin_lo;        // first bin of the analysis band
+    uint16_t bin_hi;        // last bin of the analysis band
+
+    /* precomputed tables */
+    float    *window;       // Hann window, n
+    float    *twiddle;      // exp(-2 pi i k / n) for k < n / 2, interleaved re/im
+    uint16_t *bitrev;       // bit-reversal permutation, n
+
+    /* consumer scratch */
+    float    *work;         // n complex values, interleaved re/im
+    float    *psd;          // 2 * (n / 2 + 1) power bins for the channel pair
+
+    /* producer state */
+    int8_t   *ring;         // ring_len rows of EMG_NUM_CHANNELS samples (frame-major)
+    volatile uint32_t written;   // frames pushed since reset
+    uint16_t since_window;
+} emg_spectral_t;
+
+/**
+ * @brief Allocate tables and history.
+ *
+ * @param n       FFT size, 256 or 512 (any power of two from 64 to 1024)
+ * @param hop     frames between windows, 1..n (overlap = 1 - hop / n)
+ * @param rate_hz frame rate, used to convert bins to Hz
+ * @param band_lo_hz, band_hi_hz analysis band; DC is always excluded
+ * @return 0 on success, -1 on invalid parameters or allocation failure
+ */
+int emg_spectral_init(emg_spectral_t *s, uint16_t n, uint16_t hop, float rate_hz,
+                      float band_lo_hz, float band_hi_hz);
+
+void emg_spectral_free(emg_spectral_t *s);
+
+/** @brief Drop all history (producer side). */
+void emg_spectral_reset(emg_spectral_t *s);
+
+/**
+ * @brief Append one raw frame (EMG_FRAME_BYTES offset-binary samples).
+ *
+ * @return true when a new window ends at this frame; its end position is
+ *         s->written after the call.
+ */
+bool emg_spectral_push(emg_spectral_t *s, const uint8_t *raw);
+
+/**
+ * @brief Analyse the window ending at ring position `end` (a value of s->written).
+ *
+ * @return true if msg was filled, false if the producer overwrote part of the
+ *         window while it was being analysed.
+ */
+bool emg_spectral_compute(emg_spectral_t *s, uint32_t end, emg_spectral_msg_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
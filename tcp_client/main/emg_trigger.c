@@ -0,0 +1,166 @@
+/*
+ * Activity-triggered capture, see emg_trigger.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "emg_trigger.h"
+
+#define ENV_TO_FEATURE_SHIFT (EMG_TRIGGER_ENV_SHIFT - EMG_FEATURE_FRAC_BITS)
+
+int emg_trigger_init(emg_trigger_t *t, uint32_t pre_frames, uint32_t onset_frames,
+                     uint32_t hold_frames, uint8_t smooth_shift, uint16_t threshold_counts,
+                     uint64_t chan_mask, uint32_t summary_frames)
+{
+    memset(t, 0, sizeof(*t));
+    if (pre_frames > EMG_TRIGGER_MAX_PRE_FRAMES) {
+        return -2;
+    }
+    t->pre_frames = (uint16_t)pre_frames;
+    t->onset_frames = onset_frames ? onset_frames : 1;
+    t->hold_frames = hold_frames;
+    t->smooth_shift = smooth_shift;
+    t->threshold = (int32_t)threshold_counts << EMG_TRIGGER_ENV_SHIFT;
+    t->chan_mask = chan_mask;
+    t->summary_frames = summary_frames ? summary_frames : 1;
+
+    if (pre_frames) {
+        t->ring = (uint8_t *)malloc((size_t)pre_frames * EMG_FRAME_BYTES);
+        if (!t->ring) {
+            return -1;
+        }
+    }
+
+    emg_trigger_reset(t);
+    return 0;
+}
+
+void emg_trigger_free(emg_trigger_t *t)
+{
+    free(t->ring);
+    t->ring = NULL;
+}
+
+static void idle_stats_reset(emg_trigger_t *t, uint64_t first_frame)
+{
+    t->idle_frames = 0;
+    t->idle_first_frame = first_frame;
+    memset(t->env_sum, 0, sizeof(t->env_sum));
+    memset(t->env_max, 0, sizeof(t->env_max));
+}
+
+void emg_trigger_reset(emg_trigger_t *t)
+{
+    t->active = false;
+    t->above_run = 0;
+    t->below_run = 0;
+    t->ring_head = 0;
+    t->ring_count = 0;
+    memset(t->env, 0, sizeof(t->env));
+    idle_stats_reset(t, 0);
+}
+
+emg_trigger_action_t emg_trigger_push(emg_trigger_t *t, const uint8_t *raw, const int16_t *sig,
+                                      uint64_t frame_idx)
+{
+    const uint8_t sh = t->smooth_shift;
+    bool above = false;
+
+    // Rectified EMA envelope on every channel; only masked ones can trigger
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        int32_t x = sig[ch] < 0 ? -sig[ch] : sig[ch];
+        t->env[ch] += ((x << EMG_TRIGGER_ENV_SHIFT) - t->env[ch]) >> sh;
+        if (t->env[ch] > t->threshold && ((t->chan_mask >> ch) & 1)) {
+            above = true;
+        }
+    }
+
+    if (t->active) {
+        t->below_run = above ? 0 : t->below_run + 1;
+        if (t->below_run < t->hold_frames) {
+            return EMG_TRIG_STREAM;
+        }
+        t->active = false;
+        t->above_run = 0;
+        idle_stats_reset(t, frame_idx + 1);
+        return EMG_TRIG_STOP;
+    }
+
+    t->above_run = above ? t->above_run + 1 : 0;
+    if (t->above_run >= t->onset_frames) {
+        t->active = true;
+        t->below_run = 0;
+        t->captures++;
+        return EMG_TRIG_START;
+    }
+
+    // Still idle: keep the frame for the next onset and account for it
+    if (t->pre_frames) {
+        memcpy(t->ring + (size_t)t->ring_head * EMG_FRAME_BYTES, raw, EMG_FRAME_BYTES);
+        t->ring_head = (uint16_t)((t->ring_head + 1) % t->pre_frames);
+        if (t->ring_count < t->pre_frames) t->ring_count++;
+    }
+
+    if (t->idle_frames == 0) {
+        t->idle_first_frame = frame_idx;
+    }
+    t->idle_frames++;
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        t->env_sum[ch] += (uint32_t)(t->env[ch] >> ENV_TO_FEATURE_SHIFT);
+        if (t->env[ch] > t->env_max[ch]) t->env_max[ch] = t->env[ch];
+    }
+    return EMG_TRIG_BUFFER;
+}
+
+uint16_t emg_trigger_take_pretrigger(emg_trigger_t *t, const uint8_t **a, uint16_t *n_a,
+                                     const uint8_t **b, uint16_t *n_b)
+{
+    uint16_t count = t->ring_count;
+    uint16_t start = (uint16_t)((t->ring_head + t->pre_frames - count) % (t->pre_frames ? t->pre_frames : 1));
+
+    if (count == 0) {
+        *a = *b = NULL;
+        *n_a = *n_b = 0;
+    } else if (start + count <= t->pre_frames) {
+        *a = t->ring + (size_t)start * EMG_FRAME_BYTES;
+        *n_a = count;
+        *b = NULL;
+        *n_b = 0;
+    } else {
+        *a = t->ring + (size_t)start * EMG_FRAME_BYTES;
+        *n_a = (uint16_t)(t->pre_frames - start);
+        *b = t->ring;
+        *n_b = (uint16_t)(count - *n_a);
+    }
+
+    t->ring_count = 0;
+    t->ring_head = 0;
+    return count;
+}
+
+bool emg_trigger_summary_due(const emg_trigger_t *t)
+{
+    return !t->active && t->idle_frames >= t->summary_frames;
+}
+
+static inline uint16_t sat_u16(uint32_t v)
+{
+    return (uint16_t)(v > 0xFFFF ? 0xFFFF : v);
+}
+
+void emg_trigger_fill_summary(emg_trigger_t *t, emg_summary_msg_t *msg, uint64_t *first_frame)
+{
+    uint32_t n = t->idle_frames ? t->idle_frames : 1;
+
+    msg->frames = t->idle_frames;
+    msg->captures = t->captures;
+    msg->channels = EMG_NUM_CHANNELS;
+    msg->frac_bits = EMG_FEATURE_FRAC_BITS;
+    msg->reserved = 0;
+    for (int ch = 0; ch < EMG_NUM_CHANNELS; ch++) {
+        msg->env_mean[ch] = sat_u16((uint32_t)(t->env_sum[ch] / n));
+        msg->env_max[ch] = sat_u16((uint32_t)(t->env_max[ch] >> ENV_TO_FEATURE_SHIFT));
+    }
+
+    *first_frame = t->idle_first_frame;
+    idle_stats_reset(t, t->idle_first_frame + t->idle_frames);
+}
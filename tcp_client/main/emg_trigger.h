@@ -0,0 +1,108 @@
+/*
+ * Activity-triggered capture.
+ *
+ * While idle, raw frames only go into a pre-trigger ring. A rectified,
+ * exponentially smoothed envelope is tracked per channel; when any selected
+ * channel stays above the threshold for `onset_frames`, the capture starts:
+ * the caller streams the ring (oldest first) followed by live frames until
+ * the selected envelopes have been below the threshold for `hold_frames`.
+ * Idle periods are reported as periodic summaries instead of raw data.
+ *
+ * Plain C, no ESP-IDF dependencies.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "emg_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMG_TRIGGER_ENV_SHIFT 8   // envelope fixed point: counts << 8
+#define EMG_TRIGGER_MAX_PRE_FRAMES 0xFFFF   // ring indices are 16-bit
+
+typedef enum {
+    EMG_TRIG_BUFFER,    // idle: frame kept in the pre-trigger ring only
+    EMG_TRIG_START,     // onset: stream the ring (emg_trigger_take_pretrigger), then this frame
+    EMG_TRIG_STREAM,    // capturing: stream this frame
+    EMG_TRIG_STOP,      // hold expired: stream this frame, then close the capture
+} emg_trigger_action_t;
+
+typedef struct {
+    /* configuration */
+    uint16_t pre_frames;        // pre-trigger ring capacity
+    uint32_t onset_frames;      // consecutive frames above threshold to trigger
+    uint32_t hold_frames;       // frames below threshold before the capture ends
+    uint8_t  smooth_shift;      // envelope time constant = 2^shift frames
+    int32_t  threshold;         // envelope threshold, counts << EMG_TRIGGER_ENV_SHIFT
+    uint64_t chan_mask;         // channels allowed to trigger
+    uint32_t summary_frames;    // idle frames per summary message
+
+    /* state */
+    bool     active;
+    uint32_t above_run;
+    uint32_t below_run;
+    uint8_t *ring;              // pre_frames * EMG_FRAME_BYTES
+    uint16_t ring_head;         // next slot to write
+    uint16_t ring_count;
+    uint32_t captures;
+    int32_t  env[EMG_NUM_CHANNELS];
+
+    /* idle summary accumulators */
+    uint32_t idle_frames;
+    uint64_t idle_first_frame;
+    uint64_t env_sum[EMG_NUM_CHANNELS];   // per-frame envelope sum, EMG_FEATURE_FRAC_BITS fixed point
+    int32_t  env_max[EMG_NUM_CHANNELS];
+} emg_trigger_t;
+
+/**
+ * @brief Allocate the pre-trigger ring and reset the state.
+ *
+ * @param pre_frames       pre-trigger ring capacity, at most EMG_TRIGGER_MAX_PRE_FRAMES
+ * @param threshold_counts envelope threshold in counts of the analysed signal
+ * @return 0 on success, -1 if allocation failed, -2 if pre_frames is too large.
+ */
+int emg_trigger_init(emg_trigger_t *t, uint32_t pre_frames, uint32_t onset_frames,
+                     uint32_t hold_frames, uint8_t smooth_shift, uint16_t threshold_counts,
+                     uint64_t chan_mask, uint32_t summary_frames);
+
+void emg_trigger_free(emg_trigger_t *t);
+
+/** @brief Back to idle with an empty ring, e.g. after the stream was interrupted. */
+void emg_trigger_reset(emg_trigger_t *t);
+
+/**
+ * @brief Feed one frame.
+ *
+ * @param raw       the raw frame (EMG_FRAME_BYTES), copied into the ring while idle
+ * @param sig       the analysed signal for this frame (EMG_NUM_CHANNELS samples)
+ * @param frame_idx device frame index of this frame
+ */
+emg_trigger_action_t emg_trigger_push(emg_trigger_t *t, const uint8_t *raw, const int16_t *sig,
+                                      uint64_t frame_idx);
+
+/**
+ * @brief Hand out the buffered pre-trigger frames, oldest first, and empty the ring.
+ *
+ * The frames are returned as up to two contiguous spans (the ring may wrap);
+ * they stay valid until the next emg_trigger_push().
+ *
+ * @return total number of frames (n_a + n_b)
+ */
+uint16_t emg_trigger_take_pretrigger(emg_trigger_t *t, const uint8_t **a, uint16_t *n_a,
+                                     const uint8_t **b, uint16_t *n_b);
+
+/** @brief True when enough idle frames have accumulated for a summary. */
+bool emg_trigger_summary_due(const emg_trigger_t *t);
+
+/**
+ * @brief Fill an idle summary and restart the accumulation period.
+ *
+ * @param[out] first_frame device frame index of the first summarised frame
+ */
+void emg_trigger_fill_summary(emg_trigger_t *t, emg_summary_msg_t *msg, uint64_t *first_frame);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,12 +20,29 @@
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_rom_sys.h"
+#include "esp_mac.h"
+#include "esp_random.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
 
+#include "emg_proto.h"
+#include "emg_spatial.h"
+#if CONFIG_EMG_FEATURES_ENABLE
+#include "emg_features.h"
+#endif
+#if CONFIG_EMG_TRIGGER_ENABLE
+#include "emg_trigger.h"
+#endif
+#if CONFIG_EMG_SPECTRAL_ENABLE
+#include "emg_spectral.h"
+#endif
+#if CONFIG_EMG_QUALITY_ENABLE
+#include "emg_quality.h"
+#endif
+
 #if defined(CONFIG_EXAMPLE_SOCKET_IP_INPUT_STDIN)
 #include "addr_from_stdin.h"
 #endif
@@ -65,14 +82,95 @@ static spi_device_handle_t spi = NULL;
 /* ======= Double-buffering between tasks ======= */
 #define NUM_BATCH_BUFS 2
 
+/* Every outgoing message travels through filled_q as one of these. `buf`
+ * starts with the emg_msg_hdr_t, followed by the payload, so each message is
+ * a single contiguous send. The buffer goes back to `home` (its pool's free
+ * queue) once sent. */
 typedef struct {
-    uint8_t *buf;
-    size_t   len;     // always TCP_BATCH_SIZE in this design
+    uint8_t      *buf;
+    size_t        len;     // header + payload bytes
+    QueueHandle_t home;
 } batch_item_t;
 
+#define MSG_HDR_SIZE   sizeof(emg_msg_hdr_t)
+
 static QueueHandle_t free_q   = NULL;
 static QueueHandle_t filled_q = NULL;
 
+/* ======= Spatial filter configuration ======= */
+#if CONFIG_EMG_LAYOUT_13X5
+#define ELECTRODE_LAYOUT     emg_layout_13x5
+#define ELECTRODE_LAYOUT_ID  EMG_LAYOUT_13X5
+#else
+#define ELECTRODE_LAYOUT     emg_layout_8x8
+#define ELECTRODE_LAYOUT_ID  EMG_LAYOUT_8X8
+#endif
+
+#if CONFIG_EMG_SPATIAL_CAR
+#define SPATIAL_MODE      EMG_SPATIAL_CAR
+#elif CONFIG_EMG_SPATIAL_SD
+#define SPATIAL_MODE      EMG_SPATIAL_SD
+#elif CONFIG_EMG_SPATIAL_DD
+#define SPATIAL_MODE      EMG_SPATIAL_DD
+#elif CONFIG_EMG_SPATIAL_NDD
+#define SPATIAL_MODE      EMG_SPATIAL_NDD
+#else
+#define SPATIAL_MODE      EMG_SPATIAL_NONE
+#endif
+
+static emg_spatial_t s_spatial;
+static int16_t s_centered[EMG_NUM_CHANNELS];
+#if !CONFIG_EMG_SPATIAL_NONE
+static int16_t s_filtered[EMG_NUM_CHANNELS];
+#endif
+
+/* ======= Feature stream configuration ======= */
+#if CONFIG_EMG_FEATURES_ENABLE
+#define NUM_FEATURE_BUFS 2
+static QueueHandle_t feat_free_q = NULL;
+static emg_features_t s_feat;
+#else
+#define NUM_FEATURE_BUFS 0
+#endif
+
+/* ======= Activity trigger configuration ======= */
+#if CONFIG_EMG_TRIGGER_ENABLE
+#define NUM_SUMMARY_BUFS 1
+static QueueHandle_t summ_free_q = NULL;
+static emg_trigger_t s_trig;
+#else
+#define NUM_SUMMARY_BUFS 0
+#endif
+
+/* ======= Spectral (fatigue) configuration ======= */
+#if CONFIG_EMG_SPECTRAL_ENABLE
+#define NUM_SPECTRAL_BUFS 1
+#if CONFIG_EMG_SPECTRAL_FFT_512
+#define SPECTRAL_FFT_SIZE 512
+#else
+#define SPECTRAL_FFT_SIZE 256
+#endif
+static QueueHandle_t spec_free_q = NULL;
+static TaskHandle_t spectral_task_handle = NULL;
+static emg_spectral_t s_spec;
+/* Window handed from spi_task to spectral_task (valid while spectral_busy) */
+static volatile uint32_t s_spec_end = 0;
+static volatile uint64_t s_spec_frame0 = 0;
+static volatile int64_t  s_spec_t0_us = 0;
+static volatile bool     s_spec_busy = false;
+#else
+#define NUM_SPECTRAL_BUFS 0
+#endif
+
+/* ======= Channel quality configuration ======= */
+#if CONFIG_EMG_QUALITY_ENABLE
+#define NUM_QUALITY_BUFS 1
+static QueueHandle_t qual_free_q = NULL;
+static emg_quality_t s_qual;
+#else
+#define NUM_QUALITY_BUFS 0
+#endif
+
 static EventGroupHandle_t g_evt = NULL;
 #define CONNECTED_BIT       (1 << 0)
 #define HANDSHAKE_DONE_BIT  (1 << 1)
@@ -80,6 +178,24 @@ static EventGroupHandle_t g_evt = NULL;
 /* Stats (written in SPI task, read in TCP task) */
 static volatile int correct = 0;
 static volatile int incorrect = 0;
+static volatile int dropped_msgs = 0;
+
+static uint32_t s_seq[EMG_MSG_TYPE_COUNT];
+static uint32_t s_boot_id = 0;
+
+static inline void msg_hdr_init(uint8_t *buf, uint8_t type, uint32_t len,
+                                uint32_t count, uint64_t frame0, int64_t t_us)
+{
+    emg_msg_hdr_t *h = (emg_msg_hdr_t *)buf;
+    h->magic   = EMG_MSG_MAGIC;
+    h->version = EMG_PROTO_VERSION;
+    h->type    = type;
+    h->len     = len;
+    h->seq     = s_seq[type]++;
+    h->count   = count;
+    h->frame0  = frame0;
+    h->t_us    = (uint64_t)t_us;
+}
 
 /* ======= SPI init ======= */
 static void spi_master_init(void)
@@ -196,6 +312,256 @@ static uint8_t *spi_get_and_requeue(void)
     return buf;
 }
 
+/* ======= Small periodic messages (features, summaries) ======= */
+static inline __attribute__((unused)) int64_t frames_to_us(int64_t frames)
+{
+    return frames * 1000000 / CONFIG_EMG_FRAME_RATE_HZ;
+}
+
+/* Take a buffer from a small-message pool without blocking. These messages
+ * are periodic, so if TCP is behind we skip one rather than stall. */
+static __attribute__((unused)) bool msg_take(QueueHandle_t pool, batch_item_t *item)
+{
+    if (xQueueReceive(pool, item, 0) != pdTRUE) {
+        dropped_msgs++;
+        return false;
+    }
+    return true;
+}
+
+static __attribute__((unused)) void msg_publish(batch_item_t *item, uint8_t type, uint32_t len,
+                                                uint32_t count, uint64_t frame0, int64_t t0_us)
+{
+    msg_hdr_init(item->buf, type, len, count, frame0, t0_us);
+    item->len = MSG_HDR_SIZE + len;
+
+    if (xQueueSend(filled_q, item, 0) != pdTRUE) {
+        xQueueSend(item->home, item, 0);
+        dropped_msgs++;
+    }
+}
+
+/* ======= Feature stream ======= */
+#if CONFIG_EMG_FEATURES_ENABLE
+static void emit_features(uint64_t frame_idx, int64_t now_us)
+{
+    batch_item_t item;
+    if (!msg_take(feat_free_q, &item)) {
+        return;
+    }
+
+    emg_features_msg_t *msg = (emg_features_msg_t *)(item.buf + MSG_HDR_SIZE);
+    emg_features_fill(&s_feat, msg);
+    msg->channels = s_spatial.n_out;
+
+    // The window ends at this frame; back-date its start from the nominal rate
+    uint32_t win = s_feat.window;
+    msg_publish(&item, EMG_MSG_FEATURES, sizeof(emg_features_msg_t),
+                win, frame_idx + 1 - win, now_us - frames_to_us(win - 1));
+}
+#endif
+
+/* ======= Activity trigger ======= */
+#if CONFIG_EMG_TRIGGER_ENABLE
+static void emit_summary(uint64_t frame_idx, int64_t now_us)
+{
+    batch_item_t item;
+    if (!msg_take(summ_free_q, &item)) {
+        return;
+    }
+
+    uint64_t first = 0;
+    emg_summary_msg_t *msg = (emg_summary_msg_t *)(item.buf + MSG_HDR_SIZE);
+    emg_trigger_fill_summary(&s_trig, msg, &first);
+    msg->channels = s_spatial.n_out;
+
+    msg_publish(&item, EMG_MSG_SUMMARY, sizeof(emg_summary_msg_t),
+                msg->frames, first, now_us - frames_to_us((int64_t)(frame_idx - first)));
+}
+#endif
+
+/* ======= Channel quality ======= */
+#if CONFIG_EMG_QUALITY_ENABLE
+static void emit_quality(uint64_t frame_idx, int64_t now_us)
+{
+    batch_item_t item;
+    if (!msg_take(qual_free_q, &item)) {
+        return;
+    }
+
+    emg_quality_msg_t *msg = (emg_quality_msg_t *)(item.buf + MSG_HDR_SIZE);
+    emg_quality_fill(&s_qual, msg);
+
+    // The report period ends at this frame
+    uint32_t frames = msg->frames;
+    msg_publish(&item, EMG_MSG_QUALITY, sizeof(emg_quality_msg_t),
+                frames, frame_idx + 1 - frames, now_us - frames_to_us(frames - 1));
+}
+#endif
+
+/* ======= Spectral analysis ======= */
+#if CONFIG_EMG_SPECTRAL_ENABLE
+/* Hand the window that just ended to spectral_task, unless it is still busy */
+static void spectral_window_ready(uint64_t frame_idx, int64_t now_us)
+{
+    if (s_spec_busy) {
+        // Previous window not finished; skip this one rather than queue up work
+        dropped_msgs++;
+        return;
+    }
+    s_spec_end = s_spec.written;
+    s_spec_frame0 = frame_idx + 1 - s_spec.n;
+    s_spec_t0_us = now_us - frames_to_us(s_spec.n - 1);
+    s_spec_busy = true;
+    xTaskNotifyGive(spectral_task_handle);
+}
+
+/* Runs below spi_task's priority on the same core, so it only ever uses the
+ * time spi_task spends waiting for SPI transactions. */
+static void spectral_task(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        batch_item_t item;
+        if (msg_take(spec_free_q, &item)) {
+            emg_spectral_msg_t *msg = (emg_spectral_msg_t *)(item.buf + MSG_HDR_SIZE);
+            if (emg_spectral_compute(&s_spec, s_spec_end, msg)) {
+                msg_publish(&item, EMG_MSG_SPECTRAL, sizeof(emg_spectral_msg_t),
+                            s_spec.n, s_spec_frame0, s_spec_t0_us);
+            } else {
+                // Overwritten while we worked (or the stream restarted)
+                xQueueSend(spec_free_q, &item, 0);
+                dropped_msgs++;
+            }
+        }
+
+        s_spec_busy = false;
+    }
+}
+#endif
+
+/* Centre the raw frame and run the spatial filter. Returns the signal the
+ * on-device analysis stages consume; raw batches stay monopolar. */
+static inline __attribute__((unused)) const int16_t *condition_frame(const uint8_t *frame)
+{
+    for (int k = 0; k < EMG_NUM_CHANNELS; k++) {
+        s_centered[k] = (int16_t)frame[k] - EMG_SAMPLE_ZERO;
+    }
+#if CONFIG_EMG_SPATIAL_NONE
+    return s_centered;
+#else
+    emg_spatial_apply(&s_spatial, s_centered, s_filtered);
+    return s_filtered;
+#endif
+}
+
+/* ======= Raw batch assembly (spi_task only) ======= */
+#if CONFIG_EMG_STREAM_RAW
+static batch_item_t s_batch;
+static uint8_t *s_batch_dst = NULL;     // payload area of the batch being filled, NULL if none
+static size_t   s_batch_filled = 0;
+static uint64_t s_batch_frame0 = 0;
+static int64_t  s_batch_t_us = 0;
+
+/* Publish the current batch, full or partial (e.g. at the end of a triggered capture) */
+static void batch_flush(void)
+{
+    if (!s_batch_dst) {
+        return;
+    }
+    if (s_batch_filled > 0) {
+        msg_hdr_init(s_batch.buf, EMG_MSG_RAW_BATCH, s_batch_filled,
+                     s_batch_filled / SPI_BUF_SIZE, s_batch_frame0, s_batch_t_us);
+        s_batch.len = MSG_HDR_SIZE + s_batch_filled;
+
+        // Publish filled buffer to TCP task
+        // If TCP disconnects, this send could block; keep it bounded.
+        if (xQueueSend(filled_q, &s_batch, pdMS_TO_TICKS(100)) != pdTRUE) {
+            // If we couldn't publish, return buffer to free list
+            xQueueSend(free_q, &s_batch, 0);
+        }
+    } else {
+        xQueueSend(free_q, &s_batch, 0);
+    }
+    s_batch_dst = NULL;
+}
+
+/* Return the batch being filled to the free list without sending it */
+static void batch_drop(void)
+{
+    if (s_batch_dst) {
+        xQueueSendToFront(free_q, &s_batch, 0);
+        s_batch_dst = NULL;
+    }
+}
+
+/* Append one frame. `age` is how many frames ago it was acquired (non-zero
+ * for pre-trigger frames), used to back-date the batch timestamp. */
+static void batch_append(const uint8_t *frame, uint64_t frame_idx, uint32_t age)
+{
+    if (!s_batch_dst) {
+        // Get an empty batch buffer to fill
+        if (xQueueReceive(free_q, &s_batch, portMAX_DELAY) != pdTRUE) {
+            return;
+        }
+        s_batch_dst = s_batch.buf + MSG_HDR_SIZE;
+        s_batch_filled = 0;
+        s_batch_frame0 = frame_idx;
+        s_batch_t_us = esp_timer_get_time() - frames_to_us(age);
+    }
+
+    // Copy SPI frame into batch buffer
+    memcpy(s_batch_dst + s_batch_filled, frame, SPI_BUF_SIZE);
+    s_batch_filled += SPI_BUF_SIZE;
+
+    if (s_batch_filled == TCP_BATCH_SIZE) {
+        batch_flush();
+    }
+}
+#endif
+
+#if CONFIG_EMG_TRIGGER_ENABLE
+/* Route one frame through the activity trigger */
+static void trigger_frame(const uint8_t *frame, const int16_t *sig, uint64_t frame_idx)
+{
+    switch (emg_trigger_push(&s_trig, frame, sig, frame_idx)) {
+    case EMG_TRIG_BUFFER:
+        if (emg_trigger_summary_due(&s_trig)) {
+            emit_summary(frame_idx, esp_timer_get_time());
+        }
+        break;
+
+    case EMG_TRIG_START: {
+        // Stream the pre-trigger ring first; its frames directly precede this one
+        const uint8_t *a, *b;
+        uint16_t n_a, n_b;
+        uint16_t n = emg_trigger_take_pretrigger(&s_trig, &a, &n_a, &b, &n_b);
+        uint64_t idx = frame_idx - n;
+        for (uint16_t i = 0; i < n_a; i++, idx++) {
+            batch_append(a + (size_t)i * SPI_BUF_SIZE, idx, (uint32_t)(frame_idx - idx));
+        }
+        for (uint16_t i = 0; i < n_b; i++, idx++) {
+            batch_append(b + (size_t)i * SPI_BUF_SIZE, idx, (uint32_t)(frame_idx - idx));
+        }
+        batch_append(frame, frame_idx, 0);
+        break;
+    }
+
+    case EMG_TRIG_STREAM:
+        batch_append(frame, frame_idx, 0);
+        break;
+
+    case EMG_TRIG_STOP:
+        batch_append(frame, frame_idx, 0);
+        batch_flush();
+        break;
+    }
+}
+#endif
+
 /* ======= SPI Producer Task ======= */
 static void spi_task(void *arg)
 {
@@ -213,64 +579,118 @@ static void spi_task(void *arg)
 
     uint32_t validate_count = 0;
     uint32_t validate_mod = 100; // validate every 100 frames
+    uint64_t frame_idx = 0;      // frames pulled since boot, stamped into every message
 
     while (1) {
         // Wait until TCP is connected before producing (prevents backlog growth)
-        xEventGroupWaitBits(g_evt, CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        if (!(xEventGroupGetBits(g_evt) & CONNECTED_BIT)) {
+#if CONFIG_EMG_STREAM_RAW
+            // Drop the partial batch; the host sees the gap in frame0
+            batch_drop();
+#endif
+#if CONFIG_EMG_FEATURES_ENABLE
+            emg_features_reset(&s_feat);
+#endif
+#if CONFIG_EMG_TRIGGER_ENABLE
+            emg_trigger_reset(&s_trig);
+#endif
+#if CONFIG_EMG_SPECTRAL_ENABLE
+            emg_spectral_reset(&s_spec);
+#endif
+#if CONFIG_EMG_QUALITY_ENABLE
+            emg_quality_reset(&s_qual);
+#endif
+            xEventGroupWaitBits(g_evt, CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        }
 
-        // Get an empty batch buffer to fill
-        batch_item_t item;
-        if (xQueueReceive(free_q, &item, portMAX_DELAY) != pdTRUE) {
+        uint8_t *frame = spi_get_and_requeue();
+        if (!frame) {
+#if CONFIG_EMG_STREAM_RAW
+            // Return buffer and retry later
+            batch_drop();
+#endif
+            vTaskDelay(pdMS_TO_TICKS(10));
             continue;
         }
 
-        // Fill one full batch
-        uint8_t *dst = item.buf;
-        size_t filled = 0;
+        // Validate every 100 frames (low overhead)
+        validate_count++;
+        if (validate_count >= validate_mod) {
+            validate_count = 0;
 
-        while (filled < TCP_BATCH_SIZE) {
-            uint8_t *frame = spi_get_and_requeue();
-            if (!frame) {
-                // Return buffer and retry later
-                xQueueSendToFront(free_q, &item, 0);
-                vTaskDelay(pdMS_TO_TICKS(10));
-                break;
+            int matched = 1;
+            int allZeros = 1;
+            for (int k = 0; k < 64; k++) {
+                if (frame[k] != (uint8_t)k && frame[k] != 0) matched = 0;
+                if (frame[k] != 0) allZeros = 0;
             }
+            if (matched && !allZeros) correct++;
+            else incorrect++;
+        }
+
+#if CONFIG_EMG_QUALITY_ENABLE
+        // Monopolar check on the raw frame, independent of any spatial filter
+        if (emg_quality_push(&s_qual, frame)) {
+            emit_quality(frame_idx, esp_timer_get_time());
+        }
+#endif
 
-            // Copy SPI frame into batch buffer
-            memcpy(dst + filled, frame, SPI_BUF_SIZE);
-            filled += SPI_BUF_SIZE;
+#if CONFIG_EMG_FEATURES_ENABLE || CONFIG_EMG_TRIGGER_ENABLE
+        const int16_t *sig = condition_frame(frame);
+#endif
 
-            // Validate every 100 frames (low overhead)
-            validate_count++;
-            if (validate_count >= validate_mod) {
-                validate_count = 0;
+#if CONFIG_EMG_FEATURES_ENABLE
+        if (emg_features_push(&s_feat, sig)) {
+            emit_features(frame_idx, esp_timer_get_time());
+        }
+#endif
 
-                int matched = 1;
-                int allZeros = 1;
-                for (int k = 0; k < 64; k++) {
-                    if (frame[k] != (uint8_t)k && frame[k] != 0) matched = 0;
-                    if (frame[k] != 0) allZeros = 0;
-                }
-                if (matched && !allZeros) correct++;
-                else incorrect++;
-            }
+#if CONFIG_EMG_SPECTRAL_ENABLE
+        if (emg_spectral_push(&s_spec, frame)) {
+            spectral_window_ready(frame_idx, esp_timer_get_time());
         }
+#endif
 
-        if (filled == TCP_BATCH_SIZE) {
-            item.len = TCP_BATCH_SIZE;
+#if CONFIG_EMG_TRIGGER_ENABLE
+        trigger_frame(frame, sig, frame_idx);
+#elif CONFIG_EMG_STREAM_RAW
+        batch_append(frame, frame_idx, 0);
+#endif
 
-            // Publish filled buffer to TCP task
-            // If TCP disconnects, this send could block; keep it bounded.
-            if (xQueueSend(filled_q, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
-                // If we couldn't publish, return buffer to free list
-                xQueueSend(free_q, &item, 0);
-            }
-        }
+        frame_idx++;
     }
 }
 
 /* ======= TCP Consumer Task ======= */
+/* Identify ourselves; the host uses this to reattach a reconnect to the same stream */
+static bool send_hello(int sock)
+{
+    static uint8_t buf[MSG_HDR_SIZE + sizeof(emg_hello_msg_t)];
+    emg_hello_msg_t *hello = (emg_hello_msg_t *)(buf + MSG_HDR_SIZE);
+
+    memset(buf, 0, sizeof(buf));
+    esp_read_mac(hello->mac, ESP_MAC_BASE);
+    hello->channels = EMG_NUM_CHANNELS;
+    hello->sample_bits = 8;
+    hello->frame_rate_hz = CONFIG_EMG_FRAME_RATE_HZ;
+    hello->boot_id = s_boot_id;
+    hello->layout = ELECTRODE_LAYOUT_ID;
+    hello->spatial = (uint8_t)SPATIAL_MODE;
+    strncpy(hello->name, CONFIG_EMG_DEVICE_NAME, sizeof(hello->name));
+    msg_hdr_init(buf, EMG_MSG_HELLO, sizeof(emg_hello_msg_t), 0, 0, esp_timer_get_time());
+
+    size_t sent_total = 0;
+    while (sent_total < sizeof(buf)) {
+        ssize_t n = send(sock, buf + sent_total, sizeof(buf) - sent_total, 0);
+        if (n > 0) {
+            sent_total += (size_t)n;
+        } else if (n < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void tcp_task(void *arg)
 {
     (void)arg;
@@ -314,6 +734,14 @@ static void tcp_task(void *arg)
 
         ESP_LOGI(TAG, "Successfully connected to PC");
 
+        // The hello goes out before anything else on this connection
+        if (!send_hello(sock)) {
+            ESP_LOGE(TAG, "Hello failed: errno %d", errno);
+            close(sock);
+            vTaskDelay(pdMS_TO_TICKS(500));
+            continue;
+        }
+
         // Wait for SPI handshake to be completed once
         xEventGroupWaitBits(g_evt, HANDSHAKE_DONE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
 
@@ -346,7 +774,7 @@ static void tcp_task(void *arg)
                 ESP_LOGE(TAG, "TCP send failed: errno %d", errno);
 
                 // Return buffer before reconnecting
-                xQueueSend(free_q, &item, 0);
+                xQueueSend(item.home, &item, 0);
 
                 // Disconnect handling
                 xEventGroupClearBits(g_evt, CONNECTED_BIT);
@@ -355,14 +783,14 @@ static void tcp_task(void *arg)
 
                 // Drain any already-filled buffers back to free list (avoid deadlock)
                 while (xQueueReceive(filled_q, &item, 0) == pdTRUE) {
-                    xQueueSend(free_q, &item, 0);
+                    xQueueSend(item.home, &item, 0);
                 }
 
                 goto reconnect;
             }
 
-            // Return buffer to free list
-            xQueueSend(free_q, &item, 0);
+            // Return buffer to its free list
+            xQueueSend(item.home, &item, 0);
 
             // 1 Hz stats print (very low overhead)
             int64_t now_us = esp_timer_get_time() - start_us;
@@ -375,10 +803,11 @@ static void tcp_task(void *arg)
                 int acc_milli = (total > 0) ? (c * 1000) / total : 0;
 
                 // total samples checked = total validations * 100 (since validate every 100 frames)
-                esp_rom_printf("t=%lld ms  validated_samples=%d  acc=%d.%03d\n",
+                esp_rom_printf("t=%lld ms  validated_samples=%d  acc=%d.%03d  dropped_msgs=%d\n",
                                (long long)(now_us / 1000),
                                total * 100,
-                               acc_milli / 1000, acc_milli % 1000);
+                               acc_milli / 1000, acc_milli % 1000,
+                               (int)dropped_msgs);
             }
         }
 
@@ -394,22 +823,114 @@ void tcp_client(void)
     // Init SPI once
     spi_master_init();
 
+    // Lets the host tell a reconnect (frame indices continue) from a reboot (they restart)
+    s_boot_id = esp_random();
+
     // Create sync primitives
     g_evt = xEventGroupCreate();
     assert(g_evt);
 
     free_q   = xQueueCreate(NUM_BATCH_BUFS, sizeof(batch_item_t));
-    filled_q = xQueueCreate(NUM_BATCH_BUFS, sizeof(batch_item_t));
+    filled_q = xQueueCreate(NUM_BATCH_BUFS + NUM_FEATURE_BUFS + NUM_SUMMARY_BUFS + NUM_SPECTRAL_BUFS +
+                            NUM_QUALITY_BUFS, sizeof(batch_item_t));
     assert(free_q && filled_q);
 
     // Allocate two batch buffers (internal RAM is fastest for memcpy + TCP)
     for (int i = 0; i < NUM_BATCH_BUFS; i++) {
-        uint8_t *buf = (uint8_t *)heap_caps_malloc(TCP_BATCH_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(MSG_HDR_SIZE + TCP_BATCH_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
         assert(buf);
-        batch_item_t item = { .buf = buf, .len = TCP_BATCH_SIZE };
+        batch_item_t item = { .buf = buf, .len = MSG_HDR_SIZE + TCP_BATCH_SIZE, .home = free_q };
         xQueueSend(free_q, &item, portMAX_DELAY);
     }
 
+    // Spatial filter plan (NONE still yields the layout's channel order)
+    ESP_ERROR_CHECK(emg_spatial_init(&s_spatial, &ELECTRODE_LAYOUT, SPATIAL_MODE) == 0 ? ESP_OK : ESP_ERR_INVALID_ARG);
+    ESP_LOGI(TAG, "Spatial filter: layout=%s mode=%d outputs=%d",
+             ELECTRODE_LAYOUT.name, (int)SPATIAL_MODE, s_spatial.n_out);
+
+#if CONFIG_EMG_FEATURES_ENABLE
+    ESP_ERROR_CHECK(emg_features_init(&s_feat, CONFIG_EMG_FEATURES_WINDOW, CONFIG_EMG_FEATURES_HOP,
+                                      CONFIG_EMG_FEATURES_THRESHOLD) == 0 ? ESP_OK : ESP_ERR_NO_MEM);
+
+    feat_free_q = xQueueCreate(NUM_FEATURE_BUFS, sizeof(batch_item_t));
+    assert(feat_free_q);
+    for (int i = 0; i < NUM_FEATURE_BUFS; i++) {
+        size_t sz = MSG_HDR_SIZE + sizeof(emg_features_msg_t);
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        assert(buf);
+        batch_item_t item = { .buf = buf, .len = sz, .home = feat_free_q };
+        xQueueSend(feat_free_q, &item, portMAX_DELAY);
+    }
+#endif
+
+#if CONFIG_EMG_TRIGGER_ENABLE
+    // 64-bit: 60000 ms at 50000 Hz overflows an int before the division
+    const uint64_t rate = CONFIG_EMG_FRAME_RATE_HZ;
+    int trig_err = emg_trigger_init(&s_trig,
+                                    (uint32_t)(CONFIG_EMG_TRIGGER_PRE_MS * rate / 1000),
+                                    (uint32_t)(CONFIG_EMG_TRIGGER_ONSET_MS * rate / 1000),
+                                    (uint32_t)(CONFIG_EMG_TRIGGER_HOLD_MS * rate / 1000),
+                                    CONFIG_EMG_TRIGGER_SMOOTH_SHIFT,
+                                    CONFIG_EMG_TRIGGER_THRESHOLD,
+                                    (uint64_t)CONFIG_EMG_TRIGGER_CHANNEL_MASK,
+                                    (uint32_t)(CONFIG_EMG_TRIGGER_SUMMARY_MS * rate / 1000));
+    if (trig_err == -2) {
+        ESP_LOGE(TAG, "Pre-trigger buffer of %d ms is more than %d frames at %d Hz", CONFIG_EMG_TRIGGER_PRE_MS,
+                 EMG_TRIGGER_MAX_PRE_FRAMES, CONFIG_EMG_FRAME_RATE_HZ);
+    }
+    ESP_ERROR_CHECK(trig_err == 0 ? ESP_OK : trig_err == -2 ? ESP_ERR_INVALID_ARG : ESP_ERR_NO_MEM);
+
+    summ_free_q = xQueueCreate(NUM_SUMMARY_BUFS, sizeof(batch_item_t));
+    assert(summ_free_q);
+    for (int i = 0; i < NUM_SUMMARY_BUFS; i++) {
+        size_t sz = MSG_HDR_SIZE + sizeof(emg_summary_msg_t);
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        assert(buf);
+        batch_item_t item = { .buf = buf, .len = sz, .home = summ_free_q };
+        xQueueSend(summ_free_q, &item, portMAX_DELAY);
+    }
+#endif
+
+#if CONFIG_EMG_SPECTRAL_ENABLE
+    uint16_t fft_n = SPECTRAL_FFT_SIZE;
+    uint16_t fft_hop = (uint16_t)(fft_n * (100 - CONFIG_EMG_SPECTRAL_OVERLAP_PCT) / 100);
+    ESP_ERROR_CHECK(emg_spectral_init(&s_spec, fft_n, fft_hop, CONFIG_EMG_FRAME_RATE_HZ,
+                                      CONFIG_EMG_SPECTRAL_BAND_LOW_HZ,
+                                      CONFIG_EMG_SPECTRAL_BAND_HIGH_HZ) == 0 ? ESP_OK : ESP_ERR_NO_MEM);
+    ESP_LOGI(TAG, "Spectral: fft=%d hop=%d (%d.%02d Hz updates)", fft_n, fft_hop,
+             CONFIG_EMG_FRAME_RATE_HZ / fft_hop, (CONFIG_EMG_FRAME_RATE_HZ % fft_hop) * 100 / fft_hop);
+
+    spec_free_q = xQueueCreate(NUM_SPECTRAL_BUFS, sizeof(batch_item_t));
+    assert(spec_free_q);
+    for (int i = 0; i < NUM_SPECTRAL_BUFS; i++) {
+        size_t sz = MSG_HDR_SIZE + sizeof(emg_spectral_msg_t);
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        assert(buf);
+        batch_item_t item = { .buf = buf, .len = sz, .home = spec_free_q };
+        xQueueSend(spec_free_q, &item, portMAX_DELAY);
+    }
+
+    // Same core as spi_task but lower priority: it can never preempt acquisition
+    xTaskCreatePinnedToCore(spectral_task, "spectral_task", 4096, NULL, 4, &spectral_task_handle, 1);
+#endif
+
+#if CONFIG_EMG_QUALITY_ENABLE
+    ESP_ERROR_CHECK(emg_quality_init(&s_qual, CONFIG_EMG_FRAME_RATE_HZ, CONFIG_EMG_QUALITY_REPORT_MS,
+                                     CONFIG_EMG_QUALITY_SAT_PERMILLE, CONFIG_EMG_QUALITY_LEADOFF_MS,
+                                     CONFIG_EMG_QUALITY_MAINS_PCT,
+                                     CONFIG_EMG_QUALITY_NOISE_LIMIT) == 0 ? ESP_OK : ESP_ERR_INVALID_ARG);
+
+    qual_free_q = xQueueCreate(NUM_QUALITY_BUFS, sizeof(batch_item_t));
+    assert(qual_free_q);
+    for (int i = 0; i < NUM_QUALITY_BUFS; i++) {
+        size_t sz = MSG_HDR_SIZE + sizeof(emg_quality_msg_t);
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        assert(buf);
+        batch_item_t item = { .buf = buf, .len = sz, .home = qual_free_q };
+        xQueueSend(qual_free_q, &item, portMAX_DELAY);
+    }
+#endif
+
     // Create tasks pinned to different cores
     // ESP32: Core 0 often busier with Wi-Fi; common pattern is TCP on core 0, SPI on core 1.
     xTaskCreatePinnedToCore(tcp_task, "tcp_task", 8192, NULL, 12, NULL, 0);